@@ -24,6 +24,14 @@ git rev-parse --git-dir >/dev/null 2>&1 || {
 }
 
 AETHER_FILE="docs/json/aether.json"
+# Extra descriptions; aether.json holds byte offsets into it, so the two are
+# always committed together
+DETAILS_FILE="docs/json/aether.details.json"
+# Written by area_to_json --summary alongside the two: whether they are valid
+# JSON, their sizes and hashes, and the object count
+SUMMARY_FILE="docs/json/aether.summary.json"
+# Best items per wear slot for the preset builds (--score-presets), optional
+SCORES_FILE="docs/json/aether.scores.json"
 
 # --- handle stale .git/index.lock safely ---
 if [ -f .git/index.lock ]; then
@@ -61,7 +69,13 @@ if [ "$current_branch" != "HEAD" ]; then
 fi
 
 # --- change detection (both working tree and index) ---
-if git diff --quiet -- "$AETHER_FILE" && git diff --cached --quiet -- "$AETHER_FILE"; then
+if git diff --quiet -- "$AETHER_FILE" && git diff --cached --quiet -- "$AETHER_FILE" \
+   && { [ ! -e "$DETAILS_FILE" ] || git ls-files --error-unmatch -- "$DETAILS_FILE" >/dev/null 2>&1; } \
+   && git diff --quiet -- "$DETAILS_FILE" && git diff --cached --quiet -- "$DETAILS_FILE" \
+   && { [ ! -e "$SUMMARY_FILE" ] || git ls-files --error-unmatch -- "$SUMMARY_FILE" >/dev/null 2>&1; } \
+   && git diff --quiet -- "$SUMMARY_FILE" && git diff --cached --quiet -- "$SUMMARY_FILE" \
+   && { [ ! -e "$SCORES_FILE" ] || git ls-files --error-unmatch -- "$SCORES_FILE" >/dev/null 2>&1; } \
+   && git diff --quiet -- "$SCORES_FILE" && git diff --cached --quiet -- "$SCORES_FILE"; then
   echo "No changes detected in $AETHER_FILE"
   exit 0
 fi
@@ -70,22 +84,41 @@ fi
 # 1) File non-empty
 [ -s "$AETHER_FILE" ] || { echo "Error: $AETHER_FILE is empty"; exit 1; }
 
-# 2) jq present
-command -v jq >/dev/null || { echo "Error: jq is not installed"; exit 1; }
+# 2) Summary present; it has one "key": value per line
+[ -s "$SUMMARY_FILE" ] || { echo "Error: $SUMMARY_FILE is missing"; exit 1; }
+summary_value() { sed -n "s/^  \"$1\": \"\{0,1\}\([^\",]*\).*/\1/p" "$SUMMARY_FILE"; }
+file_size() { stat -c %s "$1" 2>/dev/null || stat -f %z "$1"; }
 
-# 3) Valid JSON
-jq empty "$AETHER_FILE" >/dev/null 2>&1 || { echo "Error: invalid JSON in $AETHER_FILE"; exit 1; }
+# 3) area_to_json found the output valid as it wrote it
+[ "$(summary_value valid)" = "true" ] || {
+  echo "Error: invalid JSON in $AETHER_FILE: $(summary_value error)"
+  exit 1
+}
 
-# 4) Must contain non-empty .objects
-jq -e '.objects | length > 0' "$AETHER_FILE" >/dev/null 2>&1 || {
+# 4) Must contain at least one object
+[ "$(summary_value objects)" -gt 0 ] 2>/dev/null || {
   echo "Error: $AETHER_FILE must contain '.objects' with at least one object"
   exit 1
 }
 
+# 5) The summary describes the files as they are now, not an earlier run's
+[ "$(summary_value bytes)" = "$(file_size "$AETHER_FILE")" ] || {
+  echo "Error: $SUMMARY_FILE does not match $AETHER_FILE"
+  exit 1
+}
+details_bytes="$(summary_value details_bytes)"
+if [ -n "$details_bytes" ] && [ "$details_bytes" != "$(file_size "$DETAILS_FILE")" ]; then
+  echo "Error: $SUMMARY_FILE does not match $DETAILS_FILE"
+  exit 1
+fi
+
 echo "All sanity checks passed. Proceeding with commit..."
 
 # --- stage, commit, push ---
 git add -- "$AETHER_FILE"
+[ -e "$DETAILS_FILE" ] && git add -- "$DETAILS_FILE"
+git add -- "$SUMMARY_FILE"
+[ -e "$SCORES_FILE" ] && git add -- "$SCORES_FILE"
 
 TIMESTAMP="$(date '+%Y-%m-%d %H:%M:%S %z')"
 if git commit -m "auto: update aether.json - $TIMESTAMP"; then
@@ -1,7 +1,129 @@
+// Card grid that keeps only the rows near the viewport in the DOM. Rows
+// are laid out by the same column rule as the CSS grid; their heights are
+// measured once rendered and estimated until then, and spacers above and
+// below stand in for the rows that aren't there.
+class VirtualGrid {
+    constructor(container, renderCard, options = {}) {
+        this.container = container;
+        this.renderCard = renderCard;
+        this.minWidth = options.minWidth || 350;
+        this.gap = options.gap || 20;
+        this.estimate = options.estimate || 360;
+        this.overscan = options.overscan || 600; // Pixels rendered beyond the viewport
+        this.count = 0;
+        this.columns = 1;
+        this.heights = [];  // Measured row heights, undefined until rendered
+        this.offsets = [0]; // offsets[r] = top of row r, from the grid's top
+        this.first = -1;    // Rendered row range
+        this.last = -1;
+        this.frame = 0;
+
+        this.container.classList.add('virtual-grid');
+        this.topSpacer = document.createElement('div');
+        this.rows = document.createElement('div');
+        this.bottomSpacer = document.createElement('div');
+        this.container.replaceChildren(this.topSpacer, this.rows, this.bottomSpacer);
+
+        const schedule = () => this.schedule();
+        window.addEventListener('scroll', schedule, { passive: true });
+        window.addEventListener('resize', () => {
+            this.heights = []; // Column count and row contents may change
+            this.refresh();
+        });
+    }
+
+    // The card list changed (a new query result or more items)
+    setCount(count) {
+        this.count = count;
+        this.heights = [];
+        this.refresh();
+    }
+
+    // Re-render the visible rows, e.g. after a card changed height
+    refresh() {
+        this.first = this.last = -1;
+        this.schedule();
+    }
+
+    schedule() {
+        if (!this.frame) this.frame = requestAnimationFrame(() => this.render());
+    }
+
+    layout() {
+        const width = this.container.clientWidth;
+        this.columns = Math.max(1, Math.floor((width + this.gap) / (this.minWidth + this.gap)));
+        const rowCount = Math.ceil(this.count / this.columns);
+        this.offsets = new Array(rowCount + 1);
+        this.offsets[0] = 0;
+        for (let r = 0; r < rowCount; r++) {
+            this.offsets[r + 1] = this.offsets[r] + (this.heights[r] || this.estimate) + this.gap;
+        }
+        return rowCount;
+    }
+
+    // First row whose bottom is below y
+    rowAt(y, rowCount) {
+        let lo = 0, hi = rowCount;
+        while (lo < hi) {
+            const mid = (lo + hi) >> 1;
+            if (this.offsets[mid + 1] <= y) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    render() {
+        this.frame = 0;
+        const rowCount = this.layout();
+        const top = this.container.getBoundingClientRect().top + window.scrollY;
+        const viewTop = window.scrollY - top - this.overscan;
+        const viewBottom = window.scrollY + window.innerHeight - top + this.overscan;
+        const first = Math.min(this.rowAt(Math.max(0, viewTop), rowCount), rowCount);
+        const last = Math.min(this.rowAt(Math.max(0, viewBottom), rowCount) + 1, rowCount);
+
+        if (first !== this.first || last !== this.last) {
+            this.first = first;
+            this.last = last;
+            let html = '';
+            for (let r = first; r < last; r++) {
+                const start = r * this.columns;
+                const end = Math.min(start + this.columns, this.count);
+                let cards = '';
+                for (let i = start; i < end; i++) cards += this.renderCard(i);
+                html += `<div class="item-row" style="grid-template-columns: repeat(${this.columns}, 1fr)">${cards}</div>`;
+            }
+            this.rows.innerHTML = html;
+
+            // Measure what was rendered; if estimates were off, lay out again
+            let changed = false;
+            Array.from(this.rows.children).forEach((row, k) => {
+                const height = row.offsetHeight;
+                if (this.heights[first + k] !== height) {
+                    this.heights[first + k] = height;
+                    changed = true;
+                }
+            });
+            if (changed) this.layout();
+        }
+
+        this.topSpacer.style.height = `${this.offsets[first]}px`;
+        this.bottomSpacer.style.height = `${this.offsets[rowCount] - this.offsets[last]}px`;
+    }
+}
+
 class ItemViewer {
     constructor() {
-        this.items = [];
-        this.filteredItems = [];
+        this.items = [];              // Everything the worker has sent, in file order
+        this.results = new Int32Array(0); // Indexes into items matching the current query
+        this.queryId = 0;
+        this.worker = null;
+        this.grid = null;
+        this.expanded = new Set();    // Item indexes whose details are open
+        this.detailsHTML = new Map(); // Item index -> rendered details
+        this.styles = null;          // CSS per style index, when the JSON has style runs
+        this.detailsUrl = null;      // Side file with extra descriptions, if the JSON names one
+        this.detailsCache = new Map(); // vnum -> promise of the parsed details record
+        this.detailsFile = null;     // Whole side file, when the server ignores Range requests
         this.init();
     }
 
@@ -117,52 +239,173 @@ class ItemViewer {
         return this.parseColorCodes(text);
     }
 
-    async init() {
+    escapeHTML(text) {
+        return text.replace(/&/g, '&amp;').replace(/</g, '&lt;').replace(/>/g, '&gt;');
+    }
+
+    // Text that area_to_json already split into runs (--colors): a flat
+    // list of text and style index pairs, so no color codes are parsed here
+    renderRuns(runs) {
+        let html = '';
+        for (let i = 0; i < runs.length; i += 2) {
+            const text = this.escapeHTML(runs[i]);
+            const css = this.styles[runs[i + 1]];
+            html += css ? `<span style="${css}">${text}</span>` : text;
+        }
+        return html;
+    }
+
+    // A name or description field, from its runs when the JSON has them
+    formatField(item, key) {
+        const runs = item[key + '_runs'];
+        if (runs && this.styles) return this.renderRuns(runs);
+        return this.formatTextWithColors(item[key]);
+    }
+
+    init() {
+        this.grid = new VirtualGrid(document.getElementById('itemGrid'),
+                                    index => this.createItemCard(this.items[this.results[index]], this.results[index]));
         this.setupEventListeners();
-        await this.loadItems();
-        this.renderItems();
+        this.loadItems();
     }
 
     setupEventListeners() {
         const searchInput = document.getElementById('searchInput');
         const typeFilter = document.getElementById('typeFilter');
 
+        const sortOrder = document.getElementById('sortOrder');
+
         searchInput.addEventListener('input', () => this.filterItems());
         typeFilter.addEventListener('change', () => this.filterItems());
+        sortOrder.addEventListener('change', () => this.filterItems());
+
+        // Cards come and go as the grid scrolls, so listen on the grid
+        document.getElementById('itemGrid').addEventListener('click', (event) => {
+            const toggle = event.target.closest('.item-details-toggle');
+            if (toggle) this.toggleDetails(toggle.closest('.item-card'));
+        });
     }
 
-    async loadItems() {
-        try {
-            const response = await fetch('json/aether.json');
-            const data = await response.json();
-            
-            // Filter items with at least 2 wear flags
-            this.items = data.objects.filter(item => {
-                if (!item.wear_flags) return false;
-                const wearFlags = item.wear_flags.split(' ').filter(flag => flag.trim() !== '');
-                return wearFlags.length >= 2;
+    // Fetching, parsing, filtering and sorting all happen in worker.js. Items
+    // arrive in batches while the file downloads, and every query result is
+    // a list of indexes into them.
+    loadItems() {
+        this.worker = new Worker('worker.js');
+        this.worker.onmessage = (event) => this.onWorkerMessage(event.data);
+        this.worker.postMessage({ type: 'load', url: 'json/aether.json' });
+        this.filterItems();
+    }
+
+    onWorkerMessage(message) {
+        switch (message.type) {
+            case 'header':
+                this.detailsUrl = message.details ? 'json/' + message.details : null;
+                this.styles = message.styles;
+                break;
+            case 'reset':
+                this.items = [];
+                break;
+            case 'items':
+                for (const item of message.items) this.items.push(item);
+                break;
+            case 'results':
+                if (message.id !== this.queryId) break; // A newer query is pending
+                this.results = message.indexes;
+                this.loading = message.loading;
+                this.renderItems();
+                break;
+            case 'error':
+                console.error('Error loading items:', message.message);
+                document.getElementById('loading').innerHTML = '<p>Error loading items. Please check if the JSON file is accessible.</p>';
+                break;
+        }
+    }
+
+    // Fetch one object's record from the details file. Each object carries
+    // the byte range of its record, so only that slice is requested; if the
+    // server answers with the whole file instead, it is kept for later cards.
+    async fetchDetails(item) {
+        const { offset, length } = item.details;
+        let bytes;
+        if (this.detailsFile) {
+            bytes = this.detailsFile.slice(offset, offset + length);
+        } else {
+            const response = await fetch(this.detailsUrl, {
+                headers: { Range: `bytes=${offset}-${offset + length - 1}` }
             });
+            if (!response.ok) throw new Error(`HTTP ${response.status}`);
+            const buffer = await response.arrayBuffer();
+            if (response.status === 206) {
+                bytes = buffer;
+            } else {
+                this.detailsFile = buffer;
+                bytes = buffer.slice(offset, offset + length);
+            }
+        }
+        return JSON.parse(new TextDecoder().decode(bytes));
+    }
 
-            this.filteredItems = [...this.items];
-        } catch (error) {
-            console.error('Error loading items:', error);
-            document.getElementById('loading').innerHTML = '<p>Error loading items. Please check if the JSON file is accessible.</p>';
+    getDetails(item) {
+        if (!this.detailsCache.has(item.vnum)) {
+            const pending = this.fetchDetails(item).catch(error => {
+                this.detailsCache.delete(item.vnum);
+                throw error;
+            });
+            this.detailsCache.set(item.vnum, pending);
         }
+        return this.detailsCache.get(item.vnum);
     }
 
-    filterItems() {
-        const searchTerm = document.getElementById('searchInput').value.toLowerCase();
-        const typeFilter = document.getElementById('typeFilter').value;
+    // Open state and loaded details live on the viewer rather than the card,
+    // since the grid rebuilds cards as they scroll in and out of view
+    async toggleDetails(card) {
+        const index = Number(card.dataset.index);
+        if (this.expanded.has(index)) {
+            this.expanded.delete(index);
+            // Failed loads are retried the next time the card is opened
+            if (!this.detailsCache.has(this.items[index].vnum)) this.detailsHTML.delete(index);
+            this.grid.refresh();
+            return;
+        }
+        this.expanded.add(index);
+        this.grid.refresh();
+        if (this.detailsHTML.has(index)) return;
 
-        this.filteredItems = this.items.filter(item => {
-            const matchesSearch = item.name.toLowerCase().includes(searchTerm) ||
-                                item.short_descr.toLowerCase().includes(searchTerm);
-            const matchesType = !typeFilter || item.type === typeFilter;
-            
-            return matchesSearch && matchesType;
+        try {
+            this.detailsHTML.set(index, this.createDetailsHTML(await this.getDetails(this.items[index])));
+        } catch (error) {
+            console.error('Error loading details:', error);
+            this.detailsHTML.set(index, '<p class="item-details-loading">Could not load details.</p>');
+        }
+        this.grid.refresh();
+    }
+
+    createDetailsHTML(details) {
+        let html = '';
+        if (details.description) {
+            html += `<div class="item-description">${this.formatTextWithColors(details.description)}</div>`;
+        }
+        (details.extra_descriptions || []).forEach(ed => {
+            html += `
+                <div class="item-extra">
+                    <div class="item-extra-keyword">${ed.keyword}</div>
+                    <div class="item-extra-text">${this.formatTextWithColors(ed.description)}</div>
+                </div>
+            `;
         });
+        return html;
+    }
 
-        this.renderItems();
+    // Ask the worker for the matching items; results for older queries
+    // are dropped when they arrive
+    filterItems() {
+        this.worker.postMessage({
+            type: 'query',
+            id: ++this.queryId,
+            search: document.getElementById('searchInput').value,
+            itemType: document.getElementById('typeFilter').value,
+            sort: document.getElementById('sortOrder').value
+        });
     }
 
 
@@ -233,25 +476,41 @@ class ItemViewer {
         return modifier.toString();
     }
 
+    // One line per reset that loads the item: who wears, carries or sells
+    // it, or which room or container it turns up in
+    formatSource(source) {
+        const mob = source.mob_name ? this.formatTextWithColors(source.mob_name) : `mob #${source.mob}`;
+        const level = source.mob_level !== undefined ? ` (level ${source.mob_level})` : '';
+        const room = source.room_name ? ` in ${this.formatTextWithColors(source.room_name)}` : '';
+        switch (source.kind) {
+            case 'equipped': return `Worn by ${mob}${level}${room}`;
+            case 'carried': return `Carried by ${mob}${level}${room}`;
+            case 'sold': return `Sold by ${mob}${room}`;
+            case 'room': return `Found${room || ' on the ground'}`;
+            case 'container': {
+                const container = source.container_name
+                    ? this.formatTextWithColors(source.container_name)
+                    : `object #${source.container}`;
+                return `Inside ${container}`;
+            }
+            default: return source.kind;
+        }
+    }
+
     renderItems() {
         const itemGrid = document.getElementById('itemGrid');
         const loading = document.getElementById('loading');
         const noResults = document.getElementById('noResults');
 
-        loading.style.display = 'none';
-        
-        if (this.filteredItems.length === 0) {
-            itemGrid.innerHTML = '';
-            noResults.style.display = 'block';
-            return;
-        }
-
-        noResults.style.display = 'none';
-        
-        itemGrid.innerHTML = this.filteredItems.map(item => this.createItemCard(item)).join('');
+        // Keep the spinner until the first matches (or the end of the file)
+        const empty = this.results.length === 0;
+        loading.style.display = empty && this.loading ? 'block' : 'none';
+        noResults.style.display = empty && !this.loading ? 'block' : 'none';
+        itemGrid.style.display = empty ? 'none' : 'block';
+        this.grid.setCount(this.results.length);
     }
 
-    createItemCard(item) {
+    createItemCard(item, index) {
         const rarityClass = this.getRarityClass(item);
         const wearFlags = item.wear_flags ? item.wear_flags.split(' ').filter(flag => flag.trim() !== '') : [];
         
@@ -405,21 +664,32 @@ class ItemViewer {
             `;
         }
 
+        const sourcesHTML = (item.sources || []).map(source =>
+            `<div class="item-source">${this.formatSource(source)}</div>`
+        ).join('');
+
         // Create wear flags HTML
         const flagsHTML = wearFlags.map(flag => 
             `<span class="flag">${flag}</span>`
         ).join('');
 
         return `
-            <div class="item-card ${rarityClass}" data-vnum="${item.vnum}">
-                <div class="item-name">${this.formatTextWithColors(item.short_descr || item.name)}</div>
+            <div class="item-card ${rarityClass}" data-vnum="${item.vnum}" data-index="${index}">
+                <div class="item-name">${item.short_descr ? this.formatField(item, 'short_descr') : this.formatTextWithColors(item.name)}</div>
                 <div class="item-type">${item.type}</div>
                 
                 ${statsHTML ? `<div class="item-stats">${statsHTML}</div>` : ''}
                 
                 ${flagsHTML ? `<div class="item-flags">${flagsHTML}</div>` : ''}
                 
-                ${item.description ? `<div class="item-description">${this.formatTextWithColors(item.description)}</div>` : ''}
+                ${sourcesHTML ? `<div class="item-sources">${sourcesHTML}</div>` : ''}
+                
+                ${item.description ? `<div class="item-description">${this.formatField(item, 'description')}</div>` : ''}
+                
+                ${item.details && this.detailsUrl ? `
+                    <button type="button" class="item-details-toggle">${this.expanded.has(index) ? 'Hide' : 'Show'} details</button>
+                    <div class="item-details" ${this.expanded.has(index) ? '' : 'hidden'}>${this.expanded.has(index) ? this.detailsHTML.get(index) || '<p class="item-details-loading">Loading...</p>' : ''}</div>
+                ` : ''}
             </div>
         `;
     }
@@ -0,0 +1,162 @@
+// Data side of the viewer: fetches and parses the item JSON, then answers
+// filter and sort queries with lists of item indexes, so none of that work
+// runs on the page's main thread.
+//
+// area_to_json writes one object per block of lines, each starting with
+// "  {" and ending with "\n  }", after a header that ends in
+// '"objects": ['. That lets the body be parsed object by object as it
+// arrives; anything else falls back to a single JSON.parse at the end.
+
+const OBJECTS_MARKER = '\n  "objects": [\n';
+const OBJECT_END = '\n  }';
+const BATCH_SIZE = 500;
+const BATCH_INTERVAL = 100; // Milliseconds a partial batch may wait
+
+let items = [];      // Items shown by the viewer, in file order
+let searchKeys = []; // Lowercased name and short description per item
+let query = null;    // Latest query from the page
+let loading = true;
+
+// Only items that can be worn in at least two places are shown
+function keepItem(item) {
+    if (!item.wear_flags) return false;
+    return item.wear_flags.split(' ').filter(flag => flag.trim() !== '').length >= 2;
+}
+
+function addItems(batch) {
+    const kept = batch.filter(keepItem);
+    if (kept.length === 0) return;
+    for (const item of kept) {
+        items.push(item);
+        searchKeys.push(item.name.toLowerCase() + '\n' + (item.short_descr || '').toLowerCase());
+    }
+    self.postMessage({ type: 'items', items: kept });
+    runQuery();
+}
+
+// The header parsed on its own: close the objects array and the document
+function parseHeader(text) {
+    return JSON.parse(text + ']}');
+}
+
+function postHeader(header) {
+    self.postMessage({
+        type: 'header',
+        details: header.details || null,
+        styles: header.styles || null
+    });
+}
+
+async function load(url) {
+    const response = await fetch(url);
+    if (!response.ok) throw new Error(`HTTP ${response.status}`);
+
+    const reader = response.body.getReader();
+    const decoder = new TextDecoder();
+    let text = '';
+    let pos = 0;         // Start of the unparsed part of text
+    let inObjects = false;
+    let streaming = true; // false once the layout turned out to be unexpected
+    let batch = [];
+    let flushed = performance.now();
+
+    for (;;) {
+        const { done, value } = await reader.read();
+        if (done) break;
+        text += decoder.decode(value, { stream: true });
+        if (!streaming) continue;
+
+        try {
+            if (!inObjects) {
+                const marker = text.indexOf(OBJECTS_MARKER);
+                if (marker < 0) continue;
+                postHeader(parseHeader(text.slice(0, marker + OBJECTS_MARKER.length)));
+                pos = marker + OBJECTS_MARKER.length;
+                inObjects = true;
+            }
+            for (;;) {
+                const end = text.indexOf(OBJECT_END, pos);
+                if (end < 0) break;
+                const start = text.indexOf('{', pos);
+                batch.push(JSON.parse(text.slice(start, end + OBJECT_END.length)));
+                pos = end + OBJECT_END.length;
+                if (batch.length >= BATCH_SIZE) {
+                    addItems(batch);
+                    batch = [];
+                    flushed = performance.now();
+                }
+            }
+            // Keep only what hasn't been parsed yet
+            text = text.slice(pos);
+            pos = 0;
+        } catch (error) {
+            streaming = false;
+        }
+        // On a slow connection, show what has arrived rather than waiting
+        // for a full batch
+        if (batch.length && performance.now() - flushed >= BATCH_INTERVAL) {
+            addItems(batch);
+            batch = [];
+            flushed = performance.now();
+        }
+    }
+    text += decoder.decode();
+    if (batch.length) addItems(batch);
+
+    if (!streaming || !inObjects) {
+        // Parse the whole document the ordinary way
+        const data = JSON.parse(text);
+        items = [];
+        searchKeys = [];
+        self.postMessage({ type: 'reset' });
+        postHeader(data);
+        addItems(data.objects || []);
+    }
+}
+
+function compareBy(sort) {
+    switch (sort) {
+        case 'level':
+            return (a, b) => items[b].level - items[a].level || a - b;
+        case 'name':
+            return (a, b) => searchKeys[a].localeCompare(searchKeys[b]) || a - b;
+        case 'vnum':
+            return (a, b) => items[a].vnum - items[b].vnum || a - b;
+        default:
+            return null;
+    }
+}
+
+// Answer the latest query over everything loaded so far
+function runQuery() {
+    if (!query) return;
+    const search = query.search.toLowerCase();
+    const matches = [];
+    for (let i = 0; i < items.length; i++) {
+        if (query.itemType && items[i].type !== query.itemType) continue;
+        if (search && !searchKeys[i].includes(search)) continue;
+        matches.push(i);
+    }
+    const compare = compareBy(query.sort);
+    if (compare) matches.sort(compare);
+
+    const indexes = Int32Array.from(matches);
+    self.postMessage({ type: 'results', id: query.id, indexes, loading }, [indexes.buffer]);
+}
+
+self.onmessage = async (event) => {
+    const message = event.data;
+    if (message.type === 'query') {
+        query = message;
+        runQuery();
+    } else if (message.type === 'load') {
+        try {
+            await load(message.url);
+        } catch (error) {
+            self.postMessage({ type: 'error', message: String(error) });
+        }
+        loading = false;
+        self.postMessage({ type: 'done', count: items.length });
+        runQuery();
+    }
+};
@@ -1,1463 +1,1807 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdbool.h>
-#include <stdarg.h>
-
-// Define strdup if not available
-#ifndef _GNU_SOURCE
-char *strdup(const char *s) {
-    char *d = malloc(strlen(s) + 1);
-    if (d != NULL) strcpy(d, s);
-    return d;
-}
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "areaparse.h"
+#include "arrow_out.h"
+#include "batch_read.h"
+#include "filter.h"
+#include "history.h"
+#include "json_check.h"
+#include "metrics.h"
+#include "score.h"
+#include "serve.h"
+#include "sha256.h"
+#include "shard.h"
+#include "sort.h"
+#ifdef HAVE_SQLITE
+#include "sqlite_out.h"
 #endif
+#include "strbuf.h"
+#include "world.h"
 
-#define MAX_STRING_LENGTH 4096
-
-// Simple data structures
-typedef struct area_data {
-    char *name;
-    char *file_name;
-    char *credits;
-    char *builders;
-} AREA_DATA;
-
-typedef struct affect_data {
-    int where;
-    int type;
-    int level;
-    int duration;
-    int location;
-    int modifier;
-    long bitvector;
-    struct affect_data *next;
-} AFFECT_DATA;
-
-typedef struct extra_descr_data {
-    char *keyword;
-    char *description;
-    struct extra_descr_data *next;
-} EXTRA_DESCR_DATA;
-
-typedef struct affect_out {
-    char type[16]; // "normal", "flag", "spell"
-    char location[32];
-    int modifier;
-    char extra[64]; // for spell name or flag name if needed
-    struct affect_out *next;
-} AFFECT_OUT;
-
-typedef struct obj_index_data {
-    long vnum;
-    char *name;
-    char *short_descr;
-    char *description;
-    char *material;
-    int item_type;
-    int extra_flags;
-    char *extra_flags_str; // Store extra flags as string from area file
-    int wear_flags;
-
-
-    int level;
-    int condition;
-    int weight;
-    int cost;
-    int value[5];
-    char *materia_spell; // For materia items
-    char *weapon_type; // For weapon items
-    char *damage_type; // For weapon items
-    char *weapon_flags; // For weapon items
-    AFFECT_DATA *affected;
-    AFFECT_DATA *affected2;
-    EXTRA_DESCR_DATA *extra_descr;
-    AREA_DATA *area;
-    AFFECT_OUT *affects_out;
-    struct obj_index_data *next;
-} OBJ_INDEX_DATA;
-
-AREA_DATA *current_area = NULL;
-OBJ_INDEX_DATA *object_list = NULL;
-
-// --- Lookup tables and flag-to-string logic ---
-
-// Item type table
-static const struct { int type; const char *name; } item_type_table[] = {
-    {1, "light"}, {2, "scroll"}, {3, "wand"}, {4, "staff"}, {5, "weapon"},
-    {6, "shard"}, {7, "ticket"}, {8, "treasure"}, {9, "armor"}, {10, "potion"},
-    {11, "clothing"}, {12, "furniture"}, {13, "trash"}, {15, "container"}, {17, "drink_con"},
-    {18, "key"}, {19, "food"}, {20, "money"}, {22, "boat"}, {23, "corpse_npc"},
-    {24, "corpse_pc"}, {25, "fountain"}, {26, "pill"}, {27, "protect"}, {28, "map"},
-    {29, "portal"}, {30, "warp_stone"}, {31, "room_key"}, {32, "gem"}, {33, "jewelry"},
-    {34, "jukebox"}, {35, "quiver"}, {36, "arrow"}, {37, "poison"}, {38, "disjunction"},
-    {39, "safe_haven"}, {40, "materia"}, {41, "remote"}, {46, "scryer"}, {47, "exit"},
-    {48, "minigame"}, {0, NULL}
-};
-
-// Wear flags (bit positions) - complete list from merc.h
-// A=0, B=1, C=2, D=3, E=4, F=5, G=6, H=7, I=8, J=9, K=10, L=11, M=12, N=13, O=14, P=15
-// Q=16, R=17, S=18, T=19, U=20, V=21, W=22, X=23, Y=24, Z=25, aa=26, bb=27, cc=28, dd=29
-static const char *wear_flag_table[] = {
-    "take", "finger", "neck", "body", "head", "legs", "feet", "hands", "arms", "shield",
-    "about", "waist", "wrist", "wield", "hold", "nosac", "wearfloat", "face", "lodge_leg", "lodge_arm",
-    "lodge_rib", "materia", "nose", "belly", "ears", "tongue", "tattoo", "gadget", "grimoire", "familiar", NULL
-};
-
-// Extra flags (from tables.c - exact order)
-static const char *extra_flag_table[] = {
-    "glow", "hum", "dark", "lock", "evil", "invis", "magic", "nodrop", "bless", "antigood",
-    "antievil", "antineutral", "noremove", "inventory", "nopurge", "rotdeath", "visdeath", "noclone", "nonmetal", "nolocate",
-    "meltdrop", "hadtimer", "sellextract", "clan", "burnproof", "nouncurse", "sticky", "lodged", "trap", "no_restring",
-    "quest", "nogive", NULL
-};
-
-// Affect locations (from merc.h - exact order)
-// Affect locations (EXACT match to APPLY_* constants in merc.h)
-static const char *affect_location_table[] = {
-    "none", 
-    "strength", 
-    "dexterity", 
-    "intelligence", 
-    "wisdom", 
-    "constitution", 
-    "sex", 
-    "class", 
-    "level", 
-    "age", 
-    "height", 
-    "weight", 
-    "mana", 
-    "hp", 
-    "move", 
-    "gold", 
-    "experience",
-    "ac", 
-    "hitroll", 
-    "damroll", 
-    "saves", 
-    "savingrod", 
-    "savingpetri", 
-    "savingbreath", 
-    "savingspell", 
-    "spellaffect", 
-    "spellcast", 
-    "resistance", 
-    "critchance", 
-    "critdamage", 
-    "recuperation", 
-    "concentration", 
-    "prosperity", 
-    "endurance", 
-    "penetration", 
-    "alacrity", 
-    "insight", 
-    "celerity", 
-    "potency", 
-    "savingpara", 
-    "bounty",
-    NULL
-};
-
-// Shield flags (from tables.c)
-static const char *shield_flags[] = {
-    "living_armor", "sanctuary", "invisible", "protect_evil", "protect_good", 
-    "planeshift", "fireshield", "pass_door", "protect_voodoo", "iceshield",
-    "lightningshield", "acidshield", NULL
-};
-
-// Affect flags (from tables.c, corrected to match AFF_* definitions)
-static const char *affect_flags[] = {
-    "blind", "detect_evil", "detect_invis", "detect_magic", "detect_hidden", "detect_good", "unused_1", "unused_h", "faerie_fire", "infrared", "curse", "resistance", "poison", "unused_2", "unused_3", "sneak", "hide", "sleep", "charm", "flying", "unused_4", "haste", "calm", "plague", "weaken", "dark_vision", "berserk", "swim", "regeneration", "slow", "drained", NULL
-};
-
-// Affect2 flags (from tables.c, corrected to match AFF_* definitions)
-static const char *affect2_flags[] = {
-    "shapeshift", "unused_1", "telepathy", "life_stealer", "unused_e", "lsd", "hold_person", 
-    "unused_2", "divine_intervention", "unused_3", "mental_disruption", "talon", "kamikaze", 
-    "spiritlink", "unused_4", "unused_5", "unused_6", "unused_7", "unused_8", "unused_9", 
-    "unused_10", "unused_11", "spectral_blade", "unused_12", "unused_13", "unused_14", 
-    "focus_chi", NULL
-};
-
-// Immune flags (from tables.c)
-static const char *imm_flags[] = {
-    "summon", "charm", "magic", "weapon", "bash", "pierce", "slash", "fire", "cold", "lightning", "acid", "poison", "negative", "holy", "energy", "mental", "disease", "drowning", "light", "sound", "wood", "silver", "iron", NULL
-};
-
-// Resist flags (from tables.c)
-static const char *res_flags[] = {
-    "summon", "charm", "magic", "weapon", "bash", "pierce", "slash", "fire", "cold", "lightning", "acid", "poison", "negative", "holy", "energy", "mental", "disease", "drowning", "light", "sound", "wood", "silver", "iron", NULL
-};
+// Escape a string for use between JSON quotes, with the same escapes as the
+// rest of the output. The result is freed with mem_free.
+char *escape_json_string(const char *input) {
+    size_t len = input ? strlen(input) : 0;
+    // Room for every byte to take a \u00XX escape, so the buffer never grows
+    STRBUF sb = { mem_alloc(MEM_ESCAPE, len * 6 + 1), 0, len * 6 + 1 };
+    sb.data[0] = '\0';
+    if (input) sb_append_json_string(&sb, input, len);
+    return sb.data;
+}
 
-// Vulnerable flags (from tables.c)
-static const char *vuln_flags[] = {
-    "summon", "charm", "magic", "weapon", "bash", "pierce", "slash", "fire", "cold", "lightning", "acid", "poison", "negative", "holy", "energy", "mental", "disease", "drowning", "light", "sound", "wood", "silver", "iron", NULL
+// Object fields that --fields can select, in output order
+enum object_field {
+    FIELD_VNUM = 1 << 0,
+    FIELD_NAME = 1 << 1,
+    FIELD_TYPE = 1 << 2,
+    FIELD_LEVEL = 1 << 3,
+    FIELD_WEAR_FLAGS = 1 << 4,
+    FIELD_EXTRA_FLAGS = 1 << 5,
+    FIELD_MATERIAL = 1 << 6,
+    FIELD_CONDITION = 1 << 7,
+    FIELD_WEIGHT = 1 << 8,
+    FIELD_COST = 1 << 9,
+    FIELD_SHORT_DESCR = 1 << 10,
+    FIELD_DESCRIPTION = 1 << 11,
+    FIELD_AFFECTS = 1 << 12,
+    FIELD_VALUES = 1 << 13,
+    FIELD_SOURCES = 1 << 14, // Only on request: needs the whole area parsed
+    FIELD_DEFAULT = (1 << 14) - 1
 };
 
-// Weapon flags (from tables.c)
-static const char *weapon_flags[] = {
-    "flaming", "frost", "vampiric", "sharp", "vorpal", "two_hands", "shocking", "poisoned", NULL
+static const struct { const char *name; unsigned field; } object_fields[] = {
+    {"vnum", FIELD_VNUM}, {"name", FIELD_NAME}, {"type", FIELD_TYPE},
+    {"level", FIELD_LEVEL}, {"wear_flags", FIELD_WEAR_FLAGS},
+    {"extra_flags", FIELD_EXTRA_FLAGS}, {"material", FIELD_MATERIAL},
+    {"condition", FIELD_CONDITION}, {"weight", FIELD_WEIGHT}, {"cost", FIELD_COST},
+    {"short_descr", FIELD_SHORT_DESCR}, {"description", FIELD_DESCRIPTION},
+    {"affects", FIELD_AFFECTS}, {"values", FIELD_VALUES}, {"sources", FIELD_SOURCES},
+    {NULL, 0}
 };
 
-// Helper: get item type name
-const char *item_type_name(int type) {
-    for (int i = 0; item_type_table[i].name; ++i)
-        if (item_type_table[i].type == type)
-            return item_type_table[i].name;
-    return "unknown";
+// Parse a comma-separated --fields list into a field mask, 0 on error
+static unsigned parse_fields(const char *list) {
+    unsigned mask = 0;
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        unsigned field = 0;
+        for (int i = 0; object_fields[i].name; ++i) {
+            if (strlen(object_fields[i].name) == len && !strncmp(object_fields[i].name, list, len)) {
+                field = object_fields[i].field;
+                break;
+            }
+        }
+        if (!field) {
+            fprintf(stderr, "Error: unknown field '%.*s'\n", (int)len, list);
+            return 0;
+        }
+        mask |= field;
+        list += len;
+        if (*list == ',') list++;
+    }
+    return mask;
 }
 
-// Helper: convert bitfield to flag string (for wear/extra flags)
-void bitfield_to_names(int bits, const char **table, char *out, size_t outlen) {
-    out[0] = '\0';
-    int first = 1;
-    for (int i = 0; table[i]; ++i) {
-        if (bits & (1 << i)) {
-            if (!first) strncat(out, " ", outlen - strlen(out) - 1);
-            strncat(out, table[i], outlen - strlen(out) - 1);
-            first = 0;
+// Apply a comma-separated --limits list of name=bytes (with an optional k,
+// m or g suffix; 0 for no limit) over the defaults already in limits.
+// Returns false after printing the error.
+static bool parse_limits(const char *list, AREA_LIMITS *limits) {
+    static const char *names[] = {"string", "record", "section", "input", NULL};
+    size_t *fields[] = {&limits->string, &limits->record, &limits->section, &limits->input};
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        const char *eq = memchr(list, '=', len);
+        int which = -1;
+        for (int i = 0; eq && names[i]; ++i)
+            if (strlen(names[i]) == (size_t)(eq - list) && !strncmp(names[i], list, eq - list))
+                which = i;
+        char *end = NULL;
+        unsigned long long value = eq ? strtoull(eq + 1, &end, 10) : 0;
+        if (end && end > eq + 1 && (*end == 'k' || *end == 'm' || *end == 'g')) {
+            value <<= *end == 'k' ? 10 : *end == 'm' ? 20 : 30;
+            end++;
+        }
+        if (which < 0 || !end || end == eq + 1 || end != list + len || value > LONG_MAX ||
+            (value && value < 64)) {
+            fprintf(stderr, "Error: bad --limits entry '%.*s': expected string, record, section or input="
+                    "bytes, at least 64 (k, m or g suffix allowed) or 0 for none\n", (int)len, list);
+            return false;
         }
+        *fields[which] = (size_t)value;
+        list += len;
+        if (*list == ',') list++;
     }
-    if (first) strncat(out, "none", outlen - strlen(out) - 1);
+    return true;
 }
 
-// Helper: affect location name
-const char *affect_location_name(int loc) {
-    if (loc >= 0 && loc < 41 && affect_location_table[loc])
-        return affect_location_table[loc];
-    return "unknown";
+// Where an object's record sits in the --details file; length is 0 for
+// objects without one
+typedef struct detail_span {
+    size_t offset;
+    size_t length;
+} DETAIL_SPAN;
+
+// Output options shared by every object
+typedef struct json_opts {
+    unsigned fields; // FIELD_* mask
+    const STRING_POOL *dict; // Repeated strings are emitted as indexes into this, NULL for inline
+    const STRING_POOL *styles; // Color styles as CSS, by index; NULL without --colors
+    const DETAIL_SPAN *details; // One span per output object, NULL without --details
+    const char *details_name; // The details file as the viewer fetches it
+    const SHARD_PLAN *shard; // Areas this partial output covers, NULL unless --shard
+} JSON_OPTS;
+
+// Separate object fields: every field but the first is preceded by ",\n"
+static void begin_field(STRBUF *out, int *first) {
+    if (!*first) sb_puts(out, ",\n");
+    *first = 0;
 }
 
-// Helper: convert shield bitvector to name
-const char *shield_bit_name(int bits) {
-    for (int i = 0; shield_flags[i]; ++i) {
-        if (bits & (1 << i)) {
-            return shield_flags[i];
-        }
+// Emit a repeated string (type, flag and material names, ...) either inline
+// or, in dictionary mode, as its index in the "strings" table
+static void emit_string(STRBUF *out, const JSON_OPTS *opts, const char *s, bool escape) {
+    if (opts->dict) {
+        sb_printf(out, "%d", string_pool_find(opts->dict, s));
+    } else if (escape) {
+        char *escaped = escape_json_string(s);
+        sb_printf(out, "\"%s\"", escaped);
+        mem_free(escaped);
+    } else {
+        sb_printf(out, "\"%s\"", s);
     }
-    return "unknown";
 }
 
-// Helper: convert affect bitvector to name
-const char *affect_bit_name(int bits) {
-    for (int i = 0; affect_flags[i]; ++i) {
-        if (bits & (1 << i)) {
-            return affect_flags[i];
-        }
+static void emit_weapon_flags(STRBUF *out, const JSON_OPTS *opts, const char *flags) {
+    if (!opts->dict) {
+        char *flags_names = weapon_flags_to_names(flags);
+        sb_puts(out, flags_names);
+        mem_free(flags_names);
+        return;
     }
-    return "unknown";
-}
-
-// Helper: convert affect2 bitvector to name
-const char *affect2_bit_name(int bits) {
-    for (int i = 0; affect2_flags[i]; ++i) {
-        if (bits & (1 << i)) {
-            return affect2_flags[i];
-        }
+    sb_puts(out, "[");
+    for (const char *c = flags ? flags : ""; *c; c++) {
+        if (c != flags) sb_puts(out, ", ");
+        emit_string(out, opts, weapon_flag_letter_name(*c), false);
     }
-    return "unknown";
+    sb_puts(out, "]");
 }
 
-// Helper: convert immune bitvector to name
-const char *immune_bit_name(int bits) {
-    for (int i = 0; imm_flags[i]; ++i) {
-        if (bits & (1 << i)) {
-            return imm_flags[i];
-        }
+// Intern the CSS of every style in ct, so style indexes follow first use
+static void collect_styles(STRING_POOL *styles, const COLOR_TEXT *ct) {
+    char css[COLOR_CSS_MAX];
+    for (int i = 0; i < ct->nruns; ++i) {
+        color_style_css(ct->runs[i].style, css, sizeof(css));
+        string_intern(styles, css);
     }
-    return "unknown";
 }
 
-// Helper: convert resist bitvector to name
-const char *resist_bit_name(int bits) {
-    for (int i = 0; res_flags[i]; ++i) {
-        if (bits & (1 << i)) {
-            return res_flags[i];
-        }
+// Emit a color-coded string as "key": its plain text, then "key_runs": a
+// flat array of text and style index pairs for the viewer to render
+static void emit_colored(STRBUF *out, const JSON_OPTS *opts, const char *key, const COLOR_TEXT *ct) {
+    char css[COLOR_CSS_MAX];
+
+    sb_printf(out, "    \"%s\": \"", key);
+    sb_append_json_string(out, ct->plain, ct->len);
+    sb_printf(out, "\",\n    \"%s_runs\": [", key);
+    for (int i = 0; i < ct->nruns; ++i) {
+        size_t start = ct->runs[i].start;
+        size_t end = i + 1 < ct->nruns ? ct->runs[i + 1].start : ct->len;
+        color_style_css(ct->runs[i].style, css, sizeof(css));
+        sb_puts(out, i ? ", \"" : "\"");
+        sb_append_json_string(out, ct->plain + start, end - start);
+        sb_printf(out, "\", %d", string_pool_find(opts->styles, css));
     }
-    return "unknown";
+    sb_puts(out, "]");
 }
 
-// Helper: convert vulnerable bitvector to name
-const char *vuln_bit_name(int bits) {
-    for (int i = 0; vuln_flags[i]; ++i) {
-        if (bits & (1 << i)) {
-            return vuln_flags[i];
+// Intern every string emit_string will look up for this object, in output
+// order, so dictionary indexes follow first use
+static void collect_object_strings(STRING_POOL *dict, const OBJ_INDEX_DATA *obj, unsigned fields) {
+    char buf[FLAG_NAMES_MAX];
+
+    if (fields & FIELD_TYPE)
+        string_intern(dict, item_type_name(obj->item_type));
+    if (fields & FIELD_WEAR_FLAGS) {
+        flag_bits_to_names(&flag_wear, obj->wear_flags, buf, sizeof(buf));
+        string_intern(dict, buf);
+    }
+    if (fields & FIELD_EXTRA_FLAGS) {
+        flag_bits_to_names(&flag_extra, obj->extra_flags, buf, sizeof(buf));
+        string_intern(dict, buf);
+    }
+    if (fields & FIELD_MATERIAL)
+        string_intern(dict, obj->material ? obj->material : "");
+    if (fields & FIELD_AFFECTS) {
+        for (const AFFECT_OUT *ao = obj->affects_out; ao; ao = ao->next) {
+            string_intern(dict, ao->type);
+            string_intern(dict, ao->location);
+            if (ao->extra && ao->extra[0]) string_intern(dict, ao->extra);
         }
     }
-    return "unknown";
-}
-
-// Helper: convert weapon bitvector to name
-const char *weapon_bit_name(int bits) {
-    for (int i = 0; weapon_flags[i]; ++i) {
-        if (bits & (1 << i)) {
-            return weapon_flags[i];
+    if (fields & FIELD_VALUES) {
+        if (obj->item_type == 5) {
+            string_intern(dict, weapon_type_name(obj->value[0]));
+            string_intern(dict, obj->damage_type ? obj->damage_type : "unknown");
+            for (const char *c = obj->weapon_flags ? obj->weapon_flags : ""; *c; c++)
+                string_intern(dict, weapon_flag_letter_name(*c));
+        } else if (obj->item_type == 40) {
+            string_intern(dict, obj->materia_spell ? obj->materia_spell : "");
         }
     }
-    return "unknown";
-}
-
-// Weapon type lookup
-const char *weapon_type_name(int type) {
-    switch (type) {
-        case 0: return "exotic";
-        case 1: return "sword";
-        case 2: return "dagger";
-        case 3: return "spear";
-        case 4: return "mace";
-        case 5: return "axe";
-        case 6: return "flail";
-        case 7: return "whip";
-        case 8: return "polearm";
-        case 9: return "bow";
-        default: return "unknown";
+    if (fields & FIELD_SOURCES) {
+        for (int i = 0; i < obj->nsources; ++i)
+            string_intern(dict, source_kind_name(obj->sources[i].kind));
     }
 }
 
-// Damage type lookup
-const char *damage_type_name(int type) {
-    switch (type) {
-        case 0: return "none";
-        case 1: return "slice";
-        case 2: return "stab";
-        case 3: return "slash";
-        case 4: return "whip";
-        case 5: return "claw";
-        case 6: return "blast";
-        case 7: return "pound";
-        case 8: return "crush";
-        case 9: return "grep";
-        case 10: return "bite";
-        case 11: return "pierce";
-        case 12: return "suction";
-        case 13: return "beating";
-        case 14: return "digestion";
-        case 15: return "charge";
-        case 16: return "slap";
-        case 17: return "punch";
-        case 18: return "wrath";
-        case 19: return "magic";
-        case 20: return "divine";
-        case 21: return "kiss";
-        case 22: return "cleave";
-        case 23: return "scratch";
-        case 24: return "peck";
-        case 25: return "peckb";
-        case 26: return "chop";
-        case 27: return "sting";
-        case 28: return "smash";
-        case 29: return "shbite";
-        case 30: return "flbite";
-        case 31: return "frbite";
-        case 32: return "acbite";
-        case 33: return "chomp";
-        case 34: return "drain";
-        case 35: return "thrust";
-        case 36: return "slime";
-        case 37: return "shock";
-        case 38: return "thwack";
-        case 39: return "flame";
-        case 40: return "chill";
-        case 41: return "poison";
-        case 42: return "pulse";
-        case 43: return "bleed";
-        default: return "unknown";
-    }
-}
+enum sort_order { SORT_NONE, SORT_VNUM, SORT_AREA };
 
-// Weapon flags lookup - using actual weapon flags from merc.h
-const char *weapon_flag_name(int flag) {
-    switch (flag) {
-        case 0: return "none";
-        case 1: return "flaming";      // A
-        case 2: return "frost";        // B
-        case 4: return "vampiric";     // C
-        case 8: return "sharp";        // D
-        case 16: return "vorpal";      // E
-        case 32: return "two_hands";   // F
-        case 64: return "shocking";    // G
-        case 128: return "poison";     // H
-        case 256: return "acid";       // I
-        case 1024: return "purify";    // K
-        default: return "unknown";
+// Format object as JSON into out, limited to the fields in opts. area is
+// the index into "areas" in multi-area output, -1 otherwise. details
+// locates the object's record in the --details file, NULL if there is none.
+void print_object_json(STRBUF *out, OBJ_INDEX_DATA *obj, int area, const DETAIL_SPAN *details,
+                       const JSON_OPTS *opts) {
+    unsigned fields = opts->fields;
+    int first_field = 1;
+
+    sb_puts(out, "  {\n");
+    if (fields & FIELD_VNUM) {
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"vnum\": %ld", obj->vnum);
+    }
+    if (area >= 0) {
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"area\": %d", area);
+    }
+    if (fields & FIELD_NAME) {
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"name\": \"%s\"", obj->name ? obj->name : "");
+    }
+    if (fields & FIELD_TYPE) {
+        begin_field(out, &first_field);
+        sb_puts(out, "    \"type\": ");
+        emit_string(out, opts, item_type_name(obj->item_type), false);
+    }
+    if (fields & FIELD_LEVEL) {
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"level\": %d", obj->level);
+    }
+    if (fields & FIELD_WEAR_FLAGS) {
+        char wear_buf[FLAG_NAMES_MAX];
+        flag_bits_to_names(&flag_wear, obj->wear_flags, wear_buf, sizeof(wear_buf));
+        begin_field(out, &first_field);
+        sb_puts(out, "    \"wear_flags\": ");
+        emit_string(out, opts, wear_buf, false);
+    }
+    if (fields & FIELD_EXTRA_FLAGS) {
+        char extra_buf[FLAG_NAMES_MAX];
+        flag_bits_to_names(&flag_extra, obj->extra_flags, extra_buf, sizeof(extra_buf));
+        begin_field(out, &first_field);
+        sb_puts(out, "    \"extra_flags\": ");
+        emit_string(out, opts, extra_buf, false);
+    }
+    if (fields & FIELD_MATERIAL) {
+        begin_field(out, &first_field);
+        sb_puts(out, "    \"material\": ");
+        emit_string(out, opts, obj->material ? obj->material : "", false);
+    }
+    if (fields & FIELD_CONDITION) {
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"condition\": %d", obj->condition);
+    }
+    if (fields & FIELD_WEIGHT) {
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"weight\": %d", obj->weight);
+    }
+    if (fields & FIELD_COST) {
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"cost\": %d", obj->cost);
+    }
+    if ((fields & FIELD_SHORT_DESCR) && opts->styles && obj->short_colors.plain) {
+        begin_field(out, &first_field);
+        emit_colored(out, opts, "short_descr", &obj->short_colors);
+    } else if (fields & FIELD_SHORT_DESCR) {
+        char *escaped_short = escape_json_string(obj->short_descr);
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"short_descr\": \"%s\"", escaped_short);
+        mem_free(escaped_short);
+    }
+    if ((fields & FIELD_DESCRIPTION) && opts->styles && obj->description_colors.plain) {
+        begin_field(out, &first_field);
+        emit_colored(out, opts, "description", &obj->description_colors);
+    } else if (fields & FIELD_DESCRIPTION) {
+        char *escaped_desc = escape_json_string(obj->description);
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"description\": \"%s\"", escaped_desc);
+        mem_free(escaped_desc);
+    }
+    if (details && details->length) {
+        begin_field(out, &first_field);
+        sb_printf(out, "    \"details\": {\"offset\": %zu, \"length\": %zu}",
+                  details->offset, details->length);
     }
-}
 
-char *escape_json_string(const char *input) {
-    if (!input) return strdup("");
-    
-    // Calculate required length
-    int len = 0;
-    for (const char *p = input; *p; p++) {
-        switch (*p) {
-            case '"':  len += 2; break;  // \" 
-            case '\\': len += 2; break;  // \\
-            case '\b': len += 2; break;  // \b
-            case '\f': len += 2; break;  // \f
-            case '\n': len += 2; break;  // \n
-            case '\r': len += 2; break;  // \r
-            case '\t': len += 2; break;  // \t
-            default:   len += 1; break;
+    // Affects
+    if (fields & FIELD_AFFECTS) {
+        begin_field(out, &first_field);
+        sb_puts(out, "    \"affects\": [\n");
+        AFFECT_OUT *ao = obj->affects_out;
+        int first = 1;
+        while (ao) {
+            if (!first) sb_puts(out, ",\n");
+            first = 0;
+            sb_puts(out, "      {\n");
+            sb_puts(out, "        \"type\": ");
+            emit_string(out, opts, ao->type, false);
+            sb_puts(out, ",\n");
+            sb_puts(out, "        \"location\": ");
+            emit_string(out, opts, ao->location, false);
+            sb_puts(out, ",\n");
+            sb_printf(out, "        \"modifier\": %d", ao->modifier);
+            if (ao->extra && ao->extra[0]) {
+                sb_puts(out, ", \"extra\": ");
+                emit_string(out, opts, ao->extra, true);
+            }
+            sb_puts(out, "\n      }");
+            ao = ao->next;
         }
+        sb_puts(out, "\n    ]");
     }
-    
-    char *output = malloc(len + 1);
-    char *q = output;
-    
-    for (const char *p = input; *p; p++) {
-        switch (*p) {
-            case '"':  *q++ = '\\'; *q++ = '"';  break;
-            case '\\': *q++ = '\\'; *q++ = '\\'; break;
-            case '\b': *q++ = '\\'; *q++ = 'b';  break;
-            case '\f': *q++ = '\\'; *q++ = 'f';  break;
-            case '\n': *q++ = '\\'; *q++ = 'n';  break;
-            case '\r': *q++ = '\\'; *q++ = 'r';  break;
-            case '\t': *q++ = '\\'; *q++ = 't';  break;
-            default:   *q++ = *p; break;
+
+    // Values (interpreted per item type)
+    if (fields & FIELD_VALUES) {
+        begin_field(out, &first_field);
+        sb_puts(out, "    \"values\": {\n");
+        if (obj->item_type == 9) { // armor
+            sb_printf(out, "      \"ac_pierce\": %d,\n", obj->value[0]);
+            sb_printf(out, "      \"ac_bash\": %d,\n", obj->value[1]);
+            sb_printf(out, "      \"ac_slash\": %d,\n", obj->value[2]);
+            sb_printf(out, "      \"ac_exotic\": %d,\n", obj->value[3]);
+            sb_printf(out, "      \"v4\": %d\n", obj->value[4]);
+        } else if (obj->item_type == 5) { // weapon
+            sb_puts(out, "      \"weapon_type\": ");
+            emit_string(out, opts, weapon_type_name(obj->value[0]), false);
+            sb_puts(out, ",\n");
+            sb_printf(out, "      \"number_of_dice\": %d,\n", obj->value[1]);
+            sb_printf(out, "      \"type_of_dice\": %d,\n", obj->value[2]);
+            sb_puts(out, "      \"damage_type\": ");
+            emit_string(out, opts, obj->damage_type ? obj->damage_type : "unknown", false);
+            sb_puts(out, ",\n");
+            sb_puts(out, "      \"flags\": ");
+            emit_weapon_flags(out, opts, obj->weapon_flags);
+            sb_puts(out, "\n");
+        } else if (obj->item_type == 40) { // materia
+            sb_printf(out, "      \"charges\": %d,\n", obj->value[0]);
+            sb_puts(out, "      \"spell\": ");
+            emit_string(out, opts, obj->materia_spell ? obj->materia_spell : "", false);
+            sb_puts(out, ",\n");
+            sb_printf(out, "      \"v2\": %d,\n", obj->value[2]);
+            sb_printf(out, "      \"v3\": %d,\n", obj->value[3]);
+            sb_printf(out, "      \"v4\": %d\n", obj->value[4]);
+        } else {
+            sb_printf(out, "      \"v0\": %d,\n", obj->value[0]);
+            sb_printf(out, "      \"v1\": %d,\n", obj->value[1]);
+            sb_printf(out, "      \"v2\": %d,\n", obj->value[2]);
+            sb_printf(out, "      \"v3\": %d,\n", obj->value[3]);
+            sb_printf(out, "      \"v4\": %d\n", obj->value[4]);
         }
+        sb_puts(out, "    }");
     }
-    *q = '\0';
-    return output;
-}
 
-// Convert extra flag letters to full names
-char *extra_flags_to_names(const char *flags_str) {
-    if (!flags_str || !*flags_str) return strdup("none");
-    
-    static char result[1024];
-    char *p = result;
-    int first = 1;
-    
-    for (const char *c = flags_str; *c; c++) {
-        const char *flag_name = NULL;
-        
-        switch (*c) {
-            case 'A': flag_name = "glow"; break;
-            case 'B': flag_name = "hum"; break;
-            case 'C': flag_name = "dark"; break;
-            case 'D': flag_name = "lock"; break;
-            case 'E': flag_name = "evil"; break;
-            case 'F': flag_name = "invis"; break;
-            case 'G': flag_name = "magic"; break;
-            case 'H': flag_name = "nodrop"; break;
-            case 'I': flag_name = "bless"; break;
-            case 'J': flag_name = "antigood"; break;
-            case 'K': flag_name = "antievil"; break;
-            case 'L': flag_name = "antineutral"; break;
-            case 'M': flag_name = "noremove"; break;
-            case 'N': flag_name = "inventory"; break;
-            case 'O': flag_name = "nopurge"; break;
-            case 'P': flag_name = "rot_death"; break;
-            case 'Q': flag_name = "vis_death"; break;
-            case 'R': flag_name = "no_locate"; break;
-            case 'S': flag_name = "meltdrop"; break;
-            case 'T': flag_name = "had_charge"; break;
-            case 'U': flag_name = "sellextract"; break;
-            case 'V': flag_name = "quest"; break;
-            case 'W': flag_name = "questpoint"; break;
-            case 'X': flag_name = "no_auction"; break;
-            case 'Y': flag_name = "burnproof"; break;
-            case 'Z': flag_name = "no_give"; break;
-            case 'a': flag_name = "no_locate2"; break;
-            case 'b': flag_name = "no_sac"; break;
-            case 'c': flag_name = "no_drop2"; break;
-            case 'd': flag_name = "no_restring"; break;
-            case 'e': flag_name = "no_junk"; break;
-            case 'f': flag_name = "no_sell"; break;
-            case 'g': flag_name = "no_store"; break;
-            case 'h': flag_name = "no_purge"; break;
-            default: flag_name = "unknown"; break;
-        }
-        
-        if (!first) {
-            *p++ = ' ';
+    // Where the object loads, from the area resets
+    if (fields & FIELD_SOURCES) {
+        begin_field(out, &first_field);
+        sb_puts(out, "    \"sources\": [");
+        for (int i = 0; i < obj->nsources; ++i) {
+            const OBJ_SOURCE *src = &obj->sources[i];
+            sb_puts(out, i ? ",\n" : "\n");
+            sb_puts(out, "      {\"kind\": ");
+            emit_string(out, opts, source_kind_name(src->kind), false);
+            if (src->mob) {
+                char *escaped = escape_json_string(src->mob->short_descr);
+                sb_printf(out, ", \"mob\": %ld, \"mob_name\": \"%s\", \"mob_level\": %d",
+                          src->mob->vnum, escaped, src->mob->level);
+                mem_free(escaped);
+            }
+            if (src->room) {
+                char *escaped = escape_json_string(src->room->name);
+                sb_printf(out, ", \"room\": %ld, \"room_name\": \"%s\"", src->room->vnum, escaped);
+                mem_free(escaped);
+            }
+            if (src->kind == SOURCE_CONTAINER) {
+                sb_printf(out, ", \"container\": %ld", src->container);
+                if (src->container_obj) {
+                    char *escaped = escape_json_string(src->container_obj->short_descr);
+                    sb_printf(out, ", \"container_name\": \"%s\"", escaped);
+                    mem_free(escaped);
+                }
+            }
+            sb_puts(out, "}");
         }
-        first = 0;
-        
-        while (*flag_name) *p++ = *flag_name++;
-    }
-    
-    *p = '\0';
-    
-    return strdup(result);
+        sb_puts(out, obj->nsources ? "\n    ]" : "]");
+    }
+    sb_puts(out, "\n  }");
 }
 
+// object_header hook: drop objects the --filter expression rejects before
+// their affects and extra descriptions are decoded
+static bool filter_object_header(AREA_PARSER *ap, OBJ_INDEX_DATA *obj, void *user) {
+    (void)ap;
+    return filter_match((const OBJ_FILTER *)user, obj);
+}
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--filter EXPR] [--fields LIST] [--dict] [--colors]\n       [--sort vnum|area] [--threads N] [--sources]\n       [--details PATH [--details-description]] [--summary PATH] [--shard I/N]\n       [--sqlite PATH] [--arrow BASE]\n       [--serve PORT|HOST:PORT|unix:PATH]\n       [--metrics-prom PATH] [--metrics-json PATH]\n       [--trace PATH [--trace-threshold USEC]] [--mem-report]\n       [--history DIR [--history-time TIME]]\n       [--score WEIGHTS|PRESET] [--score-presets PATH] [--top K] [--max-level N]\n       [--hardened] [--limits LIST]\n       <area_file>...\n       %s --merge [--details PATH] <partial_output>...\n       %s --history DIR --item VNUM [--as-of TIME]\n       %s --history DIR --changes FROM..TO\n", prog, prog, prog, prog);
+    fprintf(stderr, "  Several area files are merged into one document with an \"areas\"\n");
+    fprintf(stderr, "  array; each object then carries its area's index.\n");
+    fprintf(stderr, "  --filter EXPR  keep objects matching every term, e.g.\n");
+    fprintf(stderr, "                 'type=weapon,armor level>=50 extra~quest'\n");
+    fprintf(stderr, "  --fields LIST  comma-separated object fields to emit, e.g.\n");
+    fprintf(stderr, "                 'vnum,name,level,affects'\n");
+    fprintf(stderr, "  --dict         emit repeated strings once in a \"strings\" table and\n");
+    fprintf(stderr, "                 refer to them by index\n");
+    fprintf(stderr, "  --colors       strip color codes from short_descr and description and\n");
+    fprintf(stderr, "                 add their style runs, with a \"styles\" table of CSS\n");
+    fprintf(stderr, "  --sort vnum|area  emit objects ordered by vnum, or grouped by area\n");
+    fprintf(stderr, "                 (command-line order) and then by vnum; the default is\n");
+    fprintf(stderr, "                 each area's objects newest first\n");
+    fprintf(stderr, "  --threads N    format objects on N threads (default: one per CPU);\n");
+    fprintf(stderr, "                 the output is the same for any N\n");
+    fprintf(stderr, "  --sources      add where each object loads (worn, carried or sold by a\n");
+    fprintf(stderr, "                 mobile, on a room's floor, in a container) from the resets\n");
+    fprintf(stderr, "  --details PATH write extra descriptions to a side file that objects\n");
+    fprintf(stderr, "                 point into by byte range, for loading on demand\n");
+    fprintf(stderr, "  --details-description  move descriptions into that file as well\n");
+    fprintf(stderr, "  --summary PATH check the JSON as it is written and record the result\n");
+    fprintf(stderr, "                 in PATH: valid, objects, bytes and sha256 of the output,\n");
+    fprintf(stderr, "                 details_valid, details_bytes and details_sha256 with\n");
+    fprintf(stderr, "                 --details, and the first problem as error; invalid\n");
+    fprintf(stderr, "                 output makes the run exit with status 1\n");
+    fprintf(stderr, "  --shard I/N    parse only the I-th of N size-balanced shares of the area\n");
+    fprintf(stderr, "                 files and write a partial output, sorted by vnum\n");
+    fprintf(stderr, "  --merge        merge the partial outputs of all N shards into the\n");
+    fprintf(stderr, "                 document one --sort vnum run would write; --details\n");
+    fprintf(stderr, "                 names the merged details file\n");
+    fprintf(stderr, "  --sqlite PATH  write areas, objects, affects and extra descriptions to\n");
+    fprintf(stderr, "                 an indexed SQLite database, as well as JSON on stdout\n");
+    fprintf(stderr, "  --arrow BASE   write BASE.objects.arrow and BASE.affects.arrow (Arrow\n");
+    fprintf(stderr, "                 IPC files) instead of JSON on stdout\n");
+    fprintf(stderr, "  --serve ADDR   keep the objects in memory and answer HTTP queries on\n");
+    fprintf(stderr, "                 ADDR (a port on localhost, HOST:PORT or unix:PATH),\n");
+    fprintf(stderr, "                 reloading when an area file changes\n");
+    fprintf(stderr, "  --score WEIGHTS  print the best K objects per wear slot by the sum of\n");
+    fprintf(stderr, "                 their affect modifiers times WEIGHTS, e.g.\n");
+    fprintf(stderr, "                 'hitroll=1,damroll=1.5,saves=-0.5', or a preset: melee,\n");
+    fprintf(stderr, "                 caster or tank; instead of the objects\n");
+    fprintf(stderr, "  --score-presets PATH  write every preset's rankings to PATH\n");
+    fprintf(stderr, "  --top K        objects per slot for those (default 10)\n");
+    fprintf(stderr, "  --max-level N  rank only objects up to level N\n");
+    fprintf(stderr, "  --hardened     bound what one corrupt area file can cost: records over\n");
+    fprintf(stderr, "                 1m or with a string over 16k are dropped, sections over\n");
+    fprintf(stderr, "                 256m skipped and input past 1g ignored, each an error\n");
+    fprintf(stderr, "  --limits LIST  --hardened with other bounds, e.g.\n");
+    fprintf(stderr, "                 'string=8k,record=256k,section=0,input=64m' (0 for none)\n");
+    fprintf(stderr, "  --metrics-prom PATH  write phase timings and counters as a\n");
+    fprintf(stderr, "                 Prometheus textfile-collector file\n");
+    fprintf(stderr, "  --metrics-json PATH  write the same run summary as JSON\n");
+    fprintf(stderr, "  --mem-report   print allocations, peak heap and leaked bytes by\n");
+    fprintf(stderr, "                 category, and peak RSS, to stderr at exit\n");
+    fprintf(stderr, "  --trace PATH   write Chrome trace-event spans for phases, sections\n");
+    fprintf(stderr, "                 and slow objects (open in Perfetto or chrome://tracing)\n");
+    fprintf(stderr, "  --trace-threshold USEC  only trace objects slower than this (default 50)\n");
+    fprintf(stderr, "  --history DIR  also record the parse as a snapshot in the item history\n");
+    fprintf(stderr, "                 store in DIR, appending only items that changed\n");
+    fprintf(stderr, "  --history-time TIME  record the snapshot at TIME instead of now, for\n");
+    fprintf(stderr, "                 backfilling; one older than the newest is refused\n");
+    fprintf(stderr, "  --item VNUM    print the version of VNUM in force at --as-of TIME\n");
+    fprintf(stderr, "                 (default now), reading only the store\n");
+    fprintf(stderr, "  --changes FROM..TO  list the items added, changed or removed by the\n");
+    fprintf(stderr, "                 snapshots in that range; either end may be left out\n");
+    fprintf(stderr, "  TIME is seconds since the epoch, now, or a UTC date: 2024-06-01,\n");
+    fprintf(stderr, "  2024-06-01T12:00 or 2024-06-01T12:00:30, with an optional Z\n");
+}
 
-// Convert weapon flag letters to full names - using actual weapon flags from merc.h
-char *weapon_flags_to_names(const char *flags_str) {
-    if (!flags_str || !*flags_str) return strdup("[]");
-    
-    static char result[2048];
-    char *p = result;
-    int first = 1;
-    
-    *p++ = '[';
-    
-    for (const char *c = flags_str; *c; c++) {
-        const char *flag_name = NULL;
-        
-        switch (*c) {
-            case 'A': flag_name = "flaming"; break;
-            case 'B': flag_name = "frost"; break;
-            case 'C': flag_name = "vampiric"; break;
-            case 'D': flag_name = "sharp"; break;
-            case 'E': flag_name = "vorpal"; break;
-            case 'F': flag_name = "two_hands"; break;
-            case 'G': flag_name = "shocking"; break;
-            case 'H': flag_name = "poison"; break;
-            case 'I': flag_name = "acid"; break;
-            case 'K': flag_name = "purify"; break;
-            default: flag_name = "unknown"; break;
+// The area's fields, its error count and, if it had errors, the kept
+// diagnostics. Each field is one line, which --merge relies on.
+static void print_area_json(STRBUF *out, const AREA_PARSER *ap, const char *indent) {
+    const AREA_DATA *area = ap->area;
+    sb_printf(out, "%s  \"name\": \"%s\",\n", indent, area->name ? area->name : "");
+    sb_printf(out, "%s  \"file\": \"%s\",\n", indent, area->file_name ? area->file_name : "");
+    sb_printf(out, "%s  \"credits\": \"%s\",\n", indent, area->credits ? area->credits : "");
+    sb_printf(out, "%s  \"builders\": \"%s\",\n", indent, area->builders ? area->builders : "");
+    sb_printf(out, "%s  \"errors\": %d", indent, ap->stats.errors);
+    if (ap->ndiagnostics) {
+        sb_printf(out, ",\n%s  \"diagnostics\": [", indent);
+        for (int i = 0; i < ap->ndiagnostics; ++i) {
+            const AREA_DIAGNOSTIC *d = &ap->diagnostics[i];
+            sb_printf(out, "%s{\"offset\": %ld, \"line\": %ld, \"vnum\": %ld, \"message\": \"",
+                      i ? ", " : "", d->offset, d->line, d->vnum);
+            sb_append_json_string(out, d->message, strlen(d->message));
+            sb_puts(out, "\"}");
         }
-        
-        if (!first) {
-            *p++ = ',';
-            *p++ = ' ';
-        }
-        first = 0;
-        
-        *p++ = '"';
-        strcpy(p, flag_name);
-        p += strlen(flag_name);
-        *p++ = '"';
-    }
-    
-    *p++ = ']';
-    *p = '\0';
-    
-    return strdup(result);
+        sb_puts(out, "]");
+    }
+    sb_puts(out, "\n");
 }
 
-// File reading functions
-char fread_letter(FILE *fp) {
-    char c;
-    do {
-        c = getc(fp);
-        if (c == EOF) return EOF;
-    } while (isspace(c));
-    return c;
+// Objects are formatted in chunks of this many; workers claim chunks one at
+// a time, so a thread that draws long descriptions doesn't hold up the rest
+#define SERIALIZE_CHUNK_OBJECTS 256
+#define SERIALIZE_MAX_THREADS 64
+#define WRITE_IOV_MAX 1024
+
+// The output document as buffers to be written back to back: the header,
+// one buffer per chunk of objects, and the closing brackets
+typedef struct json_doc {
+    STRBUF *parts;
+    int nparts;
+} JSON_DOC;
+
+typedef struct serialize_job {
+    JSON_DOC *doc;
+    const OBJ_REF *refs;
+    size_t nrefs;
+    int nareas;
+    const JSON_OPTS *opts;
+    int nchunks;
+    int next_chunk; // Next unclaimed chunk, taken with an atomic add
+    TRACE *trace;
+} SERIALIZE_JOB;
+
+typedef struct serialize_worker {
+    SERIALIZE_JOB *job;
+    int tid;
+    pthread_t thread;
+} SERIALIZE_WORKER;
+
+// The "area" an object carries: none when the output has a single area,
+// otherwise the area's position in "areas", which for a shard is its
+// position in the whole job
+static int output_area(const JSON_OPTS *opts, int nareas, int area) {
+    if (opts->shard) return opts->shard->nfiles == 1 ? -1 : opts->shard->files[area];
+    return nareas == 1 ? -1 : area;
 }
 
-int fread_number(FILE *fp) {
-    int number = 0;
-    char c;
-    bool negative = false;
-    
-    do {
-        c = getc(fp);
-        if (c == EOF) return 0;
-    } while (isspace(c));
-    
-    if (c == '-') {
-        negative = true;
-        c = getc(fp);
-    }
-    
-    if (!isdigit(c)) return 0;
-    
-    while (isdigit(c)) {
-        number = number * 10 + c - '0';
-        c = getc(fp);
-    }
-    
-    if (c != ' ') ungetc(c, fp);
-    
-    if (negative)
-        return -1 * number;
-    
-    return number;
+static void serialize_chunk(SERIALIZE_JOB *job, int chunk) {
+    STRBUF *out = &job->doc->parts[chunk + 1];
+    size_t begin = (size_t)chunk * SERIALIZE_CHUNK_OBJECTS;
+    size_t end = begin + SERIALIZE_CHUNK_OBJECTS;
+    if (end > job->nrefs) end = job->nrefs;
+
+    for (size_t i = begin; i < end; ++i) {
+        if (i) sb_puts(out, ",\n");
+        const DETAIL_SPAN *details = job->opts->details ? &job->opts->details[i] : NULL;
+        print_object_json(out, job->refs[i].obj, output_area(job->opts, job->nareas, job->refs[i].area),
+                          details, job->opts);
+    }
 }
 
-long flag_convert(char letter) {
-    long bitsum = 0;
-    char i;
+static void *serialize_worker(void *arg) {
+    SERIALIZE_WORKER *w = arg;
+    SERIALIZE_JOB *job = w->job;
+    double start = monotonic_seconds();
+    int chunks = 0;
 
-    if ('A' <= letter && letter <= 'Z') {
-        bitsum = 1;
-        for (i = letter; i > 'A'; i--)
-            bitsum *= 2;
-    } else if ('a' <= letter && letter <= 'z') {
-        bitsum = 67108864; /* 2^26 */
-        for (i = letter; i > 'a'; i--)
-            bitsum *= 2;
+    for (;;) {
+        int chunk = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= job->nchunks) break;
+        serialize_chunk(job, chunk);
+        chunks++;
     }
-
-    return bitsum;
+    if (job->trace)
+        trace_span(job->trace, w->tid, "phase", "serialize objects", start, monotonic_seconds(),
+                   "\"chunks\":%d", chunks);
+    return NULL;
 }
 
-static long flag_string_to_bits(const char *str) {
-    long bits = 0;
-    for (const char *p = str; *p; ++p) {
-        if (('A' <= *p && *p <= 'Z') || ('a' <= *p && *p <= 'z')) {
-            bits += flag_convert(*p);
+// Format the objects on up to threads threads, the calling thread included.
+// If a worker can't be started the others just take its share.
+static void serialize_objects(SERIALIZE_JOB *job, int threads) {
+    if (threads > job->nchunks) threads = job->nchunks;
+    if (threads > SERIALIZE_MAX_THREADS) threads = SERIALIZE_MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    SERIALIZE_WORKER workers[SERIALIZE_MAX_THREADS];
+    bool started[SERIALIZE_MAX_THREADS] = {false};
+    for (int i = 0; i < threads; ++i) {
+        workers[i].job = job;
+        workers[i].tid = i;
+    }
+    for (int i = 1; i < threads; ++i) {
+        if (job->trace) {
+            char name[32];
+            snprintf(name, sizeof(name), "serialize %d", i);
+            trace_thread_name(job->trace, i, name);
         }
+        started[i] = pthread_create(&workers[i].thread, NULL, serialize_worker, &workers[i]) == 0;
     }
-    return bits;
+    serialize_worker(&workers[0]);
+    for (int i = 1; i < threads; ++i)
+        if (started[i]) pthread_join(workers[i].thread, NULL);
 }
 
-long fread_flag(FILE *fp) {
-    int number = 0;
-    char c;
-    bool negative = false;
+static void json_doc_free(JSON_DOC *doc) {
+    for (int i = 0; i < doc->nparts; ++i)
+        sb_free(&doc->parts[i]);
+    mem_free(doc->parts);
+    doc->parts = NULL;
+    doc->nparts = 0;
+}
 
-    do {
-        c = getc(fp);
-        if (c == EOF) return 0;
-    } while (isspace(c));
+static size_t json_doc_length(const JSON_DOC *doc) {
+    size_t len = 0;
+    for (int i = 0; i < doc->nparts; ++i)
+        len += doc->parts[i].len;
+    return len;
+}
 
-    if (c == '-') {
-        negative = true;
-        c = getc(fp);
+// Format the whole output document into doc. A single area keeps the
+// original "area" object; several areas become an "areas" array that
+// objects refer to by index. A shard's partial output always has the array,
+// each entry with the area's index in the whole job, after a "shard"
+// header that --merge checks. Objects are formatted in parallel, but the
+// parts come out in order, so the bytes don't depend on the thread count.
+static int serialize_document(JSON_DOC *doc, AREA_PARSER *parsers, int nareas,
+                              const OBJ_REF *refs, size_t nrefs, JSON_OPTS *opts,
+                              STRING_POOL *dict, STRING_POOL *styles, int threads, TRACE *trace) {
+    int nchunks = (int)((nrefs + SERIALIZE_CHUNK_OBJECTS - 1) / SERIALIZE_CHUNK_OBJECTS);
+    doc->nparts = nchunks + 2;
+    doc->parts = mem_calloc(MEM_OUTPUT, doc->nparts, sizeof(*doc->parts));
+    if (!doc->parts) {
+        doc->nparts = 0;
+        return -1;
     }
+    for (int i = 0; i < doc->nparts; ++i)
+        sb_init(&doc->parts[i]);
 
-    number = 0;
-
-    if (!isdigit(c)) {
-        while (('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z')) {
-            number += flag_convert(c);
-            c = getc(fp);
+    // Output JSON
+    STRBUF *out = &doc->parts[0];
+    sb_puts(out, "{\n");
+    if (opts->shard) {
+        const SHARD_PLAN *shard = opts->shard;
+        sb_printf(out, "  \"shard\": {\"index\": %d, \"count\": %d, \"areas\": %d},\n",
+                  shard->index, shard->count, shard->nfiles);
+        sb_puts(out, "  \"areas\": [\n");
+        for (int i = 0; i < nareas; ++i) {
+            sb_printf(out, "    {\n      \"index\": %d,\n", shard->files[i]);
+            print_area_json(out, &parsers[i], "    ");
+            sb_printf(out, "    }%s\n", i + 1 < nareas ? "," : "");
         }
-        // Stop at newline, carriage return, or space
-        if (c == '\n' || c == '\r' || c == ' ') {
-            ungetc(c, fp);
-            return number;
+        sb_puts(out, "  ],\n");
+    } else if (nareas == 1) {
+        sb_puts(out, "  \"area\": {\n");
+        print_area_json(out, &parsers[0], "  ");
+        sb_puts(out, "  },\n");
+    } else {
+        sb_puts(out, "  \"areas\": [\n");
+        for (int i = 0; i < nareas; ++i) {
+            sb_puts(out, "    {\n");
+            print_area_json(out, &parsers[i], "    ");
+            sb_printf(out, "    }%s\n", i + 1 < nareas ? "," : "");
         }
-        // If we hit any other character, put it back and return
-        if (c != EOF) {
-            ungetc(c, fp);
+        sb_puts(out, "  ],\n");
+    }
+
+    if (opts->details_name) {
+        char *escaped = escape_json_string(opts->details_name);
+        sb_printf(out, "  \"details\": \"%s\",\n", escaped);
+        mem_free(escaped);
+    }
+
+    // The dictionary is built up front; workers only look strings up
+    if (dict) {
+        for (size_t i = 0; i < nrefs; ++i)
+            collect_object_strings(dict, refs[i].obj, opts->fields);
+        opts->dict = dict;
+
+        sb_puts(out, "  \"strings\": [\n");
+        for (int i = 0; i < dict->count; ++i) {
+            char *escaped = escape_json_string(dict->strings[i]);
+            sb_printf(out, "    \"%s\"%s\n", escaped, i + 1 < dict->count ? "," : "");
+            mem_free(escaped);
         }
-        return number;
+        sb_puts(out, "  ],\n");
     }
 
-    while (isdigit(c)) {
-        number = number * 10 + c - '0';
-        c = getc(fp);
+    // Style 0 is the default, unstyled text
+    if (styles) {
+        string_intern(styles, "");
+        for (size_t i = 0; i < nrefs; ++i) {
+            if (opts->fields & FIELD_SHORT_DESCR) collect_styles(styles, &refs[i].obj->short_colors);
+            if (opts->fields & FIELD_DESCRIPTION) collect_styles(styles, &refs[i].obj->description_colors);
+        }
+        opts->styles = styles;
+
+        sb_puts(out, "  \"styles\": [\n");
+        for (int i = 0; i < styles->count; ++i)
+            sb_printf(out, "    \"%s\"%s\n", styles->strings[i], i + 1 < styles->count ? "," : "");
+        sb_puts(out, "  ],\n");
     }
 
-    if (c == '|')
-        number += fread_flag(fp);
-    else if (c != ' ')
-        ungetc(c, fp);
+    sb_puts(out, "  \"objects\": [\n");
 
-    if (negative)
-        return -1 * number;
+    SERIALIZE_JOB job = { doc, refs, nrefs, nareas, opts, nchunks, 0, trace };
+    serialize_objects(&job, threads);
 
-    return number;
+    out = &doc->parts[doc->nparts - 1];
+    sb_puts(out, "\n  ]\n");
+    sb_puts(out, "}\n");
+    return 0;
 }
 
-char *fread_string(FILE *fp) {
-    static char buffer[MAX_STRING_LENGTH];
-    char *p = buffer;
-    char c;
-    
-    do {
-        c = getc(fp);
-        if (c == EOF) return strdup("");
-    } while (isspace(c));
-    
-    if (c == '~') return strdup("");
-    
-    do {
-        *p++ = c;
-        c = getc(fp);
-    } while (c != '~' && c != EOF && p < buffer + MAX_STRING_LENGTH - 1);
-    
-    *p = '\0';
-    return strdup(buffer);
+// What --summary records about a file: its bytes checked as JSON and
+// hashed in the same pass that writes them
+typedef struct output_digest {
+    JSON_CHECK check;
+    SHA256 sha;
+    long bytes;
+} OUTPUT_DIGEST;
+
+static void digest_init(OUTPUT_DIGEST *d) {
+    json_check_init(&d->check);
+    sha256_init(&d->sha);
+    d->bytes = 0;
 }
 
-char *fread_word(FILE *fp) {
-    static char buffer[MAX_STRING_LENGTH];
-    char *p = buffer;
-    char c;
-    
-    do {
-        c = getc(fp);
-        if (c == EOF) return NULL;
-    } while (isspace(c));
-    
-    do {
-        *p++ = c;
-        c = getc(fp);
-    } while (!isspace(c) && c != EOF && p < buffer + MAX_STRING_LENGTH - 1);
-    
-    *p = '\0';
-    return strdup(buffer);
+static void digest_update(OUTPUT_DIGEST *d, const char *data, size_t len) {
+    json_check_feed(&d->check, data, len);
+    sha256_update(&d->sha, data, len);
+    d->bytes += (long)len;
 }
 
-void fread_to_eol(FILE *fp) {
-    char c;
-    do {
-        c = getc(fp);
-    } while (c != '\n' && c != EOF);
+// Write every part of doc to fd, as few writev calls as the iovec limit
+// allows, picking up after short writes. Each part goes through digest,
+// when there is one, once it is out. Returns the bytes written, or -1.
+static long write_document(const JSON_DOC *doc, int fd, OUTPUT_DIGEST *digest) {
+    struct iovec iov[WRITE_IOV_MAX];
+    long total = 0;
+    int part = 0;
+    size_t offset = 0; // Already written from doc->parts[part]
+
+    while (part < doc->nparts) {
+        int n = 0;
+        for (int p = part; p < doc->nparts && n < WRITE_IOV_MAX; ++p) {
+            size_t skip = p == part ? offset : 0;
+            if (doc->parts[p].len == skip) continue;
+            iov[n].iov_base = doc->parts[p].data + skip;
+            iov[n].iov_len = doc->parts[p].len - skip;
+            n++;
+        }
+        if (!n) break;
+
+        ssize_t written = writev(fd, iov, n);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += written;
+
+        size_t left = (size_t)written;
+        while (part < doc->nparts && left >= doc->parts[part].len - offset) {
+            left -= doc->parts[part].len - offset;
+            if (digest) digest_update(digest, doc->parts[part].data, doc->parts[part].len);
+            part++;
+            offset = 0;
+        }
+        offset += left;
+    }
+    return total;
 }
 
-// Item type lookup
-int item_lookup(const char *name) {
-    if (!strcmp(name, "light")) return 1;
-    if (!strcmp(name, "scroll")) return 2;
-    if (!strcmp(name, "wand")) return 3;
-    if (!strcmp(name, "staff")) return 4;
-    if (!strcmp(name, "weapon")) return 5;
-    if (!strcmp(name, "shard")) return 6;
-    if (!strcmp(name, "ticket")) return 7;
-    if (!strcmp(name, "treasure")) return 8;
-    if (!strcmp(name, "armor")) return 9;
-    if (!strcmp(name, "potion")) return 10;
-    if (!strcmp(name, "clothing")) return 11;
-    if (!strcmp(name, "furniture")) return 12;
-    if (!strcmp(name, "trash")) return 13;
-    if (!strcmp(name, "container")) return 15;
-    if (!strcmp(name, "drink_con")) return 17;
-    if (!strcmp(name, "key")) return 18;
-    if (!strcmp(name, "food")) return 19;
-    if (!strcmp(name, "money")) return 20;
-    if (!strcmp(name, "boat")) return 22;
-    if (!strcmp(name, "corpse_npc")) return 23;
-    if (!strcmp(name, "corpse_pc")) return 24;
-    if (!strcmp(name, "fountain")) return 25;
-    if (!strcmp(name, "pill")) return 26;
-    if (!strcmp(name, "protect")) return 27;
-    if (!strcmp(name, "map")) return 28;
-    if (!strcmp(name, "portal")) return 29;
-    if (!strcmp(name, "warp_stone")) return 30;
-    if (!strcmp(name, "room_key")) return 31;
-    if (!strcmp(name, "gem")) return 32;
-    if (!strcmp(name, "jewelry")) return 33;
-    if (!strcmp(name, "jukebox")) return 34;
-    if (!strcmp(name, "quiver")) return 35;
-    if (!strcmp(name, "arrow")) return 36;
-    if (!strcmp(name, "poison")) return 37;
-    if (!strcmp(name, "disjunction")) return 38;
-    if (!strcmp(name, "safe_haven")) return 39;
-    if (!strcmp(name, "materia")) return 40;
-    if (!strcmp(name, "remote")) return 41;
-    if (!strcmp(name, "scryer")) return 46;
-    if (!strcmp(name, "exit")) return 47;
-    if (!strcmp(name, "minigame")) return 48;
-    return 0;
+// Collect every kept object in output order: by default each area's list
+// as built (newest first), areas in command-line order; optionally radix
+// sorted by vnum or by area and vnum
+static OBJ_REF *order_objects(AREA_PARSER *parsers, int nareas, int sort, size_t *count) {
+    size_t n = 0;
+    for (int i = 0; i < nareas; ++i)
+        for (OBJ_INDEX_DATA *o = parsers[i].object_list; o; o = o->next)
+            n++;
+
+    OBJ_REF *refs = mem_alloc(MEM_OTHER, (n ? n : 1) * sizeof(*refs));
+    if (!refs) return NULL;
+
+    size_t k = 0;
+    for (int i = 0; i < nareas; ++i) {
+        for (OBJ_INDEX_DATA *o = parsers[i].object_list; o; o = o->next) {
+            refs[k].obj = o;
+            refs[k].area = i;
+            refs[k].key = sort == SORT_AREA ? area_sort_key(i, o->vnum) : vnum_sort_key(o->vnum, i);
+            k++;
+        }
+    }
+    if (sort != SORT_NONE && obj_refs_sort(refs, n) != 0) {
+        mem_free(refs);
+        return NULL;
+    }
+    *count = n;
+    return refs;
 }
 
-// Weapon type lookup function
-int weapon_type_lookup(const char *name) {
-    if (!name) return 0;
-    
-    if (!strcmp(name, "exotic")) return 0;
-    if (!strcmp(name, "sword")) return 1;
-    if (!strcmp(name, "dagger")) return 2;
-    if (!strcmp(name, "spear")) return 3;
-    if (!strcmp(name, "staff")) return 3; // Staff maps to spear in the MUD
-    if (!strcmp(name, "mace")) return 4;
-    if (!strcmp(name, "axe")) return 5;
-    if (!strcmp(name, "flail")) return 6;
-    if (!strcmp(name, "whip")) return 7;
-    if (!strcmp(name, "polearm")) return 8;
-    if (!strcmp(name, "bow")) return 9;
-    
-    return 0; // Default to exotic
+static void write_metrics(const RUN_METRICS *m, const char *prom_path, const char *json_path) {
+    if (prom_path && metrics_write_prom(m, prom_path) != 0)
+        fprintf(stderr, "Error: Cannot write metrics to %s\n", prom_path);
+    if (json_path && metrics_write_json(m, json_path) != 0)
+        fprintf(stderr, "Error: Cannot write metrics to %s\n", json_path);
 }
 
-// Spell name lookup function - using actual MUD spell list
-int spell_lookup(const char *name) {
-    if (!name) return 0;
-    
-    // Spell mappings based on actual MUD spell list
-    if (!strcmp(name, "reserved")) return 0;
-    if (!strcmp(name, "hallucination")) return 1;
-    if (!strcmp(name, "acid blast")) return 2;
-    if (!strcmp(name, "armor")) return 3;
-    if (!strcmp(name, "bless")) return 4;
-    if (!strcmp(name, "blindness")) return 5;
-    if (!strcmp(name, "burning hands")) return 6;
-    if (!strcmp(name, "call lightning")) return 7;
-    if (!strcmp(name, "calm")) return 8;
-    if (!strcmp(name, "cancellation")) return 9;
-    if (!strcmp(name, "cause critical")) return 10;
-    if (!strcmp(name, "cause discord")) return 11;
-    if (!strcmp(name, "cause light")) return 12;
-    if (!strcmp(name, "cause serious")) return 13;
-    if (!strcmp(name, "chain lightning")) return 14;
-    if (!strcmp(name, "change sex")) return 15;
-    if (!strcmp(name, "charm person")) return 16;
-    if (!strcmp(name, "chill touch")) return 17;
-    if (!strcmp(name, "colour spray")) return 18;
-    if (!strcmp(name, "continual light")) return 19;
-    if (!strcmp(name, "control weather")) return 20;
-    if (!strcmp(name, "call demon")) return 21;
-    if (!strcmp(name, "create golem")) return 22;
-    if (!strcmp(name, "guardian spirit")) return 23;
-    if (!strcmp(name, "call servant")) return 24;
-    if (!strcmp(name, "create food")) return 25;
-    if (!strcmp(name, "create rose")) return 26;
-    if (!strcmp(name, "create spring")) return 27;
-    if (!strcmp(name, "create water")) return 28;
-    if (!strcmp(name, "cure blindness")) return 29;
-    if (!strcmp(name, "cure critical")) return 30;
-    if (!strcmp(name, "cure disease")) return 31;
-    if (!strcmp(name, "psychic healing")) return 32;
-    if (!strcmp(name, "poke")) return 33;
-    if (!strcmp(name, "crush")) return 34;
-    if (!strcmp(name, "tickle")) return 35;
-    if (!strcmp(name, "essence")) return 36;
-    if (!strcmp(name, "prayer")) return 37;
-    if (!strcmp(name, "cure light")) return 38;
-    if (!strcmp(name, "cure poison")) return 39;
-    if (!strcmp(name, "cure serious")) return 40;
-    if (!strcmp(name, "curse")) return 41;
-    if (!strcmp(name, "demonfire")) return 42;
-    if (!strcmp(name, "hellfire")) return 43;
-    if (!strcmp(name, "permanency")) return 44;
-    if (!strcmp(name, "fireshield")) return 45;
-    if (!strcmp(name, "detect weakness")) return 46;
-    if (!strcmp(name, "detect evil")) return 47;
-    if (!strcmp(name, "detect good")) return 48;
-    if (!strcmp(name, "detect hidden")) return 49;
-    if (!strcmp(name, "detect invis")) return 50;
-    if (!strcmp(name, "detect magic")) return 51;
-    if (!strcmp(name, "detect poison")) return 52;
-    if (!strcmp(name, "dispel evil")) return 53;
-    if (!strcmp(name, "dispel good")) return 54;
-    if (!strcmp(name, "dispel magic")) return 55;
-    if (!strcmp(name, "fissure")) return 56;
-    if (!strcmp(name, "earthquake")) return 57;
-    if (!strcmp(name, "animate dead")) return 58;
-    if (!strcmp(name, "enchant armor")) return 59;
-    if (!strcmp(name, "empower armor")) return 60;
-    if (!strcmp(name, "dark ritual")) return 61;
-    if (!strcmp(name, "brand")) return 62;
-    if (!strcmp(name, "empower weapon")) return 63;
-    if (!strcmp(name, "enchant weapon")) return 64;
-    if (!strcmp(name, "disjunction")) return 65;
-    if (!strcmp(name, "safe haven")) return 66;
-    if (!strcmp(name, "alternate dimension")) return 67;
-    if (!strcmp(name, "hold person")) return 68;
-    if (!strcmp(name, "entangle")) return 69;
-    if (!strcmp(name, "splinter storm")) return 70;
-    if (!strcmp(name, "energy drain")) return 71;
-    if (!strcmp(name, "magic drain")) return 72;
-    if (!strcmp(name, "faerie fire")) return 73;
-    if (!strcmp(name, "faerie fog")) return 74;
-    if (!strcmp(name, "farsight")) return 75;
-    if (!strcmp(name, "fireball")) return 76;
-    if (!strcmp(name, "mental blast")) return 77;
-    if (!strcmp(name, "mental disruption")) return 78;
-    if (!strcmp(name, "life drain")) return 79;
-    if (!strcmp(name, "energy syphon")) return 80;
-    if (!strcmp(name, "meteor")) return 81;
-    if (!strcmp(name, "fireproof")) return 82;
-    if (!strcmp(name, "flamestrike")) return 83;
-    if (!strcmp(name, "fly")) return 84;
-    if (!strcmp(name, "floating disc")) return 85;
-    if (!strcmp(name, "frenzy")) return 86;
-    if (!strcmp(name, "divine favor")) return 87;
-    if (!strcmp(name, "divine intervention")) return 88;
-    if (!strcmp(name, "gate")) return 89;
-    if (!strcmp(name, "giant strength")) return 90;
-    if (!strcmp(name, "harm")) return 91;
-    if (!strcmp(name, "haste")) return 92;
-    if (!strcmp(name, "heal")) return 93;
-    if (!strcmp(name, "heat metal")) return 94;
-    if (!strcmp(name, "holy word")) return 95;
-    if (!strcmp(name, "divine power")) return 96;
-    if (!strcmp(name, "wrath")) return 97;
-    if (!strcmp(name, "identify")) return 98;
-    if (!strcmp(name, "infravision")) return 99;
-    if (!strcmp(name, "invisibility")) return 100;
-    if (!strcmp(name, "know alignment")) return 101;
-    if (!strcmp(name, "lightning bolt")) return 102;
-    if (!strcmp(name, "remote view")) return 103;
-    if (!strcmp(name, "raven spy")) return 104;
-    if (!strcmp(name, "locate object")) return 105;
-    if (!strcmp(name, "magic missile")) return 106;
-    if (!strcmp(name, "mass healing")) return 107;
-    if (!strcmp(name, "ice storm")) return 108;
-    if (!strcmp(name, "mass invis")) return 109;
-    if (!strcmp(name, "nexus")) return 110;
-    if (!strcmp(name, "pass door")) return 111;
-    if (!strcmp(name, "plague")) return 112;
-    if (!strcmp(name, "poison")) return 113;
-    if (!strcmp(name, "portal")) return 114;
-    if (!strcmp(name, "protection evil")) return 115;
-    if (!strcmp(name, "protection good")) return 116;
-    if (!strcmp(name, "ray of truth")) return 117;
-    if (!strcmp(name, "recharge")) return 118;
-    if (!strcmp(name, "refresh")) return 119;
-    if (!strcmp(name, "remove curse")) return 120;
-    if (!strcmp(name, "telepathy")) return 121;
-    if (!strcmp(name, "life stealer")) return 122;
-    if (!strcmp(name, "sanctuary")) return 123;
-    if (!strcmp(name, "shapeshift")) return 124;
-    if (!strcmp(name, "living armor")) return 125;
-    if (!strcmp(name, "trembling earth")) return 126;
-    if (!strcmp(name, "planeshift")) return 127;
-    if (!strcmp(name, "protective sphere")) return 128;
-    if (!strcmp(name, "bark skin")) return 129;
-    if (!strcmp(name, "talon")) return 130;
-    if (!strcmp(name, "shield")) return 131;
-    if (!strcmp(name, "shocking grasp")) return 132;
-    if (!strcmp(name, "sleep")) return 133;
-    if (!strcmp(name, "slow")) return 134;
-    if (!strcmp(name, "stone skin")) return 135;
-    if (!strcmp(name, "summon")) return 136;
-    if (!strcmp(name, "teleport")) return 137;
-    if (!strcmp(name, "ventriloquate")) return 138;
-    if (!strcmp(name, "weaken")) return 139;
-    if (!strcmp(name, "word of recall")) return 140;
-    if (!strcmp(name, "mallocs empower")) return 141;
-    if (!strcmp(name, "caines maddness")) return 142;
-    if (!strcmp(name, "dinchaks power")) return 143;
-    if (!strcmp(name, "acid breath")) return 144;
-    if (!strcmp(name, "fire breath")) return 145;
-    if (!strcmp(name, "frost breath")) return 146;
-    if (!strcmp(name, "gas breath")) return 147;
-    if (!strcmp(name, "lightning breath")) return 148;
-    if (!strcmp(name, "general purpose")) return 149;
-    if (!strcmp(name, "high explosive")) return 150;
-    if (!strcmp(name, "imprint")) return 151;
-    if (!strcmp(name, "avalons protection")) return 152;
-    if (!strcmp(name, "psychic influence")) return 153;
-    if (!strcmp(name, "spectral blade")) return 154;
-    
-    return 0; // Unknown spell
+static void print_mem_report(FILE *fp) {
+    MEM_USAGE usage[MEM_CATEGORIES], total;
+    mem_usage(usage, &total);
+
+    fprintf(fp, "%-14s %10s %10s %14s %14s %14s\n",
+            "category", "allocs", "frees", "total bytes", "peak bytes", "leaked bytes");
+    for (int i = 0; i < MEM_CATEGORIES; ++i) {
+        fprintf(fp, "%-14s %10ld %10ld %14ld %14ld %14ld\n", mem_category_name(i),
+                usage[i].allocs, usage[i].frees, usage[i].total_bytes,
+                usage[i].peak_bytes, usage[i].live_bytes);
+    }
+    fprintf(fp, "%-14s %10ld %10ld %14ld %14ld %14ld\n", "total",
+            total.allocs, total.frees, total.total_bytes, total.peak_bytes, total.live_bytes);
+    fprintf(fp, "peak RSS: %ld KB\n", mem_peak_rss_kb());
 }
 
-// Load objects - EXACT MUD LOGIC
-void load_objects(FILE *fp) {
-    for (;;) {
-        long vnum;
-        char letter;
-        OBJ_INDEX_DATA *pObjIndex;
-
-        letter = fread_letter(fp);
-        if (letter == EOF) break;
-        if (letter != '#') {
-            fprintf(stderr, "Load_objects: # not found, got '%c'\n", letter);
-            break;
-        }
+static void write_trace(TRACE *trace, const char *path) {
+    if (trace_write(trace, path) != 0)
+        fprintf(stderr, "Error: Cannot write trace to %s\n", path);
+}
 
-        vnum = fread_number(fp);
-        fprintf(stderr, "Loading object vnum: %ld\n", vnum);
-        if (vnum == 0) {
-            // End of objects section - read until next #0 or section
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    char *next_word = fread_word(fp);
-                    if (next_word && !strcmp(next_word, "0")) {
-                        free(next_word);
-                        break;
-                    }
-                    if (next_word) free(next_word);
-                }
-            }
-            break;
-        }
+// Format the --details file: a JSON array holding, in output order, one
+// record per object with extra descriptions (or a description, when those
+// move out too). spans[i] gets the byte range of refs[i]'s record, so the
+// viewer can fetch a single record with a Range request and parse it alone.
+static void build_details(STRBUF *out, DETAIL_SPAN *spans, const OBJ_REF *refs, size_t nrefs,
+                          bool with_description) {
+    bool first = true;
 
-        pObjIndex = malloc(sizeof(OBJ_INDEX_DATA));
-        pObjIndex->vnum = vnum;
-        pObjIndex->area = current_area;
-        pObjIndex->name = fread_string(fp);
-        fprintf(stderr, "Read name: %s\n", pObjIndex->name);
-        pObjIndex->short_descr = fread_string(fp);
-        fprintf(stderr, "Read short_descr: %s\n", pObjIndex->short_descr);
-        pObjIndex->description = fread_string(fp);
-        fprintf(stderr, "Read description: %s\n", pObjIndex->description);
-        pObjIndex->material = fread_string(fp);
-        fprintf(stderr, "Read material: %s\n", pObjIndex->material);
-
-        // Read item type as string and convert
-        char *item_type_str = fread_word(fp);
-        pObjIndex->item_type = item_lookup(item_type_str);
-        fprintf(stderr, "Read item_type_str: '%s', converted to: %d\n", item_type_str, pObjIndex->item_type);
-        free(item_type_str);
-        pObjIndex->extra_flags = fread_flag(fp);
-        fprintf(stderr, "Read extra_flags: %d\n", pObjIndex->extra_flags);
-        pObjIndex->wear_flags = fread_flag(fp);
-        fprintf(stderr, "Read wear_flags: %d\n", pObjIndex->wear_flags);
-
-        // Read values based on item type
-        if (pObjIndex->item_type == 40) { // ITEM_MATERIA
-            pObjIndex->value[0] = fread_number(fp);
-            // Read spell name delimited by single quotes
-            char c = fread_letter(fp);
-            if (c == '\'') {
-                static char spell_buffer[256];
-                char *p = spell_buffer;
-                while ((c = getc(fp)) != '\'' && c != EOF && p < spell_buffer + 255) {
-                    *p++ = c;
-                }
-                *p = '\0';
-                pObjIndex->materia_spell = strdup(spell_buffer);
-            } else {
-                pObjIndex->materia_spell = strdup("");
-            }
-            fprintf(stderr, "Read materia spell: '%s'\n", pObjIndex->materia_spell);
-            pObjIndex->value[1] = 0; // Not used for materia
-            pObjIndex->value[2] = fread_number(fp);
-            pObjIndex->value[3] = fread_number(fp);
-            pObjIndex->value[4] = fread_number(fp);
-        } else if (pObjIndex->item_type == 5) { // ITEM_WEAPON
-            // Read weapon type as string and convert to number
-            char *weapon_type_str = fread_word(fp);
-            int weapon_type_num = weapon_type_lookup(weapon_type_str);
-            pObjIndex->value[0] = weapon_type_num; // Store weapon type as number
-            free(weapon_type_str);
-            // Read dice values as numbers
-            pObjIndex->value[1] = fread_number(fp); // number_of_dice
-            pObjIndex->value[2] = fread_number(fp); // type_of_dice
-            // Read damage type as string
-            char *damage_type_str = fread_word(fp);
-            pObjIndex->damage_type = strdup(damage_type_str);
-            free(damage_type_str);
-            // Read weapon flags as string
-            char *weapon_flags_str = fread_word(fp);
-            pObjIndex->weapon_flags = strdup(weapon_flags_str);
-            free(weapon_flags_str);
-            // Set unused values
-            pObjIndex->value[3] = 0; // Not used for weapon
-            pObjIndex->value[4] = 0; // Not used for weapon
-        } else if (pObjIndex->item_type == 9) { // ITEM_ARMOR
-            // Read armor values as flags (they are stored as flag strings like "CDE")
-            pObjIndex->value[0] = fread_flag(fp); // ac_pierce
-            pObjIndex->value[1] = fread_flag(fp); // ac_bash
-            pObjIndex->value[2] = fread_flag(fp); // ac_slash
-            pObjIndex->value[3] = fread_flag(fp); // ac_exotic
-            pObjIndex->value[4] = fread_flag(fp); // unused
-        } else {
-            pObjIndex->value[0] = fread_flag(fp);
-            pObjIndex->value[1] = fread_flag(fp);
-            pObjIndex->value[2] = fread_flag(fp);
-            pObjIndex->value[3] = fread_flag(fp);
-            pObjIndex->value[4] = fread_flag(fp);
+    sb_puts(out, "[\n");
+    for (size_t i = 0; i < nrefs; ++i) {
+        const OBJ_INDEX_DATA *obj = refs[i].obj;
+        bool has_description = with_description && obj->description && obj->description[0];
+        if (!obj->extra_descr && !has_description) continue;
+
+        if (!first) sb_puts(out, ",\n");
+        first = false;
+        spans[i].offset = out->len;
+        sb_printf(out, "{\"vnum\": %ld", obj->vnum);
+        if (has_description) {
+            char *escaped = escape_json_string(obj->description);
+            sb_printf(out, ", \"description\": \"%s\"", escaped);
+            mem_free(escaped);
         }
-        fprintf(stderr, "Read values: [%d, %d, %d, %d, %d]\n", 
-               pObjIndex->value[0], pObjIndex->value[1], pObjIndex->value[2], 
-               pObjIndex->value[3], pObjIndex->value[4]);
-
-        pObjIndex->level = fread_number(fp);
-        fprintf(stderr, "Read level: %d\n", pObjIndex->level);
-        pObjIndex->weight = fread_number(fp);
-        fprintf(stderr, "Read weight: %d\n", pObjIndex->weight);
-        pObjIndex->cost = fread_number(fp);
-        fprintf(stderr, "Read cost: %d\n", pObjIndex->cost);
-
-        // Read condition
-        letter = fread_letter(fp);
-        fprintf(stderr, "Read condition letter: '%c'\n", letter);
-        switch (letter) {
-        case 'P': pObjIndex->condition = 100; break;
-        case 'G': pObjIndex->condition = 90; break;
-        case 'A': pObjIndex->condition = 75; break;
-        case 'W': pObjIndex->condition = 50; break;
-        case 'D': pObjIndex->condition = 25; break;
-        case 'B': pObjIndex->condition = 10; break;
-        case 'R': pObjIndex->condition = 0; break;
-        default: pObjIndex->condition = 100; break;
+        sb_puts(out, ", \"extra_descriptions\": [");
+        for (const EXTRA_DESCR_DATA *ed = obj->extra_descr; ed; ed = ed->next) {
+            char *keyword = escape_json_string(ed->keyword);
+            char *description = escape_json_string(ed->description);
+            sb_printf(out, "%s{\"keyword\": \"%s\", \"description\": \"%s\"}",
+                      ed == obj->extra_descr ? "" : ", ", keyword, description);
+            mem_free(keyword);
+            mem_free(description);
         }
+        sb_puts(out, "]}");
+        spans[i].length = out->len - spans[i].offset;
+    }
+    sb_puts(out, first ? "]\n" : "\n]\n");
+}
 
-        // Initialize pointers
-        pObjIndex->affected = NULL;
-        pObjIndex->affected2 = NULL;
-        pObjIndex->extra_descr = NULL;
-        pObjIndex->affects_out = NULL; // Initialize the new field
-
-        // Read affects and extra descriptions (EXACT MUD LOGIC)
-        AFFECT_OUT *affects_head = NULL, *affects_tail = NULL;
-        for (;;) {
-            letter = fread_letter(fp);
-            fprintf(stderr, "Affect loop: got letter '%c'\n", letter);
-            
-            if (letter == 'A') {
-                int loc = fread_number(fp);
-                int mod = fread_number(fp);
-                fprintf(stderr, "  Reading affect: location=%d, modifier=%d\n", loc, mod);
-                AFFECT_OUT *ao = malloc(sizeof(AFFECT_OUT));
-                strcpy(ao->type, "normal");
-                strncpy(ao->location, affect_location_name(loc), sizeof(ao->location)-1);
-                ao->modifier = mod;
-                ao->extra[0] = '\0';
-                ao->next = NULL;
-                if (!affects_head) affects_head = affects_tail = ao;
-                else { affects_tail->next = ao; affects_tail = ao; }
-                // Handle spell affects
-                if (loc == 26 || loc == 27) {
-                    char nletter = fread_letter(fp);
-                    if (nletter == 'N') {
-                        char *spell_name = fread_string(fp);
-                        strncpy(ao->extra, spell_name, sizeof(ao->extra)-1);
-                        free(spell_name);
-                    } else {
-                        ungetc(nletter, fp);
-                    }
-                }
-            } else if (letter == 'F') {
-                char fwhere = fread_letter(fp);
-                int loc = fread_number(fp);
-                int mod = fread_number(fp);
-                int bitv = fread_flag(fp);
-                fprintf(stderr, "  Reading flag affect: where=%c, location=%d, modifier=%d, bitvector=%d\n", fwhere, loc, mod, bitv);
-                
-                AFFECT_OUT *ao = malloc(sizeof(AFFECT_OUT));
-                strcpy(ao->type, "flag");
-                snprintf(ao->location, sizeof(ao->location), "F%c:%s", fwhere, affect_location_name(loc));
-                ao->modifier = mod;
-                if (fwhere == 'A') {
-                    // Affect flag
-                    snprintf(ao->extra, sizeof(ao->extra), "affect:%s", affect_bit_name(bitv));
-                } else if (fwhere == 'B') {
-                    // Affect2 flag
-                    snprintf(ao->extra, sizeof(ao->extra), "affect2:%s", affect2_bit_name(bitv));
-                } else if (fwhere == 'I') {
-                    // Immune flag
-                    snprintf(ao->extra, sizeof(ao->extra), "immune:%s", immune_bit_name(bitv));
-                } else if (fwhere == 'R') {
-                    // Resist flag
-                    snprintf(ao->extra, sizeof(ao->extra), "resist:%s", resist_bit_name(bitv));
-                } else if (fwhere == 'S') {
-                    // Shield flag
-                    snprintf(ao->extra, sizeof(ao->extra), "shield:%s", shield_bit_name(bitv));
-                } else if (fwhere == 'V') {
-                    // Vulnerable flag
-                    snprintf(ao->extra, sizeof(ao->extra), "vuln:%s", vuln_bit_name(bitv));
-                } else if (fwhere == 'W') {
-                    // Weapon flag
-                    snprintf(ao->extra, sizeof(ao->extra), "weapon:%s", weapon_bit_name(bitv));
-                } else {
-                    snprintf(ao->extra, sizeof(ao->extra), "bitvector:%d", bitv);
-                }
-                ao->next = NULL;
-                if (!affects_head) affects_head = affects_tail = ao;
-                else { affects_tail->next = ao; affects_tail = ao; }
-            } else if (letter == 'E') {
-                fprintf(stderr, "  Reading extra description\n");
-                EXTRA_DESCR_DATA *ed = malloc(sizeof(EXTRA_DESCR_DATA));
-                ed->keyword = fread_string(fp);
-                ed->description = fread_string(fp);
-                ed->next = pObjIndex->extra_descr;
-                pObjIndex->extra_descr = ed;
-            } else if (letter == 'N') {
-                fprintf(stderr, "  Reading spell name\n");
-                char *spell_name = fread_string(fp);
-                // Could add as a spell affect if needed
-                free(spell_name);
-            } else if (letter == 'R') {
-                fprintf(stderr, "  Reading room affect\n");
-                int dummy1 = fread_number(fp);
-                int dummy2 = fread_number(fp);
-                (void)dummy1; (void)dummy2;
-            } else if (letter == 'S') {
-                fprintf(stderr, "  Reading shield affect\n");
-                int dummy1 = fread_number(fp);
-                int dummy2 = fread_number(fp);
-                char *dummy3 = fread_word(fp);
-                free(dummy3);
-                (void)dummy1; (void)dummy2;
-            } else if (letter == '#') {
-                fprintf(stderr, "  Found next object, breaking\n");
-                ungetc(letter, fp);
-                break;
-            } else if (letter == '0') {
-                fprintf(stderr, "  Found end of objects section\n");
-                ungetc(letter, fp);
-                break;
-            } else {
-                fprintf(stderr, "  Unknown letter '%c', skipping\n", letter);
-                // Skip this line and continue
-                fread_to_eol(fp);
-            }
+// Build the --details file and point opts at its spans, which the caller
+// frees. digest, if not NULL, takes the file's bytes. Returns the bytes
+// written, or -1 after reporting the problem.
+static long output_details(JSON_OPTS *opts, DETAIL_SPAN **spans, const char *path,
+                           bool with_description, const OBJ_REF *refs, size_t nrefs,
+                           OUTPUT_DIGEST *digest) {
+    *spans = mem_calloc(MEM_OUTPUT, nrefs ? nrefs : 1, sizeof(**spans));
+    if (!*spans) {
+        fprintf(stderr, "Error: Out of memory formatting details\n");
+        return -1;
+    }
+    STRBUF blob;
+    sb_init(&blob);
+    build_details(&blob, *spans, refs, nrefs, with_description);
+    if (digest) digest_update(digest, blob.data, blob.len);
+    long written = (long)blob.len;
+    if (sb_write_file(&blob, path) != 0) {
+        fprintf(stderr, "Error: Cannot write details to %s\n", path);
+        written = -1;
+    }
+    sb_free(&blob);
+
+    // The viewer fetches the file from next to the main document
+    const char *slash = strrchr(path, '/');
+    opts->details = *spans;
+    opts->details_name = slash ? slash + 1 : path;
+    if (with_description) opts->fields &= ~FIELD_DESCRIPTION;
+    return written;
+}
+
+// The --summary sidecar: one key per line, so a publish script can check
+// it with grep and compare "bytes" with the file size instead of parsing
+// the output again. details is NULL without --details.
+static bool write_summary(const char *path, OUTPUT_DIGEST *doc, OUTPUT_DIGEST *details, size_t objects) {
+    char hex[2 * SHA256_DIGEST_LENGTH + 1];
+    bool doc_valid = json_check_finish(&doc->check);
+    bool details_valid = !details || json_check_finish(&details->check);
+    STRBUF sb;
+    sb_init(&sb);
+    sb_printf(&sb, "{\n  \"valid\": %s,\n", doc_valid && details_valid ? "true" : "false");
+    sb_printf(&sb, "  \"objects\": %zu,\n", objects);
+    sb_printf(&sb, "  \"bytes\": %ld,\n", doc->bytes);
+    sha256_hex(&doc->sha, hex);
+    sb_printf(&sb, "  \"sha256\": \"%s\"", hex);
+    if (details) {
+        sha256_hex(&details->sha, hex);
+        sb_printf(&sb, ",\n  \"details_valid\": %s,\n", details_valid ? "true" : "false");
+        sb_printf(&sb, "  \"details_bytes\": %ld,\n", details->bytes);
+        sb_printf(&sb, "  \"details_sha256\": \"%s\"", hex);
+    }
+    if (!doc_valid || !details_valid) {
+        char *escaped = escape_json_string(!doc_valid ? doc->check.error : details->check.error);
+        sb_printf(&sb, ",\n  \"error\": \"%s%s\"", !doc_valid ? "" : "details ", escaped);
+        mem_free(escaped);
+        fprintf(stderr, "Error: %soutput is not valid JSON %s\n", !doc_valid ? "" : "details ",
+                !doc_valid ? doc->check.error : details->check.error);
+    }
+    sb_puts(&sb, "\n}\n");
+    bool ok = sb_write_file(&sb, path) == 0;
+    if (!ok) fprintf(stderr, "Error: Cannot write summary to %s\n", path);
+    sb_free(&sb);
+    return ok && doc_valid && details_valid;
+}
+
+// Serialize to JSON and write it to stdout. start is when the serialize
+// phase began (ordering the objects counts towards it). With details_path,
+// extra descriptions (and, with details_description, descriptions) go to
+// that file instead and objects carry their record's byte range. shard
+// makes the output a partial one for --merge. With summary_path, both
+// files are validated as they are written and described in that sidecar.
+static void output_json(RUN_METRICS *metrics, double start, AREA_PARSER *parsers, int nareas,
+                        const OBJ_REF *refs, size_t nrefs, unsigned fields, bool use_dict,
+                        bool use_colors, const char *details_path, bool details_description,
+                        const SHARD_PLAN *shard, const char *summary_path, int threads, TRACE *trace) {
+    JSON_OPTS opts = { fields, NULL, NULL, NULL, NULL, shard };
+    STRING_POOL dict, styles;
+    string_pool_init(&dict);
+    string_pool_init(&styles);
+    JSON_DOC doc = {0};
+    DETAIL_SPAN *spans = NULL;
+    long details_bytes = 0;
+    OUTPUT_DIGEST doc_digest, details_digest;
+    digest_init(&doc_digest);
+    digest_init(&details_digest);
+
+    if (details_path) {
+        double t = monotonic_seconds();
+        details_bytes = output_details(&opts, &spans, details_path,
+                                       details_description && (fields & FIELD_DESCRIPTION), refs, nrefs,
+                                       summary_path ? &details_digest : NULL);
+        if (trace)
+            trace_span(trace, 0, "phase", "details", t, monotonic_seconds(), "\"bytes\":%ld", details_bytes);
+        if (details_bytes < 0) {
+            mem_free(spans);
+            string_pool_free(&dict);
+            string_pool_free(&styles);
+            json_check_free(&doc_digest.check);
+            json_check_free(&details_digest.check);
+            return;
         }
-        pObjIndex->affects_out = affects_head;
+    }
 
-        // Add to list
-        pObjIndex->next = object_list;
-        object_list = pObjIndex;
+    int serialized = serialize_document(&doc, parsers, nareas, refs, nrefs, &opts,
+                                        use_dict ? &dict : NULL, use_colors ? &styles : NULL,
+                                        threads, trace);
+    size_t doc_len = json_doc_length(&doc);
+    metrics->serialize_seconds = monotonic_seconds() - start;
+    if (trace)
+        trace_span(trace, 0, "phase", "serialize", start, start + metrics->serialize_seconds,
+                   "\"bytes\":%zu", doc_len);
+
+    if (serialized == 0) {
+        double t = monotonic_seconds();
+        long written = write_document(&doc, STDOUT_FILENO, summary_path ? &doc_digest : NULL);
+        metrics->write_seconds = monotonic_seconds() - t;
+        if (trace) trace_span(trace, 0, "phase", "write", t, t + metrics->write_seconds, NULL);
+
+        if (written < 0) perror("Error: write");
+        metrics->bytes_out = written < 0 ? 0 : written + details_bytes;
+        metrics->success = written >= 0 && (size_t)written == doc_len;
+        // A run that didn't write everything leaves the old sidecar, whose
+        // byte count no longer matches
+        if (metrics->success && summary_path)
+            metrics->success = write_summary(summary_path, &doc_digest,
+                                             details_path ? &details_digest : NULL, nrefs);
+    } else {
+        fprintf(stderr, "Error: Out of memory serializing objects\n");
     }
+
+    json_check_free(&doc_digest.check);
+    json_check_free(&details_digest.check);
+    json_doc_free(&doc);
+    mem_free(spans);
+    string_pool_free(&dict);
+    string_pool_free(&styles);
 }
 
-// Print object as JSON
-void print_object_json(OBJ_INDEX_DATA *obj) {
-    printf("  {\n");
-    printf("    \"vnum\": %ld,\n", obj->vnum);
-    printf("    \"name\": \"%s\",\n", obj->name ? obj->name : "");
-    printf("    \"type\": \"%s\",\n", item_type_name(obj->item_type));
-    printf("    \"level\": %d,\n", obj->level);
-    char wear_buf[256];
-    bitfield_to_names(obj->wear_flags, wear_flag_table, wear_buf, sizeof(wear_buf));
-    printf("    \"wear_flags\": \"%s\",\n", wear_buf);
-    char extra_buf[256];
-    bitfield_to_names(obj->extra_flags, extra_flag_table, extra_buf, sizeof(extra_buf));
-    printf("    \"extra_flags\": \"%s\",\n", extra_buf);
-    printf("    \"material\": \"%s\",\n", obj->material ? obj->material : "");
-    printf("    \"condition\": %d,\n", obj->condition);
-    printf("    \"weight\": %d,\n", obj->weight);
-    printf("    \"cost\": %d,\n", obj->cost);
-    char *escaped_short = escape_json_string(obj->short_descr);
-    char *escaped_desc = escape_json_string(obj->description);
-    printf("    \"short_descr\": \"%s\",\n", escaped_short);
-    printf("    \"description\": \"%s\",\n", escaped_desc);
-    free(escaped_short);
-    free(escaped_desc);
+// Files read ahead per parse thread, so a worker rarely waits on I/O
+#define PARSE_SLOTS_PER_THREAD 2
+#define PARSE_MAX_SLOTS 32
+// Parse threads report to the trace after the serialize threads
+#define PARSE_TRACE_TID SERIALIZE_MAX_THREADS
+
+typedef struct parse_job {
+    AREA_PARSER *parsers;
+    const char **files;
+    BATCH_READER reader;
+    TRACE *trace;
+} PARSE_JOB;
+
+typedef struct parse_worker {
+    PARSE_JOB *job;
+    int tid;
+    double wait_seconds; // Blocked until the reader had a file ready
+    pthread_t thread;
+} PARSE_WORKER;
+
+// Parse files in whatever order the reader finishes them; each has its
+// own parser, so the results don't depend on the order
+static void *parse_worker(void *arg) {
+    PARSE_WORKER *w = arg;
+    PARSE_JOB *job = w->job;
 
-    // Affects
-    printf("    \"affects\": [\n");
-    AFFECT_OUT *ao = obj->affects_out;
-    int first = 1;
-    while (ao) {
-        if (!first) printf(",\n");
-        first = 0;
-        printf("      {\n");
-        printf("        \"type\": \"%s\",\n", ao->type);
-        printf("        \"location\": \"%s\",\n", ao->location);
-        printf("        \"modifier\": %d", ao->modifier);
-        if (ao->extra[0]) {
-            char *escaped_extra = escape_json_string(ao->extra);
-            printf(", \"extra\": \"%s\"", escaped_extra);
-            free(escaped_extra);
+    for (;;) {
+        double t = monotonic_seconds();
+        BATCH_FILE *f = batch_reader_next(&job->reader);
+        double waited = monotonic_seconds() - t;
+        w->wait_seconds += waited;
+        if (!f) break;
+        if (job->trace) trace_span(job->trace, w->tid, "phase", "open", t, t + waited, NULL);
+
+        AREA_PARSER *parser = &job->parsers[f->index];
+        parser->trace_tid = w->tid;
+        if (!f->error) area_parse_buffer(parser, f->data, f->len, job->files[f->index]);
+        batch_reader_release(&job->reader, f);
+    }
+    return NULL;
+}
+
+// Parse each file into its own parser on up to threads threads, the calling
+// thread included, while a reader thread loads the files ahead of them.
+// A damaged archive keeps what was parsed before the damage, with the
+// damage counted among its errors. If a file can't be read or its
+// decompression can't start, the parsers from the first such file on are
+// freed. Returns how many were parsed; those parsers need
+// area_parser_free. limits (NULL for none), metrics and trace may be NULL.
+static int parse_areas(AREA_PARSER *parsers, const char **files, int nfiles, OBJ_FILTER *filter,
+                       bool skip_body, bool load_world, bool parse_colors, const AREA_LIMITS *limits,
+                       FILE *log, int threads, RUN_METRICS *metrics, TRACE *trace) {
+    for (int i = 0; i < nfiles; ++i) {
+        AREA_PARSER *parser = &parsers[i];
+        area_parser_init(parser);
+        if (limits) parser->limits = *limits;
+        parser->log = log;
+        if (filter) {
+            parser->cb.object_header = filter_object_header;
+            parser->user = filter;
         }
-        printf("\n      }");
-        ao = ao->next;
+        // Nothing reads affects or extra descriptions when they are projected away
+        parser->skip_body = skip_body;
+        parser->load_world = load_world;
+        parser->parse_colors = parse_colors;
+        parser->trace = trace;
     }
-    printf("\n    ],\n");
 
-    // Values (interpreted per item type)
-    printf("    \"values\": {\n");
-    if (obj->item_type == 9) { // armor
-        printf("      \"ac_pierce\": %d,\n", obj->value[0]);
-        printf("      \"ac_bash\": %d,\n", obj->value[1]);
-        printf("      \"ac_slash\": %d,\n", obj->value[2]);
-        printf("      \"ac_exotic\": %d,\n", obj->value[3]);
-        printf("      \"v4\": %d\n", obj->value[4]);
-    } else if (obj->item_type == 5) { // weapon
-        printf("      \"weapon_type\": \"%s\",\n", weapon_type_name(obj->value[0]));
-        printf("      \"number_of_dice\": %d,\n", obj->value[1]);
-        printf("      \"type_of_dice\": %d,\n", obj->value[2]);
-        printf("      \"damage_type\": \"%s\",\n", obj->damage_type ? obj->damage_type : "unknown");
-        char *flags_names = weapon_flags_to_names(obj->weapon_flags);
-        printf("      \"flags\": %s\n", flags_names);
-        free(flags_names);
-    } else if (obj->item_type == 40) { // materia
-        printf("      \"charges\": %d,\n", obj->value[0]);
-        printf("      \"spell\": \"%s\",\n", obj->materia_spell ? obj->materia_spell : "");
-        printf("      \"v2\": %d,\n", obj->value[2]);
-        printf("      \"v3\": %d,\n", obj->value[3]);
-        printf("      \"v4\": %d\n", obj->value[4]);
-    } else if (obj->item_type == 9) { // armor
-        printf("      \"ac_pierce\": %d,\n", obj->value[0]);
-        printf("      \"ac_bash\": %d,\n", obj->value[1]);
-        printf("      \"ac_slash\": %d,\n", obj->value[2]);
-        printf("      \"ac_exotic\": %d,\n", obj->value[3]);
-        printf("      \"level\": %d\n", obj->value[4]);
-    } else {
-        printf("      \"v0\": %d,\n", obj->value[0]);
-        printf("      \"v1\": %d,\n", obj->value[1]);
-        printf("      \"v2\": %d,\n", obj->value[2]);
-        printf("      \"v3\": %d,\n", obj->value[3]);
-        printf("      \"v4\": %d\n", obj->value[4]);
+    if (threads > nfiles) threads = nfiles;
+    if (threads > SERIALIZE_MAX_THREADS) threads = SERIALIZE_MAX_THREADS;
+    if (threads < 1) threads = 1;
+    int slots = threads * PARSE_SLOTS_PER_THREAD;
+    PARSE_JOB job = { parsers, files, {0}, trace };
+    double start = monotonic_seconds();
+    // One byte past the input limit is enough for the parser to see the
+    // file went on; the rest is never read
+    size_t max_size = limits && limits->input ? limits->input + 1 : 0;
+    if (batch_reader_start(&job.reader, files, nfiles, slots > PARSE_MAX_SLOTS ? PARSE_MAX_SLOTS : slots,
+                           max_size) != 0) {
+        fprintf(stderr, "Error: Cannot start reading the area files\n");
+        for (int i = 0; i < nfiles; ++i)
+            area_parser_free(&parsers[i]);
+        return 0;
     }
-    printf("    }\n");
-    printf("  }");
-    
-    // Clean up materia spell names
-    if (obj->item_type == 40 && obj->materia_spell) {
-        free(obj->materia_spell);
+
+    PARSE_WORKER workers[SERIALIZE_MAX_THREADS];
+    bool started[SERIALIZE_MAX_THREADS] = {false};
+    for (int i = 0; i < threads; ++i) {
+        workers[i].job = &job;
+        workers[i].tid = i ? PARSE_TRACE_TID + i : 0;
+        workers[i].wait_seconds = 0;
     }
-    // Clean up weapon fields
-    if (obj->item_type == 5) {
-        if (obj->damage_type) free(obj->damage_type);
-        if (obj->weapon_flags) free(obj->weapon_flags);
+    for (int i = 1; i < threads; ++i) {
+        if (trace) {
+            char name[32];
+            snprintf(name, sizeof(name), "parse %d", i);
+            trace_thread_name(trace, workers[i].tid, name);
+        }
+        started[i] = pthread_create(&workers[i].thread, NULL, parse_worker, &workers[i]) == 0;
     }
-    // Clean up extra_flags_str
-    if (obj->extra_flags_str) {
-        free(obj->extra_flags_str);
+    parse_worker(&workers[0]);
+    double wait_seconds = workers[0].wait_seconds;
+    for (int i = 1; i < threads; ++i) {
+        if (!started[i]) continue;
+        pthread_join(workers[i].thread, NULL);
+        wait_seconds += workers[i].wait_seconds;
     }
 
+    // A parse that got as far as creating its area has something to show
+    int parsed = 0;
+    while (parsed < nfiles && !job.reader.files[parsed].error && parsers[parsed].area)
+        parsed++;
+    int error = parsed < nfiles ? job.reader.files[parsed].error : 0;
+    if (trace)
+        trace_span(trace, 0, "phase", "read and parse", start, monotonic_seconds(),
+                   "\"files\":%d,\"threads\":%d,\"backend\":\"%s\"", nfiles, threads,
+                   batch_reader_backend(&job.reader));
+    batch_reader_finish(&job.reader);
+
+    for (int i = 0; i < parsed; ++i) {
+        const AREA_STATS *stats = &parsers[i].stats;
+        if (parsers[i].error[0])
+            fprintf(stderr, "Error: %s: %s, keeping what was read before it\n", files[i], parsers[i].error);
+        if (!metrics) continue;
+        metrics->scan_seconds += stats->scan_seconds;
+        metrics->parse_seconds += stats->parse_seconds;
+        metrics->bytes_in += stats->bytes_in;
+        metrics->objects += stats->objects;
+        metrics->objects_skipped += stats->objects_skipped;
+        metrics->affects += stats->affects;
+        metrics->extra_descrs += stats->extra_descrs;
+        metrics->errors += stats->errors;
+    }
+    if (metrics) metrics->open_seconds += wait_seconds;
+    if (parsed < nfiles) {
+        if (error)
+            fprintf(stderr, "Error: Cannot open file %s: %s\n", files[parsed], strerror(error));
+        else
+            fprintf(stderr, "Error: Cannot read file %s: %s\n", files[parsed], parsers[parsed].error);
+        for (int i = parsed; i < nfiles; ++i)
+            area_parser_free(&parsers[i]);
+    }
+    return parsed;
+}
 
+// What --serve's callbacks need to reload the files and print objects
+typedef struct serve_context {
+    const char **files;
+    int nfiles;
+    OBJ_FILTER *filter;
+    int threads;
+    JSON_OPTS opts;
+    const AREA_LIMITS *limits; // NULL unless hardened
+} SERVE_CONTEXT;
+
+// The server always keeps affects: they back its affect index
+static int serve_load(SERVE_MODEL *model, void *user) {
+    SERVE_CONTEXT *ctx = user;
+    model->parsers = mem_calloc(MEM_OTHER, ctx->nfiles, sizeof(*model->parsers));
+    if (!model->parsers) return -1;
+    model->nareas = parse_areas(model->parsers, ctx->files, ctx->nfiles, ctx->filter, false, false, false,
+                                ctx->limits, NULL, ctx->threads, NULL, NULL);
+    if (model->nareas != ctx->nfiles) return -1;
+    model->refs = order_objects(model->parsers, model->nareas, SORT_VNUM, &model->nrefs);
+    if (!model->refs) {
+        fprintf(stderr, "Error: Out of memory ordering objects\n");
+        return -1;
+    }
+    return 0;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <area_file>\n", argv[0]);
-        return 1;
+static void serve_print_object(STRBUF *out, const OBJ_REF *ref, void *user) {
+    SERVE_CONTEXT *ctx = user;
+    print_object_json(out, ref->obj, ctx->nfiles == 1 ? -1 : ref->area, NULL, &ctx->opts);
+}
+
+// Add a written file's size to the output byte count
+static void count_output_file(RUN_METRICS *metrics, const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0) metrics->bytes_out += (long)st.st_size;
+}
+
+// Write the objects to a SQLite database next to the run's other output.
+// Building the database counts as serializing; there is no separate write
+// phase.
+static bool output_sqlite(RUN_METRICS *metrics, const char *path, AREA_PARSER *parsers, int nareas,
+                          const OBJ_REF *refs, size_t nrefs) {
+#ifdef HAVE_SQLITE
+    char err[256];
+    if (sqlite_export(path, parsers, nareas, refs, nrefs, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: SQLite export to %s failed: %s\n", path, err);
+        return false;
+    }
+    count_output_file(metrics, path);
+    return true;
+#else
+    (void)metrics; (void)parsers; (void)nareas; (void)refs; (void)nrefs;
+    fprintf(stderr, "Error: cannot write %s: built without SQLite support\n", path);
+    return false;
+#endif
+}
+
+// Write the objects and affects as Arrow IPC files base.objects.arrow and
+// base.affects.arrow
+static bool output_arrow(RUN_METRICS *metrics, const char *base, const OBJ_REF *refs, size_t nrefs) {
+    char err[256];
+    if (arrow_export(base, refs, nrefs, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: Arrow export failed: %s\n", err);
+        return false;
+    }
+    STRBUF path;
+    sb_init(&path);
+    sb_printf(&path, "%s.objects.arrow", base);
+    count_output_file(metrics, path.data);
+    path.len = 0;
+    sb_printf(&path, "%s.affects.arrow", base);
+    count_output_file(metrics, path.data);
+    sb_free(&path);
+    return true;
+}
+
+// Add the parsed objects to the history in dir as the snapshot at time.
+// Versions are the objects' default JSON, whatever the run's own output
+// options, so snapshots from any run compare equal when nothing changed.
+static bool record_history(const char *dir, int64_t time, AREA_PARSER *parsers, int nareas) {
+    size_t nrefs = 0;
+    OBJ_REF *refs = order_objects(parsers, nareas, SORT_VNUM, &nrefs);
+    HISTORY_ITEM *items = mem_calloc(MEM_OUTPUT, nrefs ? nrefs : 1, sizeof(*items));
+    size_t *starts = mem_calloc(MEM_OUTPUT, nrefs ? nrefs : 1, sizeof(*starts));
+    if (!refs || !items || !starts) {
+        fprintf(stderr, "Error: Out of memory recording history\n");
+        mem_free(refs);
+        mem_free(items);
+        mem_free(starts);
+        return false;
+    }
+
+    JSON_OPTS opts = { FIELD_DEFAULT, NULL, NULL, NULL, NULL, NULL };
+    STRBUF text;
+    sb_init(&text);
+    for (size_t i = 0; i < nrefs; ++i) {
+        starts[i] = text.len;
+        print_object_json(&text, refs[i].obj, -1, NULL, &opts);
+        items[i].vnum = refs[i].obj->vnum;
+        items[i].len = text.len - starts[i];
     }
+    for (size_t i = 0; i < nrefs; ++i)
+        items[i].text = text.data + starts[i];
+
+    HISTORY h;
+    HISTORY_COUNTS counts;
+    char err[256];
+    bool ok = history_open(&h, dir, true, err, sizeof(err)) == 0;
+    if (ok) {
+        ok = history_record(&h, time, items, nrefs, &counts, err, sizeof(err)) == 0;
+        history_close(&h);
+    }
+    if (ok)
+        fprintf(stderr, "History: %d added, %d changed, %d removed, %d unchanged "
+                "(%d keyframes, %d deltas, %d reused, %zu bytes)\n",
+                counts.added, counts.changed, counts.removed, counts.unchanged,
+                counts.keyframes, counts.deltas, counts.reused, counts.bytes);
+    else
+        fprintf(stderr, "Error: --history: %s\n", err);
+
+    sb_free(&text);
+    mem_free(starts);
+    mem_free(items);
+    mem_free(refs);
+    return ok;
+}
 
-    FILE *fp = fopen(argv[1], "r");
-    if (!fp) {
-        fprintf(stderr, "Error: Cannot open file %s\n", argv[1]);
+// --item and --changes: answer from the history in dir on stdout
+static int query_history(const char *dir, const char *item, const char *as_of, const char *changes) {
+    HISTORY h;
+    char err[256];
+    if (history_open(&h, dir, false, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: --history: %s\n", err);
         return 1;
     }
 
-    // Initialize current_area
-    current_area = malloc(sizeof(AREA_DATA));
-    current_area->name = strdup("Unknown");
-    current_area->file_name = strdup(argv[1]);
-    current_area->credits = strdup("Unknown");
-    current_area->builders = strdup("Unknown");
+    STRBUF out;
+    sb_init(&out);
+    int rc = 0;
+    if (item) {
+        int64_t time, since;
+        char *end;
+        long long vnum = strtoll(item, &end, 10);
+        if (*end || end == item || history_parse_time(as_of ? as_of : "now", &time) != 0) {
+            fprintf(stderr, "Error: --item takes a vnum and --as-of a time\n");
+            rc = 1;
+        } else {
+            STRBUF text;
+            sb_init(&text);
+            int found = history_item(&h, vnum, time, &text, &since, err, sizeof(err));
+            char when[32], changed[32];
+            history_format_time(when, sizeof(when), time);
+            history_format_time(changed, sizeof(changed), since);
+            if (found < 0) {
+                fprintf(stderr, "Error: --history: %s\n", err);
+                rc = 1;
+            } else {
+                // since is when the version shown, or the removal, was recorded
+                sb_printf(&out, "{\n  \"vnum\": %lld,\n  \"as_of\": \"%s\",\n", vnum, when);
+                if (since) sb_printf(&out, "  \"since\": \"%s\",\n", changed);
+                sb_puts(&out, "  \"object\": ");
+                if (found) sb_append(&out, text.data + 2, text.len - 2); // Drop the array indent
+                else sb_puts(&out, "null");
+                sb_puts(&out, "\n}\n");
+            }
+            sb_free(&text);
+        }
+    } else {
+        // FROM..TO, either end optional
+        int64_t from = INT64_MIN, to = INT64_MAX;
+        const char *dots = strstr(changes, "..");
+        char first[64];
+        size_t len = dots ? (size_t)(dots - changes) : 0;
+        if (!dots || len >= sizeof(first)) {
+            rc = 1;
+        } else {
+            memcpy(first, changes, len);
+            first[len] = '\0';
+            if ((len && history_parse_time(first, &from) != 0) ||
+                (dots[2] && history_parse_time(dots + 2, &to) != 0))
+                rc = 1;
+        }
+        if (rc)
+            fprintf(stderr, "Error: --changes takes FROM..TO (times or dates, either may be left out)\n");
+        else if (history_changes(&h, from, to, &out, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Error: --history: %s\n", err);
+            rc = 1;
+        }
+    }
+    if (!rc && fwrite(out.data, 1, out.len, stdout) != out.len) rc = 1;
+    sb_free(&out);
+    history_close(&h);
+    return rc;
+}
 
-    // EXACT MUD LOGIC - copy from db.c
-    for (;;) {
-        char *word;
-        char letter = fread_letter(fp);
-        if (letter != '#') {
-            fprintf(stderr, "Error: # not found.\n");
-            break;
+// --score ranks the objects per wear slot for one weighting, on stdout in
+// place of the objects; --score-presets writes every preset's ranking to a
+// file next to whatever else the run writes. weights is NULL without
+// --score.
+static bool output_scores(const OBJ_REF *refs, size_t nrefs, const SCORE_WEIGHTS *weights,
+                          const char *presets_path, int top, long max_level, TRACE *trace) {
+    double t = monotonic_seconds();
+    SCORE_TABLE table;
+    if (score_table_build(&table, refs, nrefs) != 0) {
+        fprintf(stderr, "Error: Out of memory scoring objects\n");
+        return false;
+    }
+    bool ok = true;
+    STRBUF out;
+    sb_init(&out);
+    if (weights) {
+        SCORE_RESULT result;
+        ok = score_top(&table, weights, top, max_level, &result) == 0;
+        if (ok) {
+            score_result_json(&out, &table, weights, &result, "");
+            sb_puts(&out, "\n");
+            score_result_free(&result);
+            ok = fwrite(out.data, 1, out.len, stdout) == out.len && fflush(stdout) == 0;
+            if (!ok) perror("Error: write");
+        } else {
+            fprintf(stderr, "Error: Out of memory scoring objects\n");
         }
+    }
+    if (ok && presets_path) {
+        sb_free(&out);
+        sb_init(&out);
+        if (score_presets_json(&out, &table, top, max_level) != 0) {
+            fprintf(stderr, "Error: Out of memory scoring objects\n");
+            ok = false;
+        } else if (sb_write_file(&out, presets_path) != 0) {
+            fprintf(stderr, "Error: Cannot write score presets to %s\n", presets_path);
+            ok = false;
+        }
+    }
+    sb_free(&out);
+    score_table_free(&table);
+    if (trace) trace_span(trace, 0, "phase", "score", t, monotonic_seconds(), "\"objects\":%zu", nrefs);
+    return ok;
+}
 
-        word = fread_word(fp);
-        fprintf(stderr, "Read section: %s\n", word);
+// One serializer thread per online CPU
+static int default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    return n > SERIALIZE_MAX_THREADS ? SERIALIZE_MAX_THREADS : (int)n;
+}
 
-        // Remove leading # if present
-        if (word && word[0] == '#') {
-            word++;
-        }
+// --mem-report has to be seen before anything is allocated
+static bool mem_report_requested(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i)
+        if (!strcmp(argv[i], "--mem-report"))
+            return true;
+    return false;
+}
 
-        if (word[0] == '$')
-            break;
-        else if (!strcmp(word, "AREA"))
-            ; // Skip
-        else if (!strcmp(word, "MOBOLD"))
-            ; // Skip
-        else if (!strcmp(word, "AREADATA")) {
-            // Skip area data by reading until next #
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    ungetc(c, fp);
-                    break;
-                }
+static void finish_run(RUN_METRICS *metrics, double run_start, const char *prom_path,
+                       const char *metrics_json_path, TRACE *trace, const char *trace_path) {
+    metrics->total_seconds = monotonic_seconds() - run_start;
+    metrics->finished = time(NULL);
+    write_metrics(metrics, prom_path, metrics_json_path);
+    if (trace_path) {
+        write_trace(trace, trace_path);
+        trace_free(trace);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter_expr = NULL;
+    const char *prom_path = NULL;
+    const char *metrics_json_path = NULL;
+    const char *trace_path = NULL;
+    const char *sqlite_path = NULL;
+    const char *arrow_base = NULL;
+    const char *serve_listen = NULL;
+    const char *details_path = NULL;
+    const char *shard_spec = NULL;
+    const char *summary_path = NULL;
+    const char *score_spec = NULL;
+    const char *score_presets_path = NULL;
+    int score_top_count = 10;
+    long score_max_level = LONG_MAX;
+    const char *history_dir = NULL;
+    const char *history_time = NULL;
+    const char *history_item_vnum = NULL;
+    const char *history_as_of = NULL;
+    const char *history_range = NULL;
+    bool merge = false;
+    bool hardened = false;
+    AREA_LIMITS limits;
+    bool details_description = false;
+    bool with_sources = false;
+    bool mem_report = false;
+    double trace_threshold = 50e-6;
+    unsigned fields = FIELD_DEFAULT;
+    bool use_dict = false;
+    bool use_colors = false;
+    int sort = SORT_NONE;
+    int threads = default_threads();
+    int nareas = 0;
+    int rc = 1;
+
+    area_limits_default(&limits);
+    if (mem_report_requested(argc, argv)) {
+        mem_report = true;
+        mem_accounting(true);
+    }
+
+    const char **area_files = mem_calloc(MEM_OTHER, argc, sizeof(*area_files));
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter_expr = argv[++i];
+        } else if (!strcmp(argv[i], "--fields") && i + 1 < argc) {
+            fields = parse_fields(argv[++i]);
+            if (!fields) {
+                mem_free(area_files);
+                return 1;
             }
-        }
-        else if (!strcmp(word, "HELPS")) {
-            // Skip helps by reading until next #
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    ungetc(c, fp);
-                    break;
-                }
+        } else if (!strcmp(argv[i], "--sources")) {
+            with_sources = true;
+        } else if (!strcmp(argv[i], "--dict")) {
+            use_dict = true;
+        } else if (!strcmp(argv[i], "--colors")) {
+            use_colors = true;
+        } else if (!strcmp(argv[i], "--sort") && i + 1 < argc) {
+            ++i;
+            if (!strcmp(argv[i], "vnum")) sort = SORT_VNUM;
+            else if (!strcmp(argv[i], "area")) sort = SORT_AREA;
+            else {
+                fprintf(stderr, "Error: --sort takes vnum or area\n");
+                mem_free(area_files);
+                return 1;
             }
-        }
-        else if (!strcmp(word, "MOBILES")) {
-            // Skip mobiles by reading until next #0 or section
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    char *next_word = fread_word(fp);
-                    if (next_word && (!strcmp(next_word, "0") || !strcmp(next_word, "OBJECTS") || !strcmp(next_word, "ROOMS") || !strcmp(next_word, "RESETS") || !strcmp(next_word, "SHOPS") || !strcmp(next_word, "MOBPROGS") || !strcmp(next_word, "SPECIALS"))) {
-                        ungetc(c, fp);
-                        free(next_word);
-                        break;
-                    }
-                    if (next_word) free(next_word);
-                }
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1 || threads > SERIALIZE_MAX_THREADS) {
+                fprintf(stderr, "Error: --threads takes 1 to %d\n", SERIALIZE_MAX_THREADS);
+                mem_free(area_files);
+                return 1;
             }
-        }
-        else if (!strcmp(word, "OBJOLD")) {
-            // Skip old objects by reading until next #
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    ungetc(c, fp);
-                    break;
-                }
+        } else if (!strcmp(argv[i], "--sqlite") && i + 1 < argc) {
+            sqlite_path = argv[++i];
+#ifndef HAVE_SQLITE
+            fprintf(stderr, "Error: --sqlite needs a build with SQLite (make HAVE_SQLITE=1)\n");
+            mem_free(area_files);
+            return 1;
+#endif
+        } else if (!strcmp(argv[i], "--arrow") && i + 1 < argc) {
+            arrow_base = argv[++i];
+        } else if (!strcmp(argv[i], "--details") && i + 1 < argc) {
+            details_path = argv[++i];
+        } else if (!strcmp(argv[i], "--summary") && i + 1 < argc) {
+            summary_path = argv[++i];
+        } else if (!strcmp(argv[i], "--details-description")) {
+            details_description = true;
+        } else if (!strcmp(argv[i], "--shard") && i + 1 < argc) {
+            shard_spec = argv[++i];
+        } else if (!strcmp(argv[i], "--merge")) {
+            merge = true;
+        } else if (!strcmp(argv[i], "--score") && i + 1 < argc) {
+            score_spec = argv[++i];
+        } else if (!strcmp(argv[i], "--score-presets") && i + 1 < argc) {
+            score_presets_path = argv[++i];
+        } else if (!strcmp(argv[i], "--top") && i + 1 < argc) {
+            score_top_count = atoi(argv[++i]);
+            if (score_top_count < 1 || score_top_count > SCORE_MAX_TOP) {
+                fprintf(stderr, "Error: --top takes 1 to %d\n", SCORE_MAX_TOP);
+                mem_free(area_files);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--max-level") && i + 1 < argc) {
+            score_max_level = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--history") && i + 1 < argc) {
+            history_dir = argv[++i];
+        } else if (!strcmp(argv[i], "--history-time") && i + 1 < argc) {
+            history_time = argv[++i];
+        } else if (!strcmp(argv[i], "--item") && i + 1 < argc) {
+            history_item_vnum = argv[++i];
+        } else if (!strcmp(argv[i], "--as-of") && i + 1 < argc) {
+            history_as_of = argv[++i];
+        } else if (!strcmp(argv[i], "--changes") && i + 1 < argc) {
+            history_range = argv[++i];
+        } else if (!strcmp(argv[i], "--hardened")) {
+            hardened = true;
+        } else if (!strcmp(argv[i], "--limits") && i + 1 < argc) {
+            hardened = true;
+            if (!parse_limits(argv[++i], &limits)) {
+                mem_free(area_files);
+                return 1;
             }
+        } else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+            serve_listen = argv[++i];
+        } else if (!strcmp(argv[i], "--metrics-prom") && i + 1 < argc) {
+            prom_path = argv[++i];
+        } else if (!strcmp(argv[i], "--metrics-json") && i + 1 < argc) {
+            metrics_json_path = argv[++i];
+        } else if (!strcmp(argv[i], "--mem-report")) {
+            ; // Handled above, before the first allocation
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--trace-threshold") && i + 1 < argc) {
+            trace_threshold = atof(argv[++i]) / 1e6;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            mem_free(area_files);
+            return 1;
+        } else {
+            area_files[nareas++] = argv[i];
         }
-        else if (!strcmp(word, "OBJECTS")) {
-            fprintf(stderr, "Found OBJECTS section, calling load_objects\n");
-            load_objects(fp);
-            fprintf(stderr, "load_objects returned\n");
+    }
+    if (history_item_vnum || history_range || history_as_of) {
+        // Queries read only the history
+        if (!history_dir || nareas || (history_as_of && !history_item_vnum) ||
+            (history_item_vnum && history_range)) {
+            fprintf(stderr, "Error: --history DIR takes either --item VNUM [--as-of TIME] or --changes FROM..TO, without area files\n");
+            mem_free(area_files);
+            return 1;
         }
-        else if (!strcmp(word, "RESETS")) {
-            // Skip resets by reading until next #
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    ungetc(c, fp);
-                    break;
-                }
-            }
+        rc = query_history(history_dir, history_item_vnum, history_as_of, history_range);
+        mem_free(area_files);
+        if (mem_report) print_mem_report(stderr);
+        return rc;
+    }
+    if (!nareas) {
+        usage(argv[0]);
+        mem_free(area_files);
+        return 1;
+    }
+    if (details_description && !details_path) {
+        fprintf(stderr, "Error: --details-description needs --details PATH\n");
+        mem_free(area_files);
+        return 1;
+    }
+    if (merge) {
+        // Everything else was settled when the partial outputs were written
+        if (filter_expr || fields != FIELD_DEFAULT || with_sources || use_dict || use_colors ||
+            sort != SORT_NONE || details_description || shard_spec || sqlite_path || arrow_base ||
+            serve_listen || prom_path || metrics_json_path || trace_path || history_dir || summary_path ||
+            score_spec || score_presets_path || hardened) {
+            fprintf(stderr, "Error: --merge only takes --details and the partial outputs\n");
+            mem_free(area_files);
+            return 1;
         }
-        else if (!strcmp(word, "ROOMS")) {
-            // Skip rooms by reading until next #
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    ungetc(c, fp);
-                    break;
-                }
-            }
+        char err[256];
+        rc = shard_merge(area_files, nareas, details_path, err, sizeof(err)) == 0 ? 0 : 1;
+        if (rc) fprintf(stderr, "Error: --merge failed: %s\n", err);
+        mem_free(area_files);
+        if (mem_report) print_mem_report(stderr);
+        return rc;
+    }
+    if (with_sources) fields |= FIELD_SOURCES;
+    if ((details_path || summary_path || use_colors || (fields & FIELD_SOURCES)) &&
+        (arrow_base || serve_listen)) {
+        fprintf(stderr, "Error: --details, --summary, --sources and --colors only apply to JSON output\n");
+        mem_free(area_files);
+        return 1;
+    }
+
+    // Rankings need the whole catalog in one run
+    SCORE_WEIGHTS score_weights;
+    if (score_spec || score_presets_path) {
+        char err[256];
+        if (score_spec && (details_path || summary_path || use_colors || use_dict || (fields & FIELD_SOURCES) ||
+                           sqlite_path || arrow_base)) {
+            fprintf(stderr, "Error: --score writes rankings in place of the objects; it can't be combined with other output options\n");
+            mem_free(area_files);
+            return 1;
         }
-        else if (!strcmp(word, "SHOPS")) {
-            // Skip shops by reading until next #
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    ungetc(c, fp);
-                    break;
-                }
-            }
+        if (serve_listen || shard_spec) {
+            fprintf(stderr, "Error: --score and --score-presets can't be combined with --serve or --shard; the server answers /score\n");
+            mem_free(area_files);
+            return 1;
         }
-        else if (!strcmp(word, "MOBPROGS")) {
-            // Skip mobprogs by reading until next #
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    ungetc(c, fp);
-                    break;
-                }
-            }
+        if (score_spec && score_parse_weights(&score_weights, score_spec, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Error: bad --score: %s\n", err);
+            mem_free(area_files);
+            return 1;
         }
-        else if (!strcmp(word, "SPECIALS")) {
-            // Skip specials by reading until next #
-            for (;;) {
-                char c = fread_letter(fp);
-                if (c == EOF) break;
-                if (c == '#') {
-                    ungetc(c, fp);
-                    break;
-                }
-            }
+    }
+
+    // Items missing from a snapshot are recorded as removed, so it has to
+    // hold every object of every area
+    int64_t snapshot_time = 0;
+    if (history_dir && (filter_expr || shard_spec || serve_listen)) {
+        fprintf(stderr, "Error: --history records whole snapshots; it can't be combined with --filter, --shard or --serve\n");
+        mem_free(area_files);
+        return 1;
+    }
+    if (history_time && (!history_dir || history_parse_time(history_time, &snapshot_time) != 0)) {
+        fprintf(stderr, "Error: --history-time takes a time or date and needs --history DIR\n");
+        mem_free(area_files);
+        return 1;
+    }
+    if (history_dir && !history_time) snapshot_time = (int64_t)time(NULL);
+
+    // A shard parses only its share of the files, still in command-line
+    // order; the plan maps them back to their places in the whole job
+    SHARD_PLAN plan = {0};
+    if (shard_spec) {
+        int index, count;
+        char extra;
+        char err[256];
+        if (sscanf(shard_spec, "%d/%d%c", &index, &count, &extra) != 2 || count < 1 ||
+            index < 1 || index > count) {
+            fprintf(stderr, "Error: --shard takes I/N with 1 <= I <= N\n");
+            mem_free(area_files);
+            return 1;
+        }
+        if (sqlite_path || arrow_base || serve_listen || sort == SORT_AREA || !(fields & FIELD_VNUM)) {
+            fprintf(stderr, "Error: --shard writes JSON sorted by vnum and needs the vnum field\n");
+            mem_free(area_files);
+            return 1;
         }
-        else {
-            fprintf(stderr, "Unknown section: %s\n", word);
+        // Resets load objects from other areas, which another shard may hold
+        if (fields & FIELD_SOURCES) {
+            fprintf(stderr, "Error: --sources needs every area in one run; it can't be sharded\n");
+            mem_free(area_files);
+            return 1;
         }
+        if (shard_plan(&plan, area_files, nareas, index, count, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Error: --shard: %s\n", err);
+            mem_free(area_files);
+            return 1;
+        }
+        for (int i = 0; i < plan.nowned; ++i)
+            area_files[i] = area_files[plan.files[i]];
+        nareas = plan.nowned;
+        sort = SORT_VNUM;
     }
 
-    fclose(fp);
+    OBJ_FILTER filter = {0};
+    if (filter_expr) {
+        char err[256];
+        if (filter_parse(&filter, filter_expr, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Error: bad --filter: %s\n", err);
+            shard_plan_free(&plan);
+            mem_free(area_files);
+            return 1;
+        }
+    }
 
-    // Output JSON
-    printf("{\n");
-    printf("  \"area\": {\n");
-    printf("    \"name\": \"%s\",\n", current_area->name ? current_area->name : "");
-    printf("    \"file\": \"%s\",\n", current_area->file_name ? current_area->file_name : "");
-    printf("    \"credits\": \"%s\",\n", current_area->credits ? current_area->credits : "");
-    printf("    \"builders\": \"%s\"\n", current_area->builders ? current_area->builders : "");
-    printf("  },\n");
-    printf("  \"objects\": [\n");
-
-    OBJ_INDEX_DATA *obj = object_list;
-    bool first = true;
-    while (obj) {
-        if (!first) printf(",\n");
-        first = false;
-        print_object_json(obj);
-        obj = obj->next;
+    if (serve_listen) {
+        SERVE_CONTEXT ctx = { area_files, nareas, filter_expr ? &filter : NULL, threads,
+                              { fields, NULL, NULL, NULL, NULL, NULL }, hardened ? &limits : NULL };
+        SERVE_CONFIG cfg = { serve_listen, area_files, nareas, serve_load, serve_print_object, &ctx };
+        int serve_rc = serve_run(&cfg);
+        filter_free(&filter);
+        mem_free(area_files);
+        if (mem_report) print_mem_report(stderr);
+        return serve_rc;
     }
 
-    printf("\n  ]\n");
-    printf("}\n");
+    RUN_METRICS metrics = {0};
+    metrics.area_files = area_files;
+    metrics.nareas = nareas;
+    double run_start = monotonic_seconds();
 
-    return 0;
-} 
\ No newline at end of file
+    TRACE trace;
+    if (trace_path) {
+        trace_init(&trace, trace_threshold);
+        trace_thread_name(&trace, 0, "main");
+    }
+
+    AREA_PARSER *parsers = mem_calloc(MEM_OTHER, nareas ? nareas : 1, sizeof(*parsers));
+    int parsed = parse_areas(parsers, area_files, nareas, filter_expr ? &filter : NULL,
+                             !(fields & FIELD_AFFECTS) && !details_path && !history_dir && !score_spec &&
+                             !score_presets_path && !sqlite_path && !arrow_base, fields & FIELD_SOURCES,
+                             use_colors, hardened ? &limits : NULL, stderr, threads, &metrics,
+                             trace_path ? &trace : NULL);
+
+    WORLD_SOURCES sources = {0};
+    bool joined = true;
+    if (parsed == nareas && (fields & FIELD_SOURCES)) {
+        double t = monotonic_seconds();
+        if (world_link_sources(&sources, parsers, nareas) != 0) {
+            fprintf(stderr, "Error: Out of memory joining resets\n");
+            joined = false;
+        }
+        if (trace_path)
+            trace_span(&trace, 0, "phase", "sources", t, monotonic_seconds(), "\"sources\":%zu", sources.count);
+    }
+
+    if (parsed == nareas && joined) {
+        double t = monotonic_seconds();
+        size_t nrefs = 0;
+        OBJ_REF *refs = order_objects(parsers, nareas, sort, &nrefs);
+        TRACE *tr = trace_path ? &trace : NULL;
+        if (!refs)
+            fprintf(stderr, "Error: Out of memory ordering objects\n");
+        else if (arrow_base) {
+            // Arrow files replace JSON on stdout
+            metrics.success = output_arrow(&metrics, arrow_base, refs, nrefs);
+            metrics.serialize_seconds = monotonic_seconds() - t;
+            if (tr) trace_span(tr, 0, "phase", "serialize", t, t + metrics.serialize_seconds, NULL);
+        } else if (score_spec) {
+            metrics.success = true;
+        } else
+            output_json(&metrics, t, parsers, nareas, refs, nrefs, fields, use_dict, use_colors,
+                        details_path, details_description, shard_spec ? &plan : NULL, summary_path,
+                        threads, tr);
+        // The database comes from the same parse as the rest of the output
+        if (refs && sqlite_path) {
+            double ts = monotonic_seconds();
+            if (!output_sqlite(&metrics, sqlite_path, parsers, nareas, refs, nrefs)) metrics.success = false;
+            double elapsed = monotonic_seconds() - ts;
+            metrics.serialize_seconds += elapsed;
+            if (tr) trace_span(tr, 0, "phase", "sqlite", ts, ts + elapsed, NULL);
+        }
+        if (refs && (score_spec || score_presets_path) &&
+            !output_scores(refs, nrefs, score_spec ? &score_weights : NULL, score_presets_path,
+                           score_top_count, score_max_level, tr))
+            metrics.success = false;
+        mem_free(refs);
+        if (history_dir && !record_history(history_dir, snapshot_time, parsers, nareas))
+            metrics.success = false;
+    }
+    finish_run(&metrics, run_start, prom_path, metrics_json_path, &trace, trace_path);
+    rc = metrics.success ? 0 : 1;
+
+    world_sources_free(&sources);
+    for (int i = 0; i < parsed; ++i)
+        area_parser_free(&parsers[i]);
+    mem_free(parsers);
+    mem_free(area_files);
+    shard_plan_free(&plan);
+    filter_free(&filter);
+    // Everything is released by now, so whatever is still live has leaked
+    if (mem_report) print_mem_report(stderr);
+    return rc;
+}
@@ -0,0 +1,1560 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "areaparse.h"
+#include "decompress.h"
+#include "mem.h"
+
+// --- Lookup tables and flag-to-string logic ---
+
+// Item type table
+static const struct { int type; const char *name; } item_type_table[] = {
+    {1, "light"}, {2, "scroll"}, {3, "wand"}, {4, "staff"}, {5, "weapon"},
+    {6, "shard"}, {7, "ticket"}, {8, "treasure"}, {9, "armor"}, {10, "potion"},
+    {11, "clothing"}, {12, "furniture"}, {13, "trash"}, {15, "container"}, {17, "drink_con"},
+    {18, "key"}, {19, "food"}, {20, "money"}, {22, "boat"}, {23, "corpse_npc"},
+    {24, "corpse_pc"}, {25, "fountain"}, {26, "pill"}, {27, "protect"}, {28, "map"},
+    {29, "portal"}, {30, "warp_stone"}, {31, "room_key"}, {32, "gem"}, {33, "jewelry"},
+    {34, "jukebox"}, {35, "quiver"}, {36, "arrow"}, {37, "poison"}, {38, "disjunction"},
+    {39, "safe_haven"}, {40, "materia"}, {41, "remote"}, {46, "scryer"}, {47, "exit"},
+    {48, "minigame"}, {0, NULL}
+};
+
+// Affect locations (from merc.h - exact order)
+// Affect locations (EXACT match to APPLY_* constants in merc.h)
+static const char *const affect_location_table[] = {
+    "none", 
+    "strength", 
+    "dexterity", 
+    "intelligence", 
+    "wisdom", 
+    "constitution", 
+    "sex", 
+    "class", 
+    "level", 
+    "age", 
+    "height", 
+    "weight", 
+    "mana", 
+    "hp", 
+    "move", 
+    "gold", 
+    "experience",
+    "ac", 
+    "hitroll", 
+    "damroll", 
+    "saves", 
+    "savingrod", 
+    "savingpetri", 
+    "savingbreath", 
+    "savingspell", 
+    "spellaffect", 
+    "spellcast", 
+    "resistance", 
+    "critchance", 
+    "critdamage", 
+    "recuperation", 
+    "concentration", 
+    "prosperity", 
+    "endurance", 
+    "penetration", 
+    "alacrity", 
+    "insight", 
+    "celerity", 
+    "potency", 
+    "savingpara", 
+    "bounty",
+    NULL
+};
+
+// Helper: get item type name
+const char *item_type_name(int type) {
+    for (int i = 0; item_type_table[i].name; ++i)
+        if (item_type_table[i].type == type)
+            return item_type_table[i].name;
+    return "unknown";
+}
+
+// Helper: affect location name
+const char *affect_location_name(int loc) {
+    if (loc >= 0 && loc < AFFECT_LOCATIONS && affect_location_table[loc])
+        return affect_location_table[loc];
+    return "unknown";
+}
+
+// Location number for a name affect_location_name returns, or -1
+int affect_location_lookup(const char *name) {
+    for (int loc = 0; loc < AFFECT_LOCATIONS; ++loc)
+        if (!strcmp(affect_location_table[loc], name))
+            return loc;
+    return -1;
+}
+
+// Weapon type lookup
+const char *weapon_type_name(int type) {
+    switch (type) {
+        case 0: return "exotic";
+        case 1: return "sword";
+        case 2: return "dagger";
+        case 3: return "spear";
+        case 4: return "mace";
+        case 5: return "axe";
+        case 6: return "flail";
+        case 7: return "whip";
+        case 8: return "polearm";
+        case 9: return "bow";
+        default: return "unknown";
+    }
+}
+
+// Damage type lookup
+const char *damage_type_name(int type) {
+    switch (type) {
+        case 0: return "none";
+        case 1: return "slice";
+        case 2: return "stab";
+        case 3: return "slash";
+        case 4: return "whip";
+        case 5: return "claw";
+        case 6: return "blast";
+        case 7: return "pound";
+        case 8: return "crush";
+        case 9: return "grep";
+        case 10: return "bite";
+        case 11: return "pierce";
+        case 12: return "suction";
+        case 13: return "beating";
+        case 14: return "digestion";
+        case 15: return "charge";
+        case 16: return "slap";
+        case 17: return "punch";
+        case 18: return "wrath";
+        case 19: return "magic";
+        case 20: return "divine";
+        case 21: return "kiss";
+        case 22: return "cleave";
+        case 23: return "scratch";
+        case 24: return "peck";
+        case 25: return "peckb";
+        case 26: return "chop";
+        case 27: return "sting";
+        case 28: return "smash";
+        case 29: return "shbite";
+        case 30: return "flbite";
+        case 31: return "frbite";
+        case 32: return "acbite";
+        case 33: return "chomp";
+        case 34: return "drain";
+        case 35: return "thrust";
+        case 36: return "slime";
+        case 37: return "shock";
+        case 38: return "thwack";
+        case 39: return "flame";
+        case 40: return "chill";
+        case 41: return "poison";
+        case 42: return "pulse";
+        case 43: return "bleed";
+        default: return "unknown";
+    }
+}
+
+double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Parse trace, written only when the caller asked for it
+static void ap_log(AREA_PARSER *ap, const char *fmt, ...) {
+    if (!ap->log) return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(ap->log, fmt, args);
+    va_end(args);
+}
+
+// Count malformed input and log it. The first AREA_MAX_DIAGNOSTICS are also
+// kept with where they were found, which is the current input position.
+static void ap_error(AREA_PARSER *ap, const char *fmt, ...) {
+    ap->stats.errors++;
+    // A flood of errors past the kept ones costs no more than counting them
+    bool keep = ap->ndiagnostics < AREA_MAX_DIAGNOSTICS;
+    if (!keep && !ap->log) return;
+
+    char message[sizeof(ap->diagnostics->message)];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    // Messages quote input bytes; keep them to plain text for the log and JSON
+    for (char *c = message; *c; ++c)
+        if (!isprint((unsigned char)*c)) *c = '?';
+    long line = input_line(&ap->in);
+    ap_log(ap, "Error: line %ld: %s\n", line, message);
+    if (!keep) return;
+    if (!ap->diagnostics) {
+        ap->diagnostics = mem_alloc(MEM_OTHER, AREA_MAX_DIAGNOSTICS * sizeof(*ap->diagnostics));
+        if (!ap->diagnostics) return;
+    }
+    AREA_DIAGNOSTIC *d = &ap->diagnostics[ap->ndiagnostics++];
+    d->offset = input_tell(&ap->in);
+    d->line = line;
+    d->vnum = ap->record_vnum;
+    memcpy(d->message, message, sizeof(message));
+}
+
+// File reading functions. They work on the parser's input buffer and keep
+// the stop-and-pushback behaviour of the original getc/ungetc versions.
+static int fread_letter(AREA_PARSER *ap) {
+    return input_skip_space(&ap->in);
+}
+
+static int fread_number(AREA_PARSER *ap) {
+    unsigned number = 0;
+    int c;
+    bool negative = false;
+    
+    c = input_skip_space(&ap->in);
+    if (c == EOF) return 0;
+    
+    if (c == '-') {
+        negative = true;
+        c = input_getc(&ap->in);
+    }
+    
+    // A # is left for the record reader: a number never starts with one
+    if (!isdigit(c)) {
+        if (c == '#') input_ungetc(&ap->in, c);
+        return 0;
+    }
+    
+    number = c - '0';
+    input_digits(&ap->in, &number);
+    
+    c = input_getc(&ap->in);
+    if (c != ' ') input_ungetc(&ap->in, c);
+    
+    if (negative)
+        return -1 * (int)number;
+    
+    return (int)number;
+}
+
+// A flag is terms joined by |: numbers, each optionally negated, or a run
+// of flag letters, which ends the flag. The original read one term per
+// recursive call, negating the sum of a term and everything after it; the
+// loop keeps the product of the signs seen so far instead, so a long chain
+// of terms can't exhaust the stack. Sums wrap like the int they were.
+static long fread_flag(AREA_PARSER *ap) {
+    unsigned total = 0;
+    unsigned sign = 1;
+    int c;
+
+    for (;;) {
+        unsigned term_sign = sign;
+        c = input_skip_space(&ap->in);
+        if (c == EOF) break;
+
+        if (c == '-') {
+            sign = -sign;
+            c = input_getc(&ap->in);
+        }
+
+        if (!isdigit(c)) {
+            // Letters take no sign of their own
+            unsigned letters = 0;
+            long bit;
+            while (c != EOF && (bit = flag_letter_bits[c]) != 0) {
+                letters += (unsigned)bit;
+                c = input_getc(&ap->in);
+            }
+            // Whatever ended the letters is left for the next read
+            input_ungetc(&ap->in, c);
+            total += term_sign * letters;
+            break;
+        }
+
+        unsigned digits = c - '0';
+        input_digits(&ap->in, &digits);
+        total += sign * digits;
+
+        c = input_getc(&ap->in);
+        if (c == '|') continue;
+        if (c != ' ') input_ungetc(&ap->in, c);
+        break;
+    }
+    return (int)total;
+}
+
+// input_copy_until consumes one byte past a full copy; a ~ there still
+// ended the string
+static bool dropped_tilde(const AREA_INPUT *in) {
+    return in->pos > 0 && in->buf[in->pos - 1] == '~';
+}
+
+// Hardened mode: a string was cut off after consumed bytes. Look for its ~
+// within the string limit; a string that ends there is kept truncated, one
+// that doesn't spoils its record.
+static void string_overrun(AREA_PARSER *ap, size_t consumed) {
+    bool found = false;
+    if (consumed < ap->limits.string)
+        input_copy_until(&ap->in, '~', NULL, ap->limits.string - consumed, &found);
+    if (found) {
+        ap_error(ap, "string over %d bytes truncated", MAX_STRING_LENGTH - 1);
+    } else {
+        ap_error(ap, "string not terminated within %zu bytes", ap->limits.string);
+        ap->record_bad = "has an unterminated string";
+    }
+}
+
+// A line starting #<digit> opens the next record
+static bool at_record_line(AREA_INPUT *in) {
+    int c = input_getc(in);
+    int next = input_getc(in);
+    input_ungetc(in, next);
+    input_ungetc(in, c);
+    return c == '#' && isdigit(next);
+}
+
+// Go back to the #<digit> line a string of the current record ran over,
+// if there was one and it is still in the buffer
+static bool record_rewind(AREA_PARSER *ap) {
+    return ap->record_resume && input_rewind(&ap->in, ap->record_resume);
+}
+
+// Drop the current record, which ran into the start of the next one here:
+// the input ends here until record_end, so the fields still to come read
+// as missing instead of eating the next record
+static void record_cut(AREA_PARSER *ap, const char *why) {
+    if (!ap->record_bad) ap->record_bad = why;
+    input_set_limit(&ap->in, input_tell(&ap->in));
+}
+
+// True when the next field is a line starting #<digit> instead: numbers and
+// flags don't start with #, so the record ended early. Only the whitespace
+// before it is consumed.
+static bool fields_cut_short(AREA_PARSER *ap) {
+    int c = input_skip_space(&ap->in);
+    input_ungetc(&ap->in, c);
+    return c == '#' && ap->in.pos > 0 && ap->in.buf[ap->in.pos - 1] == '\n' && at_record_line(&ap->in);
+}
+
+// Copy a string's text after its first byte. A line inside it that starts
+// #<digit> is valid text, but should the record turn out broken it is most
+// likely where the next record begins, so the first one is remembered.
+static size_t copy_string(AREA_PARSER *ap, char *dst, size_t max, bool *found) {
+    if (ap->record_resume) return input_copy_until(&ap->in, '~', dst, max, found);
+    size_t len = 0;
+    int stop;
+    do {
+        len += input_copy_line(&ap->in, '~', dst ? dst + len : NULL, max - len, &stop);
+        if (stop == '\n' && at_record_line(&ap->in)) {
+            ap->record_resume = input_tell(&ap->in);
+            return len + input_copy_until(&ap->in, '~', dst ? dst + len : NULL, max - len, found);
+        }
+    } while (stop == '\n');
+    *found = stop == '~';
+    return len;
+}
+
+// Read a ~-terminated string into ap->buf and return its length
+static size_t fread_string_buf(AREA_PARSER *ap) {
+    char *buffer = ap->buf;
+    bool found;
+    
+    int c = input_skip_space(&ap->in);
+    if (c == EOF || c == '~') {
+        buffer[0] = '\0';
+        return 0;
+    }
+    
+    if (c == '#' && !ap->record_resume && ap->in.pos >= 2 && ap->in.buf[ap->in.pos - 2] == '\n') {
+        input_ungetc(&ap->in, c);
+        if (at_record_line(&ap->in)) ap->record_resume = input_tell(&ap->in);
+        input_getc(&ap->in);
+    }
+
+    size_t max = MAX_STRING_LENGTH - 2;
+    if (ap->limits.string && ap->limits.string - 1 < max) max = ap->limits.string - 1;
+    buffer[0] = c;
+    size_t len = 1 + copy_string(ap, buffer + 1, max, &found);
+    buffer[len] = '\0';
+    if (ap->limits.string && !found && len == max + 1 && !dropped_tilde(&ap->in))
+        string_overrun(ap, len + 1);
+    return len;
+}
+
+static char *fread_string(AREA_PARSER *ap) {
+    fread_string_buf(ap);
+    return mem_strdup(MEM_STRING, ap->buf);
+}
+
+// Strings from a record the limits already spoiled are dropped with it, so
+// they are kept out of the pool
+static const char *fread_string_intern(AREA_PARSER *ap) {
+    size_t len = fread_string_buf(ap);
+    if (ap->record_bad) len = 0;
+    return string_intern_len(&ap->strings, ap->buf, len);
+}
+
+// Read a whitespace-delimited word into ap->buf; returns its length or -1 at EOF
+static int fread_word_buf(AREA_PARSER *ap) {
+    char *buffer = ap->buf;
+    char *p = buffer;
+    int c;
+    
+    c = input_skip_space(&ap->in);
+    if (c == EOF) return -1;
+    
+    do {
+        *p++ = c;
+        c = input_getc(&ap->in);
+    } while (!isspace(c) && c != EOF && p < buffer + MAX_STRING_LENGTH - 1);
+    
+    *p = '\0';
+    return p - buffer;
+}
+
+static char *fread_word(AREA_PARSER *ap) {
+    if (fread_word_buf(ap) < 0) return NULL;
+    return mem_strdup(MEM_STRING, ap->buf);
+}
+
+static const char *fread_word_intern(AREA_PARSER *ap) {
+    int len = fread_word_buf(ap);
+    if (len < 0) return NULL;
+    return string_intern_len(&ap->strings, ap->buf, len);
+}
+
+// Skip a ~-terminated string without copying it
+static void skip_string(AREA_PARSER *ap) {
+    bool found;
+    size_t max = ap->limits.string ? ap->limits.string : (size_t)-1;
+    size_t len = copy_string(ap, NULL, max, &found);
+    if (ap->limits.string && !found && len == max && !dropped_tilde(&ap->in))
+        string_overrun(ap, len + 1);
+}
+
+static void fread_to_eol(AREA_PARSER *ap) {
+    bool found;
+    input_copy_until(&ap->in, '\n', NULL, (size_t)-1, &found);
+}
+
+// Item type lookup
+int item_lookup(const char *name) {
+    if (!name) return 0;
+
+    if (!strcmp(name, "light")) return 1;
+    if (!strcmp(name, "scroll")) return 2;
+    if (!strcmp(name, "wand")) return 3;
+    if (!strcmp(name, "staff")) return 4;
+    if (!strcmp(name, "weapon")) return 5;
+    if (!strcmp(name, "shard")) return 6;
+    if (!strcmp(name, "ticket")) return 7;
+    if (!strcmp(name, "treasure")) return 8;
+    if (!strcmp(name, "armor")) return 9;
+    if (!strcmp(name, "potion")) return 10;
+    if (!strcmp(name, "clothing")) return 11;
+    if (!strcmp(name, "furniture")) return 12;
+    if (!strcmp(name, "trash")) return 13;
+    if (!strcmp(name, "container")) return 15;
+    if (!strcmp(name, "drink_con")) return 17;
+    if (!strcmp(name, "key")) return 18;
+    if (!strcmp(name, "food")) return 19;
+    if (!strcmp(name, "money")) return 20;
+    if (!strcmp(name, "boat")) return 22;
+    if (!strcmp(name, "corpse_npc")) return 23;
+    if (!strcmp(name, "corpse_pc")) return 24;
+    if (!strcmp(name, "fountain")) return 25;
+    if (!strcmp(name, "pill")) return 26;
+    if (!strcmp(name, "protect")) return 27;
+    if (!strcmp(name, "map")) return 28;
+    if (!strcmp(name, "portal")) return 29;
+    if (!strcmp(name, "warp_stone")) return 30;
+    if (!strcmp(name, "room_key")) return 31;
+    if (!strcmp(name, "gem")) return 32;
+    if (!strcmp(name, "jewelry")) return 33;
+    if (!strcmp(name, "jukebox")) return 34;
+    if (!strcmp(name, "quiver")) return 35;
+    if (!strcmp(name, "arrow")) return 36;
+    if (!strcmp(name, "poison")) return 37;
+    if (!strcmp(name, "disjunction")) return 38;
+    if (!strcmp(name, "safe_haven")) return 39;
+    if (!strcmp(name, "materia")) return 40;
+    if (!strcmp(name, "remote")) return 41;
+    if (!strcmp(name, "scryer")) return 46;
+    if (!strcmp(name, "exit")) return 47;
+    if (!strcmp(name, "minigame")) return 48;
+    return 0;
+}
+
+// Weapon type lookup function
+int weapon_type_lookup(const char *name) {
+    if (!name) return 0;
+    
+    if (!strcmp(name, "exotic")) return 0;
+    if (!strcmp(name, "sword")) return 1;
+    if (!strcmp(name, "dagger")) return 2;
+    if (!strcmp(name, "spear")) return 3;
+    if (!strcmp(name, "staff")) return 3; // Staff maps to spear in the MUD
+    if (!strcmp(name, "mace")) return 4;
+    if (!strcmp(name, "axe")) return 5;
+    if (!strcmp(name, "flail")) return 6;
+    if (!strcmp(name, "whip")) return 7;
+    if (!strcmp(name, "polearm")) return 8;
+    if (!strcmp(name, "bow")) return 9;
+    
+    return 0; // Default to exotic
+}
+
+// Spell name lookup function - using actual MUD spell list
+int spell_lookup(const char *name) {
+    if (!name) return 0;
+    
+    // Spell mappings based on actual MUD spell list
+    if (!strcmp(name, "reserved")) return 0;
+    if (!strcmp(name, "hallucination")) return 1;
+    if (!strcmp(name, "acid blast")) return 2;
+    if (!strcmp(name, "armor")) return 3;
+    if (!strcmp(name, "bless")) return 4;
+    if (!strcmp(name, "blindness")) return 5;
+    if (!strcmp(name, "burning hands")) return 6;
+    if (!strcmp(name, "call lightning")) return 7;
+    if (!strcmp(name, "calm")) return 8;
+    if (!strcmp(name, "cancellation")) return 9;
+    if (!strcmp(name, "cause critical")) return 10;
+    if (!strcmp(name, "cause discord")) return 11;
+    if (!strcmp(name, "cause light")) return 12;
+    if (!strcmp(name, "cause serious")) return 13;
+    if (!strcmp(name, "chain lightning")) return 14;
+    if (!strcmp(name, "change sex")) return 15;
+    if (!strcmp(name, "charm person")) return 16;
+    if (!strcmp(name, "chill touch")) return 17;
+    if (!strcmp(name, "colour spray")) return 18;
+    if (!strcmp(name, "continual light")) return 19;
+    if (!strcmp(name, "control weather")) return 20;
+    if (!strcmp(name, "call demon")) return 21;
+    if (!strcmp(name, "create golem")) return 22;
+    if (!strcmp(name, "guardian spirit")) return 23;
+    if (!strcmp(name, "call servant")) return 24;
+    if (!strcmp(name, "create food")) return 25;
+    if (!strcmp(name, "create rose")) return 26;
+    if (!strcmp(name, "create spring")) return 27;
+    if (!strcmp(name, "create water")) return 28;
+    if (!strcmp(name, "cure blindness")) return 29;
+    if (!strcmp(name, "cure critical")) return 30;
+    if (!strcmp(name, "cure disease")) return 31;
+    if (!strcmp(name, "psychic healing")) return 32;
+    if (!strcmp(name, "poke")) return 33;
+    if (!strcmp(name, "crush")) return 34;
+    if (!strcmp(name, "tickle")) return 35;
+    if (!strcmp(name, "essence")) return 36;
+    if (!strcmp(name, "prayer")) return 37;
+    if (!strcmp(name, "cure light")) return 38;
+    if (!strcmp(name, "cure poison")) return 39;
+    if (!strcmp(name, "cure serious")) return 40;
+    if (!strcmp(name, "curse")) return 41;
+    if (!strcmp(name, "demonfire")) return 42;
+    if (!strcmp(name, "hellfire")) return 43;
+    if (!strcmp(name, "permanency")) return 44;
+    if (!strcmp(name, "fireshield")) return 45;
+    if (!strcmp(name, "detect weakness")) return 46;
+    if (!strcmp(name, "detect evil")) return 47;
+    if (!strcmp(name, "detect good")) return 48;
+    if (!strcmp(name, "detect hidden")) return 49;
+    if (!strcmp(name, "detect invis")) return 50;
+    if (!strcmp(name, "detect magic")) return 51;
+    if (!strcmp(name, "detect poison")) return 52;
+    if (!strcmp(name, "dispel evil")) return 53;
+    if (!strcmp(name, "dispel good")) return 54;
+    if (!strcmp(name, "dispel magic")) return 55;
+    if (!strcmp(name, "fissure")) return 56;
+    if (!strcmp(name, "earthquake")) return 57;
+    if (!strcmp(name, "animate dead")) return 58;
+    if (!strcmp(name, "enchant armor")) return 59;
+    if (!strcmp(name, "empower armor")) return 60;
+    if (!strcmp(name, "dark ritual")) return 61;
+    if (!strcmp(name, "brand")) return 62;
+    if (!strcmp(name, "empower weapon")) return 63;
+    if (!strcmp(name, "enchant weapon")) return 64;
+    if (!strcmp(name, "disjunction")) return 65;
+    if (!strcmp(name, "safe haven")) return 66;
+    if (!strcmp(name, "alternate dimension")) return 67;
+    if (!strcmp(name, "hold person")) return 68;
+    if (!strcmp(name, "entangle")) return 69;
+    if (!strcmp(name, "splinter storm")) return 70;
+    if (!strcmp(name, "energy drain")) return 71;
+    if (!strcmp(name, "magic drain")) return 72;
+    if (!strcmp(name, "faerie fire")) return 73;
+    if (!strcmp(name, "faerie fog")) return 74;
+    if (!strcmp(name, "farsight")) return 75;
+    if (!strcmp(name, "fireball")) return 76;
+    if (!strcmp(name, "mental blast")) return 77;
+    if (!strcmp(name, "mental disruption")) return 78;
+    if (!strcmp(name, "life drain")) return 79;
+    if (!strcmp(name, "energy syphon")) return 80;
+    if (!strcmp(name, "meteor")) return 81;
+    if (!strcmp(name, "fireproof")) return 82;
+    if (!strcmp(name, "flamestrike")) return 83;
+    if (!strcmp(name, "fly")) return 84;
+    if (!strcmp(name, "floating disc")) return 85;
+    if (!strcmp(name, "frenzy")) return 86;
+    if (!strcmp(name, "divine favor")) return 87;
+    if (!strcmp(name, "divine intervention")) return 88;
+    if (!strcmp(name, "gate")) return 89;
+    if (!strcmp(name, "giant strength")) return 90;
+    if (!strcmp(name, "harm")) return 91;
+    if (!strcmp(name, "haste")) return 92;
+    if (!strcmp(name, "heal")) return 93;
+    if (!strcmp(name, "heat metal")) return 94;
+    if (!strcmp(name, "holy word")) return 95;
+    if (!strcmp(name, "divine power")) return 96;
+    if (!strcmp(name, "wrath")) return 97;
+    if (!strcmp(name, "identify")) return 98;
+    if (!strcmp(name, "infravision")) return 99;
+    if (!strcmp(name, "invisibility")) return 100;
+    if (!strcmp(name, "know alignment")) return 101;
+    if (!strcmp(name, "lightning bolt")) return 102;
+    if (!strcmp(name, "remote view")) return 103;
+    if (!strcmp(name, "raven spy")) return 104;
+    if (!strcmp(name, "locate object")) return 105;
+    if (!strcmp(name, "magic missile")) return 106;
+    if (!strcmp(name, "mass healing")) return 107;
+    if (!strcmp(name, "ice storm")) return 108;
+    if (!strcmp(name, "mass invis")) return 109;
+    if (!strcmp(name, "nexus")) return 110;
+    if (!strcmp(name, "pass door")) return 111;
+    if (!strcmp(name, "plague")) return 112;
+    if (!strcmp(name, "poison")) return 113;
+    if (!strcmp(name, "portal")) return 114;
+    if (!strcmp(name, "protection evil")) return 115;
+    if (!strcmp(name, "protection good")) return 116;
+    if (!strcmp(name, "ray of truth")) return 117;
+    if (!strcmp(name, "recharge")) return 118;
+    if (!strcmp(name, "refresh")) return 119;
+    if (!strcmp(name, "remove curse")) return 120;
+    if (!strcmp(name, "telepathy")) return 121;
+    if (!strcmp(name, "life stealer")) return 122;
+    if (!strcmp(name, "sanctuary")) return 123;
+    if (!strcmp(name, "shapeshift")) return 124;
+    if (!strcmp(name, "living armor")) return 125;
+    if (!strcmp(name, "trembling earth")) return 126;
+    if (!strcmp(name, "planeshift")) return 127;
+    if (!strcmp(name, "protective sphere")) return 128;
+    if (!strcmp(name, "bark skin")) return 129;
+    if (!strcmp(name, "talon")) return 130;
+    if (!strcmp(name, "shield")) return 131;
+    if (!strcmp(name, "shocking grasp")) return 132;
+    if (!strcmp(name, "sleep")) return 133;
+    if (!strcmp(name, "slow")) return 134;
+    if (!strcmp(name, "stone skin")) return 135;
+    if (!strcmp(name, "summon")) return 136;
+    if (!strcmp(name, "teleport")) return 137;
+    if (!strcmp(name, "ventriloquate")) return 138;
+    if (!strcmp(name, "weaken")) return 139;
+    if (!strcmp(name, "word of recall")) return 140;
+    if (!strcmp(name, "mallocs empower")) return 141;
+    if (!strcmp(name, "caines maddness")) return 142;
+    if (!strcmp(name, "dinchaks power")) return 143;
+    if (!strcmp(name, "acid breath")) return 144;
+    if (!strcmp(name, "fire breath")) return 145;
+    if (!strcmp(name, "frost breath")) return 146;
+    if (!strcmp(name, "gas breath")) return 147;
+    if (!strcmp(name, "lightning breath")) return 148;
+    if (!strcmp(name, "general purpose")) return 149;
+    if (!strcmp(name, "high explosive")) return 150;
+    if (!strcmp(name, "imprint")) return 151;
+    if (!strcmp(name, "avalons protection")) return 152;
+    if (!strcmp(name, "psychic influence")) return 153;
+    if (!strcmp(name, "spectral blade")) return 154;
+    
+    return 0; // Unknown spell
+}
+
+// Step over the affect and extra description lines of an object record.
+// Same grammar as the loop in load_objects, but nothing is stored: numbers
+// are read and dropped and strings are scanned to their ~ without a copy.
+static void skip_object_body(AREA_PARSER *ap) {
+    for (;;) {
+        int letter = fread_letter(ap);
+        if (letter == EOF) break;
+
+        if (letter == '#' || letter == '0') {
+            input_ungetc(&ap->in, letter);
+            break;
+        } else if (letter == 'A') {
+            int loc = fread_number(ap);
+            fread_number(ap);
+            if (loc == 26 || loc == 27) {
+                int nletter = fread_letter(ap);
+                if (nletter == 'N') skip_string(ap);
+                else input_ungetc(&ap->in, nletter);
+            }
+        } else if (letter == 'F') {
+            fread_letter(ap);
+            fread_number(ap);
+            fread_number(ap);
+            fread_flag(ap);
+        } else if (letter == 'E') {
+            skip_string(ap);
+            skip_string(ap);
+        } else if (letter == 'N') {
+            skip_string(ap);
+        } else if (letter == 'R') {
+            fread_number(ap);
+            fread_number(ap);
+        } else if (letter == 'S') {
+            fread_number(ap);
+            fread_number(ap);
+            fread_word_buf(ap);
+        } else {
+            fread_to_eol(ap);
+        }
+    }
+}
+
+// Read affects and extra descriptions (EXACT MUD LOGIC)
+static void load_object_body(AREA_PARSER *ap, OBJ_INDEX_DATA *pObjIndex) {
+    int letter;
+    AFFECT_OUT *affects_head = NULL, *affects_tail = NULL;
+    for (;;) {
+        letter = fread_letter(ap);
+        ap_log(ap, "Affect loop: got letter '%c'\n", letter);
+        
+        if (letter == EOF) {
+            break;
+        } else if (letter == 'A') {
+            int loc = fread_number(ap);
+            int mod = fread_number(ap);
+            ap_log(ap, "  Reading affect: location=%d, modifier=%d\n", loc, mod);
+            AFFECT_OUT *ao = mem_alloc(MEM_AFFECT, sizeof(AFFECT_OUT));
+            ao->type = string_intern(&ap->strings, "normal");
+            ao->location = string_intern(&ap->strings, affect_location_name(loc));
+            ao->modifier = mod;
+            ao->extra = NULL;
+            ao->next = NULL;
+            if (!affects_head) affects_head = affects_tail = ao;
+            else { affects_tail->next = ao; affects_tail = ao; }
+            // Handle spell affects
+            if (loc == 26 || loc == 27) {
+                int nletter = fread_letter(ap);
+                if (nletter == 'N') {
+                    ao->extra = fread_string_intern(ap);
+                } else {
+                    input_ungetc(&ap->in, nletter);
+                }
+            }
+            ap->stats.affects++;
+            if (ap->cb.affect) ap->cb.affect(ap, pObjIndex, ao, ap->user);
+        } else if (letter == 'F') {
+            int fwhere = fread_letter(ap);
+            int loc = fread_number(ap);
+            int mod = fread_number(ap);
+            int bitv = fread_flag(ap);
+            ap_log(ap, "  Reading flag affect: where=%c, location=%d, modifier=%d, bitvector=%d\n", fwhere, loc, mod, bitv);
+            
+            char location[64], extra[64];
+            AFFECT_OUT *ao = mem_alloc(MEM_AFFECT, sizeof(AFFECT_OUT));
+            ao->type = string_intern(&ap->strings, "flag");
+            snprintf(location, sizeof(location), "F%c:%s", fwhere, affect_location_name(loc));
+            ao->location = string_intern(&ap->strings, location);
+            ao->modifier = mod;
+            const FLAG_FAMILY *fam = flag_family_by_where[(unsigned char)fwhere];
+            if (fam) {
+                ao->extra = string_intern(&ap->strings, flag_affect_name(fam, bitv));
+            } else {
+                snprintf(extra, sizeof(extra), "bitvector:%d", bitv);
+                ao->extra = string_intern(&ap->strings, extra);
+            }
+            ao->next = NULL;
+            if (!affects_head) affects_head = affects_tail = ao;
+            else { affects_tail->next = ao; affects_tail = ao; }
+            ap->stats.affects++;
+            if (ap->cb.affect) ap->cb.affect(ap, pObjIndex, ao, ap->user);
+        } else if (letter == 'E') {
+            ap_log(ap, "  Reading extra description\n");
+            EXTRA_DESCR_DATA *ed = mem_alloc(MEM_EXTRA_DESCR, sizeof(EXTRA_DESCR_DATA));
+            ed->keyword = fread_string(ap);
+            ed->description = fread_string(ap);
+            ed->next = pObjIndex->extra_descr;
+            pObjIndex->extra_descr = ed;
+            ap->stats.extra_descrs++;
+            if (ap->cb.extra_descr) ap->cb.extra_descr(ap, pObjIndex, ed, ap->user);
+        } else if (letter == 'N') {
+            ap_log(ap, "  Reading spell name\n");
+            char *spell_name = fread_string(ap);
+            // Could add as a spell affect if needed
+            mem_free(spell_name);
+        } else if (letter == 'R') {
+            ap_log(ap, "  Reading room affect\n");
+            int dummy1 = fread_number(ap);
+            int dummy2 = fread_number(ap);
+            (void)dummy1; (void)dummy2;
+        } else if (letter == 'S') {
+            ap_log(ap, "  Reading shield affect\n");
+            int dummy1 = fread_number(ap);
+            int dummy2 = fread_number(ap);
+            char *dummy3 = fread_word(ap);
+            mem_free(dummy3);
+            (void)dummy1; (void)dummy2;
+        } else if (letter == '#') {
+            ap_log(ap, "  Found next object, breaking\n");
+            input_ungetc(&ap->in, letter);
+            break;
+        } else if (letter == '0') {
+            ap_log(ap, "  Found end of objects section\n");
+            input_ungetc(&ap->in, letter);
+            break;
+        } else {
+            input_ungetc(&ap->in, letter);
+            ap_error(ap, "unknown letter '%c' in object, line skipped", letter);
+            fread_to_eol(ap);
+        }
+    }
+    pObjIndex->affects_out = affects_head;
+}
+
+// Step to the next line starting with #, leaving the # unread
+static void skip_to_record(AREA_PARSER *ap) {
+    for (;;) {
+        int c = fread_letter(ap);
+        if (c == EOF) return;
+        if (c == '#') {
+            input_ungetc(&ap->in, c);
+            return;
+        }
+        fread_to_eol(ap);
+    }
+}
+
+// Recover from malformed input among #vnum records: step to the next line
+// that starts a record, #<digits>, and return true, or stop at a section
+// header or the end of the input and return false. What it stops at is
+// left unread.
+static bool resync_record(AREA_PARSER *ap) {
+    for (;;) {
+        int c = fread_letter(ap);
+        if (c == EOF) return false;
+        if (c == '#') {
+            int next = input_getc(&ap->in);
+            input_ungetc(&ap->in, next);
+            if (isdigit(next) || isupper(next) || next == '$') {
+                input_ungetc(&ap->in, c);
+                return isdigit(next);
+            }
+        }
+        fread_to_eol(ap);
+    }
+}
+
+// Step to the next line starting with a section header, #NAME or #$,
+// leaving it unread
+static void skip_to_section(AREA_PARSER *ap) {
+    while (resync_record(ap))
+        fread_to_eol(ap);
+}
+
+// The offset bound bytes past from, or cap if that comes first; a bound of
+// 0 is no bound
+static long limit_after(long from, size_t bound, long cap) {
+    if (!bound || (size_t)(cap - from) <= bound) return cap;
+    return from + (long)bound;
+}
+
+// Keep the record in the buffer for record_rewind, and in hardened mode
+// make the input end where the record limit says, counting from just after
+// the record's #vnum
+static void record_begin(AREA_PARSER *ap, long vnum) {
+    ap->record_vnum = vnum;
+    ap->record_bad = NULL;
+    ap->record_resume = 0;
+    input_mark(&ap->in);
+    if (ap->limits.record)
+        input_set_limit(&ap->in, limit_after(input_tell(&ap->in), ap->limits.record, ap->section_end));
+}
+
+// Lift the record limit. Returns false, with the error counted and the
+// input moved to the next record, if the record ran into a limit or was
+// found bad on the way; the next record is looked for from the #<digit>
+// line a string ran over, if any.
+static bool record_end(AREA_PARSER *ap, const char *section, long vnum) {
+    const char *bad = ap->record_bad;
+    bool over = !bad && input_at_limit(&ap->in);
+    ap->record_bad = NULL;
+    if (ap->limits.record || bad) input_set_limit(&ap->in, ap->section_end);
+    if (over || bad) {
+        ap_error(ap, "%s: record %ld %s, dropped", section, vnum, over ? "exceeds the size limit" : bad);
+        record_rewind(ap);
+        resync_record(ap);
+    }
+    input_unmark(&ap->in);
+    return !over && !bad;
+}
+
+// Read a #vnum record header; returns the vnum, or 0 at the section's #0.
+// Anything else is an error: a stray line is skipped up to the next record,
+// and a section header or the end of the input ends the section early.
+static long fread_record_vnum(AREA_PARSER *ap, const char *section) {
+    for (;;) {
+        int letter = fread_letter(ap);
+        if (letter == EOF) return 0;
+        int next = input_getc(&ap->in);
+        input_ungetc(&ap->in, next);
+        if (letter == '#' && isdigit(next)) return fread_number(ap);
+        input_ungetc(&ap->in, letter);
+        if (letter == '#' && (isupper(next) || next == '$')) {
+            ap_error(ap, "%s: #0 missing before the next section", section);
+            return 0;
+        }
+        ap_error(ap, "%s: # not found, got '%c', skipping to the next record", section, letter);
+        fread_to_eol(ap);
+        if (!resync_record(ap)) return 0;
+    }
+}
+
+// Record a span for an object that took longer than the trace threshold
+static void trace_object(AREA_PARSER *ap, long vnum, double start, long pos,
+                         int affects_before, int extras_before) {
+    double end = monotonic_seconds();
+    if (end - start < ap->trace->object_threshold) return;
+    char name[32];
+    snprintf(name, sizeof(name), "#%ld", vnum);
+    trace_span(ap->trace, ap->trace_tid, "object", name, start, end,
+               "\"vnum\":%ld,\"bytes\":%ld,\"affects\":%d,\"extra_descrs\":%d",
+               vnum, input_tell(&ap->in) - pos, ap->stats.affects - affects_before,
+               ap->stats.extra_descrs - extras_before);
+}
+
+// Load objects - EXACT MUD LOGIC
+static void load_objects(AREA_PARSER *ap) {
+    for (;;) {
+        long vnum;
+        int letter;
+        OBJ_INDEX_DATA *pObjIndex;
+        double obj_start = 0;
+        long obj_pos = 0;
+        int affects_before = ap->stats.affects;
+        int extras_before = ap->stats.extra_descrs;
+
+        if (ap->trace) {
+            obj_start = monotonic_seconds();
+            obj_pos = input_tell(&ap->in);
+        }
+
+        vnum = fread_record_vnum(ap, "Load_objects");
+        ap_log(ap, "Loading object vnum: %ld\n", vnum);
+        if (vnum == 0) break; // End of the section
+
+        record_begin(ap, vnum);
+        pObjIndex = mem_calloc(MEM_OBJECT, 1, sizeof(OBJ_INDEX_DATA));
+        if (!pObjIndex) {
+            // Later records would fail the same way, so the section ends here
+            record_end(ap, "Load_objects", vnum);
+            ap_error(ap, "Load_objects: out of memory at record %ld, skipping the rest of the section", vnum);
+            skip_to_section(ap);
+            break;
+        }
+        pObjIndex->vnum = vnum;
+        pObjIndex->area = ap->area;
+        if (ap->cb.object_begin) ap->cb.object_begin(ap, pObjIndex, ap->user);
+        pObjIndex->name = fread_string(ap);
+        ap_log(ap, "Read name: %s\n", pObjIndex->name);
+        pObjIndex->short_descr = fread_string(ap);
+        ap_log(ap, "Read short_descr: %s\n", pObjIndex->short_descr);
+        pObjIndex->description = fread_string(ap);
+        ap_log(ap, "Read description: %s\n", pObjIndex->description);
+        pObjIndex->material = fread_string_intern(ap);
+        ap_log(ap, "Read material: %s\n", pObjIndex->material);
+
+        // Read item type as string and convert
+        if (fields_cut_short(ap)) record_cut(ap, "runs into the next record");
+        char *item_type_str = fread_word(ap);
+        pObjIndex->item_type = item_lookup(item_type_str);
+        ap_log(ap, "Read item_type_str: '%s', converted to: %d\n", item_type_str, pObjIndex->item_type);
+        mem_free(item_type_str);
+        // A type that isn't one, after a string ran over a #<digit> line, is
+        // debris from a string that lost its ~; other unknown types are kept
+        if (!pObjIndex->item_type && !ap->record_bad && ap->record_resume) {
+            record_rewind(ap);
+            record_cut(ap, "runs into the next record");
+        }
+        pObjIndex->extra_flags = fread_flag(ap);
+        ap_log(ap, "Read extra_flags: %d\n", pObjIndex->extra_flags);
+        pObjIndex->wear_flags = fread_flag(ap);
+        ap_log(ap, "Read wear_flags: %d\n", pObjIndex->wear_flags);
+
+        // Read values based on item type; the words and letters among them
+        // would eat a #<digit> line, so look for one before each
+        if (fields_cut_short(ap)) record_cut(ap, "runs into the next record");
+        if (pObjIndex->item_type == 40) { // ITEM_MATERIA
+            pObjIndex->value[0] = fread_number(ap);
+            // Read spell name delimited by single quotes
+            if (fields_cut_short(ap)) record_cut(ap, "runs into the next record");
+            int c = fread_letter(ap);
+            if (c == '\'') {
+                char *spell_buffer = ap->buf;
+                char *p = spell_buffer;
+                while ((c = input_getc(&ap->in)) != '\'' && c != EOF && p < spell_buffer + 255) {
+                    *p++ = c;
+                }
+                *p = '\0';
+                pObjIndex->materia_spell = mem_strdup(MEM_STRING, spell_buffer);
+            } else {
+                pObjIndex->materia_spell = mem_strdup(MEM_STRING, "");
+            }
+            ap_log(ap, "Read materia spell: '%s'\n", pObjIndex->materia_spell);
+            pObjIndex->value[1] = 0; // Not used for materia
+            pObjIndex->value[2] = fread_number(ap);
+            pObjIndex->value[3] = fread_number(ap);
+            pObjIndex->value[4] = fread_number(ap);
+        } else if (pObjIndex->item_type == 5) { // ITEM_WEAPON
+            // Read weapon type as string and convert to number
+            char *weapon_type_str = fread_word(ap);
+            int weapon_type_num = weapon_type_lookup(weapon_type_str);
+            pObjIndex->value[0] = weapon_type_num; // Store weapon type as number
+            mem_free(weapon_type_str);
+            // Read dice values as numbers
+            pObjIndex->value[1] = fread_number(ap); // number_of_dice
+            pObjIndex->value[2] = fread_number(ap); // type_of_dice
+            // Read damage type as string
+            if (fields_cut_short(ap)) record_cut(ap, "runs into the next record");
+            pObjIndex->damage_type = fread_word_intern(ap);
+            // Read weapon flags as string
+            pObjIndex->weapon_flags = fread_word_intern(ap);
+            // Set unused values
+            pObjIndex->value[3] = 0; // Not used for weapon
+            pObjIndex->value[4] = 0; // Not used for weapon
+        } else if (pObjIndex->item_type == 9) { // ITEM_ARMOR
+            // Read armor values as flags (they are stored as flag strings like "CDE")
+            pObjIndex->value[0] = fread_flag(ap); // ac_pierce
+            pObjIndex->value[1] = fread_flag(ap); // ac_bash
+            pObjIndex->value[2] = fread_flag(ap); // ac_slash
+            pObjIndex->value[3] = fread_flag(ap); // ac_exotic
+            pObjIndex->value[4] = fread_flag(ap); // unused
+        } else {
+            pObjIndex->value[0] = fread_flag(ap);
+            pObjIndex->value[1] = fread_flag(ap);
+            pObjIndex->value[2] = fread_flag(ap);
+            pObjIndex->value[3] = fread_flag(ap);
+            pObjIndex->value[4] = fread_flag(ap);
+        }
+        ap_log(ap, "Read values: [%d, %d, %d, %d, %d]\n", 
+               pObjIndex->value[0], pObjIndex->value[1], pObjIndex->value[2], 
+               pObjIndex->value[3], pObjIndex->value[4]);
+
+        pObjIndex->level = fread_number(ap);
+        ap_log(ap, "Read level: %d\n", pObjIndex->level);
+        pObjIndex->weight = fread_number(ap);
+        ap_log(ap, "Read weight: %d\n", pObjIndex->weight);
+        pObjIndex->cost = fread_number(ap);
+        ap_log(ap, "Read cost: %d\n", pObjIndex->cost);
+
+        if (fields_cut_short(ap)) record_cut(ap, "runs into the next record");
+        // Read condition
+        letter = fread_letter(ap);
+        ap_log(ap, "Read condition letter: '%c'\n", letter);
+        switch (letter) {
+        case 'P': pObjIndex->condition = 100; break;
+        case 'G': pObjIndex->condition = 90; break;
+        case 'A': pObjIndex->condition = 75; break;
+        case 'W': pObjIndex->condition = 50; break;
+        case 'D': pObjIndex->condition = 25; break;
+        case 'B': pObjIndex->condition = 10; break;
+        case 'R': pObjIndex->condition = 0; break;
+        default: pObjIndex->condition = 100; break;
+        }
+
+        if (ap->record_bad) {
+            record_end(ap, "Load_objects", vnum);
+            free_object(pObjIndex);
+            continue;
+        }
+        if (ap->cb.object_header && !ap->cb.object_header(ap, pObjIndex, ap->user)) {
+            ap_log(ap, "Object %ld filtered out, skipping record\n", vnum);
+            ap->stats.objects_skipped++;
+            skip_object_body(ap);
+            free_object(pObjIndex);
+            record_end(ap, "Load_objects", vnum);
+            if (ap->trace) trace_object(ap, vnum, obj_start, obj_pos, affects_before, extras_before);
+            continue;
+        }
+        // Out of memory leaves the plain text NULL; output then falls back
+        // to the raw string
+        if (ap->parse_colors) {
+            color_parse(&pObjIndex->short_colors, pObjIndex->short_descr);
+            color_parse(&pObjIndex->description_colors, pObjIndex->description);
+        }
+        if (ap->skip_body)
+            skip_object_body(ap);
+        else
+            load_object_body(ap, pObjIndex);
+        if (!record_end(ap, "Load_objects", vnum)) {
+            free_object(pObjIndex);
+            continue;
+        }
+        ap->stats.objects++;
+        if (ap->cb.object_end) ap->cb.object_end(ap, pObjIndex, ap->user);
+        if (ap->trace) trace_object(ap, vnum, obj_start, obj_pos, affects_before, extras_before);
+
+        if (!ap->keep_objects) {
+            free_object(pObjIndex);
+            continue;
+        }
+
+        // Add to list
+        pObjIndex->next = ap->object_list;
+        ap->object_list = pObjIndex;
+    }
+}
+
+// Make room for one more row at the end of a world table. Returns the new
+// row, zeroed, or NULL when out of memory.
+static void *table_append(void **rows, int *count, int *cap, size_t size) {
+    if (*count == *cap) {
+        int new_cap = *cap ? *cap * 2 : 64;
+        void *grown = mem_realloc(MEM_WORLD, *rows, (size_t)new_cap * size);
+        if (!grown) return NULL;
+        *rows = grown;
+        *cap = new_cap;
+    }
+    void *row = (char *)*rows + (size_t)(*count)++ * size;
+    memset(row, 0, size);
+    return row;
+}
+
+// New-format mobiles. Only the short description and level are kept; the
+// rest of each record is stepped over line by line.
+static void load_mobiles(AREA_PARSER *ap) {
+    AREA_WORLD *w = &ap->world;
+    long vnum;
+    while ((vnum = fread_record_vnum(ap, "Load_mobiles")) != 0) {
+        record_begin(ap, vnum);
+        skip_string(ap); // name
+        const char *short_descr = fread_string_intern(ap);
+        skip_string(ap); // long_descr
+        skip_string(ap); // description
+        skip_string(ap); // race
+        fread_flag(ap); // act
+        fread_flag(ap); // affected_by
+        fread_number(ap); // alignment
+        fread_number(ap); // group
+        int level = fread_number(ap);
+        skip_to_record(ap);
+        if (!record_end(ap, "Load_mobiles", vnum)) continue;
+        MOB_INDEX_DATA *mob = table_append((void **)&w->mobs, &w->nmobs, &w->mobs_cap, sizeof(*mob));
+        if (!mob) continue;
+        mob->vnum = vnum;
+        mob->short_descr = short_descr;
+        mob->level = level;
+        ap_log(ap, "Loaded mobile %ld: %s\n", vnum, short_descr);
+    }
+}
+
+static void load_rooms(AREA_PARSER *ap) {
+    AREA_WORLD *w = &ap->world;
+    long vnum;
+    while ((vnum = fread_record_vnum(ap, "Load_rooms")) != 0) {
+        record_begin(ap, vnum);
+        const char *name = fread_string_intern(ap);
+        skip_string(ap); // description
+        fread_number(ap); // area number
+        fread_flag(ap); // room_flags
+        fread_number(ap); // sector_type
+        for (;;) {
+            int letter = fread_letter(ap);
+            if (letter == 'S' || letter == EOF) break;
+            if (letter == '#') {
+                input_ungetc(&ap->in, letter);
+                ap_error(ap, "Load_rooms: room %ld has no S", vnum);
+                break;
+            }
+            if (letter == 'D') {
+                fread_number(ap); // door
+                skip_string(ap); // description
+                skip_string(ap); // keyword
+                fread_number(ap); // locks
+                fread_number(ap); // key
+                fread_number(ap); // to_room
+            } else if (letter == 'E') {
+                skip_string(ap);
+                skip_string(ap);
+            } else if (letter == 'O' || letter == 'C') {
+                skip_string(ap); // owner, clan
+            } else {
+                fread_to_eol(ap);
+            }
+        }
+        if (!record_end(ap, "Load_rooms", vnum)) continue;
+        ROOM_INDEX_DATA *room = table_append((void **)&w->rooms, &w->nrooms, &w->rooms_cap, sizeof(*room));
+        if (!room) continue;
+        room->vnum = vnum;
+        room->name = name;
+    }
+}
+
+// Keep the resets that place objects and the M lines they follow
+static void load_resets(AREA_PARSER *ap) {
+    AREA_WORLD *w = &ap->world;
+    for (;;) {
+        int letter = fread_letter(ap);
+        if (letter == 'S' || letter == EOF) break;
+        if (letter == '#') {
+            input_ungetc(&ap->in, letter);
+            ap_error(ap, "Load_resets: S not found");
+            break;
+        }
+        if (letter == '*') {
+            fread_to_eol(ap);
+            continue;
+        }
+        RESET_DATA reset = { (char)letter, 0, 0, 0, 0 };
+        fread_number(ap); // if_flag
+        reset.arg1 = fread_number(ap);
+        reset.arg2 = fread_number(ap);
+        reset.arg3 = letter == 'G' || letter == 'R' ? 0 : fread_number(ap);
+        reset.arg4 = letter == 'P' || letter == 'M' ? fread_number(ap) : 0;
+        fread_to_eol(ap);
+        if (!strchr("MOGEP", letter)) continue;
+
+        RESET_DATA *row = table_append((void **)&w->resets, &w->nresets, &w->resets_cap, sizeof(*row));
+        if (row) *row = reset;
+    }
+}
+
+static void load_shops(AREA_PARSER *ap) {
+    AREA_WORLD *w = &ap->world;
+    for (;;) {
+        int c = fread_letter(ap);
+        if (c == EOF) break;
+        input_ungetc(&ap->in, c);
+        if (c == '#') {
+            ap_error(ap, "Load_shops: 0 not found");
+            break;
+        }
+        long keeper = fread_number(ap);
+        if (keeper == 0) break;
+        fread_to_eol(ap); // Buy types, profits and hours
+        long *row = table_append((void **)&w->shopkeepers, &w->nshops, &w->shops_cap, sizeof(*row));
+        if (row) *row = keeper;
+    }
+}
+
+// Skip a section we don't care about by reading until the next #
+static void skip_section(AREA_PARSER *ap) {
+    for (;;) {
+        int c = fread_letter(ap);
+        if (c == EOF) break;
+        if (c == '#') {
+            input_ungetc(&ap->in, c);
+            break;
+        }
+    }
+}
+
+// Skip a section of #vnum records line by line, through its #0 or, if that
+// is missing, up to the next section header, which is left unread
+static void skip_records(AREA_PARSER *ap) {
+    for (;;) {
+        int c = fread_letter(ap);
+        if (c == EOF) return;
+        if (c == '#') {
+            int next = input_getc(&ap->in);
+            input_ungetc(&ap->in, next);
+            if (isdigit(next) && fread_number(ap) == 0) return;
+            if (isupper(next) || next == '$') {
+                input_ungetc(&ap->in, c);
+                ap_error(ap, "#0 missing before the next section");
+                return;
+            }
+        }
+        fread_to_eol(ap);
+    }
+}
+
+void area_limits_default(AREA_LIMITS *limits) {
+    limits->string = 16 << 10;
+    limits->record = 1 << 20;
+    limits->section = 256 << 20;
+    limits->input = 1 << 30;
+}
+
+void area_parser_init(AREA_PARSER *ap) {
+    memset(ap, 0, sizeof(*ap));
+    ap->keep_objects = true;
+    string_pool_init(&ap->strings);
+}
+
+// A read callback whose first few bytes were taken to sniff the format;
+// they are handed back before anything else
+typedef struct peeked_source {
+    unsigned char head[4];
+    size_t head_len;
+    size_t head_pos;
+    INPUT_READ read;
+    void *ctx;
+} PEEKED_SOURCE;
+
+static void peek_source(PEEKED_SOURCE *src, INPUT_READ read, void *ctx) {
+    src->head_len = 0;
+    src->head_pos = 0;
+    src->read = read;
+    src->ctx = ctx;
+    while (src->head_len < sizeof(src->head)) {
+        size_t n = read(ctx, (char *)src->head + src->head_len, sizeof(src->head) - src->head_len);
+        if (n == 0) break;
+        src->head_len += n;
+    }
+}
+
+static size_t read_peeked(void *ctx, char *dst, size_t len) {
+    PEEKED_SOURCE *src = ctx;
+    if (src->head_pos == src->head_len) return src->read(src->ctx, dst, len);
+    if (len > src->head_len - src->head_pos) len = src->head_len - src->head_pos;
+    memcpy(dst, src->head + src->head_pos, len);
+    src->head_pos += len;
+    return len;
+}
+
+// EXACT MUD LOGIC - copy from db.c
+int area_parse_source(AREA_PARSER *ap, INPUT_READ read, void *ctx, const char *file_name) {
+    double start = monotonic_seconds();
+    double parse_before = ap->stats.parse_seconds;
+    ap->error[0] = '\0';
+
+    // gzip and zstd input is recognized by its magic number and decompressed
+    // a chunk at a time straight into the tokenizer's buffer
+    PEEKED_SOURCE raw;
+    DECOMPRESSOR dz;
+    peek_source(&raw, read, ctx);
+    COMPRESSION kind = compression_detect(raw.head, raw.head_len);
+    if (kind != COMPRESSION_NONE) {
+        if (decompress_init(&dz, kind, read_peeked, &raw) != 0) {
+            snprintf(ap->error, sizeof(ap->error), "%s", dz.error);
+            decompress_free(&dz);
+            return -1;
+        }
+        read = decompress_read;
+        ctx = &dz;
+    } else {
+        read = read_peeked;
+        ctx = &raw;
+    }
+    if (input_init(&ap->in, read, ctx) != 0) {
+        snprintf(ap->error, sizeof(ap->error), "Out of memory for the input buffer");
+        if (kind != COMPRESSION_NONE) decompress_free(&dz);
+        return -1;
+    }
+
+    if (!ap->area) {
+        ap->area = mem_alloc(MEM_OTHER, sizeof(AREA_DATA));
+        ap->area->name = mem_strdup(MEM_OTHER, "Unknown");
+        ap->area->file_name = mem_strdup(MEM_OTHER, file_name ? file_name : "");
+        ap->area->credits = mem_strdup(MEM_OTHER, "Unknown");
+        ap->area->builders = mem_strdup(MEM_OTHER, "Unknown");
+    }
+
+    // Hardened mode: the input limit caps the whole file, each section's
+    // limit caps the section within it
+    long input_end = limit_after(0, ap->limits.input, LONG_MAX);
+    input_set_limit(&ap->in, input_end);
+    ap->section_end = input_end;
+
+    for (;;) {
+        char *word;
+        double section_start = 0;
+        long section_pos = 0;
+        if (ap->trace) {
+            section_start = monotonic_seconds();
+            section_pos = input_tell(&ap->in);
+        }
+        int letter = fread_letter(ap);
+        if (letter == EOF) break;
+        if (letter != '#') {
+            // Stray text between sections: skip it rather than lose the rest
+            input_ungetc(&ap->in, letter);
+            ap_error(ap, "# not found, got '%c', skipping to the next section", letter);
+            fread_to_eol(ap);
+            skip_to_section(ap);
+            continue;
+        }
+
+        word = fread_word(ap);
+        if (!word) break;
+        ap_log(ap, "Read section: %s\n", word);
+
+        // Remove leading # if present
+        const char *section = word[0] == '#' ? word + 1 : word;
+
+        if (section[0] == '$') {
+            mem_free(word);
+            break;
+        }
+        ap->record_vnum = 0;
+        if (ap->limits.section) {
+            ap->section_end = limit_after(input_tell(&ap->in), ap->limits.section, input_end);
+            input_set_limit(&ap->in, ap->section_end);
+        }
+
+        if (!strcmp(section, "AREA"))
+            ; // Skip
+        else if (!strcmp(section, "MOBOLD"))
+            ; // Skip
+        else if (!strcmp(section, "MOBILES") && ap->load_world)
+            load_mobiles(ap);
+        else if (!strcmp(section, "ROOMS") && ap->load_world)
+            load_rooms(ap);
+        else if (!strcmp(section, "RESETS") && ap->load_world)
+            load_resets(ap);
+        else if (!strcmp(section, "SHOPS") && ap->load_world)
+            load_shops(ap);
+        else if (!strcmp(section, "MOBILES") || !strcmp(section, "ROOMS"))
+            skip_records(ap);
+        else if (!strcmp(section, "OBJECTS")) {
+            ap_log(ap, "Found OBJECTS section, calling load_objects\n");
+            double parse_start = monotonic_seconds();
+            load_objects(ap);
+            ap->stats.parse_seconds += monotonic_seconds() - parse_start;
+            ap_log(ap, "load_objects returned\n");
+        }
+        else if (!strcmp(section, "AREADATA") || !strcmp(section, "HELPS")
+                 || !strcmp(section, "OBJOLD") || !strcmp(section, "RESETS")
+                 || !strcmp(section, "SHOPS")
+                 || !strcmp(section, "MOBPROGS") || !strcmp(section, "SPECIALS")) {
+            skip_section(ap);
+        }
+        else {
+            ap_error(ap, "Unknown section: %s", section);
+            skip_to_section(ap);
+        }
+        if (ap->limits.section) {
+            bool over = ap->section_end < input_end && input_at_limit(&ap->in);
+            ap->section_end = input_end;
+            input_set_limit(&ap->in, input_end);
+            if (over) {
+                ap_error(ap, "section %s exceeds %zu bytes, skipping the rest", section, ap->limits.section);
+                skip_to_section(ap);
+            }
+        }
+        if (ap->trace)
+            trace_span(ap->trace, ap->trace_tid, "section", section, section_start,
+                       monotonic_seconds(), "\"bytes\":%ld", input_tell(&ap->in) - section_pos);
+        mem_free(word);
+    }
+
+    if (input_at_limit(&ap->in))
+        ap_error(ap, "input exceeds %zu bytes, ignoring the rest", ap->limits.input);
+    // A damaged archive ends the input early; what was parsed is kept
+    if (kind != COMPRESSION_NONE && dz.error[0]) {
+        ap_error(ap, "%s", dz.error);
+        snprintf(ap->error, sizeof(ap->error), "%s", dz.error);
+    }
+    long end = input_tell(&ap->in);
+    if (ap->trace)
+        trace_span(ap->trace, ap->trace_tid, "area", ap->area->file_name, start,
+                   monotonic_seconds(), "\"bytes\":%ld", end);
+    if (end > 0) ap->stats.bytes_in += end;
+    ap->stats.scan_seconds += monotonic_seconds() - start
+                              - (ap->stats.parse_seconds - parse_before);
+    input_free(&ap->in);
+    if (kind == COMPRESSION_NONE) return 0;
+    decompress_free(&dz);
+    return ap->error[0] ? -1 : 0;
+}
+
+static size_t read_stdio(void *ctx, char *dst, size_t len) {
+    return fread(dst, 1, len, (FILE *)ctx);
+}
+
+// The parser reads ahead, so fp is left past the end of what was parsed
+int area_parse_stream(AREA_PARSER *ap, FILE *fp, const char *file_name) {
+    return area_parse_source(ap, read_stdio, fp, file_name);
+}
+
+typedef struct memory_source {
+    const char *data;
+    size_t len;
+    size_t pos;
+} MEMORY_SOURCE;
+
+static size_t read_memory(void *ctx, char *dst, size_t len) {
+    MEMORY_SOURCE *src = ctx;
+    if (len > src->len - src->pos) len = src->len - src->pos;
+    memcpy(dst, src->data + src->pos, len);
+    src->pos += len;
+    return len;
+}
+
+// Parse an area file already read into memory
+int area_parse_buffer(AREA_PARSER *ap, const char *data, size_t len, const char *file_name) {
+    MEMORY_SOURCE src = { data, len, 0 };
+    return area_parse_source(ap, read_memory, &src, file_name);
+}
+
+int area_parse_file(AREA_PARSER *ap, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        snprintf(ap->error, sizeof(ap->error), "%s", strerror(errno));
+        return -1;
+    }
+    int rc = area_parse_stream(ap, fp, path);
+    fclose(fp);
+    return rc;
+}
+
+void free_object(OBJ_INDEX_DATA *obj) {
+    mem_free(obj->name);
+    mem_free(obj->short_descr);
+    mem_free(obj->description);
+    mem_free(obj->extra_flags_str);
+    mem_free(obj->materia_spell);
+    mem_free(obj->weapon_type);
+    color_text_free(&obj->short_colors);
+    color_text_free(&obj->description_colors);
+    while (obj->affects_out) {
+        AFFECT_OUT *next = obj->affects_out->next;
+        mem_free(obj->affects_out);
+        obj->affects_out = next;
+    }
+    while (obj->extra_descr) {
+        EXTRA_DESCR_DATA *next = obj->extra_descr->next;
+        mem_free(obj->extra_descr->keyword);
+        mem_free(obj->extra_descr->description);
+        mem_free(obj->extra_descr);
+        obj->extra_descr = next;
+    }
+    mem_free(obj);
+}
+
+void area_parser_free(AREA_PARSER *ap) {
+    while (ap->object_list) {
+        OBJ_INDEX_DATA *next = ap->object_list->next;
+        free_object(ap->object_list);
+        ap->object_list = next;
+    }
+    if (ap->area) {
+        mem_free(ap->area->name);
+        mem_free(ap->area->file_name);
+        mem_free(ap->area->credits);
+        mem_free(ap->area->builders);
+        mem_free(ap->area);
+        ap->area = NULL;
+    }
+    mem_free(ap->diagnostics);
+    ap->diagnostics = NULL;
+    ap->ndiagnostics = 0;
+    mem_free(ap->world.mobs);
+    mem_free(ap->world.rooms);
+    mem_free(ap->world.resets);
+    mem_free(ap->world.shopkeepers);
+    memset(&ap->world, 0, sizeof(ap->world));
+    string_pool_free(&ap->strings);
+}
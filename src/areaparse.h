@@ -0,0 +1,239 @@
+#ifndef AREAPARSE_H
+#define AREAPARSE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "color.h"
+#include "flags.h"
+#include "input.h"
+#include "intern.h"
+#include "mem.h"
+#include "trace.h"
+
+#define MAX_STRING_LENGTH 4096
+#define AFFECT_LOCATIONS 41 // APPLY_* numbers, 0 to 40
+
+// Simple data structures
+typedef struct area_data {
+    char *name;
+    char *file_name;
+    char *credits;
+    char *builders;
+} AREA_DATA;
+
+typedef struct affect_data {
+    int where;
+    int type;
+    int level;
+    int duration;
+    int location;
+    int modifier;
+    long bitvector;
+    struct affect_data *next;
+} AFFECT_DATA;
+
+typedef struct extra_descr_data {
+    char *keyword;
+    char *description;
+    struct extra_descr_data *next;
+} EXTRA_DESCR_DATA;
+
+// Strings are interned in the parser's string pool
+typedef struct affect_out {
+    const char *type; // "normal", "flag", "spell"
+    const char *location;
+    int modifier;
+    const char *extra; // for spell name or flag name if needed, else NULL
+    struct affect_out *next;
+} AFFECT_OUT;
+
+struct obj_source;
+
+typedef struct obj_index_data {
+    long vnum;
+    char *name;
+    char *short_descr;
+    char *description;
+    const char *material; // Interned
+    int item_type;
+    int extra_flags;
+    char *extra_flags_str; // Store extra flags as string from area file
+    int wear_flags;
+
+
+    int level;
+    int condition;
+    int weight;
+    int cost;
+    int value[5];
+    char *materia_spell; // For materia items
+    char *weapon_type; // For weapon items
+    const char *damage_type; // For weapon items, interned
+    const char *weapon_flags; // For weapon items, interned
+    AFFECT_DATA *affected;
+    AFFECT_DATA *affected2;
+    EXTRA_DESCR_DATA *extra_descr;
+    AREA_DATA *area;
+    AFFECT_OUT *affects_out;
+    COLOR_TEXT short_colors; // short_descr and description without color codes,
+    COLOR_TEXT description_colors; // with their style runs; set with parse_colors
+    const struct obj_source *sources; // Resets that load it, set by world_link_sources
+    int nsources;
+    struct obj_index_data *next;
+} OBJ_INDEX_DATA;
+
+// The parts of #MOBILES, #ROOMS, #RESETS and #SHOPS that item sources need.
+// Names are interned in the parser's string pool.
+typedef struct mob_index_data {
+    long vnum;
+    const char *short_descr;
+    int level;
+} MOB_INDEX_DATA;
+
+typedef struct room_index_data {
+    long vnum;
+    const char *name;
+} ROOM_INDEX_DATA;
+
+// One M, O, G, E or P line, arguments as the MUD reads them:
+// M mob limit room max, O obj limit room, G obj limit,
+// E obj limit wear_loc, P obj limit container count
+typedef struct reset_data {
+    char command;
+    long arg1;
+    long arg2;
+    long arg3;
+    long arg4;
+} RESET_DATA;
+
+// Tables in file order; world.h indexes them by vnum
+typedef struct area_world {
+    MOB_INDEX_DATA *mobs;
+    int nmobs, mobs_cap;
+    ROOM_INDEX_DATA *rooms;
+    int nrooms, rooms_cap;
+    RESET_DATA *resets;
+    int nresets, resets_cap;
+    long *shopkeepers; // Mob vnums from #SHOPS
+    int nshops, shops_cap;
+} AREA_WORLD;
+
+// Counters and timings collected while parsing
+typedef struct area_stats {
+    double scan_seconds; // Section dispatch and skipped sections
+    double parse_seconds; // Reading #OBJECTS records
+    long bytes_in;
+    int objects;
+    int objects_skipped; // Dropped by object_header
+    int affects;
+    int extra_descrs;
+    int errors; // Malformed input the parser had to step over
+} AREA_STATS;
+
+// Hardened parsing bounds in bytes, each 0 for none. A record (an #OBJECTS,
+// #MOBILES or #ROOMS entry) that runs past its limit or holds a string that
+// does not end within the string limit is dropped and parsing resumes at
+// the next #; an oversized section is skipped to the next section header;
+// input past the input limit is ignored. Each of these counts an error.
+// Strings longer than MAX_STRING_LENGTH but within the limit are truncated
+// (also an error) instead of spilling into the fields after them.
+typedef struct area_limits {
+    size_t string;
+    size_t record;
+    size_t section;
+    size_t input;
+} AREA_LIMITS;
+
+// Bounds generous enough for any real area file
+void area_limits_default(AREA_LIMITS *limits);
+
+// First diagnostics kept per parser; errors past them are only counted
+#define AREA_MAX_DIAGNOSTICS 100
+
+// One piece of malformed input the parser stepped over: where it noticed,
+// which record it was in and what was wrong
+typedef struct area_diagnostic {
+    long offset; // Byte offset in the (decompressed) input
+    long line;
+    long vnum; // The record it was in or had just finished; 0 before a section's first
+    char message[96];
+} AREA_DIAGNOSTIC;
+
+typedef struct area_parser AREA_PARSER;
+
+// SAX-style hooks, all optional. They fire while an #OBJECTS record is being
+// read: object_begin right after the vnum, object_header once the fixed
+// fields up to the condition letter are in, affect/extra_descr once per A/F
+// and E line, and object_end once the record is complete. Returning false
+// from object_header drops the object and skips the rest of its record
+// without decoding it. A record dropped by the hardened limits gets no
+// object_end.
+typedef struct area_callbacks {
+    void (*object_begin)(AREA_PARSER *ap, OBJ_INDEX_DATA *obj, void *user);
+    bool (*object_header)(AREA_PARSER *ap, OBJ_INDEX_DATA *obj, void *user);
+    void (*affect)(AREA_PARSER *ap, OBJ_INDEX_DATA *obj, AFFECT_OUT *affect, void *user);
+    void (*extra_descr)(AREA_PARSER *ap, OBJ_INDEX_DATA *obj, EXTRA_DESCR_DATA *ed, void *user);
+    void (*object_end)(AREA_PARSER *ap, OBJ_INDEX_DATA *obj, void *user);
+} AREA_CALLBACKS;
+
+// Parser context. Everything the parser used to keep in globals and
+// function-local statics lives here, so independent parsers can run
+// concurrently on different threads. Objects point into the context's
+// string pool and must not outlive it.
+struct area_parser {
+    AREA_INPUT in; // Buffered input while a parse is running
+    AREA_DATA *area;
+    OBJ_INDEX_DATA *object_list; // Newest first, as the MUD builds it
+    AREA_CALLBACKS cb;
+    void *user;
+    bool keep_objects; // false: objects are freed right after object_end
+    bool skip_body; // true: skip affect and extra description lines unread
+    bool load_world; // true: read #MOBILES, #ROOMS, #RESETS and #SHOPS into world
+    bool parse_colors; // true: tokenize color codes in short_descr and description
+    FILE *log; // Parse trace destination, NULL for silence
+    TRACE *trace; // Span recorder for sections and slow objects, NULL when off
+    int trace_tid; // Thread id this parser reports under
+    AREA_LIMITS limits; // All 0 unless hardened
+    long section_end; // Where the current section's limit puts the end of input
+    const char *record_bad; // Why the current record is dropped, NULL while it is sound
+    long record_resume; // First #<digit> line a string of the record ran over, 0 for none
+    long record_vnum; // Latest record of the section, for diagnostics
+    AREA_DIAGNOSTIC *diagnostics; // The first AREA_MAX_DIAGNOSTICS errors, in input order
+    int ndiagnostics;
+    STRING_POOL strings; // Shared materials, damage types and affect names
+    AREA_WORLD world;
+    AREA_STATS stats;
+    char error[128]; // Why the last parse call returned -1
+    char buf[MAX_STRING_LENGTH]; // Scratch for fread_string/fread_word
+};
+
+// Parser lifecycle. Input compressed with gzip or zstd is recognized and
+// decompressed as it is read. The parse calls return 0, or -1 with the
+// reason in ap->error; a damaged archive still leaves what was parsed
+// before the damage.
+void area_parser_init(AREA_PARSER *ap);
+int area_parse_file(AREA_PARSER *ap, const char *path);
+int area_parse_stream(AREA_PARSER *ap, FILE *fp, const char *file_name);
+int area_parse_source(AREA_PARSER *ap, INPUT_READ read, void *ctx, const char *file_name);
+int area_parse_buffer(AREA_PARSER *ap, const char *data, size_t len, const char *file_name);
+void area_parser_free(AREA_PARSER *ap);
+void free_object(OBJ_INDEX_DATA *obj);
+
+// Seconds on a monotonic clock, for timing phases
+double monotonic_seconds(void);
+
+// Flag and name helpers
+const char *item_type_name(int type);
+const char *affect_location_name(int loc);
+const char *weapon_type_name(int type);
+const char *damage_type_name(int type);
+
+// Name to number lookups
+int item_lookup(const char *name);
+int weapon_type_lookup(const char *name);
+int spell_lookup(const char *name);
+int affect_location_lookup(const char *name);
+
+#endif
@@ -0,0 +1,585 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "arrow_out.h"
+#include "intern.h"
+#include "mem.h"
+#include "strbuf.h"
+
+// Arrow IPC file format ("Feather v2"): magic, a schema message, dictionary
+// batches, record batches, an end-of-stream marker, and a footer that
+// repeats the schema and indexes the batches. Message metadata and the
+// footer are flatbuffers, built here by hand; bodies are the raw column
+// buffers, each padded to 8 bytes. Everything is little-endian.
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_METADATA_V5 4
+#define ARROW_MAX_BLOCKS 8
+
+// Message header and type union tags from Message.fbs and Schema.fbs
+enum { HEADER_SCHEMA = 1, HEADER_DICTIONARY_BATCH = 2, HEADER_RECORD_BATCH = 3 };
+enum { TYPE_INT = 2, TYPE_UTF8 = 5 };
+
+// Flatbuffer under construction. It is written front to back: a table
+// comes first and the strings, vectors and tables it refers to are
+// appended after it, since flatbuffer offsets must point forward.
+typedef struct fbuilder {
+    STRBUF sb;
+    bool failed;
+} FBUILDER;
+
+static void put_le(FBUILDER *fb, size_t pos, unsigned long long v, int size) {
+    if (fb->failed || pos + size > fb->sb.len) return;
+    for (int i = 0; i < size; ++i)
+        fb->sb.data[pos + i] = (char)(v >> (8 * i));
+}
+
+// Append n zero bytes, returning where they start
+static size_t fb_zero(FBUILDER *fb, size_t n) {
+    static const char zeros[64];
+    size_t pos = fb->sb.len;
+    if (sb_reserve(&fb->sb, n) != 0) {
+        fb->failed = true;
+        return pos;
+    }
+    while (n) {
+        size_t k = n < sizeof(zeros) ? n : sizeof(zeros);
+        sb_append(&fb->sb, zeros, k);
+        n -= k;
+    }
+    return pos;
+}
+
+static void fb_pad(FBUILDER *fb, size_t align) {
+    if (fb->sb.len % align) fb_zero(fb, align - fb->sb.len % align);
+}
+
+// Point the uoffset at at to target, which must come later in the buffer
+static void fb_offset(FBUILDER *fb, size_t at, size_t target) {
+    put_le(fb, at, target - at, 4);
+}
+
+// Lay out a table with the given field sizes (0 for an absent field):
+// vtable first, then the table itself with each field aligned to its
+// size. Returns the table position and each field's position in pos.
+static size_t fb_table(FBUILDER *fb, int nfields, const unsigned char *sizes, size_t *pos) {
+    size_t rel[8] = {0};
+    size_t size = 4; // soffset to the vtable
+    size_t align = 4;
+    for (int i = 0; i < nfields; ++i) {
+        if (!sizes[i]) continue;
+        size = (size + sizes[i] - 1) & ~(size_t)(sizes[i] - 1);
+        rel[i] = size;
+        size += sizes[i];
+        if (sizes[i] > align) align = sizes[i];
+    }
+
+    fb_pad(fb, 2);
+    size_t vtable = fb_zero(fb, 4 + 2 * nfields);
+    fb_pad(fb, align);
+    size_t table = fb_zero(fb, size);
+
+    put_le(fb, vtable, 4 + 2 * nfields, 2);
+    put_le(fb, vtable + 2, size, 2);
+    for (int i = 0; i < nfields; ++i) {
+        put_le(fb, vtable + 4 + 2 * i, rel[i], 2);
+        if (pos) pos[i] = table + rel[i];
+    }
+    put_le(fb, table, table - vtable, 4);
+    return table;
+}
+
+static size_t fb_string(FBUILDER *fb, const char *s) {
+    size_t len = strlen(s);
+    fb_pad(fb, 4);
+    size_t pos = fb_zero(fb, 4 + len + 1);
+    put_le(fb, pos, len, 4);
+    if (!fb->failed) memcpy(fb->sb.data + pos + 4, s, len);
+    return pos;
+}
+
+// Vector of n elements; they start 4 bytes after the returned position
+static size_t fb_vector(FBUILDER *fb, size_t n, size_t elem_size, size_t elem_align) {
+    fb_pad(fb, 4);
+    if ((fb->sb.len + 4) % elem_align) fb_zero(fb, 4);
+    size_t pos = fb_zero(fb, 4 + n * elem_size);
+    put_le(fb, pos, n, 4);
+    return pos;
+}
+
+static size_t fb_int_type(FBUILDER *fb, int bits, bool is_signed) {
+    static const unsigned char sizes[] = {4, 1};
+    size_t pos[2];
+    size_t t = fb_table(fb, 2, sizes, pos);
+    put_le(fb, pos[0], bits, 4);
+    put_le(fb, pos[1], is_signed, 1);
+    return t;
+}
+
+enum arrow_kind { ARROW_INT32, ARROW_UINT32, ARROW_INT64, ARROW_UTF8, ARROW_DICT };
+
+// One column being filled row by row. Dictionary columns intern their
+// strings; pool ids are dense and in first-seen order, so they are the
+// dictionary indexes.
+typedef struct arrow_column {
+    const char *name;
+    int kind;
+    bool nullable;
+    int dict_id; // ARROW_DICT only
+    const FLAG_FAMILY *flags; // Bitset columns: bit names go in the field metadata
+    size_t rows;
+    size_t null_count;
+    STRBUF validity; // One bit per row, kept for nullable columns
+    STRBUF values; // Integers, dictionary indexes, or UTF-8 bytes
+    STRBUF offsets; // ARROW_UTF8: int32 offsets, rows + 1 of them
+    STRING_POOL dict;
+} ARROW_COLUMN;
+
+static int kind_width(int kind) {
+    return kind == ARROW_INT64 ? 8 : 4;
+}
+
+static void append_le(STRBUF *sb, unsigned long long v, int size) {
+    char bytes[8];
+    for (int i = 0; i < size; ++i)
+        bytes[i] = (char)(v >> (8 * i));
+    sb_append(sb, bytes, size);
+}
+
+static void column_init(ARROW_COLUMN *col, const char *name, int kind, bool nullable) {
+    memset(col, 0, sizeof(*col));
+    col->name = name;
+    col->kind = kind;
+    col->nullable = nullable;
+    sb_init(&col->validity);
+    sb_init(&col->values);
+    sb_init(&col->offsets);
+    string_pool_init(&col->dict);
+    if (kind == ARROW_UTF8) append_le(&col->offsets, 0, 4);
+}
+
+static void column_free(ARROW_COLUMN *col) {
+    sb_free(&col->validity);
+    sb_free(&col->values);
+    sb_free(&col->offsets);
+    string_pool_free(&col->dict);
+}
+
+static void column_valid(ARROW_COLUMN *col, bool valid) {
+    if (col->nullable) {
+        if (col->rows % 8 == 0) sb_append(&col->validity, "", 1);
+        if (valid && col->validity.len) col->validity.data[col->validity.len - 1] |= (char)(1 << (col->rows % 8));
+    }
+    if (!valid) col->null_count++;
+    col->rows++;
+}
+
+static void column_int(ARROW_COLUMN *col, long long v) {
+    append_le(&col->values, (unsigned long long)v, kind_width(col->kind));
+    column_valid(col, true);
+}
+
+// NULL appends a null
+static void column_string(ARROW_COLUMN *col, const char *s) {
+    if (col->kind == ARROW_DICT) {
+        int id = s ? string_pool_find(&col->dict, s) : 0;
+        if (id < 0) {
+            string_intern(&col->dict, s);
+            id = col->dict.count - 1;
+        }
+        append_le(&col->values, (unsigned)id, 4);
+    } else {
+        if (s) sb_puts(&col->values, s);
+        append_le(&col->offsets, col->values.len, 4);
+    }
+    column_valid(col, s != NULL);
+}
+
+// True when every buffer grew as far as it should have; a short buffer
+// means an allocation failed along the way
+static bool column_complete(const ARROW_COLUMN *col) {
+    if (col->nullable && col->validity.len != (col->rows + 7) / 8) return false;
+    if (col->kind == ARROW_UTF8) return col->offsets.len == (col->rows + 1) * 4;
+    return col->values.len == col->rows * kind_width(col->kind);
+}
+
+// Comma-separated flag names indexed by bit, empty for unused bits
+static void flag_bit_list(const FLAG_FAMILY *fam, char *out, size_t outlen) {
+    size_t len = 0;
+    out[0] = '\0';
+    for (int bit = 0; bit < 32 && len < outlen; ++bit) {
+        const char *name = fam->defined & (1UL << bit) ? fam->bit_names[bit] : "";
+        len += snprintf(out + len, outlen - len, "%s%s", bit ? "," : "", name);
+    }
+}
+
+static size_t fb_field(FBUILDER *fb, const ARROW_COLUMN *col) {
+    // name, nullable, type_type, type, dictionary, children, custom_metadata
+    unsigned char sizes[7] = {4, 1, 1, 4, 0, 4, 0};
+    if (col->kind == ARROW_DICT) sizes[4] = 4;
+    if (col->flags) sizes[6] = 4;
+    size_t pos[7];
+    size_t t = fb_table(fb, 7, sizes, pos);
+
+    bool text = col->kind == ARROW_UTF8 || col->kind == ARROW_DICT;
+    put_le(fb, pos[1], col->nullable, 1);
+    put_le(fb, pos[2], text ? TYPE_UTF8 : TYPE_INT, 1);
+    fb_offset(fb, pos[0], fb_string(fb, col->name));
+    if (text) fb_offset(fb, pos[3], fb_table(fb, 0, NULL, NULL));
+    else fb_offset(fb, pos[3], fb_int_type(fb, kind_width(col->kind) * 8, col->kind != ARROW_UINT32));
+
+    if (col->kind == ARROW_DICT) {
+        static const unsigned char dsizes[] = {8, 4}; // id, indexType
+        size_t dpos[2];
+        size_t d = fb_table(fb, 2, dsizes, dpos);
+        fb_offset(fb, pos[4], d);
+        put_le(fb, dpos[0], col->dict_id, 8);
+        fb_offset(fb, dpos[1], fb_int_type(fb, 32, true));
+    }
+    fb_offset(fb, pos[5], fb_vector(fb, 0, 4, 4));
+
+    if (col->flags) {
+        char names[32 * (FLAG_NAME_MAX + 1)];
+        flag_bit_list(col->flags, names, sizeof(names));
+        size_t vec = fb_vector(fb, 1, 4, 4);
+        fb_offset(fb, pos[6], vec);
+        static const unsigned char ksizes[] = {4, 4}; // key, value
+        size_t kpos[2];
+        fb_offset(fb, vec + 4, fb_table(fb, 2, ksizes, kpos));
+        fb_offset(fb, kpos[0], fb_string(fb, "flags"));
+        fb_offset(fb, kpos[1], fb_string(fb, names));
+    }
+    return t;
+}
+
+static size_t fb_schema(FBUILDER *fb, const ARROW_COLUMN *cols, int ncols) {
+    static const unsigned char sizes[] = {2, 4}; // endianness, fields
+    size_t pos[2];
+    size_t t = fb_table(fb, 2, sizes, pos);
+    size_t vec = fb_vector(fb, ncols, 4, 4);
+    fb_offset(fb, pos[1], vec);
+    for (int i = 0; i < ncols; ++i)
+        fb_offset(fb, vec + 4 + 4 * i, fb_field(fb, &cols[i]));
+    return t;
+}
+
+// Root Message table; the caller appends the header and points
+// *header at it
+static void fb_message(FBUILDER *fb, int header_type, size_t body_length, size_t *header) {
+    static const unsigned char sizes[] = {2, 1, 4, 8}; // version, header_type, header, bodyLength
+    size_t pos[4];
+    size_t root = fb_zero(fb, 4);
+    fb_offset(fb, root, fb_table(fb, 4, sizes, pos));
+    put_le(fb, pos[0], ARROW_METADATA_V5, 2);
+    put_le(fb, pos[1], header_type, 1);
+    put_le(fb, pos[3], body_length, 8);
+    *header = pos[2];
+}
+
+typedef struct arrow_block {
+    long offset;
+    int metadata_length;
+    long body_length;
+} ARROW_BLOCK;
+
+typedef struct arrow_file {
+    FILE *fp;
+    long pos;
+    bool failed;
+    ARROW_BLOCK dictionaries[ARROW_MAX_BLOCKS];
+    int ndictionaries;
+    ARROW_BLOCK batches[ARROW_MAX_BLOCKS];
+    int nbatches;
+} ARROW_FILE;
+
+static void file_write(ARROW_FILE *f, const void *data, size_t len) {
+    if (f->failed) return;
+    if (len && fwrite(data, 1, len, f->fp) != len) f->failed = true;
+    f->pos += (long)len;
+}
+
+static void file_pad(ARROW_FILE *f) {
+    static const char zeros[8];
+    if (f->pos % 8) file_write(f, zeros, 8 - f->pos % 8);
+}
+
+// Write one encapsulated message: continuation marker, metadata length,
+// the flatbuffer padded to 8, then the body
+static void write_message(ARROW_FILE *f, FBUILDER *fb, const STRBUF *body, ARROW_BLOCK *block) {
+    while (fb->sb.len % 8) fb_zero(fb, 1);
+    if (fb->failed) {
+        f->failed = true;
+        return;
+    }
+    STRBUF prefix;
+    sb_init(&prefix);
+    append_le(&prefix, 0xFFFFFFFFu, 4);
+    append_le(&prefix, fb->sb.len, 4);
+
+    if (block) {
+        block->offset = f->pos;
+        block->metadata_length = (int)(prefix.len + fb->sb.len);
+        block->body_length = body ? (long)body->len : 0;
+    }
+    file_write(f, prefix.data, prefix.len);
+    file_write(f, fb->sb.data, fb->sb.len);
+    if (body) file_write(f, body->data, body->len);
+    sb_free(&prefix);
+}
+
+// Append a buffer to a message body, padded to 8, and note where it went
+static void body_buffer(STRBUF *body, STRBUF *layout, const char *data, size_t len) {
+    static const char zeros[8];
+    append_le(layout, body->len, 8);
+    append_le(layout, len, 8);
+    if (len) sb_append(body, data, len);
+    if (body->len % 8) sb_append(body, zeros, 8 - body->len % 8);
+}
+
+// Body, field nodes and buffer layout of a batch holding these columns
+static void build_batch(const ARROW_COLUMN *cols, int ncols, STRBUF *body, STRBUF *nodes, STRBUF *buffers) {
+    for (int i = 0; i < ncols; ++i) {
+        const ARROW_COLUMN *col = &cols[i];
+        append_le(nodes, col->rows, 8);
+        append_le(nodes, col->null_count, 8);
+        // The validity bitmap may be left out when nothing is null
+        if (col->null_count) body_buffer(body, buffers, col->validity.data, col->validity.len);
+        else body_buffer(body, buffers, NULL, 0);
+        if (col->kind == ARROW_UTF8) body_buffer(body, buffers, col->offsets.data, col->offsets.len);
+        body_buffer(body, buffers, col->values.data, col->values.len);
+    }
+}
+
+// RecordBatch table with its nodes and buffers vectors copied from the
+// prebuilt little-endian struct arrays
+static size_t fb_record_batch(FBUILDER *fb, size_t rows, const STRBUF *nodes, const STRBUF *buffers) {
+    static const unsigned char sizes[] = {8, 4, 4}; // length, nodes, buffers
+    size_t pos[3];
+    size_t t = fb_table(fb, 3, sizes, pos);
+    put_le(fb, pos[0], rows, 8);
+
+    const STRBUF *lists[2] = { nodes, buffers };
+    for (int i = 0; i < 2; ++i) {
+        size_t vec = fb_vector(fb, lists[i]->len / 16, 16, 8);
+        fb_offset(fb, pos[1 + i], vec);
+        if (!fb->failed && lists[i]->len) memcpy(fb->sb.data + vec + 4, lists[i]->data, lists[i]->len);
+    }
+    return t;
+}
+
+// Write cols as one record batch, or, with dict_id >= 0, the single
+// column cols[0] as that dictionary's batch
+static void write_batch(ARROW_FILE *f, const ARROW_COLUMN *cols, int ncols, long dict_id) {
+    STRBUF body, nodes, buffers;
+    sb_init(&body);
+    sb_init(&nodes);
+    sb_init(&buffers);
+    build_batch(cols, ncols, &body, &nodes, &buffers);
+
+    FBUILDER fb = { {NULL, 0, 0}, false };
+    size_t header;
+    ARROW_BLOCK *block;
+    if (dict_id >= 0) {
+        fb_message(&fb, HEADER_DICTIONARY_BATCH, body.len, &header);
+        static const unsigned char sizes[] = {8, 4}; // id, data
+        size_t pos[2];
+        size_t t = fb_table(&fb, 2, sizes, pos);
+        fb_offset(&fb, header, t);
+        put_le(&fb, pos[0], dict_id, 8);
+        fb_offset(&fb, pos[1], fb_record_batch(&fb, cols[0].rows, &nodes, &buffers));
+        block = f->ndictionaries < ARROW_MAX_BLOCKS ? &f->dictionaries[f->ndictionaries++] : NULL;
+    } else {
+        fb_message(&fb, HEADER_RECORD_BATCH, body.len, &header);
+        fb_offset(&fb, header, fb_record_batch(&fb, ncols ? cols[0].rows : 0, &nodes, &buffers));
+        block = f->nbatches < ARROW_MAX_BLOCKS ? &f->batches[f->nbatches++] : NULL;
+    }
+    if (!block) f->failed = true;
+    write_message(f, &fb, &body, block);
+
+    sb_free(&fb.sb);
+    sb_free(&body);
+    sb_free(&nodes);
+    sb_free(&buffers);
+}
+
+static size_t fb_blocks(FBUILDER *fb, const ARROW_BLOCK *blocks, int n) {
+    size_t vec = fb_vector(fb, n, 24, 8);
+    for (int i = 0; i < n; ++i) {
+        size_t at = vec + 4 + 24 * i;
+        put_le(fb, at, blocks[i].offset, 8);
+        put_le(fb, at + 8, blocks[i].metadata_length, 4);
+        put_le(fb, at + 16, blocks[i].body_length, 8);
+    }
+    return vec;
+}
+
+// Write a whole table: schema, one dictionary batch per dictionary
+// column, a single record batch, end of stream and the footer
+static int write_table(const char *path, const ARROW_COLUMN *cols, int ncols) {
+    for (int i = 0; i < ncols; ++i)
+        if (!column_complete(&cols[i])) return -1;
+
+    ARROW_FILE f;
+    memset(&f, 0, sizeof(f));
+    f.fp = fopen(path, "wb");
+    if (!f.fp) return -1;
+
+    file_write(&f, ARROW_MAGIC, strlen(ARROW_MAGIC));
+    file_pad(&f);
+
+    FBUILDER fb = { {NULL, 0, 0}, false };
+    size_t header;
+    fb_message(&fb, HEADER_SCHEMA, 0, &header);
+    fb_offset(&fb, header, fb_schema(&fb, cols, ncols));
+    write_message(&f, &fb, NULL, NULL);
+    sb_free(&fb.sb);
+
+    for (int i = 0; i < ncols; ++i) {
+        if (cols[i].kind != ARROW_DICT) continue;
+        ARROW_COLUMN values;
+        column_init(&values, cols[i].name, ARROW_UTF8, false);
+        for (int id = 0; id < cols[i].dict.count; ++id)
+            column_string(&values, cols[i].dict.strings[id]);
+        if (!column_complete(&values)) f.failed = true;
+        write_batch(&f, &values, 1, cols[i].dict_id);
+        column_free(&values);
+    }
+    write_batch(&f, cols, ncols, -1);
+
+    static const char eos[8] = {'\xff', '\xff', '\xff', '\xff', 0, 0, 0, 0};
+    file_write(&f, eos, sizeof(eos));
+
+    // Footer: version, schema, dictionaries, recordBatches
+    FBUILDER footer = { {NULL, 0, 0}, false };
+    static const unsigned char sizes[] = {2, 4, 4, 4};
+    size_t pos[4];
+    size_t root = fb_zero(&footer, 4);
+    fb_offset(&footer, root, fb_table(&footer, 4, sizes, pos));
+    put_le(&footer, pos[0], ARROW_METADATA_V5, 2);
+    fb_offset(&footer, pos[1], fb_schema(&footer, cols, ncols));
+    fb_offset(&footer, pos[2], fb_blocks(&footer, f.dictionaries, f.ndictionaries));
+    fb_offset(&footer, pos[3], fb_blocks(&footer, f.batches, f.nbatches));
+    if (footer.failed) f.failed = true;
+
+    STRBUF tail;
+    sb_init(&tail);
+    append_le(&tail, footer.sb.len, 4);
+    sb_puts(&tail, ARROW_MAGIC);
+    file_write(&f, footer.sb.data, footer.sb.len);
+    file_write(&f, tail.data, tail.len);
+    sb_free(&tail);
+    sb_free(&footer.sb);
+
+    if (fclose(f.fp) != 0) f.failed = true;
+    return f.failed ? -1 : 0;
+}
+
+// Build under path.tmp and rename into place
+static int write_table_atomically(const char *path, const ARROW_COLUMN *cols, int ncols) {
+    size_t len = strlen(path) + 5;
+    char *tmp = mem_alloc(MEM_OTHER, len);
+    if (!tmp) return -1;
+    snprintf(tmp, len, "%s.tmp", path);
+
+    int rc = write_table(tmp, cols, ncols);
+    if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+    if (rc != 0) remove(tmp);
+    mem_free(tmp);
+    return rc;
+}
+
+enum {
+    OBJ_VNUM, OBJ_AREA, OBJ_NAME, OBJ_TYPE, OBJ_LEVEL, OBJ_CONDITION, OBJ_WEIGHT, OBJ_COST,
+    OBJ_V0, OBJ_WEAR = OBJ_V0 + 5, OBJ_EXTRA, OBJ_COLUMNS
+};
+
+enum { AFF_VNUM, AFF_AREA, AFF_TYPE, AFF_LOCATION, AFF_MODIFIER, AFF_EXTRA, AFF_COLUMNS };
+
+static void init_object_columns(ARROW_COLUMN *c) {
+    static const char *value_names[5] = {"v0", "v1", "v2", "v3", "v4"};
+    column_init(&c[OBJ_VNUM], "vnum", ARROW_INT64, false);
+    column_init(&c[OBJ_AREA], "area", ARROW_INT32, false);
+    column_init(&c[OBJ_NAME], "name", ARROW_UTF8, false);
+    column_init(&c[OBJ_TYPE], "type", ARROW_DICT, false);
+    column_init(&c[OBJ_LEVEL], "level", ARROW_INT32, false);
+    column_init(&c[OBJ_CONDITION], "condition", ARROW_INT32, false);
+    column_init(&c[OBJ_WEIGHT], "weight", ARROW_INT32, false);
+    column_init(&c[OBJ_COST], "cost", ARROW_INT32, false);
+    for (int i = 0; i < 5; ++i)
+        column_init(&c[OBJ_V0 + i], value_names[i], ARROW_INT32, false);
+    column_init(&c[OBJ_WEAR], "wear_flags", ARROW_UINT32, false);
+    column_init(&c[OBJ_EXTRA], "extra_flags", ARROW_UINT32, false);
+    c[OBJ_WEAR].flags = &flag_wear;
+    c[OBJ_EXTRA].flags = &flag_extra;
+}
+
+static void init_affect_columns(ARROW_COLUMN *c) {
+    column_init(&c[AFF_VNUM], "vnum", ARROW_INT64, false);
+    column_init(&c[AFF_AREA], "area", ARROW_INT32, false);
+    column_init(&c[AFF_TYPE], "type", ARROW_DICT, false);
+    column_init(&c[AFF_LOCATION], "location", ARROW_DICT, false);
+    column_init(&c[AFF_MODIFIER], "modifier", ARROW_INT32, false);
+    column_init(&c[AFF_EXTRA], "extra", ARROW_DICT, true);
+    c[AFF_LOCATION].dict_id = 1;
+    c[AFF_EXTRA].dict_id = 2;
+}
+
+int arrow_export(const char *base, const OBJ_REF *refs, size_t nrefs, char *err, size_t errlen) {
+    ARROW_COLUMN objects[OBJ_COLUMNS];
+    ARROW_COLUMN affects[AFF_COLUMNS];
+    init_object_columns(objects);
+    init_affect_columns(affects);
+
+    for (size_t i = 0; i < nrefs; ++i) {
+        const OBJ_INDEX_DATA *obj = refs[i].obj;
+        column_int(&objects[OBJ_VNUM], obj->vnum);
+        column_int(&objects[OBJ_AREA], refs[i].area);
+        column_string(&objects[OBJ_NAME], obj->name ? obj->name : "");
+        column_string(&objects[OBJ_TYPE], item_type_name(obj->item_type));
+        column_int(&objects[OBJ_LEVEL], obj->level);
+        column_int(&objects[OBJ_CONDITION], obj->condition);
+        column_int(&objects[OBJ_WEIGHT], obj->weight);
+        column_int(&objects[OBJ_COST], obj->cost);
+        for (int v = 0; v < 5; ++v)
+            column_int(&objects[OBJ_V0 + v], obj->value[v]);
+        column_int(&objects[OBJ_WEAR], (unsigned)obj->wear_flags);
+        column_int(&objects[OBJ_EXTRA], (unsigned)obj->extra_flags);
+
+        for (const AFFECT_OUT *ao = obj->affects_out; ao; ao = ao->next) {
+            column_int(&affects[AFF_VNUM], obj->vnum);
+            column_int(&affects[AFF_AREA], refs[i].area);
+            column_string(&affects[AFF_TYPE], ao->type);
+            column_string(&affects[AFF_LOCATION], ao->location);
+            column_int(&affects[AFF_MODIFIER], ao->modifier);
+            column_string(&affects[AFF_EXTRA], ao->extra && ao->extra[0] ? ao->extra : NULL);
+        }
+    }
+
+    size_t len = strlen(base) + sizeof(".objects.arrow");
+    char *path = mem_alloc(MEM_OTHER, len);
+    int rc = -1;
+    if (!path) {
+        snprintf(err, errlen, "out of memory");
+    } else {
+        snprintf(path, len, "%s.objects.arrow", base);
+        if (write_table_atomically(path, objects, OBJ_COLUMNS) != 0) {
+            snprintf(err, errlen, "cannot write %s", path);
+        } else {
+            snprintf(path, len, "%s.affects.arrow", base);
+            if (write_table_atomically(path, affects, AFF_COLUMNS) != 0)
+                snprintf(err, errlen, "cannot write %s", path);
+            else
+                rc = 0;
+        }
+    }
+
+    mem_free(path);
+    for (int i = 0; i < OBJ_COLUMNS; ++i)
+        column_free(&objects[i]);
+    for (int i = 0; i < AFF_COLUMNS; ++i)
+        column_free(&affects[i]);
+    return rc;
+}
@@ -0,0 +1,14 @@
+#ifndef ARROW_OUT_H
+#define ARROW_OUT_H
+
+#include <stddef.h>
+
+#include "areaparse.h"
+#include "sort.h"
+
+// Write the objects (in refs order) as two Arrow IPC files,
+// base.objects.arrow and base.affects.arrow. Each is built under a .tmp
+// name and renamed into place. Returns 0, or -1 with a message in err.
+int arrow_export(const char *base, const OBJ_REF *refs, size_t nrefs, char *err, size_t errlen);
+
+#endif
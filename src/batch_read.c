@@ -0,0 +1,498 @@
+#define _GNU_SOURCE // syscall(), for io_uring calls libc doesn't wrap
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#include "batch_read.h"
+#include "mem.h"
+
+static void push_ready(BATCH_READER *r, BATCH_FILE *f) {
+    pthread_mutex_lock(&r->lock);
+    f->queued = true;
+    r->ready[r->ready_tail++] = f->index;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// A free buffer slot, waiting for a worker to release one if block is set;
+// -1 if none is free and block isn't
+static int take_slot(BATCH_READER *r, bool block) {
+    int slot = -1;
+    pthread_mutex_lock(&r->lock);
+    while (block && !r->nfree)
+        pthread_cond_wait(&r->changed, &r->lock);
+    if (r->nfree) slot = r->free_slots[--r->nfree];
+    pthread_mutex_unlock(&r->lock);
+    return slot;
+}
+
+// Point f at room for its size, cut to the reader's maximum: its slot, or
+// a buffer of its own
+static int attach_buffer(BATCH_READER *r, BATCH_FILE *f) {
+    if (r->max_size && f->size > r->max_size) f->size = r->max_size;
+    if (f->size <= BATCH_SLOT_SIZE) {
+        f->data = r->arena + (size_t)f->slot * BATCH_SLOT_SIZE;
+        return 0;
+    }
+    f->heap = mem_alloc(MEM_INPUT, f->size);
+    if (!f->heap) {
+        f->error = ENOMEM;
+        return -1;
+    }
+    f->data = f->heap;
+    return 0;
+}
+
+// Pipes, FIFOs and files that report no size (/dev/stdin, <(zcat ...))
+// are read until end of input into a buffer of their own that grows as
+// needed, up to the reader's maximum
+static void read_stream(BATCH_READER *r, BATCH_FILE *f, int fd) {
+    size_t cap = 0;
+    while (!r->max_size || f->len < r->max_size) {
+        if (f->len == cap) {
+            size_t ncap = cap ? cap * 2 : BATCH_SLOT_SIZE;
+            char *grown = mem_realloc(MEM_INPUT, f->heap, ncap);
+            if (!grown) {
+                f->error = ENOMEM;
+                break;
+            }
+            f->heap = f->data = grown;
+            cap = ncap;
+        }
+        size_t want = cap - f->len;
+        if (r->max_size && want > r->max_size - f->len) want = r->max_size - f->len;
+        ssize_t n = read(fd, f->data + f->len, want);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) f->error = errno;
+        if (n <= 0) break;
+        f->len += (size_t)n;
+    }
+    f->size = f->len;
+}
+
+static void read_with_pread(BATCH_READER *r, BATCH_FILE *f) {
+    struct stat st;
+    int fd = open(r->paths[f->index], O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        f->error = errno;
+        if (fd >= 0) close(fd);
+        return;
+    }
+    f->size = (size_t)st.st_size;
+    f->stream = !S_ISREG(st.st_mode) || f->size == 0;
+    if (f->stream) {
+        read_stream(r, f, fd);
+    } else if (attach_buffer(r, f) == 0) {
+        while (f->len < f->size) {
+            ssize_t n = pread(fd, f->data + f->len, f->size - f->len, (off_t)f->len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) f->error = errno;
+            if (n <= 0) break; // An error, or the file shrank since the stat
+            f->len += (size_t)n;
+        }
+    }
+    close(fd);
+}
+
+static void *pread_thread(void *arg) {
+    BATCH_READER *r = arg;
+    for (int i = 0; i < r->npaths; ++i) {
+        BATCH_FILE *f = &r->files[i];
+        f->slot = take_slot(r, true);
+        read_with_pread(r, f);
+        push_ready(r, f);
+    }
+    return NULL;
+}
+
+#ifdef HAVE_IO_URING
+
+enum { OP_OPEN, OP_STATX, OP_READ, OP_CLOSE };
+
+// Completion user_data: the file index and which of its operations it was
+#define RING_TAG(index, op) ((uint64_t)(index) << 2 | (op))
+
+// The submission and completion queues, mapped from the kernel as the
+// io_uring_setup(2) layout describes. Only the reader thread touches them.
+struct batch_ring {
+    int fd;
+    unsigned entries;
+    void *sq_map;
+    size_t sq_map_len;
+    void *cq_map; // Same as sq_map with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned sq_local_tail; // Prepared entries, published on submit
+    unsigned to_submit;
+    int ops; // Submitted and not yet completed
+    bool fixed; // Slots are registered buffers
+    struct statx *stats; // One per slot
+};
+
+static void ring_free(struct batch_ring *ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_map && ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_len);
+    if (ring->sq_map) munmap(ring->sq_map, ring->sq_map_len);
+    if (ring->fd >= 0) close(ring->fd);
+    mem_free(ring->stats);
+    mem_free(ring);
+}
+
+static void *map_ring(int fd, size_t len, off_t offset) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// The kernel must know every operation the reader issues
+static bool ring_supported(int fd) {
+    enum { PROBE_OPS = 256 };
+    static const int needed[] = {
+        IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE
+    };
+    struct io_uring_probe *probe = mem_calloc(MEM_OTHER, 1, sizeof(*probe) + PROBE_OPS * sizeof(probe->ops[0]));
+    if (!probe) return false;
+    bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) == 0;
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); ++i)
+        ok = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    mem_free(probe);
+    return ok;
+}
+
+// Set up a ring for r's slots, registering them as fixed buffers if the
+// locked-memory limit allows. NULL if io_uring is unavailable.
+static struct batch_ring *ring_open(BATCH_READER *r) {
+    struct batch_ring *ring = mem_calloc(MEM_OTHER, 1, sizeof(*ring));
+    if (!ring) return NULL;
+    ring->fd = -1;
+
+    // Per slot: a close left over from its last file, then an open and a
+    // statx (or a read) for the next; the completion queue is twice this
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, 4 * r->nslots, &p);
+    ring->stats = mem_calloc(MEM_OTHER, r->nslots, sizeof(*ring->stats));
+    if (ring->fd < 0 || !ring->stats || !ring_supported(ring->fd)) goto fail;
+
+    ring->entries = p.sq_entries;
+    ring->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_len > ring->sq_map_len) ring->sq_map_len = ring->cq_map_len;
+        ring->cq_map_len = ring->sq_map_len;
+    }
+    ring->sq_map = map_ring(ring->fd, ring->sq_map_len, IORING_OFF_SQ_RING);
+    if (!ring->sq_map) goto fail;
+    ring->cq_map = (p.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_map
+                   : map_ring(ring->fd, ring->cq_map_len, IORING_OFF_CQ_RING);
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = map_ring(ring->fd, ring->sqes_len, IORING_OFF_SQES);
+    if (!ring->cq_map || !ring->sqes) goto fail;
+
+    char *sq = ring->sq_map, *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->sq_local_tail = *ring->sq_tail;
+
+    struct iovec *iov = mem_alloc(MEM_OTHER, r->nslots * sizeof(*iov));
+    if (iov) {
+        for (int i = 0; i < r->nslots; ++i) {
+            iov[i].iov_base = r->arena + (size_t)i * BATCH_SLOT_SIZE;
+            iov[i].iov_len = BATCH_SLOT_SIZE;
+        }
+        ring->fixed = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                              iov, r->nslots) == 0;
+        mem_free(iov);
+    }
+    return ring;
+
+fail:
+    ring_free(ring);
+    return NULL;
+}
+
+// Hand queued entries to the kernel and, with wait, block until at least
+// one completion is posted
+static int ring_enter(struct batch_ring *ring, unsigned wait) {
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    for (;;) {
+        long n = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait,
+                         wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (n >= 0) {
+            ring->to_submit -= (unsigned)n;
+            return 0;
+        }
+        if (errno != EINTR) return -1;
+    }
+}
+
+// The next free submission entry, zeroed. The ring is sized so it never
+// fills, but if it does the queued entries are submitted first.
+static struct io_uring_sqe *ring_sqe(struct batch_ring *ring, uint64_t tag) {
+    while (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries) {
+        if (ring_enter(ring, 0) != 0) return NULL;
+    }
+    unsigned idx = ring->sq_local_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = tag;
+    ring->sq_array[idx] = idx;
+    ring->sq_local_tail++;
+    ring->to_submit++;
+    ring->ops++;
+    return sqe;
+}
+
+static void start_file(BATCH_READER *r, BATCH_FILE *f) {
+    struct batch_ring *ring = r->ring;
+    const char *path = r->paths[f->index];
+
+    f->pending = 2;
+    struct io_uring_sqe *sqe = ring_sqe(ring, RING_TAG(f->index, OP_OPEN));
+    if (sqe) {
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t)path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    }
+    sqe = ring_sqe(ring, RING_TAG(f->index, OP_STATX));
+    if (sqe) {
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t)path;
+        sqe->len = STATX_SIZE | STATX_TYPE;
+        sqe->off = (uintptr_t)&ring->stats[f->slot];
+    }
+}
+
+static void submit_read(BATCH_READER *r, BATCH_FILE *f) {
+    struct batch_ring *ring = r->ring;
+    size_t want = f->size - f->len;
+    struct io_uring_sqe *sqe = ring_sqe(ring, RING_TAG(f->index, OP_READ));
+    if (!sqe) return;
+    sqe->opcode = ring->fixed && !f->heap ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = f->fd;
+    sqe->addr = (uintptr_t)(f->data + f->len);
+    sqe->len = want > (1u << 30) ? 1u << 30 : (unsigned)want;
+    sqe->off = f->len;
+    if (sqe->opcode == IORING_OP_READ_FIXED) sqe->buf_index = (unsigned short)f->slot;
+}
+
+// The file is read (or has failed): close it in the background and queue it
+static void finish_file(BATCH_READER *r, BATCH_FILE *f) {
+    if (f->fd >= 0) {
+        struct io_uring_sqe *sqe = ring_sqe(r->ring, RING_TAG(f->index, OP_CLOSE));
+        if (sqe) {
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = f->fd;
+        } else {
+            close(f->fd);
+        }
+        f->fd = -1;
+    }
+    push_ready(r, f);
+}
+
+// Both the open and the statx are back: start reading. A stream is read
+// right here, with blocking reads, since its end can't be known up front.
+static void file_opened(BATCH_READER *r, BATCH_FILE *f) {
+    if (!f->error && f->stream) {
+        read_stream(r, f, f->fd);
+        finish_file(r, f);
+    } else if (f->error || attach_buffer(r, f) != 0) {
+        finish_file(r, f);
+    } else {
+        submit_read(r, f);
+    }
+}
+
+static void complete(BATCH_READER *r, const struct io_uring_cqe *cqe) {
+    BATCH_FILE *f = &r->files[cqe->user_data >> 2];
+    int res = cqe->res;
+
+    r->ring->ops--;
+    switch (cqe->user_data & 3) {
+    case OP_OPEN:
+        if (res < 0) f->error = -res;
+        else f->fd = res;
+        if (--f->pending == 0) file_opened(r, f);
+        break;
+    case OP_STATX:
+        if (res < 0 && !f->error) f->error = -res;
+        else if (res >= 0) {
+            const struct statx *st = &r->ring->stats[f->slot];
+            f->size = (size_t)st->stx_size;
+            f->stream = !S_ISREG(st->stx_mode) || f->size == 0;
+        }
+        if (--f->pending == 0) file_opened(r, f);
+        break;
+    case OP_READ:
+        if (res == -EINTR || res == -EAGAIN) {
+            submit_read(r, f);
+        } else if (res < 0) {
+            f->error = -res;
+            finish_file(r, f);
+        } else {
+            f->len += (size_t)res;
+            // Zero means the file shrank since the statx
+            if (res > 0 && f->len < f->size) submit_read(r, f);
+            else finish_file(r, f);
+        }
+        break;
+    case OP_CLOSE:
+        break;
+    }
+}
+
+static void *uring_thread(void *arg) {
+    BATCH_READER *r = arg;
+    struct batch_ring *ring = r->ring;
+    int next = 0; // Next file to start
+
+    for (;;) {
+        int slot;
+        while (next < r->npaths && (slot = take_slot(r, false)) >= 0) {
+            r->files[next].slot = slot;
+            start_file(r, &r->files[next++]);
+        }
+        if (!ring->ops) {
+            if (next == r->npaths) break;
+            // Every buffer is with a worker; wait for one to come back
+            r->files[next].slot = take_slot(r, true);
+            start_file(r, &r->files[next++]);
+        }
+        if (ring_enter(ring, 1) != 0) break;
+
+        unsigned head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            complete(r, &ring->cqes[head & *ring->cq_mask]);
+            head++;
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    // The ring failed: whatever hasn't been queued gets an error
+    pthread_mutex_lock(&r->lock);
+    for (int i = 0; i < r->npaths; ++i) {
+        BATCH_FILE *f = &r->files[i];
+        if (f->queued) continue;
+        f->error = EIO;
+        f->queued = true;
+        r->ready[r->ready_tail++] = i;
+    }
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+#endif
+
+int batch_reader_start(BATCH_READER *r, const char **paths, int npaths, int nslots, size_t max_size) {
+    memset(r, 0, sizeof(*r));
+    r->paths = paths;
+    r->npaths = npaths;
+    r->max_size = max_size;
+    if (nslots > npaths) nslots = npaths;
+    if (nslots < 1) nslots = 1;
+    r->nslots = nslots;
+
+    r->files = mem_calloc(MEM_INPUT, npaths ? npaths : 1, sizeof(*r->files));
+    r->arena = mem_alloc(MEM_INPUT, (size_t)nslots * BATCH_SLOT_SIZE);
+    r->free_slots = mem_alloc(MEM_INPUT, nslots * sizeof(*r->free_slots));
+    r->ready = mem_alloc(MEM_INPUT, (npaths ? npaths : 1) * sizeof(*r->ready));
+    if (!r->files || !r->arena || !r->free_slots || !r->ready) goto fail;
+    for (int i = 0; i < npaths; ++i) {
+        r->files[i].index = i;
+        r->files[i].fd = -1;
+        r->files[i].slot = -1;
+    }
+    for (int i = 0; i < nslots; ++i)
+        r->free_slots[r->nfree++] = nslots - 1 - i;
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->changed, NULL);
+#ifdef HAVE_IO_URING
+    r->ring = ring_open(r);
+    r->uring = r->ring != NULL;
+    if (pthread_create(&r->thread, NULL, r->uring ? uring_thread : pread_thread, r) == 0)
+        return 0;
+    if (r->ring) ring_free(r->ring);
+#else
+    if (pthread_create(&r->thread, NULL, pread_thread, r) == 0)
+        return 0;
+#endif
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->changed);
+
+fail:
+    mem_free(r->files);
+    mem_free(r->arena);
+    mem_free(r->free_slots);
+    mem_free(r->ready);
+    memset(r, 0, sizeof(*r));
+    return -1;
+}
+
+BATCH_FILE *batch_reader_next(BATCH_READER *r) {
+    BATCH_FILE *f = NULL;
+    pthread_mutex_lock(&r->lock);
+    while (r->ready_head == r->ready_tail && r->delivered < r->npaths)
+        pthread_cond_wait(&r->changed, &r->lock);
+    if (r->ready_head < r->ready_tail) {
+        f = &r->files[r->ready[r->ready_head++]];
+        r->delivered++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return f;
+}
+
+void batch_reader_release(BATCH_READER *r, BATCH_FILE *f) {
+    mem_free(f->heap);
+    f->heap = NULL;
+    f->data = NULL;
+    if (f->slot < 0) return;
+    pthread_mutex_lock(&r->lock);
+    r->free_slots[r->nfree++] = f->slot;
+    f->slot = -1;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void batch_reader_finish(BATCH_READER *r) {
+    if (!r->files) return;
+    pthread_join(r->thread, NULL);
+#ifdef HAVE_IO_URING
+    if (r->ring) ring_free(r->ring);
+#endif
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->changed);
+    mem_free(r->files);
+    mem_free(r->arena);
+    mem_free(r->free_slots);
+    mem_free(r->ready);
+    memset(r, 0, sizeof(*r));
+}
+
+const char *batch_reader_backend(const BATCH_READER *r) {
+    return r->uring ? "io_uring" : "pread";
+}
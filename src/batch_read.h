@@ -0,0 +1,75 @@
+#ifndef BATCH_READ_H
+#define BATCH_READ_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Files up to this size are read into one of the reader's fixed buffers;
+// larger ones get a buffer of their own
+#define BATCH_SLOT_SIZE (1 << 20)
+
+// One file read whole into memory, as handed out by batch_reader_next
+typedef struct batch_file {
+    int index; // Position in the path list
+    char *data;
+    size_t len;
+    int error; // errno if the file could not be opened or read, else 0
+    int slot; // Fixed buffer the file holds until it is released
+    char *heap; // Buffer of its own when larger than a slot, else NULL
+    int fd;
+    size_t size; // Expected length, from statx
+    bool stream; // A pipe or the like, with no size: read until end of input
+    int pending; // Open and statx completions still outstanding
+    bool queued; // Read (or failed) and waiting for a worker, or handed out
+} BATCH_FILE;
+
+struct batch_ring;
+
+// Reads a list of files on a background thread and queues each as soon
+// as it is complete, so parse workers can start on whichever file arrives
+// first. On Linux the reads go through io_uring: opens, stats and reads
+// for many files are in flight at once, into registered buffers. Elsewhere,
+// or if the kernel refuses, files are read one after another with pread.
+// At most nslots files are held at a time, read or being read; a worker
+// hands its file back with batch_reader_release.
+typedef struct batch_reader {
+    const char **paths;
+    int npaths;
+    size_t max_size; // Bytes read per file at most, 0 for all
+    BATCH_FILE *files;
+    char *arena; // nslots buffers of BATCH_SLOT_SIZE bytes
+    int nslots;
+    int *free_slots;
+    int nfree;
+    int *ready; // Queue of read file indexes
+    int ready_head;
+    int ready_tail;
+    int delivered; // Files handed out so far
+    bool uring; // false: the pread fallback is in use
+    struct batch_ring *ring;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} BATCH_READER;
+
+// Start reading paths (which must outlive the reader) with nslots buffers,
+// each file only up to its first max_size bytes unless that is 0.
+// Returns 0, or -1 if out of memory or the thread can't be started.
+int batch_reader_start(BATCH_READER *r, const char **paths, int npaths, int nslots, size_t max_size);
+
+// The next read file, in completion order, waiting if none is ready yet.
+// NULL once every file has been handed out. Safe to call from any thread.
+BATCH_FILE *batch_reader_next(BATCH_READER *r);
+
+// Give a file's buffer back so another file can be read into it
+void batch_reader_release(BATCH_READER *r, BATCH_FILE *f);
+
+// Wait for the reader thread and free everything; every file handed out
+// must have been released
+void batch_reader_finish(BATCH_READER *r);
+
+// "io_uring" or "pread"
+const char *batch_reader_backend(const BATCH_READER *r);
+
+#endif
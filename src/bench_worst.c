@@ -0,0 +1,150 @@
+// Worst-case input benchmark for make bench: builds adversarial area files
+// in memory at N and 4N bytes and times the parser on each, plain and with
+// the hardened limits. Parse time should grow with the input (a 4N/N ratio
+// near 4) and peak heap should stay flat, apart from distinct strings the
+// input adds to the string pool.
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "areaparse.h"
+#include "mem.h"
+#include "strbuf.h"
+
+#define BENCH_RUNS 3 // Best of, per size
+
+static const char header[] = "#AREADATA\nName Bench~\nEnd\n\n";
+static const char footer[] = "\n#0\n\n#$\n";
+
+static void record(STRBUF *sb, long vnum, const char *values) {
+    sb_printf(sb, "#%ld\nthing~\na thing~\nA thing is here.~\niron~\ntrash 0 A %s\n1 1 1 P\n", vnum, values);
+}
+
+// One object whose first value is 1|1|1|... across the whole input
+static void flag_chain(STRBUF *sb, size_t size) {
+    sb_printf(sb, "%s#OBJECTS\n#1\nchain~\na chain~\nA chain.~\niron~\ntrash 0 A ", header);
+    while (sb->len < size) sb_puts(sb, "1|1|1|1|1|1|1|1|");
+    sb_printf(sb, "1 0 0 0 0\n1 1 1 P%s", footer);
+}
+
+// A name that never gets its ~, then ordinary records with none either
+static void unterminated(STRBUF *sb, size_t size) {
+    sb_printf(sb, "%s#OBJECTS\n#1\nrunaway name ", header);
+    while (sb->len < size / 2) sb_puts(sb, "no tilde in sight, ");
+    sb_puts(sb, "\n");
+    for (long vnum = 2; sb->len < size; ++vnum)
+        sb_printf(sb, "#%ld\nthing\ntrash 0 A 0 0 0 0 0\n1 1 1 P\n", vnum);
+    sb_puts(sb, footer);
+}
+
+// A #MOBILES section that is nothing but # words
+static void hash_flood(STRBUF *sb, size_t size) {
+    sb_printf(sb, "%s#MOBILES\n", header);
+    while (sb->len < size) sb_puts(sb, "#x #y #z #\n");
+    sb_puts(sb, footer);
+}
+
+// Records whose descriptions are 8k: past MAX_STRING_LENGTH, within the
+// hardened string limit
+static void long_strings(STRBUF *sb, size_t size) {
+    sb_printf(sb, "%s#OBJECTS\n", header);
+    for (long vnum = 1; sb->len < size; ++vnum) {
+        sb_printf(sb, "#%ld\nthing~\na thing~\n", vnum);
+        for (int i = 0; i < 8192 / 32; ++i) sb_puts(sb, "A long, long description line. ");
+        sb_puts(sb, "~\niron~\ntrash 0 A 0 0 0 0 0\n1 1 1 P\n");
+    }
+    sb_puts(sb, footer);
+}
+
+// As many of the smallest records as fit
+static void tiny_records(STRBUF *sb, size_t size) {
+    sb_printf(sb, "%s#OBJECTS\n", header);
+    for (long vnum = 1; sb->len < size; ++vnum) record(sb, vnum, "0 0 0 0 0");
+    sb_puts(sb, footer);
+}
+
+// One object whose extra flags are a single run of letters
+static void letter_run(STRBUF *sb, size_t size) {
+    sb_printf(sb, "%s#OBJECTS\n#1\nflags~\nflags~\nFlags.~\niron~\ntrash ", header);
+    while (sb->len < size) sb_puts(sb, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef");
+    sb_printf(sb, " A 0 0 0 0 0\n1 1 1 P%s", footer);
+}
+
+static const struct {
+    const char *name;
+    void (*build)(STRBUF *sb, size_t size);
+} cases[] = {
+    {"flag chain", flag_chain},
+    {"unterminated ~", unterminated},
+    {"# flood", hash_flood},
+    {"long strings", long_strings},
+    {"tiny records", tiny_records},
+    {"letter run", letter_run},
+    {NULL, NULL}
+};
+
+typedef struct bench_run {
+    double seconds;
+    int objects;
+    int errors;
+    long peak_bytes;
+} BENCH_RUN;
+
+static BENCH_RUN run(const STRBUF *input, const AREA_LIMITS *limits) {
+    BENCH_RUN best = {0};
+    for (int i = 0; i < BENCH_RUNS; ++i) {
+        AREA_PARSER ap;
+        MEM_USAGE usage[MEM_CATEGORIES], total;
+        mem_reset_peak();
+        mem_usage(usage, &total);
+        long live = total.live_bytes;
+        area_parser_init(&ap);
+        ap.keep_objects = false;
+        if (limits) ap.limits = *limits;
+        double start = monotonic_seconds();
+        area_parse_buffer(&ap, input->data, input->len, "bench");
+        double seconds = monotonic_seconds() - start;
+        mem_usage(usage, &total);
+        if (!i || seconds < best.seconds) best.seconds = seconds;
+        best.objects = ap.stats.objects;
+        best.errors = ap.stats.errors;
+        best.peak_bytes = total.peak_bytes - live;
+        area_parser_free(&ap);
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = (argc > 1 ? (size_t)atol(argv[1]) : 4) << 20;
+    if (argc > 2 || size == 0) {
+        fprintf(stderr, "Usage: %s [MB]\n", argv[0]);
+        return 1;
+    }
+    mem_accounting(true);
+    AREA_LIMITS hardened;
+    area_limits_default(&hardened);
+
+    printf("%-15s %-8s %9s %9s %6s %8s %7s %10s\n", "case", "mode", "N MB/s", "4N MB/s", "4N/N",
+           "objects", "errors", "peak heap");
+    for (int c = 0; cases[c].name; ++c) {
+        STRBUF small, large;
+        sb_init(&small);
+        sb_init(&large);
+        cases[c].build(&small, size);
+        cases[c].build(&large, size * 4);
+        for (int mode = 0; mode < 2; ++mode) {
+            const AREA_LIMITS *limits = mode ? &hardened : NULL;
+            BENCH_RUN a = run(&small, limits);
+            BENCH_RUN b = run(&large, limits);
+            printf("%-15s %-8s %9.1f %9.1f %6.2f %8d %7d %9ldK\n", cases[c].name, mode ? "hardened" : "plain",
+                   small.len / a.seconds / 1e6, large.len / b.seconds / 1e6, b.seconds / a.seconds,
+                   b.objects, b.errors, (b.peak_bytes + 1023) / 1024);
+            fflush(stdout);
+        }
+        sb_free(&small);
+        sb_free(&large);
+    }
+    return 0;
+}
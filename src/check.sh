@@ -0,0 +1,203 @@
+#!/bin/sh
+# Regression checks for make check: small area files are written on the fly
+# and run through area_to_json, and the output is checked for what must hold
+set -u
+
+BIN=${BIN:-./area_to_json}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+failures=0
+
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1: expected $3, got $2"
+        failures=$((failures + 1))
+    fi
+}
+
+# One #OBJECTS record
+record() {
+    printf '#%s\nthing%s~\na thing~\nA thing is here.~\niron~\ntrash 0 A 0 0 0 0 0\n1 1 1 P\n' "$1" "$1"
+}
+
+# An area whose #OBJECTS section holds the given vnums
+area() {
+    printf '#AREADATA\nName Check~\nEnd\n\n#OBJECTS\n'
+    for vnum in "$@"; do record "$vnum"; done
+    printf '#0\n\n#$\n'
+}
+
+objects() {
+    grep -c '^ *"vnum": [0-9]*,$' "$1"
+}
+
+# The object vnums of an output, in order, on one line
+vnums() {
+    grep -o '^    "vnum": [0-9]*' "$1" | awk '{ printf "%s%s", sep, $2; sep = " " }'
+}
+
+area 1001 1002 1003 > "$TMP/plain.are"
+
+# Input with no size to read up to: a pipe
+cat "$TMP/plain.are" | "$BIN" /dev/stdin > "$TMP/pipe.json" 2>/dev/null
+check "pipe exit status" "$?" 0
+check "pipe objects" "$(objects "$TMP/pipe.json")" 3
+
+# A record cut off inside a string: the next record is kept, and the cut one
+# is dropped with an error of its own
+{
+    printf '#AREADATA\nName Check~\nEnd\n\n#OBJECTS\n'
+    record 1001
+    printf '#1002\nthing1002~\na thing\n'
+    record 1003
+    printf '#0\n\n#$\n'
+} > "$TMP/cut.are"
+for mode in "" --hardened; do
+    "$BIN" $mode "$TMP/cut.are" > "$TMP/cut.json" 2>/dev/null
+    check "cut record${mode:+ $mode} objects" "$(objects "$TMP/cut.json")" 2
+    check "cut record${mode:+ $mode} next kept" "$(grep -c '"vnum": 1003,' "$TMP/cut.json")" 1
+    check "cut record${mode:+ $mode} errors" "$(grep -c '"errors": 1,' "$TMP/cut.json")" 1
+    check "cut record${mode:+ $mode} diagnostic" \
+        "$(grep -c '"vnum": 1002, "message": "Load_objects: record 1002 runs into the next record' "$TMP/cut.json")" 1
+done
+
+# Numbers and | flag sums read as they always have, including negative
+# numbers and terms of more than 8 digits, which span two digit runs
+{
+    printf '#AREADATA\nName Check~\nEnd\n\n#OBJECTS\n#1001\nthing~\na thing~\nA thing is here.~\niron~\n'
+    printf 'trash 0 A 123456789|987654321 -5 12345678|1|2 -0 0\n-12 -123456789 2147483647 P\n'
+    printf '#0\n\n#$\n'
+} > "$TMP/numbers.are"
+"$BIN" "$TMP/numbers.are" > "$TMP/numbers.json" 2>/dev/null
+numbers=$(grep -E '"(level|weight|cost|v[0-3])":' "$TMP/numbers.json" | tr -d ' ,\n')
+check "numbers and flag sums" "$numbers" \
+    '"level":-12"weight":-123456789"cost":2147483647"v0":1111111110"v1":-5"v2":12345681"v3":0'
+
+# A well-formed area converts as it did before records could be dropped: the
+# expected output predates the errors field, so that is left out. It has an
+# extra description with a line starting #1 and an item type the parser
+# doesn't know, both of which are kept.
+for mode in "" --hardened; do
+    "$BIN" $mode testdata/sample.are 2>/dev/null | grep -v '^ *"errors": 0$' |
+        sed 's/^\( *"builders": .*\),$/\1/' > "$TMP/sample.json"
+    check "sample area${mode:+ $mode} matches" \
+        "$(cmp -s "$TMP/sample.json" testdata/sample.json && echo same)" same
+    check "sample area${mode:+ $mode} unknown type kept" \
+        "$(grep -c '"vnum": 90991,' "$TMP/sample.json")" 1
+    check "sample area${mode:+ $mode} #1 line kept" \
+        "$(grep -c '"vnum": 90990,' "$TMP/sample.json")" 1
+done
+
+# --filter keeps the objects of the sample area matching every term, and
+# refuses expressions it can't read
+while IFS=: read -r expr expected; do
+    "$BIN" --filter "$expr" testdata/sample.are > "$TMP/filter.json" 2>/dev/null
+    check "filter '$expr'" "$(vnums "$TMP/filter.json")" "$expected"
+done <<'END'
+type=weapon,armor extra~evil:90007 90006 90003
+level<100 cost>=25:99997 90990
+extra!~burnproof,glow wear~take:90991 90990
+type!=trash,portal weight>4:90007 90006
+vnum>=90990 vnum<99999:99998 99997 90991 90990
+END
+for expr in 'level>>5' 'colour=red' 'type=bogus' 'extra~notaflag' 'level>='; do
+    "$BIN" --filter "$expr" testdata/sample.are > /dev/null 2>&1
+    check "filter '$expr' refused" "$?" 1
+done
+
+# --sort vnum orders the objects of all areas by vnum, and objects sharing a
+# vnum by the order of their areas on the command line, on any number of
+# threads; --sort area orders by area first
+area 5 3 1 > "$TMP/one.are"
+area 4 3 2 > "$TMP/two.are"
+area 3 1 > "$TMP/three.are"
+placed() {
+    grep -E '^    "(vnum|area)": ' "$1" | awk '{ v = $2 + 0; if ($1 ~ /vnum/) n = v; else { printf "%s%s/%s", sep, n, v; sep = " " } }'
+}
+for threads in 1 4; do
+    "$BIN" --sort vnum --threads $threads "$TMP/one.are" "$TMP/two.are" "$TMP/three.are" > "$TMP/sorted.json" 2>/dev/null
+    check "sort vnum ties --threads $threads" "$(placed "$TMP/sorted.json")" "1/0 1/2 2/1 3/0 3/1 3/2 4/1 5/0"
+done
+"$BIN" --sort vnum "$TMP/three.are" "$TMP/two.are" "$TMP/one.are" > "$TMP/sorted.json" 2>/dev/null
+check "sort vnum ties, areas reversed" "$(placed "$TMP/sorted.json")" "1/0 1/2 2/1 3/0 3/1 3/2 4/1 5/2"
+"$BIN" --sort area "$TMP/one.are" "$TMP/two.are" "$TMP/three.are" > "$TMP/sorted.json" 2>/dev/null
+check "sort area" "$(placed "$TMP/sorted.json")" "1/0 3/0 5/0 2/1 3/1 4/1 1/2 3/2"
+
+# Two shards merged give the bytes of one --sort vnum run, details file
+# included, with the objects' strings inline or in a --dict table
+set -- "$TMP/one.are" "$TMP/two.are" "$TMP/three.are" testdata/sample.are
+for mode in "" --dict; do
+    "$BIN" --sort vnum $mode --details "$TMP/details.json" "$@" > "$TMP/whole.json" 2>/dev/null
+    mv "$TMP/details.json" "$TMP/whole.details.json"
+    for i in 1 2; do
+        "$BIN" --shard $i/2 $mode --details "$TMP/part$i.details.json" "$@" > "$TMP/part$i.json" 2>/dev/null
+    done
+    "$BIN" --merge --details "$TMP/details.json" "$TMP/part1.json" "$TMP/part2.json" > "$TMP/merged.json" 2>/dev/null
+    check "shards${mode:+ $mode} merged exit status" "$?" 0
+    check "shards${mode:+ $mode} both used" \
+        "$([ "$(objects "$TMP/part1.json")" -gt 0 ] && [ "$(objects "$TMP/part2.json")" -gt 0 ] && echo yes)" yes
+    check "shards${mode:+ $mode} merged output" "$(cmp -s "$TMP/merged.json" "$TMP/whole.json" && echo same)" same
+    check "shards${mode:+ $mode} merged details" \
+        "$(cmp -s "$TMP/details.json" "$TMP/whole.details.json" && echo same)" same
+done
+
+# A ~ just before, on and just after the end of the first 64K buffer: leading
+# blank lines move the whole area so a ~ lands there
+area $(seq 3001 4000) > "$TMP/long.are"
+tilde=$(grep -bo '~' "$TMP/long.are" | awk -F: '$1 >= 65536 - 100 { print $1; exit }')
+for at in 65533 65534 65535 65536 65537; do
+    { yes '' | head -n $((at - tilde)); cat "$TMP/long.are"; } > "$TMP/edge.are"
+    for mode in "" --hardened; do
+        "$BIN" $mode "$TMP/edge.are" > "$TMP/edge.json" 2>/dev/null
+        check "~ at $at${mode:+ $mode} objects" "$(objects "$TMP/edge.json")" 1000
+        check "~ at $at${mode:+ $mode} errors" "$(grep -c '"errors": 0' "$TMP/edge.json")" 1
+    done
+done
+
+# A control byte in a string is escaped wherever the string is written: the
+# output and details file pass the --summary check, inline and with --dict
+{
+    printf '#AREADATA\nName Check~\nEnd\n\n#OBJECTS\n#1001\nthing~\na \001 thing~\n'
+    printf 'A thing is here.~\niron~\ntrash 0 A 0 0 0 0 0\n1 1 1 P\nE\nthing~\nIt reads \001.\n~\n'
+    printf '#0\n\n#$\n'
+} > "$TMP/control.are"
+for mode in "" --dict; do
+    "$BIN" $mode --details "$TMP/control.details" --summary "$TMP/control.summary" \
+        "$TMP/control.are" > "$TMP/control.json" 2>/dev/null
+    check "control byte${mode:+ $mode} exit status" "$?" 0
+    check "control byte${mode:+ $mode} summary" "$(grep -c '"valid": true' "$TMP/control.summary")" 1
+    check "control byte${mode:+ $mode} escaped" "$(cat "$TMP/control.json" "$TMP/control.details" | grep -c 'u0001')" 2
+done
+
+# Names are written as they are read, so a raw control byte in one reaches
+# the output: --summary must catch it, record the problem and fail the run
+{
+    printf '#AREADATA\nName Check~\nEnd\n\n#OBJECTS\n#1001\nthing \001~\na thing~\n'
+    printf 'A thing is here.~\niron~\ntrash 0 A 0 0 0 0 0\n1 1 1 P\n#0\n\n#$\n'
+} > "$TMP/raw.are"
+"$BIN" --summary "$TMP/raw.summary" "$TMP/raw.are" > /dev/null 2>&1
+check "raw control byte exit status" "$?" 1
+check "raw control byte summary" "$(grep -c '"valid": false' "$TMP/raw.summary")" 1
+check "raw control byte error" \
+    "$(grep -c '"error": "at byte [0-9]*: unescaped control character 0x01"' "$TMP/raw.summary")" 1
+
+# A gzip archive cut off halfway: the objects before the cut are kept and the
+# other files are still converted. Skipped when gzip or zlib support is
+# missing.
+area $(seq 2001 2400) | gzip -c > "$TMP/whole.are.gz" 2>/dev/null
+if [ -s "$TMP/whole.are.gz" ] && "$BIN" "$TMP/whole.are.gz" > /dev/null 2>&1; then
+    size=$(wc -c < "$TMP/whole.are.gz")
+    head -c $((size / 2)) "$TMP/whole.are.gz" > "$TMP/cut.are.gz"
+    "$BIN" "$TMP/cut.are.gz" "$TMP/plain.are" > "$TMP/gz.json" 2>/dev/null
+    check "truncated gzip exit status" "$?" 0
+    check "truncated gzip other file kept" "$(grep -c '"vnum": 1003,' "$TMP/gz.json")" 1
+    kept=$(grep -c '"vnum": 2[0-9][0-9][0-9],' "$TMP/gz.json")
+    check "truncated gzip partial objects" "$([ "$kept" -gt 0 ] && [ "$kept" -lt 400 ] && echo some)" some
+    check "truncated gzip diagnostic" "$(grep -c '"message": "Truncated gzip input"' "$TMP/gz.json")" 1
+else
+    echo "skip truncated gzip"
+fi
+
+[ "$failures" -eq 0 ] || exit 1
@@ -0,0 +1,151 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "color.h"
+#include "mem.h"
+
+// The viewer's color map, in the order fg values are assigned (fg 1 is
+// {r). {n is a reset there, like {x.
+static const struct { char code; const char *css; } named_colors[] = {
+    {'r', "#cc6666"}, {'g', "#66cc66"}, {'y', "#cccc66"}, {'b', "#6666cc"},
+    {'m', "#cc66cc"}, {'c', "#66cccc"}, {'w', "#cccccc"}, {'D', "#666666"},
+    {'R', "#ff6666"}, {'G', "#66ff66"}, {'Y', "#ffff66"}, {'B', "#6666ff"},
+    {'M', "#ff66ff"}, {'C', "#66ffff"}, {'W', "#ffffff"},
+    {'N', "#ffcc66"}, {'p', "#aa66ff"}, {'P', "#cc9966"}, {'t', "#66aaaa"},
+    {'T', "#66cccc"}, {'l', "#66cc66"}, {'L', "#aaccaa"}, {'s', "#aaaaaa"},
+    {'S', "#aacccc"}
+};
+
+#define NAMED_COLORS (int)(sizeof(named_colors) / sizeof(named_colors[0]))
+// fg values above this are 1 + an RGB code of three decimal digits
+#define RGB_FG_BASE 64
+
+// Letter after { -> fg value, 0 for letters that aren't colors
+static unsigned named_fg(int code) {
+    for (int i = 0; i < NAMED_COLORS; ++i)
+        if (named_colors[i].code == code) return (unsigned)(i + 1);
+    return 0;
+}
+
+// \t[F###] or \t[B###] at s: store the 000-999 code and return true
+static bool rgb_code(const char *s, char *which, unsigned *code) {
+    if (s[0] != '\\' || s[1] != 't' || s[2] != '[' || (s[3] != 'F' && s[3] != 'B'))
+        return false;
+    for (int i = 4; i < 7; ++i)
+        if (s[i] < '0' || s[i] > '9') return false;
+    if (s[7] != ']') return false;
+    *which = s[3];
+    *code = (unsigned)((s[4] - '0') * 100 + (s[5] - '0') * 10 + (s[6] - '0'));
+    return true;
+}
+
+// Append one byte of plain text in the current style, starting a run when
+// the style changed. Returns -1 when out of memory.
+static int emit_char(COLOR_TEXT *out, int *runs_cap, unsigned style, char c) {
+    if (!out->nruns || out->runs[out->nruns - 1].style != style) {
+        if (out->nruns == *runs_cap) {
+            int cap = *runs_cap ? *runs_cap * 2 : 4;
+            COLOR_RUN *grown = mem_realloc(MEM_STRING, out->runs, (size_t)cap * sizeof(*grown));
+            if (!grown) return -1;
+            out->runs = grown;
+            *runs_cap = cap;
+        }
+        out->runs[out->nruns].start = out->len;
+        out->runs[out->nruns].style = style;
+        out->nruns++;
+    }
+    out->plain[out->len++] = c;
+    return 0;
+}
+
+int color_parse(COLOR_TEXT *out, const char *s) {
+    memset(out, 0, sizeof(*out));
+    if (!s) s = "";
+
+    // Codes only ever shrink the text
+    out->plain = mem_alloc(MEM_STRING, strlen(s) + 1);
+    if (!out->plain) return -1;
+
+    int runs_cap = 0;
+    unsigned style = 0;
+    int rc = 0;
+    while (*s && rc == 0) {
+        char which;
+        unsigned code;
+        if (s[0] == '{' && s[1]) {
+            char c = s[1];
+            unsigned fg = named_fg(c);
+            if (c == '{' || c == '-') {
+                rc = emit_char(out, &runs_cap, style, c == '{' ? '{' : '~');
+            } else if (c == 'x' || c == 'n') {
+                style = 0;
+            } else if (fg) {
+                style = (style & ~COLOR_FG_MASK) | fg;
+            } else if (c == '@') {
+                style |= COLOR_BOLD;
+            } else if (c == '!') {
+                style |= COLOR_BLINK;
+            } else if (c == '+') {
+                style |= COLOR_REVERSE;
+            } else {
+                // Not a code: the { stays in the text
+                rc = emit_char(out, &runs_cap, style, *s++);
+                continue;
+            }
+            s += 2;
+        } else if (s[0] == '\\' && rgb_code(s, &which, &code)) {
+            if (which == 'F')
+                style = (style & ~COLOR_FG_MASK) | (RGB_FG_BASE + code);
+            else
+                style = (style & ~COLOR_BG_MASK) | (code + 1) << COLOR_BG_SHIFT;
+            s += 8;
+        } else {
+            rc = emit_char(out, &runs_cap, style, *s++);
+        }
+    }
+    if (rc != 0) {
+        color_text_free(out);
+        return -1;
+    }
+    out->plain[out->len] = '\0';
+    return 0;
+}
+
+void color_text_free(COLOR_TEXT *ct) {
+    mem_free(ct->plain);
+    mem_free(ct->runs);
+    memset(ct, 0, sizeof(*ct));
+}
+
+// Each digit of an RGB code is a 0-5 level, 51 apart; larger digits clamp
+static int rgb_level(unsigned digit) {
+    return digit >= 5 ? 255 : (int)digit * 51;
+}
+
+static int css_rgb(char *buf, size_t len, const char *prop, unsigned code) {
+    return snprintf(buf, len, "%s: rgb(%d, %d, %d); ", prop, rgb_level(code / 100),
+                    rgb_level(code / 10 % 10), rgb_level(code % 10));
+}
+
+void color_style_css(unsigned style, char *buf, size_t len) {
+    unsigned fg = style & COLOR_FG_MASK;
+    unsigned bg = (style & COLOR_BG_MASK) >> COLOR_BG_SHIFT;
+    size_t n = 0;
+
+    buf[0] = '\0';
+    if (fg >= RGB_FG_BASE)
+        n += css_rgb(buf + n, len - n, "color", fg - RGB_FG_BASE);
+    else if (fg >= 1 && fg <= NAMED_COLORS)
+        n += snprintf(buf + n, len - n, "color: %s; ", named_colors[fg - 1].css);
+    if (bg && n < len)
+        n += css_rgb(buf + n, len - n, "background-color", bg - 1);
+    if ((style & COLOR_BOLD) && n < len)
+        n += snprintf(buf + n, len - n, "font-weight: bold; ");
+    if ((style & COLOR_BLINK) && n < len)
+        n += snprintf(buf + n, len - n, "animation: blink 1s infinite; ");
+    if ((style & COLOR_REVERSE) && n < len)
+        n += snprintf(buf + n, len - n, "filter: invert(1); ");
+    // Drop the trailing space
+    if (n && n < len) buf[n - 1] = '\0';
+}
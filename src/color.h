@@ -0,0 +1,44 @@
+#ifndef COLOR_H
+#define COLOR_H
+
+#include <stddef.h>
+
+// Style keys pack everything a color code can set: the foreground (named
+// color or \t[F###] RGB), the \t[B###] background and the bold, blink and
+// reverse attributes. 0 is the default style.
+#define COLOR_FG_MASK 0x7ffu
+#define COLOR_BG_SHIFT 11
+#define COLOR_BG_MASK (0x3ffu << COLOR_BG_SHIFT)
+#define COLOR_BOLD (1u << 21)
+#define COLOR_BLINK (1u << 22)
+#define COLOR_REVERSE (1u << 23)
+
+// Longest CSS color_style_css writes
+#define COLOR_CSS_MAX 160
+
+// A run of plain text in one style. It starts at byte start and ends where
+// the next run starts (or at the end of the text).
+typedef struct color_run {
+    size_t start;
+    unsigned style;
+} COLOR_RUN;
+
+// A string with its color codes taken out: the text as shown, and the
+// style runs over it. Adjacent runs always differ in style.
+typedef struct color_text {
+    char *plain;
+    size_t len;
+    COLOR_RUN *runs;
+    int nruns;
+} COLOR_TEXT;
+
+// Tokenize the {x-style and \t[F###]/\t[B###] codes in s. {{ and {- give
+// a literal { and ~, {x and {n reset the style, and unknown codes are kept
+// as text. Returns 0, or -1 when out of memory (out is then empty).
+int color_parse(COLOR_TEXT *out, const char *s);
+void color_text_free(COLOR_TEXT *ct);
+
+// Inline CSS declarations for a style key, "" for the default style
+void color_style_css(unsigned style, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,189 @@
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "decompress.h"
+#include "mem.h"
+
+COMPRESSION compression_detect(const unsigned char *head, size_t len) {
+    if (len >= 2 && head[0] == 0x1f && head[1] == 0x8b) return COMPRESSION_GZIP;
+    if (len >= 4 && head[0] == 0x28 && head[1] == 0xb5 && head[2] == 0x2f && head[3] == 0xfd)
+        return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+const char *compression_name(COMPRESSION kind) {
+    switch (kind) {
+        case COMPRESSION_GZIP: return "gzip";
+        case COMPRESSION_ZSTD: return "zstd";
+        default: return "none";
+    }
+}
+
+static void set_error(DECOMPRESSOR *d, const char *what, const char *detail) {
+    snprintf(d->error, sizeof(d->error), "%s %s input%s%s", what, compression_name(d->kind),
+             detail ? ": " : "", detail ? detail : "");
+}
+
+static void refill(DECOMPRESSOR *d) {
+    d->chunk_pos = 0;
+    d->chunk_len = d->read(d->ctx, (char *)d->chunk, DECOMPRESS_CHUNK);
+    if (d->chunk_len == 0) d->source_eof = true;
+}
+
+#ifdef HAVE_ZLIB
+// zlib's window and tables are counted with the rest of the input memory
+static voidpf zlib_alloc(voidpf opaque, uInt items, uInt size) {
+    (void)opaque;
+    return mem_alloc(MEM_INPUT, (size_t)items * size);
+}
+
+static void zlib_free(voidpf opaque, voidpf address) {
+    (void)opaque;
+    mem_free(address);
+}
+
+static size_t gzip_step(DECOMPRESSOR *d, char *dst, size_t len) {
+    z_stream *z = d->stream;
+    if (!d->frame_open) {
+        // Another member follows the one that ended
+        if (d->chunk_pos == d->chunk_len) return 0;
+        inflateReset(z);
+        d->frame_open = true;
+    }
+    z->next_in = d->chunk + d->chunk_pos;
+    z->avail_in = (uInt)(d->chunk_len - d->chunk_pos);
+    z->next_out = (Bytef *)dst;
+    z->avail_out = (uInt)len;
+    int rc = inflate(z, Z_NO_FLUSH);
+    d->chunk_pos = d->chunk_len - z->avail_in;
+    if (rc == Z_STREAM_END)
+        d->frame_open = false;
+    else if (rc != Z_OK && rc != Z_BUF_ERROR)
+        set_error(d, "Corrupt", z->msg);
+    return len - z->avail_out;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static size_t zstd_step(DECOMPRESSOR *d, char *dst, size_t len) {
+    if (!d->frame_open && d->chunk_pos == d->chunk_len) return 0;
+    ZSTD_inBuffer in = { d->chunk, d->chunk_len, d->chunk_pos };
+    ZSTD_outBuffer out = { dst, len, 0 };
+    size_t rc = ZSTD_decompressStream(d->stream, &out, &in);
+    d->chunk_pos = in.pos;
+    if (ZSTD_isError(rc))
+        set_error(d, "Corrupt", ZSTD_getErrorName(rc));
+    else
+        d->frame_open = rc != 0; // 0: a frame ended and everything is flushed
+    return out.pos;
+}
+#endif
+
+int decompress_init(DECOMPRESSOR *d, COMPRESSION kind, INPUT_READ read, void *ctx) {
+    memset(d, 0, sizeof(*d));
+    d->kind = kind;
+    d->read = read;
+    d->ctx = ctx;
+    d->chunk = mem_alloc(MEM_INPUT, DECOMPRESS_CHUNK);
+    if (!d->chunk) {
+        set_error(d, "Out of memory for", NULL);
+        return -1;
+    }
+
+    switch (kind) {
+#ifdef HAVE_ZLIB
+        case COMPRESSION_GZIP: {
+            z_stream *z = mem_calloc(MEM_INPUT, 1, sizeof(z_stream));
+            if (!z) break;
+            z->zalloc = zlib_alloc;
+            z->zfree = zlib_free;
+            // 16 + MAX_WBITS: expect a gzip header and trailer
+            if (inflateInit2(z, 16 + MAX_WBITS) != Z_OK) {
+                mem_free(z);
+                break;
+            }
+            d->stream = z;
+            d->frame_open = true;
+            return 0;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESSION_ZSTD: {
+            ZSTD_DStream *z = ZSTD_createDStream();
+            if (!z) break;
+            if (ZSTD_isError(ZSTD_initDStream(z))) {
+                ZSTD_freeDStream(z);
+                break;
+            }
+            d->stream = z;
+            d->frame_open = true;
+            return 0;
+        }
+#endif
+        case COMPRESSION_NONE:
+            snprintf(d->error, sizeof(d->error), "Input is not compressed");
+            return -1;
+        default:
+            set_error(d, "Built without support for", NULL);
+            return -1;
+    }
+    set_error(d, "Cannot start decompressing", NULL);
+    return -1;
+}
+
+static size_t step(DECOMPRESSOR *d, char *dst, size_t len) {
+    switch (d->kind) {
+#ifdef HAVE_ZLIB
+        case COMPRESSION_GZIP: return gzip_step(d, dst, len);
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESSION_ZSTD: return zstd_step(d, dst, len);
+#endif
+        default:
+            // Never reached: decompress_init refuses kinds not built in
+            (void)dst;
+            (void)len;
+            return 0;
+    }
+}
+
+size_t decompress_read(void *ctx, char *dst, size_t len) {
+    DECOMPRESSOR *d = ctx;
+    if (len > UINT_MAX) len = UINT_MAX;
+    size_t produced = 0;
+    while (produced == 0 && !d->done && !d->error[0]) {
+        if (d->chunk_pos == d->chunk_len && !d->flush) {
+            if (!d->source_eof) refill(d);
+            if (d->source_eof) {
+                if (d->frame_open) set_error(d, "Truncated", NULL);
+                d->done = true;
+                break;
+            }
+        }
+        produced = step(d, dst, len);
+        d->flush = produced == len;
+    }
+    return produced;
+}
+
+void decompress_free(DECOMPRESSOR *d) {
+#ifdef HAVE_ZLIB
+    if (d->kind == COMPRESSION_GZIP && d->stream) {
+        inflateEnd(d->stream);
+        mem_free(d->stream);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (d->kind == COMPRESSION_ZSTD && d->stream) ZSTD_freeDStream(d->stream);
+#endif
+    mem_free(d->chunk);
+    memset(d, 0, sizeof(*d));
+}
@@ -0,0 +1,52 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "input.h"
+
+#define DECOMPRESS_CHUNK 65536 // Compressed bytes read per refill
+
+typedef enum compression {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+} COMPRESSION;
+
+// Streaming decompressor with the INPUT_READ signature on both sides:
+// compressed bytes come from a read callback a chunk at a time, and
+// decompress_read inflates straight into the caller's buffer, so the
+// decompressed file is never held whole. Concatenated gzip members and
+// zstd frames are read as one stream.
+typedef struct decompressor {
+    COMPRESSION kind;
+    INPUT_READ read; // Source of compressed bytes
+    void *ctx;
+    unsigned char *chunk;
+    size_t chunk_pos;
+    size_t chunk_len;
+    bool source_eof;
+    bool done; // Last frame finished and the source is exhausted
+    bool frame_open; // Inside a frame that hasn't ended yet
+    bool flush; // The last step filled its output, so more may be held back
+    void *stream; // z_stream or ZSTD_DStream
+    char error[128]; // Why the stream stopped early, empty if it didn't
+} DECOMPRESSOR;
+
+// The compression the first bytes of a stream announce: gzip needs 2 bytes
+// to be recognized, zstd 4
+COMPRESSION compression_detect(const unsigned char *head, size_t len);
+const char *compression_name(COMPRESSION kind);
+
+// Returns 0, or -1 with the reason in d->error (including support for kind
+// not being built in); d needs decompress_free either way
+int decompress_init(DECOMPRESSOR *d, COMPRESSION kind, INPUT_READ read, void *ctx);
+
+// INPUT_READ over the decompressed bytes; ctx is the DECOMPRESSOR. Returns 0
+// at the end of the data, or early with d->error set if it is corrupt or
+// truncated.
+size_t decompress_read(void *ctx, char *dst, size_t len);
+void decompress_free(DECOMPRESSOR *d);
+
+#endif
@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "filter.h"
+#include "mem.h"
+
+static const struct { const char *name; int field; } filter_fields[] = {
+    {"vnum", FILTER_VNUM}, {"type", FILTER_TYPE}, {"level", FILTER_LEVEL},
+    {"weight", FILTER_WEIGHT}, {"cost", FILTER_COST},
+    {"extra", FILTER_EXTRA}, {"extra_flags", FILTER_EXTRA},
+    {"wear", FILTER_WEAR}, {"wear_flags", FILTER_WEAR}, {NULL, 0}
+};
+
+// Longest operators first so "<=" is not read as "<"
+static const struct { const char *text; int op; } filter_ops[] = {
+    {"!=", FILTER_NE}, {"!~", FILTER_NOT}, {"<=", FILTER_LE}, {">=", FILTER_GE},
+    {"=", FILTER_EQ}, {"~", FILTER_HAS}, {"<", FILTER_LT}, {">", FILTER_GT}, {NULL, 0}
+};
+
+// Parse one "field<op>value[,value...]" term
+static int parse_term(FILTER_TERM *term, const char *text, char *err, size_t errlen) {
+    size_t flen = 0;
+    while (text[flen] && (isalnum((unsigned char)text[flen]) || text[flen] == '_'))
+        flen++;
+
+    term->field = -1;
+    for (int i = 0; filter_fields[i].name; ++i) {
+        if (strlen(filter_fields[i].name) == flen && !strncmp(filter_fields[i].name, text, flen)) {
+            term->field = filter_fields[i].field;
+            break;
+        }
+    }
+    if (term->field < 0) {
+        snprintf(err, errlen, "unknown filter field in '%s'", text);
+        return -1;
+    }
+
+    const char *p = text + flen;
+    term->op = -1;
+    for (int i = 0; filter_ops[i].text; ++i) {
+        size_t olen = strlen(filter_ops[i].text);
+        if (!strncmp(p, filter_ops[i].text, olen)) {
+            term->op = filter_ops[i].op;
+            p += olen;
+            break;
+        }
+    }
+    if (term->op < 0 || !*p) {
+        snprintf(err, errlen, "expected <field><op><value> in '%s'", text);
+        return -1;
+    }
+
+    bool is_flag = term->field == FILTER_EXTRA || term->field == FILTER_WEAR;
+    bool is_list = term->op == FILTER_EQ || term->op == FILTER_NE
+                   || term->op == FILTER_HAS || term->op == FILTER_NOT;
+    if (!is_flag && (term->op == FILTER_HAS || term->op == FILTER_NOT)) {
+        snprintf(err, errlen, "'~' only applies to extra and wear in '%s'", text);
+        return -1;
+    }
+    if (is_flag && !is_list) {
+        snprintf(err, errlen, "extra and wear only take =, !=, ~ and !~ in '%s'", text);
+        return -1;
+    }
+
+    term->nvalues = 0;
+    if (is_flag) term->values[0] = 0;
+
+    char value[64];
+    while (*p) {
+        size_t vlen = strcspn(p, ",");
+        if (vlen == 0 || vlen >= sizeof(value)) {
+            snprintf(err, errlen, "bad value in '%s'", text);
+            return -1;
+        }
+        memcpy(value, p, vlen);
+        value[vlen] = '\0';
+        p += vlen;
+        if (*p == ',') p++;
+
+        if (is_flag) {
+            const FLAG_FAMILY *fam = term->field == FILTER_EXTRA ? &flag_extra : &flag_wear;
+            long bit = flag_lookup(fam, value);
+            if (!bit) {
+                snprintf(err, errlen, "unknown flag '%s' in '%s'", value, text);
+                return -1;
+            }
+            term->values[0] |= bit;
+            term->nvalues = 1;
+            continue;
+        }
+
+        if (term->nvalues == FILTER_MAX_VALUES || (!is_list && term->nvalues == 1)) {
+            snprintf(err, errlen, "too many values in '%s'", text);
+            return -1;
+        }
+
+        if (term->field == FILTER_TYPE) {
+            int type = item_lookup(value);
+            if (!type) {
+                snprintf(err, errlen, "unknown item type '%s' in '%s'", value, text);
+                return -1;
+            }
+            term->values[term->nvalues++] = type;
+        } else {
+            char *end;
+            long n = strtol(value, &end, 10);
+            if (*end) {
+                snprintf(err, errlen, "'%s' is not a number in '%s'", value, text);
+                return -1;
+            }
+            term->values[term->nvalues++] = n;
+        }
+    }
+    return 0;
+}
+
+int filter_parse(OBJ_FILTER *filter, const char *expr, char *err, size_t errlen) {
+    filter->terms = NULL;
+    filter->nterms = 0;
+
+    char *copy = mem_strdup(MEM_OTHER, expr);
+    if (!copy) return -1;
+
+    int rc = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        FILTER_TERM *terms = mem_realloc(MEM_OTHER, filter->terms, (filter->nterms + 1) * sizeof(FILTER_TERM));
+        if (!terms) {
+            rc = -1;
+            break;
+        }
+        filter->terms = terms;
+        if (parse_term(&filter->terms[filter->nterms], tok, err, errlen) != 0) {
+            rc = -1;
+            break;
+        }
+        filter->nterms++;
+    }
+
+    mem_free(copy);
+    if (rc != 0) filter_free(filter);
+    return rc;
+}
+
+static long field_value(const OBJ_INDEX_DATA *obj, int field) {
+    switch (field) {
+        case FILTER_VNUM: return obj->vnum;
+        case FILTER_TYPE: return obj->item_type;
+        case FILTER_LEVEL: return obj->level;
+        case FILTER_WEIGHT: return obj->weight;
+        case FILTER_COST: return obj->cost;
+        case FILTER_EXTRA: return obj->extra_flags;
+        case FILTER_WEAR: return obj->wear_flags;
+        default: return 0;
+    }
+}
+
+static bool term_match(const FILTER_TERM *term, const OBJ_INDEX_DATA *obj) {
+    long v = field_value(obj, term->field);
+
+    if (term->field == FILTER_EXTRA || term->field == FILTER_WEAR) {
+        bool any = (v & term->values[0]) != 0;
+        return (term->op == FILTER_EQ || term->op == FILTER_HAS) ? any : !any;
+    }
+
+    switch (term->op) {
+        case FILTER_EQ:
+        case FILTER_NE: {
+            bool found = false;
+            for (int i = 0; i < term->nvalues && !found; ++i)
+                found = v == term->values[i];
+            return term->op == FILTER_EQ ? found : !found;
+        }
+        case FILTER_LT: return v < term->values[0];
+        case FILTER_LE: return v <= term->values[0];
+        case FILTER_GT: return v > term->values[0];
+        case FILTER_GE: return v >= term->values[0];
+        default: return false;
+    }
+}
+
+bool filter_match(const OBJ_FILTER *filter, const OBJ_INDEX_DATA *obj) {
+    for (int i = 0; i < filter->nterms; ++i)
+        if (!term_match(&filter->terms[i], obj))
+            return false;
+    return true;
+}
+
+void filter_free(OBJ_FILTER *filter) {
+    mem_free(filter->terms);
+    filter->terms = NULL;
+    filter->nterms = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "areaparse.h"
+
+#define FILTER_MAX_VALUES 16
+
+// Fields a filter term can test. All of them are known once the object
+// header (everything before the affect lines) has been read.
+enum filter_field {
+    FILTER_VNUM,
+    FILTER_TYPE,
+    FILTER_LEVEL,
+    FILTER_WEIGHT,
+    FILTER_COST,
+    FILTER_EXTRA,
+    FILTER_WEAR
+};
+
+enum filter_op {
+    FILTER_EQ,  // = (any of the listed values / flags)
+    FILTER_NE,  // != (none of the listed values / flags)
+    FILTER_LT,
+    FILTER_LE,
+    FILTER_GT,
+    FILTER_GE,
+    FILTER_HAS, // ~ (flag fields: any listed flag set)
+    FILTER_NOT  // !~ (flag fields: no listed flag set)
+};
+
+typedef struct filter_term {
+    int field;
+    int op;
+    long values[FILTER_MAX_VALUES]; // Flag fields keep a single OR-ed mask in values[0]
+    int nvalues;
+} FILTER_TERM;
+
+// Space-separated terms, all of which must match
+typedef struct obj_filter {
+    FILTER_TERM *terms;
+    int nterms;
+} OBJ_FILTER;
+
+int filter_parse(OBJ_FILTER *filter, const char *expr, char *err, size_t errlen);
+bool filter_match(const OBJ_FILTER *filter, const OBJ_INDEX_DATA *obj);
+void filter_free(OBJ_FILTER *filter);
+
+#endif
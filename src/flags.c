@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+
+#include "flags.h"
+#include "mem.h"
+
+// Space-separated names of every named bit in bits, lowest first, or "none".
+// Output is cut at a name boundary if outlen is short; FLAG_NAMES_MAX
+// always fits.
+size_t flag_bits_to_names(const FLAG_FAMILY *fam, long bits, char *out, size_t outlen) {
+    unsigned long set = (unsigned long)bits & fam->defined;
+    size_t len = 0;
+
+    if (!set) {
+        snprintf(out, outlen, "none");
+        return strlen(out);
+    }
+    while (set) {
+        int bit = __builtin_ctzl(set);
+        size_t n = fam->bit_name_len[bit];
+        set &= set - 1;
+        if (len + (len ? 1 : 0) + n + 1 > outlen) break;
+        if (len) out[len++] = ' ';
+        memcpy(out + len, fam->bit_names[bit], n);
+        len += n;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Name of the lowest named bit, "unknown" if none is set
+const char *flag_bit_name(const FLAG_FAMILY *fam, long bits) {
+    unsigned long set = (unsigned long)bits & fam->defined;
+    return set ? fam->bit_names[__builtin_ctzl(set)] : "unknown";
+}
+
+// "prefix:name" for an F affect line's bitvector
+const char *flag_affect_name(const FLAG_FAMILY *fam, long bits) {
+    unsigned long set = (unsigned long)bits & fam->defined;
+    return set ? fam->affect_names[__builtin_ctzl(set)] : fam->affect_unknown;
+}
+
+const char *flag_letter_name(const FLAG_FAMILY *fam, int letter) {
+    const char *name = fam->letter_names[(unsigned char)letter];
+    return name ? name : "unknown";
+}
+
+// Bit value for a flag name, 0 if the family has no such flag
+long flag_lookup(const FLAG_FAMILY *fam, const char *name) {
+    for (int bit = 0; bit < FLAG_BITS; ++bit)
+        if (fam->bit_names[bit] && !strcmp(fam->bit_names[bit], name))
+            return 1L << bit;
+    return 0;
+}
+
+long flag_convert(char letter) {
+    return flag_letter_bits[(unsigned char)letter];
+}
+
+const char *weapon_flag_name(int flag) {
+    if (flag == 0) return "none";
+    if (flag & (flag - 1)) return "unknown";
+    return flag_bit_name(&flag_weapon, flag);
+}
+
+const char *weapon_flag_letter_name(char letter) {
+    return flag_letter_name(&flag_weapon, letter);
+}
+
+// Convert extra flag letters to full names
+char *extra_flags_to_names(const char *flags_str) {
+    if (!flags_str || !*flags_str) return mem_strdup(MEM_ESCAPE, "none");
+
+    char *result = mem_alloc(MEM_ESCAPE, strlen(flags_str) * (FLAG_NAME_MAX + 1) + 1);
+    if (!result) return NULL;
+    char *p = result;
+
+    for (const char *c = flags_str; *c; c++) {
+        const char *name = flag_letter_name(&flag_extra, *c);
+        size_t n = strlen(name);
+        if (c != flags_str) *p++ = ' ';
+        memcpy(p, name, n);
+        p += n;
+    }
+    *p = '\0';
+    return result;
+}
+
+// Convert weapon flag letters to a JSON array of names
+char *weapon_flags_to_names(const char *flags_str) {
+    if (!flags_str || !*flags_str) return mem_strdup(MEM_ESCAPE, "[]");
+
+    // Each name plus quotes and separator
+    char *result = mem_alloc(MEM_ESCAPE, strlen(flags_str) * (FLAG_NAME_MAX + 4) + 3);
+    if (!result) return NULL;
+    char *p = result;
+
+    *p++ = '[';
+    for (const char *c = flags_str; *c; c++) {
+        const char *name = flag_letter_name(&flag_weapon, *c);
+        size_t n = strlen(name);
+        if (c != flags_str) {
+            *p++ = ',';
+            *p++ = ' ';
+        }
+        *p++ = '"';
+        memcpy(p, name, n);
+        p += n;
+        *p++ = '"';
+    }
+    *p++ = ']';
+    *p = '\0';
+    return result;
+}
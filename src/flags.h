@@ -0,0 +1,43 @@
+#ifndef FLAGS_H
+#define FLAGS_H
+
+#include <stddef.h>
+
+#define FLAG_BITS 32
+
+// One flag family (wear, extra, affect, ...). Instances are generated from
+// flags.spec into flag_tables.c, so the letter, bit and name views of a
+// family always agree.
+typedef struct flag_family {
+    const char *name;
+    unsigned long defined; // Mask of bits that have a name
+    const char *bit_names[FLAG_BITS]; // NULL for unused bits
+    unsigned char bit_name_len[FLAG_BITS];
+    const char *affect_names[FLAG_BITS]; // "prefix:name" for F affect lines
+    const char *affect_unknown; // "prefix:unknown", NULL if no F lines use the family
+    const char *letter_names[256]; // Area-file letter -> name, NULL if unused
+} FLAG_FAMILY;
+
+#include "flag_tables.h"
+
+// Area-file letter -> bit value (A = 1, B = 2, ..., a = 1 << 26, ...), 0 for
+// anything that isn't a flag letter
+extern const long flag_letter_bits[256];
+// F affect line "where" letter -> family, NULL if unknown
+extern const FLAG_FAMILY *const flag_family_by_where[256];
+
+size_t flag_bits_to_names(const FLAG_FAMILY *fam, long bits, char *out, size_t outlen);
+const char *flag_bit_name(const FLAG_FAMILY *fam, long bits);
+const char *flag_affect_name(const FLAG_FAMILY *fam, long bits);
+const char *flag_letter_name(const FLAG_FAMILY *fam, int letter);
+long flag_lookup(const FLAG_FAMILY *fam, const char *name);
+long flag_convert(char letter);
+
+// Weapon flags as stored in object values
+const char *weapon_flag_name(int flag);
+const char *weapon_flag_letter_name(char letter);
+// Allocated with mem_alloc; release with mem_free
+char *extra_flags_to_names(const char *flags_str);
+char *weapon_flags_to_names(const char *flags_str);
+
+#endif
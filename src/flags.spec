@@ -0,0 +1,198 @@
+# Flag families, the single source for every flag table in the parser.
+# gen_flags turns this into flag_tables.c and flag_tables.h at build time.
+#
+#   family <name> <F-line where letter or -> <affect prefix or -> [like <family>]
+#
+# starts a family; "like" copies another family's flags. Each following line
+# is "<letter> <name>". Letters follow the area-file convention: A-Z are
+# bits 0-25 and a-f bits 26-31.
+
+# Wear locations (merc.h ITEM_WEAR_*)
+family wear - -
+A take
+B finger
+C neck
+D body
+E head
+F legs
+G feet
+H hands
+I arms
+J shield
+K about
+L waist
+M wrist
+N wield
+O hold
+P nosac
+Q wearfloat
+R face
+S lodge_leg
+T lodge_arm
+U lodge_rib
+V materia
+W nose
+X belly
+Y ears
+Z tongue
+a tattoo
+b gadget
+c grimoire
+d familiar
+
+# Extra flags (tables.c extra_flags, the names the JSON output has always used)
+family extra - -
+A glow
+B hum
+C dark
+D lock
+E evil
+F invis
+G magic
+H nodrop
+I bless
+J antigood
+K antievil
+L antineutral
+M noremove
+N inventory
+O nopurge
+P rotdeath
+Q visdeath
+R noclone
+S nonmetal
+T nolocate
+U meltdrop
+V hadtimer
+W sellextract
+X clan
+Y burnproof
+Z nouncurse
+a sticky
+b lodged
+c trap
+d no_restring
+e quest
+f nogive
+
+# Affect flags (merc.h AFF_*)
+family affect A affect
+A blind
+B detect_evil
+C detect_invis
+D detect_magic
+E detect_hidden
+F detect_good
+G unused_1
+H unused_h
+I faerie_fire
+J infrared
+K curse
+L resistance
+M poison
+N unused_2
+O unused_3
+P sneak
+Q hide
+R sleep
+S charm
+T flying
+U unused_4
+V haste
+W calm
+X plague
+Y weaken
+Z dark_vision
+a berserk
+b swim
+c regeneration
+d slow
+e drained
+
+# Second affect word (merc.h AFF2_*)
+family affect2 B affect2
+A shapeshift
+B unused_1
+C telepathy
+D life_stealer
+E unused_e
+F lsd
+G hold_person
+H unused_2
+I divine_intervention
+J unused_3
+K mental_disruption
+L talon
+M kamikaze
+N spiritlink
+O unused_4
+P unused_5
+Q unused_6
+R unused_7
+S unused_8
+T unused_9
+U unused_10
+V unused_11
+W spectral_blade
+X unused_12
+Y unused_13
+Z unused_14
+a focus_chi
+
+# Immunities (merc.h IMM_*); resistances and vulnerabilities use the same bits
+family imm I immune
+A summon
+B charm
+C magic
+D weapon
+E bash
+F pierce
+G slash
+H fire
+I cold
+J lightning
+K acid
+L poison
+M negative
+N holy
+O energy
+P mental
+Q disease
+R drowning
+S light
+T sound
+U wood
+V silver
+W iron
+
+family res R resist like imm
+
+family vuln V vuln like imm
+
+# Shield flags (tables.c shield_flags)
+family shield S shield
+A living_armor
+B sanctuary
+C invisible
+D protect_evil
+E protect_good
+F planeshift
+G fireshield
+H pass_door
+I protect_voodoo
+J iceshield
+K lightningshield
+L acidshield
+
+# Weapon flags (merc.h WEAPON_*). J is unused.
+family weapon W weapon
+A flaming
+B frost
+C vampiric
+D sharp
+E vorpal
+F two_hands
+G shocking
+H poison
+I acid
+K purify
@@ -0,0 +1,201 @@
+// Build-time generator: reads flags.spec and writes flag_tables.c and
+// flag_tables.h, so every letter, bit and name table comes from one list.
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLAG_BITS 32
+#define MAX_FAMILIES 32
+#define MAX_NAME 64
+#define MAX_WORDS 6
+
+typedef struct spec_family {
+    char name[MAX_NAME];
+    char where; // F-line letter, 0 for none
+    char prefix[MAX_NAME]; // Affect prefix, empty for none
+    char names[FLAG_BITS][MAX_NAME];
+} SPEC_FAMILY;
+
+static SPEC_FAMILY families[MAX_FAMILIES];
+static int nfamilies;
+
+// Area-file letters: A-Z are bits 0-25, a-z continue from bit 26
+static int letter_bit(int c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return 26 + c - 'a';
+    return -1;
+}
+
+static SPEC_FAMILY *find_family(const char *name) {
+    for (int i = 0; i < nfamilies; ++i)
+        if (!strcmp(families[i].name, name))
+            return &families[i];
+    return NULL;
+}
+
+static int split_words(char *line, char *words[MAX_WORDS]) {
+    int n = 0;
+    char *save = NULL;
+    for (char *w = strtok_r(line, " \t\r\n", &save); w; w = strtok_r(NULL, " \t\r\n", &save)) {
+        if (n == MAX_WORDS || strlen(w) >= MAX_NAME) return -1;
+        words[n++] = w;
+    }
+    return n;
+}
+
+static int parse_spec(FILE *fp, const char *path) {
+    char line[256];
+    int lineno = 0;
+    SPEC_FAMILY *cur = NULL;
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *words[MAX_WORDS];
+        lineno++;
+        if (line[strspn(line, " \t")] == '#') continue;
+        int n = split_words(line, words);
+        if (n == 0) continue;
+
+        if (!strcmp(words[0], "family")) {
+            if ((n != 4 && n != 6) || (n == 6 && strcmp(words[4], "like"))
+                || strlen(words[2]) != 1 || nfamilies == MAX_FAMILIES || find_family(words[1])) {
+                fprintf(stderr, "%s:%d: expected a new family <name> <where> <prefix> [like <family>]\n", path, lineno);
+                return -1;
+            }
+            cur = &families[nfamilies++];
+            memset(cur, 0, sizeof(*cur));
+            strcpy(cur->name, words[1]);
+            cur->where = words[2][0] == '-' ? 0 : words[2][0];
+            if (strcmp(words[3], "-")) strcpy(cur->prefix, words[3]);
+            if (n == 6) {
+                SPEC_FAMILY *like = find_family(words[5]);
+                if (!like) {
+                    fprintf(stderr, "%s:%d: unknown family '%s'\n", path, lineno, words[5]);
+                    return -1;
+                }
+                memcpy(cur->names, like->names, sizeof(cur->names));
+            }
+            continue;
+        }
+
+        int bit = strlen(words[0]) == 1 ? letter_bit(words[0][0]) : -1;
+        if (!cur || n != 2 || bit < 0 || bit >= FLAG_BITS || cur->names[bit][0]) {
+            fprintf(stderr, "%s:%d: expected a new <letter A-Z or a-f> <name> inside a family\n", path, lineno);
+            return -1;
+        }
+        strcpy(cur->names[bit], words[1]);
+    }
+    if (!nfamilies) {
+        fprintf(stderr, "%s: no families\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void write_header(FILE *out) {
+    size_t name_max = 0, names_max = 0;
+    for (int f = 0; f < nfamilies; ++f) {
+        size_t all = 0;
+        for (int b = 0; b < FLAG_BITS; ++b) {
+            size_t len = strlen(families[f].names[b]);
+            if (len > name_max) name_max = len;
+            if (len) all += len + 1;
+        }
+        if (all > names_max) names_max = all;
+    }
+
+    fprintf(out, "// Generated by gen_flags from flags.spec; do not edit\n");
+    fprintf(out, "#ifndef FLAG_TABLES_H\n#define FLAG_TABLES_H\n\n");
+    fprintf(out, "#define FLAG_NAME_MAX %zu // Longest flag name\n", name_max);
+    fprintf(out, "#define FLAG_NAMES_MAX %zu // Every flag of a family, space separated, plus NUL\n\n",
+            names_max < 5 ? 5 : names_max);
+    for (int f = 0; f < nfamilies; ++f)
+        fprintf(out, "extern const FLAG_FAMILY flag_%s;\n", families[f].name);
+    fprintf(out, "\n#endif\n");
+}
+
+static void write_family(FILE *out, const SPEC_FAMILY *fam) {
+    unsigned long defined = 0;
+    for (int b = 0; b < FLAG_BITS; ++b)
+        if (fam->names[b][0]) defined |= 1UL << b;
+
+    fprintf(out, "const FLAG_FAMILY flag_%s = {\n", fam->name);
+    fprintf(out, "    .name = \"%s\",\n", fam->name);
+    fprintf(out, "    .defined = 0x%lxUL,\n", defined);
+    fprintf(out, "    .bit_names = {");
+    for (int b = 0; b < FLAG_BITS; ++b)
+        if (fam->names[b][0]) fprintf(out, "\n        [%d] = \"%s\",", b, fam->names[b]);
+    fprintf(out, "\n    },\n");
+    fprintf(out, "    .bit_name_len = {");
+    for (int b = 0; b < FLAG_BITS; ++b)
+        if (fam->names[b][0]) fprintf(out, " [%d] = %zu,", b, strlen(fam->names[b]));
+    fprintf(out, " },\n");
+    if (fam->prefix[0]) {
+        fprintf(out, "    .affect_names = {");
+        for (int b = 0; b < FLAG_BITS; ++b)
+            if (fam->names[b][0]) fprintf(out, "\n        [%d] = \"%s:%s\",", b, fam->prefix, fam->names[b]);
+        fprintf(out, "\n    },\n");
+        fprintf(out, "    .affect_unknown = \"%s:unknown\",\n", fam->prefix);
+    }
+    fprintf(out, "    .letter_names = {");
+    for (int b = 0; b < FLAG_BITS; ++b) {
+        int letter = b < 26 ? 'A' + b : 'a' + b - 26;
+        if (fam->names[b][0]) fprintf(out, "\n        ['%c'] = \"%s\",", letter, fam->names[b]);
+    }
+    fprintf(out, "\n    },\n");
+    fprintf(out, "};\n\n");
+}
+
+static void write_source(FILE *out) {
+    fprintf(out, "// Generated by gen_flags from flags.spec; do not edit\n");
+    fprintf(out, "#include \"flags.h\"\n\n");
+
+    fprintf(out, "const long flag_letter_bits[256] = {\n");
+    for (int c = 0; c < 256; ++c) {
+        int bit = letter_bit(c);
+        if (bit >= 0 && bit < (int)(sizeof(long) * 8 - 1))
+            fprintf(out, "    ['%c'] = 0x%lxL,\n", c, 1UL << bit);
+    }
+    fprintf(out, "};\n\n");
+
+    for (int f = 0; f < nfamilies; ++f)
+        write_family(out, &families[f]);
+
+    fprintf(out, "const FLAG_FAMILY *const flag_family_by_where[256] = {\n");
+    for (int f = 0; f < nfamilies; ++f)
+        if (families[f].where)
+            fprintf(out, "    ['%c'] = &flag_%s,\n", families[f].where, families[f].name);
+    fprintf(out, "};\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <flags.spec> <out.c> <out.h>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[1], "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open file %s\n", argv[1]);
+        return 1;
+    }
+    int rc = parse_spec(fp, argv[1]);
+    fclose(fp);
+    if (rc != 0) return 1;
+
+    FILE *src = fopen(argv[2], "w");
+    FILE *hdr = fopen(argv[3], "w");
+    if (!src || !hdr) {
+        fprintf(stderr, "Error: Cannot write generated tables\n");
+        return 1;
+    }
+    write_source(src);
+    write_header(hdr);
+    if (fclose(src) != 0 || fclose(hdr) != 0) {
+        remove(argv[2]);
+        remove(argv[3]);
+        return 1;
+    }
+    return 0;
+}
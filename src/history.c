@@ -0,0 +1,788 @@
+#define _DEFAULT_SOURCE // flock() and fdatasync() alongside the POSIX calls
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "history.h"
+#include "mem.h"
+#include "strbuf.h"
+
+// The log starts with a magic line, so no record sits at offset 0 and base 0
+// can mean "none". Every record is a fixed header and a payload: the text for
+// a keyframe, delta operations for a delta, nothing otherwise. All integers
+// are little-endian.
+static const char LOG_MAGIC[8] = "AHLOG1\n";
+static const char INDEX_MAGIC[8] = "AHIDX1\n";
+#define LOG_HEADER_SIZE 8
+#define RECORD_MAGIC 0x31524841u // "AHR1"
+#define RECORD_HEADER_SIZE 48
+#define INDEX_HEADER_SIZE 32
+#define INDEX_ENTRY_SIZE 48
+#define INDEX_SNAPSHOT_SIZE 24
+// Reuse adds a hop on top of a delta chain
+#define MAX_CHAIN (2 * HISTORY_KEYFRAME_INTERVAL + 2)
+
+typedef struct record_header {
+    int change;
+    int storage;
+    int depth;
+    int64_t vnum;
+    int64_t time;
+    uint64_t hash;
+    uint64_t base;
+    uint32_t payload_len;
+    uint32_t text_len;
+} RECORD_HEADER;
+
+static void put_u16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint16_t get_u16(const unsigned char *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; --i) v = v << 8 | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = v << 8 | p[i];
+    return v;
+}
+
+// FNV-1a; 0 is kept for "no text"
+static uint64_t text_hash(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ull;
+    }
+    return h ? h : 1;
+}
+
+static void encode_header(unsigned char *p, const RECORD_HEADER *r) {
+    put_u32(p, RECORD_MAGIC);
+    p[4] = (unsigned char)r->change;
+    p[5] = (unsigned char)r->storage;
+    put_u16(p + 6, (uint16_t)r->depth);
+    put_u64(p + 8, (uint64_t)r->vnum);
+    put_u64(p + 16, (uint64_t)r->time);
+    put_u64(p + 24, r->hash);
+    put_u64(p + 32, r->base);
+    put_u32(p + 40, r->payload_len);
+    put_u32(p + 44, r->text_len);
+}
+
+static bool decode_header(const unsigned char *p, RECORD_HEADER *r) {
+    if (get_u32(p) != RECORD_MAGIC) return false;
+    r->change = p[4];
+    r->storage = p[5];
+    r->depth = get_u16(p + 6);
+    r->vnum = (int64_t)get_u64(p + 8);
+    r->time = (int64_t)get_u64(p + 16);
+    r->hash = get_u64(p + 24);
+    r->base = get_u64(p + 32);
+    r->payload_len = get_u32(p + 40);
+    r->text_len = get_u32(p + 44);
+    return r->change >= HISTORY_ADDED && r->change <= HISTORY_REMOVED
+           && r->storage >= HISTORY_KEYFRAME && r->storage <= HISTORY_NONE;
+}
+
+static int read_at(int fd, void *buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+static int write_at(int fd, const void *buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, (const char *)buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+// Deltas are varint operations: (len << 1 | 1, start) copies len bytes of
+// the base text from start, (len << 1) is followed by len new bytes
+static void put_varint(STRBUF *sb, uint64_t v) {
+    char buf[10];
+    size_t n = 0;
+    do {
+        buf[n] = (char)(v & 0x7f);
+        v >>= 7;
+        if (v) buf[n] |= (char)0x80;
+        n++;
+    } while (v);
+    sb_append(sb, buf, n);
+}
+
+static bool get_varint(const unsigned char **p, const unsigned char *end, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char b = *(*p)++;
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+typedef struct line_span {
+    size_t start;
+    size_t len;
+} LINE_SPAN;
+
+static size_t line_end(const char *s, size_t len, size_t pos) {
+    const char *nl = memchr(s + pos, '\n', len - pos);
+    return nl ? (size_t)(nl - s) + 1 : len;
+}
+
+// Objects are written a field per line, so an edit changes a few lines and
+// the rest are found in the previous version: each line of text is copied
+// from an equal base line if there is one (preferring the line after the
+// last copy, to keep copies contiguous) and inserted otherwise
+static void delta_encode(STRBUF *out, const char *base, size_t blen, const char *text, size_t tlen) {
+    size_t nlines = 0;
+    for (size_t pos = 0; pos < blen; pos = line_end(base, blen, pos)) nlines++;
+    LINE_SPAN *lines = mem_alloc(MEM_OTHER, (nlines ? nlines : 1) * sizeof(*lines));
+    if (!lines) {
+        nlines = 0;
+    } else {
+        size_t i = 0;
+        for (size_t pos = 0; pos < blen; pos = line_end(base, blen, pos)) {
+            lines[i].start = pos;
+            lines[i++].len = line_end(base, blen, pos) - pos;
+        }
+    }
+
+    size_t copy_start = 0, copy_len = 0;
+    size_t insert_start = 0, insert_len = 0;
+    size_t expect = 0;
+    for (size_t pos = 0; pos < tlen;) {
+        size_t len = line_end(text, tlen, pos) - pos;
+        size_t match = nlines;
+        if (expect < nlines && lines[expect].len == len && !memcmp(base + lines[expect].start, text + pos, len))
+            match = expect;
+        for (size_t k = 0; match == nlines && k < nlines; ++k)
+            if (lines[k].len == len && !memcmp(base + lines[k].start, text + pos, len))
+                match = k;
+
+        if (match < nlines) {
+            if (insert_len) {
+                put_varint(out, (uint64_t)insert_len << 1);
+                sb_append(out, text + insert_start, insert_len);
+                insert_len = 0;
+            }
+            if (copy_len && copy_start + copy_len == lines[match].start) {
+                copy_len += len;
+            } else {
+                if (copy_len) {
+                    put_varint(out, (uint64_t)copy_len << 1 | 1);
+                    put_varint(out, copy_start);
+                }
+                copy_start = lines[match].start;
+                copy_len = len;
+            }
+            expect = match + 1;
+        } else {
+            if (copy_len) {
+                put_varint(out, (uint64_t)copy_len << 1 | 1);
+                put_varint(out, copy_start);
+                copy_len = 0;
+            }
+            if (!insert_len) insert_start = pos;
+            insert_len += len;
+        }
+        pos += len;
+    }
+    if (copy_len) {
+        put_varint(out, (uint64_t)copy_len << 1 | 1);
+        put_varint(out, copy_start);
+    }
+    if (insert_len) {
+        put_varint(out, (uint64_t)insert_len << 1);
+        sb_append(out, text + insert_start, insert_len);
+    }
+    mem_free(lines);
+}
+
+static int delta_apply(STRBUF *out, const char *base, size_t blen, const unsigned char *ops, size_t len) {
+    const unsigned char *p = ops, *end = ops + len;
+    while (p < end) {
+        uint64_t op, start;
+        if (!get_varint(&p, end, &op)) return -1;
+        uint64_t n = op >> 1;
+        if (op & 1) {
+            if (!get_varint(&p, end, &start) || start > blen || n > blen - start) return -1;
+            sb_append(out, base + start, (size_t)n);
+        } else {
+            if (n > (uint64_t)(end - p)) return -1;
+            sb_append(out, (const char *)p, (size_t)n);
+            p += n;
+        }
+    }
+    return 0;
+}
+
+// Append the text of the version recorded at offset
+static int version_text(const HISTORY *h, uint64_t offset, STRBUF *out, int hops) {
+    unsigned char buf[RECORD_HEADER_SIZE];
+    RECORD_HEADER r;
+    if (hops > MAX_CHAIN || read_at(h->fd, buf, sizeof(buf), offset) != 0 || !decode_header(buf, &r))
+        return -1;
+    if (r.storage == HISTORY_REUSE) return version_text(h, r.base, out, hops + 1);
+    if (r.storage == HISTORY_NONE) return -1;
+
+    unsigned char *payload = mem_alloc(MEM_OTHER, r.payload_len ? r.payload_len : 1);
+    if (!payload || read_at(h->fd, payload, r.payload_len, offset + RECORD_HEADER_SIZE) != 0) {
+        mem_free(payload);
+        return -1;
+    }
+    int rc = 0;
+    size_t before = out->len;
+    if (r.storage == HISTORY_KEYFRAME) {
+        sb_append(out, (const char *)payload, r.payload_len);
+    } else {
+        STRBUF base;
+        sb_init(&base);
+        rc = version_text(h, r.base, &base, hops + 1);
+        if (rc == 0) rc = delta_apply(out, base.data, base.len, payload, r.payload_len);
+        sb_free(&base);
+    }
+    mem_free(payload);
+    if (rc == 0 && out->len - before != r.text_len) rc = -1;
+    return rc;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const HISTORY_ENTRY *x = a, *y = b;
+    if (x->vnum != y->vnum) return x->vnum < y->vnum ? -1 : 1;
+    if (x->time != y->time) return x->time < y->time ? -1 : 1;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int add_entry(HISTORY_ENTRY **entries, size_t *count, size_t *cap, const HISTORY_ENTRY *e) {
+    if (*count == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 1024;
+        HISTORY_ENTRY *grown = mem_realloc(MEM_OTHER, *entries, ncap * sizeof(**entries));
+        if (!grown) return -1;
+        *entries = grown;
+        *cap = ncap;
+    }
+    (*entries)[(*count)++] = *e;
+    return 0;
+}
+
+static int add_snapshot(HISTORY *h, int64_t time, uint64_t start, uint64_t end) {
+    // Records are scanned back in one at a time; consecutive ones at the
+    // same time belong to one snapshot
+    if (h->nsnapshots && h->snapshots[h->nsnapshots - 1].time == time
+        && h->snapshots[h->nsnapshots - 1].end == start) {
+        h->snapshots[h->nsnapshots - 1].end = end;
+        return 0;
+    }
+    HISTORY_SNAPSHOT *grown = mem_realloc(MEM_OTHER, h->snapshots, (h->nsnapshots + 1) * sizeof(*grown));
+    if (!grown) return -1;
+    h->snapshots = grown;
+    h->snapshots[h->nsnapshots++] = (HISTORY_SNAPSHOT){ time, start, end };
+    return 0;
+}
+
+static void entry_from_header(HISTORY_ENTRY *e, const RECORD_HEADER *r, uint64_t offset) {
+    e->vnum = r->vnum;
+    e->time = r->time;
+    e->offset = offset;
+    e->hash = r->hash;
+    e->base = r->base;
+    e->change = r->change;
+    e->storage = r->storage;
+    e->depth = r->depth;
+}
+
+// Index the records from h->log_bytes to the end of the log. A record cut
+// short by a crash ends the scan; a writable store truncates it away.
+static int scan_log(HISTORY *h, bool writable, bool *changed) {
+    struct stat st;
+    if (fstat(h->fd, &st) != 0) return -1;
+    uint64_t size = (uint64_t)st.st_size;
+    size_t cap = h->nentries;
+    uint64_t pos = h->log_bytes;
+    while (pos + RECORD_HEADER_SIZE <= size) {
+        unsigned char buf[RECORD_HEADER_SIZE];
+        RECORD_HEADER r;
+        if (read_at(h->fd, buf, sizeof(buf), pos) != 0 || !decode_header(buf, &r)) break;
+        uint64_t end = pos + RECORD_HEADER_SIZE + r.payload_len;
+        if (end > size) break;
+        HISTORY_ENTRY e;
+        entry_from_header(&e, &r, pos);
+        if (add_entry(&h->entries, &h->nentries, &cap, &e) != 0 || add_snapshot(h, r.time, pos, end) != 0)
+            return -1;
+        pos = end;
+        *changed = true;
+    }
+    if (pos < size && writable) {
+        if (ftruncate(h->fd, (off_t)pos) != 0) return -1;
+        *changed = true;
+    }
+    h->log_bytes = pos;
+    if (*changed) qsort(h->entries, h->nentries, sizeof(*h->entries), compare_entries);
+    return 0;
+}
+
+// Take the saved index if it is intact and no longer than the log
+static void load_index(HISTORY *h, uint64_t log_size) {
+    FILE *fp = fopen(h->index_path, "rb");
+    if (!fp) return;
+    unsigned char head[INDEX_HEADER_SIZE];
+    if (fread(head, 1, sizeof(head), fp) != sizeof(head) || memcmp(head, INDEX_MAGIC, 8)) {
+        fclose(fp);
+        return;
+    }
+    uint64_t log_bytes = get_u64(head + 8);
+    uint64_t nentries = get_u64(head + 16);
+    uint64_t nsnapshots = get_u64(head + 24);
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0
+        || (uint64_t)st.st_size != INDEX_HEADER_SIZE + nentries * INDEX_ENTRY_SIZE + nsnapshots * INDEX_SNAPSHOT_SIZE
+        || log_bytes < LOG_HEADER_SIZE || log_bytes > log_size) {
+        fclose(fp);
+        return;
+    }
+
+    HISTORY_ENTRY *entries = mem_alloc(MEM_OTHER, (nentries ? nentries : 1) * sizeof(*entries));
+    HISTORY_SNAPSHOT *snapshots = mem_alloc(MEM_OTHER, (nsnapshots ? nsnapshots : 1) * sizeof(*snapshots));
+    bool ok = entries && snapshots;
+    unsigned char buf[INDEX_ENTRY_SIZE];
+    for (uint64_t i = 0; ok && i < nentries; ++i) {
+        ok = fread(buf, 1, INDEX_ENTRY_SIZE, fp) == INDEX_ENTRY_SIZE;
+        HISTORY_ENTRY *e = &entries[i];
+        e->vnum = (int64_t)get_u64(buf);
+        e->time = (int64_t)get_u64(buf + 8);
+        e->offset = get_u64(buf + 16);
+        e->hash = get_u64(buf + 24);
+        e->base = get_u64(buf + 32);
+        e->change = buf[40];
+        e->storage = buf[41];
+        e->depth = get_u16(buf + 42);
+    }
+    for (uint64_t i = 0; ok && i < nsnapshots; ++i) {
+        ok = fread(buf, 1, INDEX_SNAPSHOT_SIZE, fp) == INDEX_SNAPSHOT_SIZE;
+        snapshots[i].time = (int64_t)get_u64(buf);
+        snapshots[i].start = get_u64(buf + 8);
+        snapshots[i].end = get_u64(buf + 16);
+    }
+    fclose(fp);
+    if (!ok) {
+        mem_free(entries);
+        mem_free(snapshots);
+        return;
+    }
+    h->entries = entries;
+    h->nentries = (size_t)nentries;
+    h->snapshots = snapshots;
+    h->nsnapshots = (size_t)nsnapshots;
+    h->log_bytes = log_bytes;
+}
+
+static int save_index(const HISTORY *h) {
+    STRBUF sb;
+    sb_init(&sb);
+    size_t size = INDEX_HEADER_SIZE + h->nentries * INDEX_ENTRY_SIZE + h->nsnapshots * INDEX_SNAPSHOT_SIZE;
+    if (sb_reserve(&sb, size) != 0) return -1;
+    unsigned char *p = (unsigned char *)sb.data;
+    memcpy(p, INDEX_MAGIC, 8);
+    put_u64(p + 8, h->log_bytes);
+    put_u64(p + 16, h->nentries);
+    put_u64(p + 24, h->nsnapshots);
+    p += INDEX_HEADER_SIZE;
+    for (size_t i = 0; i < h->nentries; ++i, p += INDEX_ENTRY_SIZE) {
+        const HISTORY_ENTRY *e = &h->entries[i];
+        memset(p, 0, INDEX_ENTRY_SIZE);
+        put_u64(p, (uint64_t)e->vnum);
+        put_u64(p + 8, (uint64_t)e->time);
+        put_u64(p + 16, e->offset);
+        put_u64(p + 24, e->hash);
+        put_u64(p + 32, e->base);
+        p[40] = (unsigned char)e->change;
+        p[41] = (unsigned char)e->storage;
+        put_u16(p + 42, (uint16_t)e->depth);
+    }
+    for (size_t i = 0; i < h->nsnapshots; ++i, p += INDEX_SNAPSHOT_SIZE) {
+        put_u64(p, (uint64_t)h->snapshots[i].time);
+        put_u64(p + 8, h->snapshots[i].start);
+        put_u64(p + 16, h->snapshots[i].end);
+    }
+    sb.len = size;
+    int rc = sb_write_file(&sb, h->index_path);
+    sb_free(&sb);
+    return rc;
+}
+
+static char *join_path(const char *dir, const char *name) {
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = mem_alloc(MEM_OTHER, len);
+    if (path) snprintf(path, len, "%s/%s", dir, name);
+    return path;
+}
+
+int history_open(HISTORY *h, const char *dir, bool writable, char *err, size_t errlen) {
+    memset(h, 0, sizeof(*h));
+    h->fd = -1;
+    if (writable && mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        snprintf(err, errlen, "cannot create %s: %s", dir, strerror(errno));
+        return -1;
+    }
+    h->log_path = join_path(dir, "history.log");
+    h->index_path = join_path(dir, "history.idx");
+    if (!h->log_path || !h->index_path) {
+        snprintf(err, errlen, "out of memory");
+        history_close(h);
+        return -1;
+    }
+    h->fd = open(h->log_path, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0666);
+    if (h->fd < 0) {
+        snprintf(err, errlen, "cannot open %s: %s", h->log_path, strerror(errno));
+        history_close(h);
+        return -1;
+    }
+    // Appends from overlapping runs would interleave; readers wait for them
+    if (flock(h->fd, writable ? LOCK_EX : LOCK_SH) != 0) {
+        snprintf(err, errlen, "cannot lock %s: %s", h->log_path, strerror(errno));
+        history_close(h);
+        return -1;
+    }
+
+    struct stat st;
+    char magic[LOG_HEADER_SIZE];
+    if (fstat(h->fd, &st) != 0) {
+        snprintf(err, errlen, "cannot stat %s: %s", h->log_path, strerror(errno));
+        history_close(h);
+        return -1;
+    }
+    if (st.st_size == 0 && writable) {
+        if (write_at(h->fd, LOG_MAGIC, LOG_HEADER_SIZE, 0) != 0) {
+            snprintf(err, errlen, "cannot write %s: %s", h->log_path, strerror(errno));
+            history_close(h);
+            return -1;
+        }
+        st.st_size = LOG_HEADER_SIZE;
+    }
+    if (read_at(h->fd, magic, LOG_HEADER_SIZE, 0) != 0 || memcmp(magic, LOG_MAGIC, LOG_HEADER_SIZE)) {
+        snprintf(err, errlen, "%s is not a history log", h->log_path);
+        history_close(h);
+        return -1;
+    }
+
+    // The index covers the log up to its log_bytes; whatever was appended
+    // after it (a run that died before rewriting the index) is scanned in
+    load_index(h, (uint64_t)st.st_size);
+    bool rebuilt = !h->log_bytes;
+    if (rebuilt) h->log_bytes = LOG_HEADER_SIZE;
+    bool changed = false;
+    if (scan_log(h, writable, &changed) != 0) {
+        snprintf(err, errlen, "cannot read %s", h->log_path);
+        history_close(h);
+        return -1;
+    }
+    if (writable && (changed || rebuilt) && save_index(h) != 0) {
+        snprintf(err, errlen, "cannot write %s", h->index_path);
+        history_close(h);
+        return -1;
+    }
+    return 0;
+}
+
+void history_close(HISTORY *h) {
+    if (h->fd >= 0) close(h->fd); // Drops the lock
+    mem_free(h->log_path);
+    mem_free(h->index_path);
+    mem_free(h->entries);
+    mem_free(h->snapshots);
+    memset(h, 0, sizeof(*h));
+    h->fd = -1;
+}
+
+// First entry for vnum (or where it would go)
+static size_t lower_bound(const HISTORY *h, int64_t vnum) {
+    size_t lo = 0, hi = h->nentries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (h->entries[mid].vnum < vnum) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// A version's own record: the one a reuse points to, else itself
+static uint64_t text_record(const HISTORY_ENTRY *e) {
+    return e->storage == HISTORY_REUSE ? e->base : e->offset;
+}
+
+// Append one record for an item that differs from its latest version
+// (latest is NULL if there is none, or it was removed). group and ngroup
+// are all of the item's versions.
+static int append_version(HISTORY *h, STRBUF *log, HISTORY_ENTRY *added, const HISTORY_ITEM *item,
+                          uint64_t hash, int64_t time, const HISTORY_ENTRY *latest,
+                          const HISTORY_ENTRY *group, size_t ngroup, HISTORY_COUNTS *counts) {
+    RECORD_HEADER r = {0};
+    r.change = latest ? HISTORY_CHANGED : HISTORY_ADDED;
+    r.vnum = item->vnum;
+    r.time = time;
+    r.hash = hash;
+    r.text_len = (uint32_t)item->len;
+    STRBUF payload;
+    sb_init(&payload);
+
+    // Changed back to something stored before: point at it
+    for (size_t i = ngroup; i-- > 0 && !r.storage;) {
+        if (group[i].hash != hash) continue;
+        STRBUF old;
+        sb_init(&old);
+        if (version_text(h, text_record(&group[i]), &old, 0) == 0 && old.len == item->len
+            && !memcmp(old.data, item->text, item->len)) {
+            r.storage = HISTORY_REUSE;
+            r.base = text_record(&group[i]);
+            r.depth = group[i].depth;
+            counts->reused++;
+        }
+        sb_free(&old);
+    }
+
+    // Otherwise a delta against the latest version while the chain is short
+    // and the delta pays for itself
+    if (!r.storage && latest && latest->depth + 1 < HISTORY_KEYFRAME_INTERVAL) {
+        STRBUF prev;
+        sb_init(&prev);
+        if (version_text(h, text_record(latest), &prev, 0) == 0) {
+            delta_encode(&payload, prev.data, prev.len, item->text, item->len);
+            if (payload.len * 2 < item->len) {
+                r.storage = HISTORY_DELTA;
+                r.base = text_record(latest);
+                r.depth = latest->depth + 1;
+                counts->deltas++;
+            }
+        }
+        sb_free(&prev);
+    }
+
+    if (!r.storage) {
+        payload.len = 0;
+        sb_append(&payload, item->text, item->len);
+        r.storage = HISTORY_KEYFRAME;
+        counts->keyframes++;
+    }
+    r.payload_len = (uint32_t)payload.len;
+
+    unsigned char head[RECORD_HEADER_SIZE];
+    encode_header(head, &r);
+    uint64_t offset = h->log_bytes + log->len;
+    sb_append(log, (const char *)head, sizeof(head));
+    sb_append(log, payload.data ? payload.data : "", payload.len);
+    sb_free(&payload);
+    entry_from_header(added, &r, offset);
+    if (r.change == HISTORY_ADDED) counts->added++;
+    else counts->changed++;
+    return 0;
+}
+
+int history_record(HISTORY *h, int64_t time, const HISTORY_ITEM *items, size_t nitems,
+                   HISTORY_COUNTS *counts, char *err, size_t errlen) {
+    memset(counts, 0, sizeof(*counts));
+    if (h->nsnapshots && time < h->snapshots[h->nsnapshots - 1].time) {
+        snprintf(err, errlen, "the last snapshot is newer (%lld); record snapshots oldest first",
+                 (long long)h->snapshots[h->nsnapshots - 1].time);
+        return -1;
+    }
+
+    STRBUF log;
+    sb_init(&log);
+    HISTORY_ENTRY *added = NULL;
+    size_t nadded = 0, added_cap = 0;
+    size_t i = 0, j = 0;
+    int rc = 0;
+    // Both lists are in vnum order: walk them together
+    while (rc == 0 && (i < nitems || j < h->nentries)) {
+        int64_t vnum = i < nitems ? items[i].vnum : h->entries[j].vnum;
+        if (j < h->nentries && h->entries[j].vnum < vnum) vnum = h->entries[j].vnum;
+        size_t start = j;
+        while (j < h->nentries && h->entries[j].vnum == vnum) j++;
+        const HISTORY_ENTRY *latest = j > start ? &h->entries[j - 1] : NULL;
+        if (latest && latest->change == HISTORY_REMOVED) latest = NULL;
+
+        HISTORY_ENTRY e;
+        if (i < nitems && items[i].vnum == vnum) {
+            const HISTORY_ITEM *item = &items[i];
+            uint64_t hash = text_hash(item->text, item->len);
+            if (latest && latest->hash == hash) {
+                counts->unchanged++;
+            } else {
+                rc = append_version(h, &log, &e, item, hash, time, latest, &h->entries[start], j - start, counts);
+                if (rc == 0) rc = add_entry(&added, &nadded, &added_cap, &e);
+            }
+            // A vnum defined twice keeps its first definition
+            while (i < nitems && items[i].vnum == vnum) i++;
+        } else if (latest) {
+            RECORD_HEADER r = { HISTORY_REMOVED, HISTORY_NONE, 0, vnum, time, 0, 0, 0, 0 };
+            unsigned char head[RECORD_HEADER_SIZE];
+            encode_header(head, &r);
+            entry_from_header(&e, &r, h->log_bytes + log.len);
+            sb_append(&log, (const char *)head, sizeof(head));
+            rc = add_entry(&added, &nadded, &added_cap, &e);
+            counts->removed++;
+        }
+    }
+
+    if (rc == 0 && log.len) {
+        uint64_t start = h->log_bytes;
+        if (write_at(h->fd, log.data, log.len, start) != 0 || fdatasync(h->fd) != 0) {
+            snprintf(err, errlen, "cannot append to %s: %s", h->log_path, strerror(errno));
+            // Leave the log as the index knows it
+            if (ftruncate(h->fd, (off_t)start) != 0) { /* the next open drops the tail */ }
+            rc = -1;
+        } else {
+            size_t cap = h->nentries;
+            for (size_t k = 0; rc == 0 && k < nadded; ++k)
+                rc = add_entry(&h->entries, &h->nentries, &cap, &added[k]);
+            if (rc == 0) rc = add_snapshot(h, time, start, start + log.len);
+            h->log_bytes = start + log.len;
+            qsort(h->entries, h->nentries, sizeof(*h->entries), compare_entries);
+            if (rc == 0 && save_index(h) != 0) {
+                snprintf(err, errlen, "cannot write %s", h->index_path);
+                rc = -1;
+            }
+            counts->bytes = log.len;
+        }
+    } else if (rc != 0) {
+        snprintf(err, errlen, "out of memory");
+    }
+    mem_free(added);
+    sb_free(&log);
+    return rc;
+}
+
+int history_item(HISTORY *h, int64_t vnum, int64_t time, STRBUF *out, int64_t *since,
+                 char *err, size_t errlen) {
+    *since = 0;
+    const HISTORY_ENTRY *found = NULL;
+    for (size_t i = lower_bound(h, vnum); i < h->nentries && h->entries[i].vnum == vnum; ++i) {
+        if (h->entries[i].time > time) break;
+        found = &h->entries[i];
+    }
+    if (!found) return 0;
+    *since = found->time;
+    if (found->change == HISTORY_REMOVED) return 0;
+    if (version_text(h, text_record(found), out, 0) != 0) {
+        snprintf(err, errlen, "damaged record at offset %llu in %s",
+                 (unsigned long long)found->offset, h->log_path);
+        return -1;
+    }
+    return 1;
+}
+
+void history_format_time(char *buf, size_t len, int64_t t) {
+    time_t tt = (time_t)t;
+    struct tm tm;
+    if (!gmtime_r(&tt, &tm) || !strftime(buf, len, "%Y-%m-%dT%H:%M:%SZ", &tm))
+        snprintf(buf, len, "%lld", (long long)t);
+}
+
+int history_changes(HISTORY *h, int64_t from, int64_t to, STRBUF *out, char *err, size_t errlen) {
+    static const char *change_names[] = { "", "added", "changed", "removed" };
+    size_t lo = 0, hi = h->nsnapshots;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (h->snapshots[mid].time < from) lo = mid + 1;
+        else hi = mid;
+    }
+
+    int count = 0;
+    sb_puts(out, "[");
+    for (size_t s = lo; s < h->nsnapshots && h->snapshots[s].time <= to; ++s) {
+        char date[32];
+        history_format_time(date, sizeof(date), h->snapshots[s].time);
+        // Only the record headers are read; payloads are skipped
+        for (uint64_t pos = h->snapshots[s].start; pos < h->snapshots[s].end;) {
+            unsigned char buf[RECORD_HEADER_SIZE];
+            RECORD_HEADER r;
+            if (read_at(h->fd, buf, sizeof(buf), pos) != 0 || !decode_header(buf, &r)) {
+                snprintf(err, errlen, "damaged record at offset %llu in %s",
+                         (unsigned long long)pos, h->log_path);
+                return -1;
+            }
+            sb_printf(out, "%s\n  {\"vnum\": %lld, \"time\": %lld, \"date\": \"%s\", \"change\": \"%s\"}",
+                      count++ ? "," : "", (long long)r.vnum, (long long)r.time, date, change_names[r.change]);
+            pos += RECORD_HEADER_SIZE + r.payload_len;
+        }
+    }
+    sb_puts(out, count ? "\n]\n" : "]\n");
+    return 0;
+}
+
+// Days from 1970-01-01 to a proleptic Gregorian date
+static int64_t days_from_civil(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+int history_parse_time(const char *s, int64_t *t) {
+    if (!strcmp(s, "now")) {
+        *t = (int64_t)time(NULL);
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    if (end != s && !*end && !errno) {
+        *t = v;
+        return 0;
+    }
+
+    int y, mo, d, hh = 0, mm = 0, ss = 0, n = 0;
+    if (sscanf(s, "%4d-%2d-%2d%n", &y, &mo, &d, &n) != 3 || n != 10) return -1;
+    s += n;
+    if (*s == 'T' || *s == ' ') {
+        int k = 0;
+        if (sscanf(s + 1, "%2d:%2d%n", &hh, &mm, &k) != 2 || k != 5) return -1;
+        s += 1 + k;
+        if (*s == ':') {
+            if (sscanf(s + 1, "%2d%n", &ss, &k) != 1 || k != 2) return -1;
+            s += 1 + k;
+        }
+    }
+    if (*s == 'Z') s++;
+    if (*s || mo < 1 || mo > 12 || d < 1 || d > 31 || hh > 23 || mm > 59 || ss > 60) return -1;
+    *t = days_from_civil(y, mo, d) * 86400 + hh * 3600 + mm * 60 + ss;
+    return 0;
+}
@@ -0,0 +1,104 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "strbuf.h"
+
+// Versions of an item chained as deltas before the next one is stored whole
+#define HISTORY_KEYFRAME_INTERVAL 16
+
+enum history_change { HISTORY_ADDED = 1, HISTORY_CHANGED, HISTORY_REMOVED };
+
+// How a version's text is stored in the log
+enum history_storage {
+    HISTORY_KEYFRAME = 1, // The whole text
+    HISTORY_DELTA, // Copy and insert operations against the version at base
+    HISTORY_REUSE, // Same text as the version at base, stored again by reference
+    HISTORY_NONE // Removed: no text
+};
+
+// One stored version, as the index keeps it
+typedef struct history_entry {
+    int64_t vnum;
+    int64_t time;
+    uint64_t offset; // Of the version's record in the log
+    uint64_t hash; // Of the text, 0 when removed
+    uint64_t base; // Record a delta or reuse refers to, else 0
+    int change;
+    int storage;
+    int depth; // Deltas between the text and its keyframe
+} HISTORY_ENTRY;
+
+// The records one history_record call appended
+typedef struct history_snapshot {
+    int64_t time;
+    uint64_t start;
+    uint64_t end;
+} HISTORY_SNAPSHOT;
+
+// Per-vnum item history kept in a directory: history.log, to which each
+// snapshot appends only the items that changed since the last one, and
+// history.idx, which places every version by vnum and time and can be
+// rebuilt from the log. While open, the log is locked: shared for queries,
+// exclusive for appends.
+typedef struct history {
+    char *log_path;
+    char *index_path;
+    int fd;
+    uint64_t log_bytes; // End of the last complete record
+    HISTORY_ENTRY *entries; // By vnum, then time
+    size_t nentries;
+    HISTORY_SNAPSHOT *snapshots; // By time
+    size_t nsnapshots;
+} HISTORY;
+
+// An item's text in the snapshot being recorded
+typedef struct history_item {
+    int64_t vnum;
+    const char *text;
+    size_t len;
+} HISTORY_ITEM;
+
+// What history_record stored
+typedef struct history_counts {
+    int added;
+    int changed;
+    int removed;
+    int unchanged;
+    int keyframes;
+    int deltas;
+    int reused; // Changed back to an earlier version, stored by reference
+    size_t bytes; // Appended to the log
+} HISTORY_COUNTS;
+
+// Open the store in dir, creating it when writable. Returns 0, or -1 with
+// a message in err.
+int history_open(HISTORY *h, const char *dir, bool writable, char *err, size_t errlen);
+void history_close(HISTORY *h);
+
+// Append the snapshot of every item at time, which can't be earlier than the
+// last snapshot's. items are sorted by vnum; vnums the last snapshot had and
+// items lacks are recorded as removed. Returns 0, or -1 with a message in err.
+int history_record(HISTORY *h, int64_t time, const HISTORY_ITEM *items, size_t nitems,
+                   HISTORY_COUNTS *counts, char *err, size_t errlen);
+
+// Append vnum's text as of time to out. Returns 1 with the time that version
+// was recorded in *since, 0 if the item didn't exist then (*since is when it
+// was removed, or 0 if it never existed before), or -1 with a message in err.
+int history_item(HISTORY *h, int64_t vnum, int64_t time, STRBUF *out, int64_t *since,
+                 char *err, size_t errlen);
+
+// Append a JSON array of the changes recorded from from to to, inclusive,
+// in the order they were recorded. Returns 0, or -1 with a message in err.
+int history_changes(HISTORY *h, int64_t from, int64_t to, STRBUF *out, char *err, size_t errlen);
+
+// Seconds since the epoch, "now", or a UTC date as YYYY-MM-DD with an
+// optional THH:MM[:SS]. Returns 0, or -1 if s is none of those.
+int history_parse_time(const char *s, int64_t *time);
+// t as YYYY-MM-DDTHH:MM:SSZ
+void history_format_time(char *buf, size_t len, int64_t t);
+
+#endif
@@ -0,0 +1,281 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "input.h"
+#include "mem.h"
+
+// isspace() in the C locale
+static const unsigned char space_table[256] = {
+    [' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1
+};
+
+// Newlines in n bytes at p
+static long count_newlines(const char *p, size_t n) {
+    long count = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    // Matches are summed per byte lane, which gains at most 4 per 64-byte
+    // step, so 63 steps fit before the lanes are added up
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 64 <= n) {
+        __m128i lanes = zero;
+        for (int steps = 0; steps < 63 && i + 64 <= n; ++steps, i += 64) {
+            __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), newline);
+            __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 16)), newline);
+            __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 32)), newline);
+            __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 48)), newline);
+            lanes = _mm_sub_epi8(lanes, _mm_add_epi8(_mm_add_epi8(a, b), _mm_add_epi8(c, d)));
+        }
+        __m128i sums = _mm_sad_epu8(lanes, zero);
+        count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+    }
+#endif
+    for (; i < n; ++i)
+        count += p[i] == '\n';
+    return count;
+}
+
+// Count newlines up to stream offset to, which lies in the buffer. Bytes
+// are counted once, when the buffer drops them or a line is asked for.
+static void count_lines_to(AREA_INPUT *in, long to) {
+    if (to <= in->counted) return;
+    in->lines += count_newlines(in->buf + (in->counted - in->base), (size_t)(to - in->counted));
+    in->counted = to;
+}
+
+int input_init(AREA_INPUT *in, INPUT_READ read, void *ctx) {
+    memset(in, 0, sizeof(*in));
+    in->buf = mem_alloc(MEM_OTHER, INPUT_BUFFER_SIZE);
+    if (!in->buf) return -1;
+    in->cap = INPUT_BUFFER_SIZE;
+    in->limit = LONG_MAX;
+    in->mark = -1;
+    in->read = read;
+    in->ctx = ctx;
+    return 0;
+}
+
+void input_free(AREA_INPUT *in) {
+    mem_free(in->buf);
+    memset(in, 0, sizeof(*in));
+}
+
+// Move len back to the limit if it lies inside the buffer, hiding the rest
+static void clamp_to_limit(AREA_INPUT *in) {
+    if (in->base + (long)in->len <= in->limit) return;
+    size_t end = in->limit > in->base + (long)in->pos ? (size_t)(in->limit - in->base) : in->pos;
+    in->hidden += in->len - end;
+    in->len = end;
+}
+
+void input_set_limit(AREA_INPUT *in, long limit) {
+    in->len += in->hidden;
+    in->hidden = 0;
+    in->limit = limit;
+    clamp_to_limit(in);
+}
+
+// Make at least want unread bytes available unless the input (or its
+// limit) ends first; returns how many there are. Nothing is hidden unless
+// len is at the limit, so the reads below start with hidden at 0.
+size_t input_fill(AREA_INPUT *in, size_t want) {
+    size_t avail = in->len - in->pos;
+    if (avail >= want || in->eof || in->base + (long)in->len >= in->limit) return avail;
+
+    size_t keep = in->pos < INPUT_KEEP ? in->pos : INPUT_KEEP;
+    if (in->mark >= 0) {
+        size_t marked = in->pos - (size_t)(in->mark - in->base);
+        if (marked > in->cap / 2) in->mark = -1;
+        else if (marked > keep) keep = marked;
+    }
+    size_t drop = in->pos - keep;
+    if (drop) {
+        count_lines_to(in, in->base + (long)drop);
+        memmove(in->buf, in->buf + drop, in->len - drop);
+        in->base += (long)drop;
+        in->len -= drop;
+        in->pos = keep;
+    }
+    while (in->len - in->pos < want && in->len < in->cap) {
+        size_t n = in->read(in->ctx, in->buf + in->len, in->cap - in->len);
+        if (n == 0) {
+            in->eof = true;
+            break;
+        }
+        in->len += n;
+    }
+    clamp_to_limit(in);
+    return in->len - in->pos;
+}
+
+bool input_rewind(AREA_INPUT *in, long to) {
+    if (in->mark < 0 || to < in->mark || to < in->base || to > input_tell(in)) return false;
+    in->pos = (size_t)(to - in->base);
+    return true;
+}
+
+// Counting reaches pos as diagnostics ask for it; only what is still
+// behind pos (after an ungetc) is counted twice
+long input_line(AREA_INPUT *in) {
+    long at = input_tell(in);
+    count_lines_to(in, at);
+    return in->lines - count_newlines(in->buf + (at - in->base), (size_t)(in->counted - at)) + 1;
+}
+
+int input_getc_slow(AREA_INPUT *in) {
+    if (input_fill(in, 1) == 0) return EOF;
+    return (unsigned char)in->buf[in->pos++];
+}
+
+// Consume whitespace and return (consuming) the next byte, or EOF
+int input_skip_space(AREA_INPUT *in) {
+    for (;;) {
+        const unsigned char *start = (const unsigned char *)in->buf;
+        const unsigned char *p = start + in->pos;
+        const unsigned char *end = start + in->len;
+#ifdef __SSE2__
+        const __m128i blank = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i ctl_span = _mm_set1_epi8('\r' - '\t');
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)p);
+            // \t..\r is one range: (c - '\t') as unsigned <= 4
+            __m128i t = _mm_sub_epi8(v, tab);
+            __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(t, ctl_span), t);
+            __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, blank), ctl);
+            unsigned mask = ~(unsigned)_mm_movemask_epi8(space) & 0xffff;
+            if (mask) {
+                p += __builtin_ctz(mask);
+                in->pos = (size_t)(p - start) + 1;
+                return *p;
+            }
+            p += 16;
+        }
+#endif
+        while (p < end && space_table[*p]) p++;
+        if (p < end) {
+            in->pos = (size_t)(p - start) + 1;
+            return *p;
+        }
+        in->pos = in->len;
+        if (input_fill(in, 1) == 0) return EOF;
+    }
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define INPUT_SWAR 1
+
+// Number of leading ASCII digits in an 8-byte little-endian word
+static unsigned swar_digit_count(uint64_t x) {
+    uint64_t high = x & 0xf0f0f0f0f0f0f0f0ULL;
+    uint64_t adj = (x + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL;
+    uint64_t nondigit = (high ^ 0x3030303030303030ULL) | (adj ^ 0x3030303030303030ULL);
+    return nondigit ? (unsigned)__builtin_ctzll(nondigit) / 8 : 8;
+}
+
+// Value of 8 digit bytes, first byte most significant
+static unsigned swar_eight_digits(uint64_t x) {
+    x = (x & 0x0f0f0f0f0f0f0f0fULL) * 2561 >> 8;
+    x = (x & 0x00ff00ff00ff00ffULL) * 6553601 >> 16;
+    return (unsigned)((x & 0x0000ffff0000ffffULL) * 42949672960001ULL >> 32);
+}
+#endif
+
+// Consume a run of digits, folding them into *value as value * 10 + digit
+// (wrapping like the int arithmetic it replaces); returns the digit count
+size_t input_digits(AREA_INPUT *in, unsigned *value) {
+    static const unsigned pow10[9] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+    };
+    unsigned v = *value;
+    size_t count = 0;
+
+    for (;;) {
+        size_t avail = input_fill(in, 8);
+#ifdef INPUT_SWAR
+        if (avail >= 8) {
+            uint64_t x;
+            memcpy(&x, in->buf + in->pos, 8);
+            unsigned n = swar_digit_count(x);
+            if (n) {
+                // Move the digits to the top bytes; the zero bytes below
+                // act as leading zeros
+                if (n < 8) x <<= 8 * (8 - n);
+                v = v * pow10[n] + swar_eight_digits(x);
+                in->pos += n;
+                count += n;
+            }
+            if (n < 8) break;
+            continue;
+        }
+#endif
+        // Fewer than 8 bytes left in the input
+        if (avail == 0) break;
+        unsigned char c = (unsigned char)in->buf[in->pos];
+        if (c < '0' || c > '9') break;
+        v = v * 10 + (c - '0');
+        in->pos++;
+        count++;
+    }
+    *value = v;
+    return count;
+}
+
+// Consume bytes up to and including delim, copying up to max of them to
+// dst (NULL to discard). When max bytes have been copied one more byte is
+// consumed and dropped, as the per-character loops this replaces did. With
+// eol set a newline also ends the run; it is copied. *stop is delim or the
+// newline that ended the run, else EOF. Returns the bytes copied.
+static size_t copy_until(AREA_INPUT *in, int delim, char *dst, size_t max, bool eol, int *stop) {
+    size_t copied = 0;
+    *stop = EOF;
+
+    for (;;) {
+        size_t avail = in->len - in->pos;
+        if (avail == 0 && (avail = input_fill(in, 1)) == 0) return copied;
+
+        size_t n = avail < max - copied ? avail : max - copied;
+        const char *p = in->buf + in->pos;
+        const char *hit = memchr(p, delim, n);
+        size_t take = hit ? (size_t)(hit - p) : n;
+        const char *nl = eol ? memchr(p, '\n', take) : NULL;
+        if (nl) take = (size_t)(nl - p) + 1;
+        if (dst) memcpy(dst + copied, p, take);
+        copied += take;
+        in->pos += take;
+        if (nl) {
+            *stop = '\n';
+            return copied;
+        }
+        if (hit) {
+            in->pos++;
+            *stop = delim;
+            return copied;
+        }
+        if (copied == max) {
+            input_getc(in);
+            return copied;
+        }
+    }
+}
+
+// *found says whether delim ended the run
+size_t input_copy_until(AREA_INPUT *in, int delim, char *dst, size_t max, bool *found) {
+    int stop;
+    size_t copied = copy_until(in, delim, dst, max, false, &stop);
+    *found = stop == delim;
+    return copied;
+}
+
+// As input_copy_until, stopping after a newline as well, so the caller can
+// look at each line start
+size_t input_copy_line(AREA_INPUT *in, int delim, char *dst, size_t max, int *stop) {
+    return copy_until(in, delim, dst, max, true, stop);
+}
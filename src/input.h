@@ -0,0 +1,84 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define INPUT_BUFFER_SIZE 65536
+#define INPUT_KEEP 16 // Consumed bytes kept across refills so ungetc still works
+
+// Fills dst with up to len bytes; returns 0 at end of input
+typedef size_t (*INPUT_READ)(void *ctx, char *dst, size_t len);
+
+// Refillable read buffer the tokenizer works on. Bytes come from a read
+// callback, so a file, a decompressor or a memory block can feed it.
+typedef struct area_input {
+    char *buf;
+    size_t pos; // Next unread byte
+    size_t len; // Valid bytes in buf
+    size_t cap;
+    long base; // Stream offset of buf[0]
+    long limit; // Stream offset reads stop at, as if the input ended there
+    size_t hidden; // Bytes read past limit, kept after len until it moves
+    long lines; // Newlines before offset counted, for input_line
+    long counted; // Stream offset newlines are counted up to
+    long mark; // Stream offset refills keep bytes from, for input_rewind; -1 for none
+    bool eof;
+    INPUT_READ read;
+    void *ctx;
+} AREA_INPUT;
+
+int input_init(AREA_INPUT *in, INPUT_READ read, void *ctx);
+void input_free(AREA_INPUT *in);
+size_t input_fill(AREA_INPUT *in, size_t want);
+int input_getc_slow(AREA_INPUT *in);
+
+static inline int input_getc(AREA_INPUT *in) {
+    if (in->pos < in->len) return (unsigned char)in->buf[in->pos++];
+    return input_getc_slow(in);
+}
+
+// Push c back like ungetc; the byte before pos has been consumed, so it can
+// be overwritten
+static inline void input_ungetc(AREA_INPUT *in, int c) {
+    if (c != EOF && in->pos > 0) in->buf[--in->pos] = (char)c;
+}
+
+static inline long input_tell(const AREA_INPUT *in) {
+    return in->base + (long)in->pos;
+}
+
+// 1-based line number of the next unread byte
+long input_line(AREA_INPUT *in);
+
+// Make the input end at stream offset limit (LONG_MAX for none) until the
+// next call; bytes already read past it are kept for later
+void input_set_limit(AREA_INPUT *in, long limit);
+
+// True when reads stopped at the limit rather than at the end of the input
+static inline bool input_at_limit(const AREA_INPUT *in) {
+    return in->pos == in->len && in->base + (long)in->len >= in->limit && (in->hidden || !in->eof);
+}
+
+// Keep the bytes from here on in the buffer so input_rewind can return to
+// them. The mark is given up if it would hold more than half the buffer.
+static inline void input_mark(AREA_INPUT *in) {
+    in->mark = input_tell(in);
+}
+
+static inline void input_unmark(AREA_INPUT *in) {
+    in->mark = -1;
+}
+
+// Move back to stream offset to, at or after the mark; returns false if
+// the mark has been given up or to is out of reach
+bool input_rewind(AREA_INPUT *in, long to);
+
+// Tokenizer primitives
+int input_skip_space(AREA_INPUT *in);
+size_t input_digits(AREA_INPUT *in, unsigned *value);
+size_t input_copy_until(AREA_INPUT *in, int delim, char *dst, size_t max, bool *found);
+size_t input_copy_line(AREA_INPUT *in, int delim, char *dst, size_t max, int *stop);
+
+#endif
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "mem.h"
+
+#define POOL_CHUNK_SIZE 8192
+
+static unsigned hash_string(const char *s, size_t len) {
+    unsigned h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void string_pool_init(STRING_POOL *pool) {
+    memset(pool, 0, sizeof(*pool));
+}
+
+void string_pool_free(STRING_POOL *pool) {
+    char *chunk = pool->chunk;
+    while (chunk) {
+        char *prev;
+        memcpy(&prev, chunk, sizeof(prev));
+        mem_free(chunk);
+        chunk = prev;
+    }
+    mem_free(pool->strings);
+    mem_free(pool->hashes);
+    mem_free(pool->slots);
+    memset(pool, 0, sizeof(*pool));
+}
+
+// Copy a string into the arena, starting a new chunk when it doesn't fit
+static char *pool_store(STRING_POOL *pool, const char *s, size_t len) {
+    if (!pool->chunk || pool->chunk_used + len + 1 > pool->chunk_size) {
+        size_t size = POOL_CHUNK_SIZE;
+        if (len + 1 + sizeof(char *) > size) size = len + 1 + sizeof(char *);
+        char *chunk = mem_alloc(MEM_INTERN, size);
+        if (!chunk) return NULL;
+        memcpy(chunk, &pool->chunk, sizeof(char *));
+        pool->chunk = chunk;
+        pool->chunk_used = sizeof(char *);
+        pool->chunk_size = size;
+    }
+    char *p = pool->chunk + pool->chunk_used;
+    memcpy(p, s, len);
+    p[len] = '\0';
+    pool->chunk_used += len + 1;
+    return p;
+}
+
+static int pool_grow_slots(STRING_POOL *pool) {
+    size_t nslots = pool->nslots ? pool->nslots * 2 : 64;
+    int *slots = mem_calloc(MEM_INTERN, nslots, sizeof(int));
+    if (!slots) return -1;
+    for (int id = 0; id < pool->count; ++id) {
+        size_t i = pool->hashes[id] & (nslots - 1);
+        while (slots[i]) i = (i + 1) & (nslots - 1);
+        slots[i] = id + 1;
+    }
+    mem_free(pool->slots);
+    pool->slots = slots;
+    pool->nslots = nslots;
+    return 0;
+}
+
+static int pool_lookup(const STRING_POOL *pool, const char *s, size_t len, unsigned h, size_t *slot) {
+    if (!pool->nslots) return -1;
+    size_t i = h & (pool->nslots - 1);
+    while (pool->slots[i]) {
+        int id = pool->slots[i] - 1;
+        const char *t = pool->strings[id];
+        if (pool->hashes[id] == h && !strncmp(t, s, len) && t[len] == '\0')
+            return id;
+        i = (i + 1) & (pool->nslots - 1);
+    }
+    if (slot) *slot = i;
+    return -1;
+}
+
+const char *string_intern_len(STRING_POOL *pool, const char *s, size_t len) {
+    unsigned h = hash_string(s, len);
+    size_t slot;
+
+    int id = pool_lookup(pool, s, len, h, &slot);
+    if (id >= 0) return pool->strings[id];
+
+    // Keep the table at most half full
+    if ((size_t)(pool->count + 1) * 2 > pool->nslots) {
+        if (pool_grow_slots(pool) != 0) return NULL;
+        pool_lookup(pool, s, len, h, &slot);
+    }
+    if (pool->count == pool->capacity) {
+        int capacity = pool->capacity ? pool->capacity * 2 : 64;
+        const char **strings = mem_realloc(MEM_INTERN, pool->strings, capacity * sizeof(*strings));
+        if (!strings) return NULL;
+        pool->strings = strings;
+        unsigned *hashes = mem_realloc(MEM_INTERN, pool->hashes, capacity * sizeof(*hashes));
+        if (!hashes) return NULL;
+        pool->hashes = hashes;
+        pool->capacity = capacity;
+    }
+
+    char *copy = pool_store(pool, s, len);
+    if (!copy) return NULL;
+    pool->strings[pool->count] = copy;
+    pool->hashes[pool->count] = h;
+    pool->slots[slot] = ++pool->count;
+    return copy;
+}
+
+const char *string_intern(STRING_POOL *pool, const char *s) {
+    return string_intern_len(pool, s, strlen(s));
+}
+
+// Id of an already interned string, -1 if it isn't in the pool
+int string_pool_find(const STRING_POOL *pool, const char *s) {
+    size_t len = strlen(s);
+    return pool_lookup(pool, s, len, hash_string(s, len), NULL);
+}
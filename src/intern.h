@@ -0,0 +1,27 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+// Hash-based string interner. Every distinct string is stored once in an
+// arena and handed out as a stable const pointer; ids are dense and follow
+// first-interning order, so they double as dictionary indexes.
+typedef struct string_pool {
+    char *chunk; // Current arena chunk; older chunks are linked through their first word
+    size_t chunk_used;
+    size_t chunk_size;
+    const char **strings; // id -> string
+    unsigned *hashes; // id -> hash
+    int count;
+    int capacity;
+    int *slots; // Open-addressing table of id + 1, 0 for empty
+    size_t nslots;
+} STRING_POOL;
+
+void string_pool_init(STRING_POOL *pool);
+void string_pool_free(STRING_POOL *pool);
+const char *string_intern(STRING_POOL *pool, const char *s);
+const char *string_intern_len(STRING_POOL *pool, const char *s, size_t len);
+int string_pool_find(const STRING_POOL *pool, const char *s);
+
+#endif
@@ -0,0 +1,281 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json_check.h"
+#include "mem.h"
+
+enum check_state {
+    J_VALUE, // A value must come next
+    J_FIRST_VALUE, // Just after '[': a value or ']'
+    J_FIRST_KEY, // Just after '{': a key or '}'
+    J_KEY, // After ',' in an object
+    J_COLON,
+    J_AFTER, // After a value inside a container: ',' or the closing bracket
+    J_STRING,
+    J_NUMBER,
+    J_LITERAL,
+    J_DONE // The top-level value is complete; only whitespace may follow
+};
+
+// Where a number is: the accepting ones can end at any non-number byte
+enum number_state { N_MINUS, N_ZERO, N_INT, N_DOT, N_FRAC, N_E, N_ESIGN, N_EXP };
+
+// Inside a string: 0 plain text, 1 after a backslash, 2-5 reading \u digits
+#define ESCAPE_HEX 2
+
+static bool fail(JSON_CHECK *c, long at, const char *fmt, ...) {
+    if (c->failed) return false;
+    c->failed = true;
+    int n = snprintf(c->error, sizeof(c->error), "at byte %ld: ", at);
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(c->error + n, sizeof(c->error) - (size_t)n, fmt, ap);
+    va_end(ap);
+    return false;
+}
+
+void json_check_init(JSON_CHECK *c) {
+    memset(c, 0, sizeof(*c));
+    c->state = J_VALUE;
+}
+
+void json_check_free(JSON_CHECK *c) {
+    mem_free(c->stack);
+    memset(c, 0, sizeof(*c));
+}
+
+static bool is_space(unsigned char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r';
+}
+
+static bool is_hex(unsigned char ch) {
+    return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+}
+
+static bool push(JSON_CHECK *c, char open) {
+    if (c->depth == c->cap) {
+        size_t ncap = c->cap ? c->cap * 2 : 32;
+        char *grown = mem_realloc(MEM_OTHER, c->stack, ncap);
+        if (!grown) return false;
+        c->stack = grown;
+        c->cap = ncap;
+    }
+    c->stack[c->depth++] = open;
+    return true;
+}
+
+static void value_done(JSON_CHECK *c) {
+    c->state = c->depth ? J_AFTER : J_DONE;
+}
+
+static bool number_accepts(int sub) {
+    return sub == N_ZERO || sub == N_INT || sub == N_FRAC || sub == N_EXP;
+}
+
+// Start the value that ch begins
+static bool begin_value(JSON_CHECK *c, unsigned char ch, long at) {
+    switch (ch) {
+        case '{':
+        case '[':
+            if (!push(c, (char)ch)) return fail(c, at, "out of memory");
+            c->state = ch == '{' ? J_FIRST_KEY : J_FIRST_VALUE;
+            return true;
+        case '"':
+            c->state = J_STRING;
+            c->key = false;
+            c->sub = 0;
+            return true;
+        case 't':
+        case 'f':
+        case 'n':
+            c->literal = ch == 't' ? "true" : ch == 'f' ? "false" : "null";
+            c->sub = 1;
+            c->state = J_LITERAL;
+            return true;
+        case '-':
+            c->state = J_NUMBER;
+            c->sub = N_MINUS;
+            return true;
+        default:
+            if (ch >= '0' && ch <= '9') {
+                c->state = J_NUMBER;
+                c->sub = ch == '0' ? N_ZERO : N_INT;
+                return true;
+            }
+            return fail(c, at, "unexpected '%c' where a value belongs", ch);
+    }
+}
+
+static bool close_container(JSON_CHECK *c, unsigned char ch, long at) {
+    char open = ch == '}' ? '{' : '[';
+    if (!c->depth || c->stack[c->depth - 1] != open)
+        return fail(c, at, "unbalanced '%c'", ch);
+    c->depth--;
+    value_done(c);
+    return true;
+}
+
+// One byte of a string, after the opening quote
+static bool string_byte(JSON_CHECK *c, unsigned char ch, long at) {
+    if (c->utf8_need) {
+        if (ch < c->utf8_lo || ch > c->utf8_hi) return fail(c, at, "invalid UTF-8");
+        c->utf8_lo = 0x80;
+        c->utf8_hi = 0xbf;
+        c->utf8_need--;
+        return true;
+    }
+    if (c->sub == 1) {
+        if (ch == 'u') {
+            c->sub = ESCAPE_HEX;
+        } else if (ch && strchr("\"\\/bfnrt", ch)) {
+            c->sub = 0;
+        } else {
+            return fail(c, at, "invalid escape '\\%c'", ch);
+        }
+        return true;
+    }
+    if (c->sub >= ESCAPE_HEX) {
+        if (!is_hex(ch)) return fail(c, at, "invalid \\u escape");
+        c->sub = c->sub == ESCAPE_HEX + 3 ? 0 : c->sub + 1;
+        return true;
+    }
+    if (ch == '"') {
+        if (c->key) c->state = J_COLON;
+        else value_done(c);
+        return true;
+    }
+    if (ch == '\\') {
+        c->sub = 1;
+        return true;
+    }
+    if (ch < 0x20) return fail(c, at, "unescaped control character 0x%02x", ch);
+    if (ch < 0x80) return true;
+
+    // Lead bytes, ruling out overlong forms, surrogates and > U+10FFFF
+    c->utf8_lo = 0x80;
+    c->utf8_hi = 0xbf;
+    if (ch >= 0xc2 && ch <= 0xdf) {
+        c->utf8_need = 1;
+    } else if (ch >= 0xe0 && ch <= 0xef) {
+        c->utf8_need = 2;
+        if (ch == 0xe0) c->utf8_lo = 0xa0;
+        if (ch == 0xed) c->utf8_hi = 0x9f;
+    } else if (ch >= 0xf0 && ch <= 0xf4) {
+        c->utf8_need = 3;
+        if (ch == 0xf0) c->utf8_lo = 0x90;
+        if (ch == 0xf4) c->utf8_hi = 0x8f;
+    } else {
+        return fail(c, at, "invalid UTF-8");
+    }
+    return true;
+}
+
+// One byte of a number; false with sub accepting means the number ended
+// before ch, which the caller then reads as what follows
+static bool number_byte(JSON_CHECK *c, unsigned char ch) {
+    bool digit = ch >= '0' && ch <= '9';
+    switch (c->sub) {
+        case N_MINUS: if (!digit) return false; c->sub = ch == '0' ? N_ZERO : N_INT; return true;
+        case N_ZERO: break;
+        case N_INT: if (digit) return true; break;
+        case N_DOT: if (!digit) return false; c->sub = N_FRAC; return true;
+        case N_FRAC: if (digit) return true; break;
+        case N_E:
+            if (ch == '+' || ch == '-') { c->sub = N_ESIGN; return true; }
+            if (!digit) return false;
+            c->sub = N_EXP;
+            return true;
+        case N_ESIGN: if (!digit) return false; c->sub = N_EXP; return true;
+        case N_EXP: return digit;
+    }
+    if (ch == '.' && c->sub != N_FRAC) {
+        c->sub = N_DOT;
+        return true;
+    }
+    if (ch == 'e' || ch == 'E') {
+        c->sub = N_E;
+        return true;
+    }
+    return false;
+}
+
+bool json_check_feed(JSON_CHECK *c, const char *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len && !c->failed; ++i) {
+        unsigned char ch = p[i];
+        long at = c->offset + (long)i;
+        switch (c->state) {
+            case J_STRING:
+                // Plain ASCII runs are the bulk of the output
+                if (!c->sub && !c->utf8_need) {
+                    while (i < len && p[i] >= 0x20 && p[i] < 0x80 && p[i] != '"' && p[i] != '\\')
+                        i++;
+                    if (i == len) break;
+                    ch = p[i];
+                    at = c->offset + (long)i;
+                }
+                string_byte(c, ch, at);
+                break;
+            case J_NUMBER:
+                if (number_byte(c, ch)) break;
+                if (!number_accepts(c->sub)) {
+                    fail(c, at, "malformed number");
+                    break;
+                }
+                value_done(c);
+                i--; // Read ch again as what follows the number
+                break;
+            case J_LITERAL:
+                if (ch != (unsigned char)c->literal[c->sub]) {
+                    fail(c, at, "malformed literal");
+                    break;
+                }
+                if (!c->literal[++c->sub]) value_done(c);
+                break;
+            default:
+                if (is_space(ch)) break;
+                switch (c->state) {
+                    case J_VALUE:
+                        begin_value(c, ch, at);
+                        break;
+                    case J_FIRST_VALUE:
+                        if (ch == ']') close_container(c, ch, at);
+                        else begin_value(c, ch, at);
+                        break;
+                    case J_FIRST_KEY:
+                    case J_KEY:
+                        if (ch == '}' && c->state == J_FIRST_KEY) {
+                            close_container(c, ch, at);
+                        } else if (ch == '"') {
+                            c->state = J_STRING;
+                            c->key = true;
+                            c->sub = 0;
+                        } else {
+                            fail(c, at, "expected an object key");
+                        }
+                        break;
+                    case J_COLON:
+                        if (ch == ':') c->state = J_VALUE;
+                        else fail(c, at, "expected ':'");
+                        break;
+                    case J_AFTER:
+                        if (ch == ',') c->state = c->stack[c->depth - 1] == '{' ? J_KEY : J_VALUE;
+                        else if (ch == '}' || ch == ']') close_container(c, ch, at);
+                        else fail(c, at, "expected ',' or a closing bracket");
+                        break;
+                    case J_DONE:
+                        fail(c, at, "data after the end of the document");
+                        break;
+                }
+        }
+    }
+    c->offset += (long)len;
+    return !c->failed;
+}
+
+bool json_check_finish(JSON_CHECK *c) {
+    if (c->state == J_NUMBER && number_accepts(c->sub) && !c->depth) c->state = J_DONE;
+    if (c->state != J_DONE) fail(c, c->offset, "document ends early");
+    return !c->failed;
+}
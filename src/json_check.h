@@ -0,0 +1,34 @@
+#ifndef JSON_CHECK_H
+#define JSON_CHECK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Streaming JSON validator. Fed a document in pieces of any size as it is
+// written, it checks the grammar (balanced brackets, commas and colons,
+// numbers and literals), string escapes and control characters, and that
+// strings are well-formed UTF-8, without building anything.
+typedef struct json_check {
+    char *stack; // '{' or '[' for each open container
+    size_t depth;
+    size_t cap;
+    int state;
+    int sub; // Progress through an escape, number or literal
+    const char *literal; // "true", "false" or "null" being matched
+    int utf8_need; // Continuation bytes still due
+    unsigned char utf8_lo; // Range of the next continuation byte, which is
+    unsigned char utf8_hi; // narrower after some lead bytes
+    bool key; // The string being read is an object key
+    long offset; // Bytes fed so far
+    bool failed;
+    char error[96]; // First problem found, with its byte offset
+} JSON_CHECK;
+
+void json_check_init(JSON_CHECK *c);
+void json_check_free(JSON_CHECK *c);
+// Returns false once the document is known to be invalid
+bool json_check_feed(JSON_CHECK *c, const char *data, size_t len);
+// True if what was fed is exactly one complete, valid document
+bool json_check_finish(JSON_CHECK *c);
+
+#endif
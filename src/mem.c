@@ -0,0 +1,136 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "mem.h"
+
+// Keeps the user block maximally aligned after the header
+typedef union mem_header {
+    struct {
+        size_t size;
+        int cat;
+    } h;
+    long double align_ld;
+    void *align_p;
+    long long align_ll;
+} MEM_HEADER;
+
+static bool accounting;
+static MEM_USAGE usage_by_cat[MEM_CATEGORIES];
+static MEM_USAGE usage_total;
+
+static const char *const category_names[MEM_CATEGORIES] = {
+    "objects", "affects", "extra_descrs", "strings",
+    "interned", "escape_temps", "output", "world", "input", "other"
+};
+
+static void raise_peak(long *peak, long live) {
+    long old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (live > old
+           && !__atomic_compare_exchange_n(peak, &old, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void count_alloc(int cat, size_t size) {
+    if (!accounting) return;
+    MEM_USAGE *u[2] = { &usage_by_cat[cat], &usage_total };
+    for (int i = 0; i < 2; ++i) {
+        __atomic_add_fetch(&u[i]->allocs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&u[i]->total_bytes, (long)size, __ATOMIC_RELAXED);
+        long live = __atomic_add_fetch(&u[i]->live_bytes, (long)size, __ATOMIC_RELAXED);
+        raise_peak(&u[i]->peak_bytes, live);
+    }
+}
+
+static void count_free(int cat, size_t size) {
+    if (!accounting) return;
+    MEM_USAGE *u[2] = { &usage_by_cat[cat], &usage_total };
+    for (int i = 0; i < 2; ++i) {
+        __atomic_add_fetch(&u[i]->frees, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&u[i]->live_bytes, (long)size, __ATOMIC_RELAXED);
+    }
+}
+
+void mem_accounting(bool on) {
+    accounting = on;
+}
+
+void *mem_alloc(int cat, size_t size) {
+    MEM_HEADER *hdr = malloc(sizeof(MEM_HEADER) + size);
+    if (!hdr) return NULL;
+    hdr->h.size = size;
+    hdr->h.cat = cat;
+    count_alloc(cat, size);
+    return hdr + 1;
+}
+
+void *mem_calloc(int cat, size_t n, size_t size) {
+    if (size && n > ((size_t)-1 - sizeof(MEM_HEADER)) / size) return NULL;
+    void *p = mem_alloc(cat, n * size);
+    if (p) memset(p, 0, n * size);
+    return p;
+}
+
+void *mem_realloc(int cat, void *p, size_t size) {
+    if (!p) return mem_alloc(cat, size);
+    MEM_HEADER *hdr = (MEM_HEADER *)p - 1;
+    size_t old_size = hdr->h.size;
+    int old_cat = hdr->h.cat;
+    MEM_HEADER *grown = realloc(hdr, sizeof(MEM_HEADER) + size);
+    if (!grown) return NULL;
+    count_free(old_cat, old_size);
+    grown->h.size = size;
+    grown->h.cat = cat;
+    count_alloc(cat, size);
+    return grown + 1;
+}
+
+char *mem_strdup(int cat, const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = mem_alloc(cat, len);
+    if (copy) memcpy(copy, s, len);
+    return copy;
+}
+
+void mem_free(void *p) {
+    if (!p) return;
+    MEM_HEADER *hdr = (MEM_HEADER *)p - 1;
+    count_free(hdr->h.cat, hdr->h.size);
+    free(hdr);
+}
+
+const char *mem_category_name(int cat) {
+    return cat >= 0 && cat < MEM_CATEGORIES ? category_names[cat] : "unknown";
+}
+
+static void load_usage(const MEM_USAGE *from, MEM_USAGE *to) {
+    to->allocs = __atomic_load_n(&from->allocs, __ATOMIC_RELAXED);
+    to->frees = __atomic_load_n(&from->frees, __ATOMIC_RELAXED);
+    to->total_bytes = __atomic_load_n(&from->total_bytes, __ATOMIC_RELAXED);
+    to->live_bytes = __atomic_load_n(&from->live_bytes, __ATOMIC_RELAXED);
+    to->peak_bytes = __atomic_load_n(&from->peak_bytes, __ATOMIC_RELAXED);
+}
+
+void mem_usage(MEM_USAGE usage[MEM_CATEGORIES], MEM_USAGE *total) {
+    for (int i = 0; i < MEM_CATEGORIES; ++i)
+        load_usage(&usage_by_cat[i], &usage[i]);
+    load_usage(&usage_total, total);
+}
+
+void mem_reset_peak(void) {
+    for (int i = 0; i < MEM_CATEGORIES; ++i)
+        __atomic_store_n(&usage_by_cat[i].peak_bytes, __atomic_load_n(&usage_by_cat[i].live_bytes, __ATOMIC_RELAXED),
+                         __ATOMIC_RELAXED);
+    __atomic_store_n(&usage_total.peak_bytes, __atomic_load_n(&usage_total.live_bytes, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+}
+
+// Peak resident set size of the process (Linux reports ru_maxrss in KB)
+long mem_peak_rss_kb(void) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+    return ru.ru_maxrss;
+}
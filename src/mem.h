@@ -0,0 +1,49 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Allocation categories reported by --mem-report
+enum mem_category {
+    MEM_OBJECT,      // OBJ_INDEX_DATA
+    MEM_AFFECT,      // AFFECT_OUT
+    MEM_EXTRA_DESCR, // EXTRA_DESCR_DATA
+    MEM_STRING,      // Per-object strings and scratch words
+    MEM_INTERN,      // String pool arenas and tables
+    MEM_ESCAPE,      // Escaped and flag-name temporaries built for output
+    MEM_OUTPUT,      // Output buffers
+    MEM_WORLD,       // Mobile, room and reset tables, item sources
+    MEM_INPUT,       // Area files read whole by the batch reader
+    MEM_OTHER,       // Area header, filters, traces
+    MEM_CATEGORIES
+};
+
+typedef struct mem_usage {
+    long allocs;
+    long frees;
+    long total_bytes; // Everything ever allocated
+    long live_bytes;  // Allocated and not yet freed
+    long peak_bytes;  // High-water mark of live_bytes
+} MEM_USAGE;
+
+// Counting wrappers around the C allocator. Every block carries a small
+// header with its size and category, so anything obtained from these must
+// be released with mem_free, including strings the library hands back
+// (extra_flags_to_names, weapon_flags_to_names). Counters are process-wide
+// and updated atomically, but only once mem_accounting(true) has been called;
+// turn it on before the first allocation so frees match their allocations.
+void mem_accounting(bool on);
+void *mem_alloc(int cat, size_t size);
+void *mem_calloc(int cat, size_t n, size_t size);
+void *mem_realloc(int cat, void *p, size_t size);
+char *mem_strdup(int cat, const char *s);
+void mem_free(void *p);
+
+const char *mem_category_name(int cat);
+void mem_usage(MEM_USAGE usage[MEM_CATEGORIES], MEM_USAGE *total);
+// Restart the high-water marks from what is live now, to measure one phase
+void mem_reset_peak(void);
+long mem_peak_rss_kb(void);
+
+#endif
@@ -0,0 +1,97 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "strbuf.h"
+#include "mem.h"
+
+static void prom_metric(STRBUF *sb, const char *name, const char *type, const char *help) {
+    sb_printf(sb, "# HELP area_to_json_%s %s\n", name, help);
+    sb_printf(sb, "# TYPE area_to_json_%s %s\n", name, type);
+}
+
+// Durations keep nanoseconds; counts and timestamps are printed whole, so
+// none lose digits to a float format
+static void prom_seconds(STRBUF *sb, const char *name, const char *labels, double value) {
+    sb_printf(sb, "area_to_json_%s%s %.9f\n", name, labels ? labels : "", value);
+}
+
+static void prom_count(STRBUF *sb, const char *name, long long value) {
+    sb_printf(sb, "area_to_json_%s %lld\n", name, value);
+}
+
+int metrics_write_prom(const RUN_METRICS *m, const char *path) {
+    STRBUF sb;
+    sb_init(&sb);
+
+    prom_metric(&sb, "phase_seconds", "gauge", "Wall time spent in each phase of the last run.");
+    prom_seconds(&sb, "phase_seconds", "{phase=\"open\"}", m->open_seconds);
+    prom_seconds(&sb, "phase_seconds", "{phase=\"scan\"}", m->scan_seconds);
+    prom_seconds(&sb, "phase_seconds", "{phase=\"parse\"}", m->parse_seconds);
+    prom_seconds(&sb, "phase_seconds", "{phase=\"serialize\"}", m->serialize_seconds);
+    prom_seconds(&sb, "phase_seconds", "{phase=\"write\"}", m->write_seconds);
+    prom_metric(&sb, "run_seconds", "gauge", "Total wall time of the last run.");
+    prom_seconds(&sb, "run_seconds", NULL, m->total_seconds);
+    prom_metric(&sb, "input_files", "gauge", "Area files named on the command line.");
+    prom_count(&sb, "input_files", m->nareas);
+    prom_metric(&sb, "input_bytes", "gauge", "Bytes of area file read.");
+    prom_count(&sb, "input_bytes", m->bytes_in);
+    prom_metric(&sb, "output_bytes", "gauge", "Bytes of JSON written.");
+    prom_count(&sb, "output_bytes", m->bytes_out);
+    prom_metric(&sb, "objects", "gauge", "Objects parsed and emitted.");
+    prom_count(&sb, "objects", m->objects);
+    prom_metric(&sb, "objects_skipped", "gauge", "Objects dropped by --filter.");
+    prom_count(&sb, "objects_skipped", m->objects_skipped);
+    prom_metric(&sb, "affects", "gauge", "Affect lines decoded.");
+    prom_count(&sb, "affects", m->affects);
+    prom_metric(&sb, "extra_descriptions", "gauge", "Extra descriptions decoded.");
+    prom_count(&sb, "extra_descriptions", m->extra_descrs);
+    prom_metric(&sb, "parse_errors", "gauge", "Malformed input the parser stepped over.");
+    prom_count(&sb, "parse_errors", m->errors);
+    prom_metric(&sb, "success", "gauge", "1 if the last run produced output.");
+    prom_count(&sb, "success", m->success ? 1 : 0);
+    prom_metric(&sb, "last_run_timestamp_seconds", "gauge", "Unix time the last run finished.");
+    prom_count(&sb, "last_run_timestamp_seconds", (long long)m->finished);
+
+    int rc = sb_write_file(&sb, path);
+    sb_free(&sb);
+    return rc;
+}
+
+int metrics_write_json(const RUN_METRICS *m, const char *path) {
+    STRBUF sb;
+    sb_init(&sb);
+
+    sb_puts(&sb, "{\n  \"areas\": [");
+    for (int i = 0; i < m->nareas; ++i) {
+        sb_puts(&sb, i ? ", \"" : "\"");
+        sb_append_json_string(&sb, m->area_files[i], strlen(m->area_files[i]));
+        sb_puts(&sb, "\"");
+    }
+    sb_puts(&sb, "],\n");
+    sb_printf(&sb, "  \"success\": %s,\n", m->success ? "true" : "false");
+    sb_printf(&sb, "  \"finished\": %ld,\n", (long)m->finished);
+    sb_puts(&sb, "  \"phases\": {\n");
+    sb_printf(&sb, "    \"open\": %.9f,\n", m->open_seconds);
+    sb_printf(&sb, "    \"scan\": %.9f,\n", m->scan_seconds);
+    sb_printf(&sb, "    \"parse\": %.9f,\n", m->parse_seconds);
+    sb_printf(&sb, "    \"serialize\": %.9f,\n", m->serialize_seconds);
+    sb_printf(&sb, "    \"write\": %.9f\n", m->write_seconds);
+    sb_puts(&sb, "  },\n");
+    sb_printf(&sb, "  \"total_seconds\": %.9f,\n", m->total_seconds);
+    sb_printf(&sb, "  \"bytes_in\": %ld,\n", m->bytes_in);
+    sb_printf(&sb, "  \"bytes_out\": %ld,\n", m->bytes_out);
+    sb_printf(&sb, "  \"objects\": %d,\n", m->objects);
+    sb_printf(&sb, "  \"objects_skipped\": %d,\n", m->objects_skipped);
+    sb_printf(&sb, "  \"affects\": %d,\n", m->affects);
+    sb_printf(&sb, "  \"extra_descriptions\": %d,\n", m->extra_descrs);
+    sb_printf(&sb, "  \"parse_errors\": %d\n", m->errors);
+    sb_puts(&sb, "}\n");
+
+    int rc = sb_write_file(&sb, path);
+    sb_free(&sb);
+    return rc;
+}
@@ -0,0 +1,31 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <time.h>
+
+// Per-run phase timings and counters for area_to_json
+typedef struct run_metrics {
+    const char **area_files;
+    int nareas;
+    double open_seconds;
+    double scan_seconds;
+    double parse_seconds;
+    double serialize_seconds;
+    double write_seconds;
+    double total_seconds;
+    long bytes_in;
+    long bytes_out;
+    int objects;
+    int objects_skipped;
+    int affects;
+    int extra_descrs;
+    int errors;
+    bool success;
+    time_t finished;
+} RUN_METRICS;
+
+int metrics_write_prom(const RUN_METRICS *m, const char *path);
+int metrics_write_json(const RUN_METRICS *m, const char *path);
+
+#endif
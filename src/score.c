@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "score.h"
+#include "mem.h"
+
+// Starting points for the usual builds. This MUD's own stats (critchance,
+// penetration, ...) run to the hundreds per item, so a point of them is
+// worth far less than a point of hitroll; saves and ac are better negative.
+static const struct { const char *name; const char *weights; } score_presets[] = {
+    {"melee", "hitroll=1,damroll=1.5,strength=0.5,dexterity=0.5,critchance=0.02,critdamage=0.02,"
+              "penetration=0.02,alacrity=0.01,hp=0.05"},
+    {"caster", "intelligence=1,wisdom=1,mana=0.05,potency=0.02,concentration=0.02,celerity=0.01,"
+               "insight=0.01,saves=-0.5"},
+    {"tank", "hp=0.1,constitution=1,ac=-0.2,saves=-1,endurance=0.01,recuperation=0.02,move=0.02"},
+    {NULL, NULL}
+};
+
+// Location names are interned, so each area's few distinct pointers are
+// looked up by name once and then found by address
+#define LOCATION_CACHE_SIZE 1024
+
+typedef struct location_cache {
+    const char *name[LOCATION_CACHE_SIZE];
+    int loc[LOCATION_CACHE_SIZE];
+} LOCATION_CACHE;
+
+// Location an affect modifies; flag affects are named "F<where>:<location>"
+static int affect_location(LOCATION_CACHE *cache, const AFFECT_OUT *ao) {
+    size_t slot = ((uintptr_t)ao->location >> 3) % LOCATION_CACHE_SIZE;
+    if (cache->name[slot] == ao->location) return cache->loc[slot];
+    const char *name = ao->location;
+    const char *colon = strchr(name, ':');
+    if (name[0] == 'F' && colon) name = colon + 1;
+    cache->name[slot] = ao->location;
+    cache->loc[slot] = affect_location_lookup(name);
+    return cache->loc[slot];
+}
+
+int score_table_build(SCORE_TABLE *t, const OBJ_REF *refs, size_t nitems) {
+    memset(t, 0, sizeof(*t));
+    t->refs = refs;
+    t->nitems = nitems;
+    t->stride = (nitems + SCORE_LANES - 1) / SCORE_LANES * SCORE_LANES;
+    t->slot_mask = flag_wear.defined & ~(unsigned long)(flag_lookup(&flag_wear, "take") |
+                                                        flag_lookup(&flag_wear, "nosac"));
+
+    LOCATION_CACHE *cache = mem_calloc(MEM_OTHER, 1, sizeof(*cache));
+    if (!cache) return -1;
+    for (size_t row = 0; row < nitems; ++row) {
+        for (const AFFECT_OUT *ao = refs[row].obj->affects_out; ao; ao = ao->next) {
+            int loc = affect_location(cache, ao);
+            if (loc <= 0 || !ao->modifier) continue;
+            if (!t->columns[loc]) {
+                t->columns[loc] = mem_calloc(MEM_OTHER, t->stride, sizeof(float));
+                if (!t->columns[loc]) {
+                    mem_free(cache);
+                    score_table_free(t);
+                    return -1;
+                }
+            }
+            t->columns[loc][row] += (float)ao->modifier;
+        }
+    }
+    mem_free(cache);
+    return 0;
+}
+
+void score_table_free(SCORE_TABLE *t) {
+    for (int loc = 0; loc < AFFECT_LOCATIONS; ++loc)
+        mem_free(t->columns[loc]);
+    memset(t, 0, sizeof(*t));
+}
+
+int score_parse_weights(SCORE_WEIGHTS *weights, const char *spec, char *err, size_t errlen) {
+    memset(weights, 0, sizeof(*weights));
+    for (int i = 0; score_presets[i].name; ++i)
+        if (!strcmp(spec, score_presets[i].name)) spec = score_presets[i].weights;
+
+    char *copy = mem_strdup(MEM_OTHER, spec);
+    if (!copy) {
+        snprintf(err, errlen, "out of memory");
+        return -1;
+    }
+    bool any = false;
+    int rc = 0;
+    char *save = NULL;
+    for (char *p = strtok_r(copy, ",", &save); p && !rc; p = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(p, '=');
+        if (!value) {
+            snprintf(err, errlen, "expected location=weight or a preset (melee, caster, tank), got '%s'", p);
+            rc = -1;
+            break;
+        }
+        *value++ = '\0';
+        int loc = affect_location_lookup(p);
+        char *end;
+        float w = strtof(value, &end);
+        if (loc <= 0) {
+            snprintf(err, errlen, "unknown affect location '%s'", p);
+            rc = -1;
+        } else if (end == value || *end || !isfinite(w)) {
+            snprintf(err, errlen, "bad weight '%s' for %s", value, p);
+            rc = -1;
+        } else {
+            weights->w[loc] = w;
+            any = any || w != 0;
+        }
+    }
+    if (!rc && !any) {
+        snprintf(err, errlen, "no nonzero weights in '%s'", spec);
+        rc = -1;
+    }
+    mem_free(copy);
+    return rc;
+}
+
+// scores += weight * column over n items, n a multiple of SCORE_LANES
+static void add_weighted(float *scores, const float *column, float weight, size_t n) {
+#ifdef __SSE2__
+    const __m128 w = _mm_set1_ps(weight);
+    for (size_t i = 0; i < n; i += SCORE_LANES) {
+        __m128 lo = _mm_add_ps(_mm_loadu_ps(scores + i), _mm_mul_ps(_mm_loadu_ps(column + i), w));
+        __m128 hi = _mm_add_ps(_mm_loadu_ps(scores + i + 4), _mm_mul_ps(_mm_loadu_ps(column + i + 4), w));
+        _mm_storeu_ps(scores + i, lo);
+        _mm_storeu_ps(scores + i + 4, hi);
+    }
+#else
+    for (size_t i = 0; i < n; ++i)
+        scores[i] += weight * column[i];
+#endif
+}
+
+static bool pick_better(const SCORE_PICK *a, const SCORE_PICK *b) {
+    return a->score > b->score || (a->score == b->score && a->row < b->row);
+}
+
+// Keep the best top picks in a heap with the worst of them at the root
+static void heap_offer(SCORE_PICK *heap, int *count, int top, SCORE_PICK pick) {
+    int i;
+    if (*count < top) {
+        i = (*count)++;
+        while (i > 0 && pick_better(&heap[(i - 1) / 2], &pick)) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = pick;
+        return;
+    }
+    if (!pick_better(&pick, &heap[0])) return;
+    i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= top) break;
+        if (child + 1 < top && pick_better(&heap[child], &heap[child + 1])) child++;
+        if (!pick_better(&pick, &heap[child])) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = pick;
+}
+
+static int compare_picks(const void *a, const void *b) {
+    return pick_better(a, b) ? -1 : pick_better(b, a) ? 1 : 0;
+}
+
+int score_top(const SCORE_TABLE *t, const SCORE_WEIGHTS *weights, int top, long max_level,
+              SCORE_RESULT *out) {
+    memset(out, 0, sizeof(*out));
+    out->top = top;
+    out->max_level = max_level;
+    out->picks = mem_alloc(MEM_OTHER, (size_t)FLAG_BITS * (top ? top : 1) * sizeof(*out->picks));
+    float *scores = mem_calloc(MEM_OTHER, t->stride ? t->stride : 1, sizeof(*scores));
+    if (!out->picks || !scores) {
+        mem_free(scores);
+        score_result_free(out);
+        return -1;
+    }
+
+    // One pass over the catalog per weighted location: every item's dot
+    // product with the weights builds up a location at a time
+    for (int loc = 0; loc < AFFECT_LOCATIONS; ++loc)
+        if (weights->w[loc] != 0 && t->columns[loc])
+            add_weighted(scores, t->columns[loc], weights->w[loc], t->stride);
+
+    for (size_t row = 0; row < t->nitems && top > 0; ++row) {
+        if (!(scores[row] > 0)) continue;
+        const OBJ_INDEX_DATA *obj = t->refs[row].obj;
+        if (obj->level > max_level) continue;
+        SCORE_PICK pick = { row, scores[row] };
+        for (unsigned long slots = (unsigned long)obj->wear_flags & t->slot_mask; slots; slots &= slots - 1) {
+            int bit = __builtin_ctzl(slots);
+            heap_offer(out->picks + (size_t)bit * top, &out->counts[bit], top, pick);
+        }
+    }
+    for (int bit = 0; bit < FLAG_BITS; ++bit)
+        qsort(out->picks + (size_t)bit * top, out->counts[bit], sizeof(*out->picks), compare_picks);
+    mem_free(scores);
+    return 0;
+}
+
+void score_result_free(SCORE_RESULT *r) {
+    mem_free(r->picks);
+    memset(r, 0, sizeof(*r));
+}
+
+void score_result_json(STRBUF *out, const SCORE_TABLE *t, const SCORE_WEIGHTS *weights,
+                       const SCORE_RESULT *r, const char *indent) {
+    sb_printf(out, "{\n%s  \"weights\": {", indent);
+    bool first = true;
+    for (int loc = 0; loc < AFFECT_LOCATIONS; ++loc) {
+        if (weights->w[loc] == 0) continue;
+        sb_printf(out, "%s\"%s\": %g", first ? "" : ", ", affect_location_name(loc), weights->w[loc]);
+        first = false;
+    }
+    sb_printf(out, "},\n%s  \"top\": %d,\n", indent, r->top);
+    if (r->max_level != LONG_MAX) sb_printf(out, "%s  \"max_level\": %ld,\n", indent, r->max_level);
+    sb_printf(out, "%s  \"slots\": {", indent);
+    first = true;
+    for (int bit = 0; bit < FLAG_BITS; ++bit) {
+        if (!r->counts[bit]) continue;
+        sb_printf(out, "%s\n%s    \"%s\": [", first ? "" : ",", indent, flag_wear.bit_names[bit]);
+        for (int i = 0; i < r->counts[bit]; ++i) {
+            const SCORE_PICK *pick = &r->picks[(size_t)bit * r->top + i];
+            const OBJ_INDEX_DATA *obj = t->refs[pick->row].obj;
+            sb_printf(out, "%s\n%s      {\"vnum\": %ld, \"short_descr\": \"", i ? "," : "", indent, obj->vnum);
+            if (obj->short_descr) sb_append_json_string(out, obj->short_descr, strlen(obj->short_descr));
+            sb_printf(out, "\", \"level\": %d, \"score\": %.7g}", obj->level, pick->score);
+        }
+        sb_printf(out, "\n%s    ]", indent);
+        first = false;
+    }
+    if (!first) sb_printf(out, "\n%s  ", indent);
+    sb_printf(out, "}\n%s}", indent);
+}
+
+int score_presets_json(STRBUF *out, const SCORE_TABLE *t, int top, long max_level) {
+    sb_puts(out, "{\n  \"presets\": {");
+    for (int i = 0; score_presets[i].name; ++i) {
+        SCORE_WEIGHTS weights;
+        SCORE_RESULT result;
+        char err[128];
+        if (score_parse_weights(&weights, score_presets[i].weights, err, sizeof(err)) != 0 ||
+            score_top(t, &weights, top, max_level, &result) != 0)
+            return -1;
+        sb_printf(out, "%s\n    \"%s\": ", i ? "," : "", score_presets[i].name);
+        score_result_json(out, t, &weights, &result, "    ");
+        score_result_free(&result);
+    }
+    sb_puts(out, "\n  }\n}\n");
+    return 0;
+}
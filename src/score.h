@@ -0,0 +1,64 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+#include <stddef.h>
+
+#include "areaparse.h"
+#include "sort.h"
+#include "strbuf.h"
+
+#define SCORE_MAX_TOP 100
+#define SCORE_LANES 8 // Items scored per step
+
+// Every item's affect modifiers summed per location, stored a location at
+// a time so a weighting only touches the locations it weighs. Columns are
+// padded with zeros to a multiple of SCORE_LANES items.
+typedef struct score_table {
+    const OBJ_REF *refs; // The items, not owned
+    size_t nitems;
+    size_t stride; // nitems rounded up to SCORE_LANES
+    float *columns[AFFECT_LOCATIONS]; // NULL where every item has 0
+    unsigned long slot_mask; // Wear bits that are slots: all but take and nosac
+} SCORE_TABLE;
+
+// Weight per affect location; a score is the sum of modifier * weight
+typedef struct score_weights {
+    float w[AFFECT_LOCATIONS];
+} SCORE_WEIGHTS;
+
+typedef struct score_pick {
+    size_t row; // In the table's refs
+    float score;
+} SCORE_PICK;
+
+// The best items per wear slot, highest score first, ties by row
+typedef struct score_result {
+    int top;
+    long max_level; // LONG_MAX for no limit
+    int counts[FLAG_BITS]; // Picks per wear bit
+    SCORE_PICK *picks; // top per wear bit, FLAG_BITS * top
+} SCORE_RESULT;
+
+int score_table_build(SCORE_TABLE *t, const OBJ_REF *refs, size_t nitems);
+void score_table_free(SCORE_TABLE *t);
+
+// "location=weight,..." or the name of a preset. Returns 0, or -1 with a
+// message in err.
+int score_parse_weights(SCORE_WEIGHTS *weights, const char *spec, char *err, size_t errlen);
+
+// Score every item and keep the top best per slot among those with a
+// positive score and a level of at most max_level. Returns 0, or -1 if
+// memory ran out.
+int score_top(const SCORE_TABLE *t, const SCORE_WEIGHTS *weights, int top, long max_level,
+              SCORE_RESULT *out);
+void score_result_free(SCORE_RESULT *r);
+
+// Append {"weights", "top", "max_level", "slots"} for one result, slots
+// keyed by wear flag name; indent is the object's own indentation
+void score_result_json(STRBUF *out, const SCORE_TABLE *t, const SCORE_WEIGHTS *weights,
+                       const SCORE_RESULT *r, const char *indent);
+// Append {"presets": {name: result, ...}} with every preset scored.
+// Returns 0, or -1 if memory ran out.
+int score_presets_json(STRBUF *out, const SCORE_TABLE *t, int top, long max_level);
+
+#endif
@@ -0,0 +1,773 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "serve.h"
+#include "filter.h"
+#include "mem.h"
+
+#define SERVE_REQUEST_MAX 8192
+#define SERVE_POLL_MS 1000 // Also how often the sources are checked for changes
+#define SERVE_RECV_TIMEOUT 5
+#define SERVE_DEFAULT_LIMIT 50
+#define SERVE_MAX_LIMIT 1000
+#define SERVE_AFFECT_KEYS 64
+
+static volatile sig_atomic_t serve_stop;
+
+static void on_stop_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+// ---- Indexes ----
+
+typedef int (*INDEX_KEYS)(const SERVE_MODEL *m, const OBJ_INDEX_DATA *obj, int *keys, int max);
+
+static int type_keys(const SERVE_MODEL *m, const OBJ_INDEX_DATA *obj, int *keys, int max) {
+    (void)m;
+    (void)max;
+    keys[0] = obj->item_type;
+    return 1;
+}
+
+static int wear_keys(const SERVE_MODEL *m, const OBJ_INDEX_DATA *obj, int *keys, int max) {
+    (void)m;
+    int n = 0;
+    for (int bit = 0; bit < 32 && n < max; ++bit)
+        if ((unsigned long)obj->wear_flags & (1UL << bit))
+            keys[n++] = bit;
+    return n;
+}
+
+// Each location once per object, however many affects touch it
+static int affect_keys(const SERVE_MODEL *m, const OBJ_INDEX_DATA *obj, int *keys, int max) {
+    int n = 0;
+    for (const AFFECT_OUT *ao = obj->affects_out; ao && n < max; ao = ao->next) {
+        int id = string_pool_find(&m->locations, ao->location);
+        bool seen = false;
+        for (int i = 0; i < n && !seen; ++i)
+            seen = keys[i] == id;
+        if (!seen) keys[n++] = id;
+    }
+    return n;
+}
+
+// Counting pass, prefix sums, then a fill pass in refs order
+static int index_build(SERVE_INDEX *ix, const SERVE_MODEL *m, int nkeys, INDEX_KEYS get_keys) {
+    int keys[SERVE_AFFECT_KEYS];
+    ix->nkeys = nkeys;
+    ix->start = mem_calloc(MEM_OTHER, nkeys + 1, sizeof(*ix->start));
+    if (!ix->start) return -1;
+
+    for (size_t row = 0; row < m->nrefs; ++row) {
+        int n = get_keys(m, m->refs[row].obj, keys, SERVE_AFFECT_KEYS);
+        for (int i = 0; i < n; ++i)
+            if (keys[i] >= 0 && keys[i] < nkeys) ix->start[keys[i] + 1]++;
+    }
+    for (int k = 0; k < nkeys; ++k)
+        ix->start[k + 1] += ix->start[k];
+
+    ix->rows = mem_alloc(MEM_OTHER, (ix->start[nkeys] ? ix->start[nkeys] : 1) * sizeof(*ix->rows));
+    size_t *fill = mem_alloc(MEM_OTHER, (nkeys ? nkeys : 1) * sizeof(*fill));
+    if (!ix->rows || !fill) {
+        mem_free(fill);
+        return -1;
+    }
+    memcpy(fill, ix->start, nkeys * sizeof(*fill));
+    for (size_t row = 0; row < m->nrefs; ++row) {
+        int n = get_keys(m, m->refs[row].obj, keys, SERVE_AFFECT_KEYS);
+        for (int i = 0; i < n; ++i)
+            if (keys[i] >= 0 && keys[i] < nkeys) ix->rows[fill[keys[i]]++] = (unsigned)row;
+    }
+    mem_free(fill);
+    return 0;
+}
+
+static void index_free(SERVE_INDEX *ix) {
+    mem_free(ix->start);
+    mem_free(ix->rows);
+    memset(ix, 0, sizeof(*ix));
+}
+
+// Sort key with value ordered first and the row breaking ties
+static unsigned long long row_key(long value, size_t row) {
+    return ((unsigned long long)((unsigned)value ^ 0x80000000u) << 32) | row;
+}
+
+static int model_build_indexes(SERVE_MODEL *m) {
+    int max_type = 0;
+    for (size_t row = 0; row < m->nrefs; ++row) {
+        const OBJ_INDEX_DATA *obj = m->refs[row].obj;
+        if (obj->item_type > max_type) max_type = obj->item_type;
+        for (const AFFECT_OUT *ao = obj->affects_out; ao; ao = ao->next)
+            if (!string_intern(&m->locations, ao->location)) return -1;
+    }
+    if (index_build(&m->by_type, m, max_type + 1, type_keys) != 0
+        || index_build(&m->by_wear, m, 32, wear_keys) != 0
+        || index_build(&m->by_affect, m, m->locations.count, affect_keys) != 0)
+        return -1;
+
+    if (score_table_build(&m->scores, m->refs, m->nrefs) != 0) return -1;
+
+    OBJ_REF *tmp = mem_alloc(MEM_OTHER, (m->nrefs ? m->nrefs : 1) * sizeof(*tmp));
+    m->by_level = mem_alloc(MEM_OTHER, (m->nrefs ? m->nrefs : 1) * sizeof(*m->by_level));
+    if (!tmp || !m->by_level) {
+        mem_free(tmp);
+        return -1;
+    }
+    for (size_t row = 0; row < m->nrefs; ++row) {
+        tmp[row] = m->refs[row];
+        tmp[row].key = row_key(m->refs[row].obj->level, row);
+    }
+    int rc = obj_refs_sort(tmp, m->nrefs);
+    for (size_t i = 0; rc == 0 && i < m->nrefs; ++i)
+        m->by_level[i] = (unsigned)(tmp[i].key & 0xffffffffu);
+    mem_free(tmp);
+    return rc;
+}
+
+static void model_free(SERVE_MODEL *m) {
+    for (int i = 0; i < m->nareas; ++i)
+        area_parser_free(&m->parsers[i]);
+    mem_free(m->parsers);
+    mem_free(m->refs);
+    index_free(&m->by_type);
+    index_free(&m->by_wear);
+    index_free(&m->by_affect);
+    string_pool_free(&m->locations);
+    mem_free(m->by_level);
+    score_table_free(&m->scores);
+    memset(m, 0, sizeof(*m));
+}
+
+static int model_load(SERVE_MODEL *m, const SERVE_CONFIG *cfg, int generation) {
+    memset(m, 0, sizeof(*m));
+    string_pool_init(&m->locations);
+    if (cfg->load(m, cfg->user) != 0) {
+        model_free(m);
+        return -1;
+    }
+    if (model_build_indexes(m) != 0) {
+        fprintf(stderr, "Error: Out of memory indexing objects\n");
+        model_free(m);
+        return -1;
+    }
+    m->generation = generation;
+    m->loaded = time(NULL);
+    return 0;
+}
+
+// ---- Queries ----
+
+enum serve_sort { SORT_BY_VNUM, SORT_BY_LEVEL, SORT_BY_COST, SORT_BY_WEIGHT };
+
+static const struct { const char *name; int field; } sort_fields[] = {
+    {"vnum", SORT_BY_VNUM}, {"level", SORT_BY_LEVEL}, {"cost", SORT_BY_COST},
+    {"weight", SORT_BY_WEIGHT}, {NULL, 0}
+};
+
+typedef struct serve_query {
+    OBJ_FILTER filter;
+    char affect[64]; // Affect location every match must have, "" for none
+    int affect_op; // FILTER_* comparison on the modifier, -1 for none
+    long affect_value;
+    int sort;
+    bool descending;
+    size_t offset;
+    size_t limit;
+} SERVE_QUERY;
+
+// Decode %XX and '+' in place
+static void url_decode(char *s) {
+    char *out = s;
+    for (; *s; s++) {
+        if (*s == '+') {
+            *out++ = ' ';
+        } else if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2])) {
+            char hex[3] = { s[1], s[2], '\0' };
+            *out++ = (char)strtol(hex, NULL, 16);
+            s += 2;
+        } else {
+            *out++ = *s;
+        }
+    }
+    *out = '\0';
+}
+
+static bool parse_count(const char *s, size_t *out) {
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (!*s || *end || n < 0) return false;
+    *out = (size_t)n;
+    return true;
+}
+
+// "location" or "location<op>modifier", e.g. "hitroll>=3"
+static bool parse_affect(SERVE_QUERY *q, const char *s, char *err, size_t errlen) {
+    static const struct { const char *text; int op; } ops[] = {
+        {"!=", FILTER_NE}, {"<=", FILTER_LE}, {">=", FILTER_GE},
+        {"=", FILTER_EQ}, {"<", FILTER_LT}, {">", FILTER_GT}, {NULL, 0}
+    };
+    size_t len = strcspn(s, "!=<>");
+    if (len == 0 || len >= sizeof(q->affect)) {
+        snprintf(err, errlen, "bad affect '%s'", s);
+        return false;
+    }
+    memcpy(q->affect, s, len);
+    q->affect[len] = '\0';
+    s += len;
+    if (!*s) return true;
+
+    for (int i = 0; ops[i].text; ++i) {
+        size_t olen = strlen(ops[i].text);
+        if (strncmp(s, ops[i].text, olen)) continue;
+        char *end;
+        q->affect_value = strtol(s + olen, &end, 10);
+        if (end == s + olen || *end) break;
+        q->affect_op = ops[i].op;
+        return true;
+    }
+    snprintf(err, errlen, "expected affect=<location>[<op><modifier>], got '%s'", q->affect);
+    return false;
+}
+
+static int parse_query(SERVE_QUERY *q, char *params, char *err, size_t errlen) {
+    memset(q, 0, sizeof(*q));
+    q->affect_op = -1;
+    q->limit = SERVE_DEFAULT_LIMIT;
+
+    char *save = NULL;
+    for (char *p = strtok_r(params, "&", &save); p; p = strtok_r(NULL, "&", &save)) {
+        char *value = strchr(p, '=');
+        if (value) *value++ = '\0';
+        else value = p + strlen(p);
+        url_decode(p);
+        url_decode(value);
+
+        if (!strcmp(p, "filter")) {
+            filter_free(&q->filter);
+            if (filter_parse(&q->filter, value, err, errlen) != 0) return -1;
+        } else if (!strcmp(p, "affect")) {
+            if (!parse_affect(q, value, err, errlen)) return -1;
+        } else if (!strcmp(p, "sort")) {
+            q->descending = value[0] == '-';
+            const char *name = q->descending ? value + 1 : value;
+            int i = 0;
+            while (sort_fields[i].name && strcmp(sort_fields[i].name, name)) i++;
+            if (!sort_fields[i].name) {
+                snprintf(err, errlen, "sort takes vnum, level, cost or weight, optionally with a leading '-'");
+                return -1;
+            }
+            q->sort = sort_fields[i].field;
+        } else if (!strcmp(p, "offset")) {
+            if (!parse_count(value, &q->offset)) {
+                snprintf(err, errlen, "bad offset '%s'", value);
+                return -1;
+            }
+        } else if (!strcmp(p, "limit")) {
+            if (!parse_count(value, &q->limit) || q->limit > SERVE_MAX_LIMIT) {
+                snprintf(err, errlen, "limit takes 0 to %d", SERVE_MAX_LIMIT);
+                return -1;
+            }
+        } else {
+            snprintf(err, errlen, "unknown parameter '%s'", p);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static bool compare(long v, int op, long target) {
+    switch (op) {
+        case FILTER_EQ: return v == target;
+        case FILTER_NE: return v != target;
+        case FILTER_LT: return v < target;
+        case FILTER_LE: return v <= target;
+        case FILTER_GT: return v > target;
+        case FILTER_GE: return v >= target;
+        default: return true;
+    }
+}
+
+static bool affect_match(const SERVE_QUERY *q, const OBJ_INDEX_DATA *obj) {
+    if (!q->affect[0]) return true;
+    for (const AFFECT_OUT *ao = obj->affects_out; ao; ao = ao->next)
+        if (!strcmp(ao->location, q->affect) && compare(ao->modifier, q->affect_op, q->affect_value))
+            return true;
+    return false;
+}
+
+// Level bounds implied by the filter's level terms
+static bool level_range(const OBJ_FILTER *filter, long *lo, long *hi) {
+    bool any = false;
+    *lo = LONG_MIN;
+    *hi = LONG_MAX;
+    for (int i = 0; i < filter->nterms; ++i) {
+        const FILTER_TERM *t = &filter->terms[i];
+        if (t->field != FILTER_LEVEL) continue;
+        long v = t->values[0];
+        switch (t->op) {
+            case FILTER_GE: if (v > *lo) *lo = v; break;
+            case FILTER_GT: if (v + 1 > *lo) *lo = v + 1; break;
+            case FILTER_LE: if (v < *hi) *hi = v; break;
+            case FILTER_LT: if (v - 1 < *hi) *hi = v - 1; break;
+            case FILTER_EQ:
+                if (t->nvalues != 1) continue;
+                if (v > *lo) *lo = v;
+                if (v < *hi) *hi = v;
+                break;
+            default: continue;
+        }
+        any = true;
+    }
+    return any;
+}
+
+// First position in by_level whose level is >= level
+static size_t level_lower_bound(const SERVE_MODEL *m, long level) {
+    size_t lo = 0, hi = m->nrefs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m->refs[m->by_level[mid]].obj->level < level) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Smallest candidate list the indexes offer. rows == NULL means every row.
+// Sets *vnum_order when the candidates are in vnum order.
+static void query_candidates(const SERVE_MODEL *m, const SERVE_QUERY *q,
+                             const unsigned **rows, size_t *n, bool *vnum_order) {
+    *rows = NULL;
+    *n = m->nrefs;
+    *vnum_order = true;
+
+#define OFFER(list, count, ordered) \
+    do { if ((count) < *n) { *rows = (list); *n = (count); *vnum_order = (ordered); } } while (0)
+
+    for (int i = 0; i < q->filter.nterms; ++i) {
+        const FILTER_TERM *t = &q->filter.terms[i];
+        if (t->field == FILTER_TYPE && t->op == FILTER_EQ && t->nvalues == 1) {
+            long type = t->values[0];
+            if (type < 0 || type >= m->by_type.nkeys) OFFER(NULL, 0, true);
+            else OFFER(m->by_type.rows + m->by_type.start[type],
+                       m->by_type.start[type + 1] - m->by_type.start[type], true);
+        } else if (t->field == FILTER_WEAR && (t->op == FILTER_EQ || t->op == FILTER_HAS)
+                   && t->values[0] && !(t->values[0] & (t->values[0] - 1))) {
+            int bit = __builtin_ctzl((unsigned long)t->values[0]);
+            OFFER(m->by_wear.rows + m->by_wear.start[bit],
+                  m->by_wear.start[bit + 1] - m->by_wear.start[bit], true);
+        }
+    }
+    if (q->affect[0]) {
+        int id = string_pool_find(&m->locations, q->affect);
+        if (id < 0) OFFER(NULL, 0, true);
+        else OFFER(m->by_affect.rows + m->by_affect.start[id],
+                   m->by_affect.start[id + 1] - m->by_affect.start[id], true);
+    }
+    long lo, hi;
+    if (level_range(&q->filter, &lo, &hi)) {
+        size_t begin = lo == LONG_MIN ? 0 : level_lower_bound(m, lo);
+        size_t end = hi == LONG_MAX ? m->nrefs : level_lower_bound(m, hi + 1);
+        OFFER(m->by_level + begin, end > begin ? end - begin : 0, false);
+    }
+#undef OFFER
+}
+
+static long sort_value(const OBJ_INDEX_DATA *obj, int sort) {
+    switch (sort) {
+        case SORT_BY_LEVEL: return obj->level;
+        case SORT_BY_COST: return obj->cost;
+        case SORT_BY_WEIGHT: return obj->weight;
+        default: return 0;
+    }
+}
+
+// Run the query and append the response body to out. Returns 0, or -1 if
+// memory ran out.
+static int run_query(const SERVE_CONFIG *cfg, const SERVE_MODEL *m, const SERVE_QUERY *q, STRBUF *out) {
+    const unsigned *rows;
+    size_t n;
+    bool vnum_order;
+    query_candidates(m, q, &rows, &n, &vnum_order);
+
+    OBJ_REF *matches = mem_alloc(MEM_OTHER, (n ? n : 1) * sizeof(*matches));
+    if (!matches) return -1;
+    size_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        size_t row = rows ? rows[i] : i;
+        const OBJ_INDEX_DATA *obj = m->refs[row].obj;
+        if (!filter_match(&q->filter, obj) || !affect_match(q, obj)) continue;
+        matches[total] = m->refs[row];
+        // Ties, and the vnum order itself, fall back on the row
+        unsigned long long key = q->sort == SORT_BY_VNUM ? row : row_key(sort_value(obj, q->sort), row);
+        if (q->descending) key = q->sort == SORT_BY_VNUM ? ~key : key ^ 0xffffffff00000000ull;
+        matches[total++].key = key;
+    }
+    if ((!vnum_order || q->sort != SORT_BY_VNUM || q->descending) && obj_refs_sort(matches, total) != 0) {
+        mem_free(matches);
+        return -1;
+    }
+
+    sb_printf(out, "{\n  \"generation\": %d,\n  \"total\": %zu,\n  \"offset\": %zu,\n  \"limit\": %zu,\n",
+              m->generation, total, q->offset, q->limit);
+    sb_puts(out, "  \"objects\": [\n");
+    size_t end = q->offset + q->limit < total ? q->offset + q->limit : total;
+    for (size_t i = q->offset; i < end; ++i) {
+        if (i > q->offset) sb_puts(out, ",\n");
+        cfg->print_object(out, &matches[i], cfg->user);
+    }
+    sb_puts(out, end > q->offset ? "\n  ]\n}\n" : "  ]\n}\n");
+    mem_free(matches);
+    return 0;
+}
+
+// /score?weights=W[&top=K][&max_level=N]: the best objects per wear slot
+// for a weighting, as --score prints them. Returns 400 or 500 with the
+// reason in err, else 0.
+static int run_score(const SERVE_MODEL *m, char *params, STRBUF *out, char *err, size_t errlen) {
+    SCORE_WEIGHTS weights;
+    const char *spec = NULL;
+    size_t top = 10;
+    long max_level = LONG_MAX;
+    char *save = NULL;
+    for (char *p = strtok_r(params, "&", &save); p; p = strtok_r(NULL, "&", &save)) {
+        char *value = strchr(p, '=');
+        if (value) *value++ = '\0';
+        else value = p + strlen(p);
+        url_decode(p);
+        url_decode(value);
+
+        if (!strcmp(p, "weights")) {
+            spec = value;
+        } else if (!strcmp(p, "top")) {
+            if (!parse_count(value, &top) || top < 1 || top > SCORE_MAX_TOP) {
+                snprintf(err, errlen, "top takes 1 to %d", SCORE_MAX_TOP);
+                return 400;
+            }
+        } else if (!strcmp(p, "max_level")) {
+            char *end;
+            max_level = strtol(value, &end, 10);
+            if (!*value || *end) {
+                snprintf(err, errlen, "bad max_level '%s'", value);
+                return 400;
+            }
+        } else {
+            snprintf(err, errlen, "unknown parameter '%s'", p);
+            return 400;
+        }
+    }
+    if (!spec) {
+        snprintf(err, errlen, "score needs weights=<location>=<weight>,... or a preset");
+        return 400;
+    }
+    if (score_parse_weights(&weights, spec, err, errlen) != 0) return 400;
+
+    SCORE_RESULT result;
+    if (score_top(&m->scores, &weights, (int)top, max_level, &result) != 0) {
+        snprintf(err, errlen, "out of memory");
+        return 500;
+    }
+    sb_printf(out, "{\n  \"generation\": %d,\n  \"score\": ", m->generation);
+    score_result_json(out, &m->scores, &weights, &result, "  ");
+    sb_puts(out, "\n}\n");
+    score_result_free(&result);
+    return 0;
+}
+
+// ---- HTTP ----
+
+static void send_all(int fd, const char *data, size_t len) {
+    while (len) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+static void send_response(int fd, int status, const char *reason, const STRBUF *body) {
+    STRBUF head;
+    sb_init(&head);
+    sb_printf(&head, "HTTP/1.1 %d %s\r\n"
+                     "Content-Type: application/json\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Access-Control-Allow-Origin: *\r\n"
+                     "Connection: close\r\n\r\n", status, reason, body->len);
+    send_all(fd, head.data, head.len);
+    send_all(fd, body->data, body->len);
+    sb_free(&head);
+}
+
+static void send_error(int fd, int status, const char *reason, const char *message) {
+    STRBUF body;
+    sb_init(&body);
+    sb_puts(&body, "{\"error\": \"");
+    for (const char *c = message; *c; c++) {
+        if (*c == '"' || *c == '\\') sb_append(&body, "\\", 1);
+        if ((unsigned char)*c >= 0x20) sb_append(&body, c, 1);
+    }
+    sb_puts(&body, "\"}\n");
+    send_response(fd, status, reason, &body);
+    sb_free(&body);
+}
+
+// First object with this vnum, in area order
+static const OBJ_REF *find_vnum(const SERVE_MODEL *m, long vnum) {
+    size_t lo = 0, hi = m->nrefs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m->refs[mid].obj->vnum < vnum) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < m->nrefs && m->refs[lo].obj->vnum == vnum ? &m->refs[lo] : NULL;
+}
+
+static void handle_request(const SERVE_CONFIG *cfg, const SERVE_MODEL *m, int fd, char *request) {
+    char *save = NULL;
+    char *method = strtok_r(request, " ", &save);
+    char *target = strtok_r(NULL, " ", &save);
+    char *version = strtok_r(NULL, "\r\n", &save);
+    if (!method || !target || !version || strncmp(version, "HTTP/1.", 7)) {
+        send_error(fd, 400, "Bad Request", "malformed request line");
+        return;
+    }
+    if (strcmp(method, "GET")) {
+        send_error(fd, 405, "Method Not Allowed", "only GET is supported");
+        return;
+    }
+
+    char *params = strchr(target, '?');
+    if (params) *params++ = '\0';
+    else params = target + strlen(target);
+
+    STRBUF body;
+    sb_init(&body);
+    if (!strcmp(target, "/objects")) {
+        char err[256];
+        SERVE_QUERY q;
+        if (parse_query(&q, params, err, sizeof(err)) != 0) send_error(fd, 400, "Bad Request", err);
+        else if (run_query(cfg, m, &q, &body) != 0) send_error(fd, 500, "Internal Server Error", "out of memory");
+        else send_response(fd, 200, "OK", &body);
+        filter_free(&q.filter);
+    } else if (!strncmp(target, "/objects/", 9)) {
+        char *end;
+        long vnum = strtol(target + 9, &end, 10);
+        const OBJ_REF *ref = *end || end == target + 9 ? NULL : find_vnum(m, vnum);
+        if (!ref) {
+            send_error(fd, 404, "Not Found", "no such object");
+        } else {
+            cfg->print_object(&body, ref, cfg->user);
+            sb_puts(&body, "\n");
+            send_response(fd, 200, "OK", &body);
+        }
+    } else if (!strcmp(target, "/score")) {
+        char err[256];
+        int status = run_score(m, params, &body, err, sizeof(err));
+        if (status == 400) send_error(fd, 400, "Bad Request", err);
+        else if (status) send_error(fd, 500, "Internal Server Error", err);
+        else send_response(fd, 200, "OK", &body);
+    } else if (!strcmp(target, "/status")) {
+        sb_printf(&body, "{\n  \"generation\": %d,\n  \"loaded\": %ld,\n  \"areas\": %d,\n  \"objects\": %zu\n}\n",
+                  m->generation, (long)m->loaded, m->nareas, m->nrefs);
+        send_response(fd, 200, "OK", &body);
+    } else {
+        send_error(fd, 404, "Not Found", "try /objects, /objects/<vnum>, /score or /status");
+    }
+    sb_free(&body);
+}
+
+// Read one request head and answer it; the connection is closed after
+static void handle_client(const SERVE_CONFIG *cfg, const SERVE_MODEL *m, int fd) {
+    struct timeval timeout = { SERVE_RECV_TIMEOUT, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char request[SERVE_REQUEST_MAX];
+    size_t len = 0;
+    while (len < sizeof(request) - 1) {
+        ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        len += (size_t)n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            handle_request(cfg, m, fd, request);
+            return;
+        }
+    }
+    send_error(fd, 431, "Request Header Fields Too Large", "request head too large");
+}
+
+// ---- Listening and reloading ----
+
+static int open_listener(const char *spec) {
+    if (!strncmp(spec, "unix:", 5)) {
+        const char *path = spec + 5;
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "Error: socket path too long: %s\n", path);
+            return -1;
+        }
+        strcpy(addr.sun_path, path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // "PORT" listens on the loopback address only
+    char host[256] = "127.0.0.1";
+    const char *port = spec;
+    const char *colon = strrchr(spec, ':');
+    if (colon) {
+        size_t hlen = (size_t)(colon - spec);
+        if (hlen >= sizeof(host)) return -1;
+        memcpy(host, spec, hlen);
+        host[hlen] = '\0';
+        port = colon + 1;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 16) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+typedef struct file_stamp {
+    bool exists;
+    struct timespec mtime;
+    off_t size;
+} FILE_STAMP;
+
+static void stamp_files(const SERVE_CONFIG *cfg, FILE_STAMP *stamps) {
+    for (int i = 0; i < cfg->nfiles; ++i) {
+        struct stat st;
+        memset(&stamps[i], 0, sizeof(stamps[i]));
+        if (stat(cfg->files[i], &st) != 0) continue;
+        stamps[i].exists = true;
+        stamps[i].mtime = st.st_mtim;
+        stamps[i].size = st.st_size;
+    }
+}
+
+static bool stamps_equal(const FILE_STAMP *a, const FILE_STAMP *b, int n) {
+    for (int i = 0; i < n; ++i)
+        if (a[i].exists != b[i].exists || a[i].size != b[i].size
+            || a[i].mtime.tv_sec != b[i].mtime.tv_sec || a[i].mtime.tv_nsec != b[i].mtime.tv_nsec)
+            return false;
+    return true;
+}
+
+int serve_run(const SERVE_CONFIG *cfg) {
+    FILE_STAMP *loaded = mem_calloc(MEM_OTHER, cfg->nfiles, sizeof(*loaded));
+    FILE_STAMP *seen = mem_calloc(MEM_OTHER, cfg->nfiles, sizeof(*seen));
+    FILE_STAMP *now = mem_calloc(MEM_OTHER, cfg->nfiles, sizeof(*now));
+    SERVE_MODEL model;
+    int generation = 1;
+    int rc = 1;
+    int fd = -1;
+
+    if (!loaded || !seen || !now) goto done;
+    stamp_files(cfg, loaded);
+    memcpy(seen, loaded, cfg->nfiles * sizeof(*seen));
+    if (model_load(&model, cfg, generation) != 0) goto done;
+
+    fd = open_listener(cfg->listen);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", cfg->listen, strerror(errno));
+        model_free(&model);
+        goto done;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "Serving %zu objects on %s\n", model.nrefs, cfg->listen);
+    double last_check = monotonic_seconds();
+    while (!serve_stop) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, SERVE_POLL_MS) > 0) {
+            int client = accept(fd, NULL, NULL);
+            if (client >= 0) {
+                handle_client(cfg, &model, client);
+                close(client);
+            }
+        }
+
+        if (monotonic_seconds() - last_check < SERVE_POLL_MS / 1000.0) continue;
+        last_check = monotonic_seconds();
+
+        // Reload once a change has held still for a whole check interval,
+        // so a file that is still being written is not picked up half done
+        stamp_files(cfg, now);
+        if (stamps_equal(now, loaded, cfg->nfiles)) continue;
+        if (!stamps_equal(now, seen, cfg->nfiles)) {
+            memcpy(seen, now, cfg->nfiles * sizeof(*seen));
+            continue;
+        }
+        memcpy(loaded, now, cfg->nfiles * sizeof(*loaded));
+
+        SERVE_MODEL next;
+        if (model_load(&next, cfg, generation + 1) != 0) {
+            fprintf(stderr, "Error: Reload failed, still serving generation %d\n", generation);
+            continue;
+        }
+        model_free(&model);
+        model = next;
+        generation++;
+        fprintf(stderr, "Reloaded: %zu objects, generation %d\n", model.nrefs, generation);
+    }
+
+    model_free(&model);
+    close(fd);
+    if (!strncmp(cfg->listen, "unix:", 5)) unlink(cfg->listen + 5);
+    rc = 0;
+
+done:
+    mem_free(loaded);
+    mem_free(seen);
+    mem_free(now);
+    return rc;
+}
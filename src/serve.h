@@ -0,0 +1,56 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "areaparse.h"
+#include "intern.h"
+#include "score.h"
+#include "sort.h"
+#include "strbuf.h"
+
+// Rows (positions in SERVE_MODEL.refs) grouped by key: the rows for key k
+// are rows[start[k]] up to rows[start[k + 1]], in vnum order
+typedef struct serve_index {
+    int nkeys;
+    size_t *start;
+    unsigned *rows;
+} SERVE_INDEX;
+
+// Parsed areas held in memory while serving, with the secondary indexes
+// queries use to pick their candidates. The loader fills parsers and refs
+// (allocated with mem_*, refs in vnum order); serve_run builds the rest and
+// frees all of it when the model is replaced.
+typedef struct serve_model {
+    AREA_PARSER *parsers;
+    int nareas;
+    OBJ_REF *refs;
+    size_t nrefs;
+    SERVE_INDEX by_type; // Keyed by item type
+    SERVE_INDEX by_wear; // Keyed by wear flag bit
+    SERVE_INDEX by_affect; // Keyed by affect location id in locations
+    STRING_POOL locations;
+    unsigned *by_level; // Every row, ordered by level
+    SCORE_TABLE scores; // Affect modifiers by location, for /score
+    int generation; // Bumped on every reload
+    time_t loaded;
+} SERVE_MODEL;
+
+typedef struct serve_config {
+    const char *listen; // "PORT", "HOST:PORT" or "unix:PATH"
+    const char **files; // Watched for changes; a change reloads the model
+    int nfiles;
+    // Parse the files into model->parsers/nareas and model->refs/nrefs.
+    // Returns 0, or -1 after reporting the problem.
+    int (*load)(SERVE_MODEL *model, void *user);
+    // Append one object's JSON
+    void (*print_object)(STRBUF *out, const OBJ_REF *ref, void *user);
+    void *user;
+} SERVE_CONFIG;
+
+// Load the model and answer HTTP requests until SIGINT or SIGTERM.
+// Returns 0 on a clean shutdown, 1 if the server could not start.
+int serve_run(const SERVE_CONFIG *cfg);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_LENGTH 32
+
+// Incremental SHA-256 (FIPS 180-4), fed in pieces of any size
+typedef struct sha256 {
+    uint32_t state[8];
+    uint64_t bytes;
+    unsigned char block[64];
+    size_t used; // Bytes waiting in block
+} SHA256;
+
+void sha256_init(SHA256 *s);
+void sha256_update(SHA256 *s, const void *data, size_t len);
+void sha256_final(SHA256 *s, unsigned char digest[SHA256_DIGEST_LENGTH]);
+// Finish and write the digest as 64 lowercase hex digits and a NUL
+void sha256_hex(SHA256 *s, char hex[2 * SHA256_DIGEST_LENGTH + 1]);
+
+#endif
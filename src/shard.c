@@ -0,0 +1,665 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "intern.h"
+#include "mem.h"
+#include "shard.h"
+#include "strbuf.h"
+
+typedef struct shard_file {
+    long size;
+    int index;
+} SHARD_FILE;
+
+// Largest first; equal sizes keep command-line order
+static int compare_files(const void *a, const void *b) {
+    const SHARD_FILE *x = a, *y = b;
+    if (x->size != y->size) return x->size > y->size ? -1 : 1;
+    return x->index - y->index;
+}
+
+int shard_plan(SHARD_PLAN *plan, const char **files, int nfiles, int index, int count,
+               char *err, size_t errlen) {
+    memset(plan, 0, sizeof(*plan));
+    plan->index = index;
+    plan->count = count;
+    plan->nfiles = nfiles;
+
+    SHARD_FILE *order = mem_alloc(MEM_OTHER, (nfiles ? nfiles : 1) * sizeof(*order));
+    int *owner = mem_alloc(MEM_OTHER, (nfiles ? nfiles : 1) * sizeof(*owner));
+    long *bytes = mem_calloc(MEM_OTHER, count, sizeof(*bytes));
+    int *owned = mem_calloc(MEM_OTHER, count, sizeof(*owned));
+    plan->files = mem_alloc(MEM_OTHER, (nfiles ? nfiles : 1) * sizeof(*plan->files));
+    int rc = -1;
+    if (!order || !owner || !bytes || !owned || !plan->files) {
+        snprintf(err, errlen, "out of memory");
+        goto done;
+    }
+
+    for (int i = 0; i < nfiles; ++i) {
+        struct stat st;
+        if (stat(files[i], &st) != 0) {
+            snprintf(err, errlen, "cannot open file %s", files[i]);
+            goto done;
+        }
+        order[i].size = (long)st.st_size;
+        order[i].index = i;
+    }
+    qsort(order, nfiles, sizeof(*order), compare_files);
+
+    // Longest-processing-time: each file goes to the lightest shard so far,
+    // the one with fewer files and then the lower number on a tie
+    for (int i = 0; i < nfiles; ++i) {
+        int best = 0;
+        for (int s = 1; s < count; ++s) {
+            if (bytes[s] < bytes[best] || (bytes[s] == bytes[best] && owned[s] < owned[best]))
+                best = s;
+        }
+        owner[order[i].index] = best;
+        bytes[best] += order[i].size;
+        owned[best]++;
+    }
+    for (int i = 0; i < nfiles; ++i)
+        if (owner[i] == index - 1) plan->files[plan->nowned++] = i;
+    rc = 0;
+
+done:
+    mem_free(order);
+    mem_free(owner);
+    mem_free(bytes);
+    mem_free(owned);
+    if (rc != 0) shard_plan_free(plan);
+    return rc;
+}
+
+void shard_plan_free(SHARD_PLAN *plan) {
+    mem_free(plan->files);
+    plan->files = NULL;
+    plan->nowned = 0;
+}
+
+// Merging works on the text area_to_json writes: a fixed header layout and
+// one object per block from "  {\n" to "\n  }". Strings are escaped, so
+// neither pattern can occur inside one.
+
+typedef struct text_span {
+    const char *s;
+    size_t len;
+} TEXT_SPAN;
+
+// One shard's output, read whole, with its header tables and a cursor
+// over its objects
+typedef struct partial {
+    const char *path;
+    char *text;
+    size_t len;
+    int index;
+    int count;
+    int nareas; // In the whole job
+    TEXT_SPAN details_name; // Still escaped; .s is NULL without details
+    char *details; // The shard's details file
+    size_t details_len;
+    bool has_strings;
+    TEXT_SPAN *strings; // Still escaped, as in the file
+    int nstrings;
+    int *string_ids; // Merged id per local id, -1 until first used
+    bool has_styles;
+    TEXT_SPAN *styles;
+    int nstyles;
+    int *style_ids;
+    const char *pos; // Next object, or the end of the array
+    TEXT_SPAN object; // Current object
+    long vnum;
+    int area;
+} PARTIAL;
+
+typedef struct merge {
+    PARTIAL *parts;
+    int nparts;
+    int nareas;
+    TEXT_SPAN *areas; // Lines of each area's entry, by global index
+    STRING_POOL strings;
+    STRING_POOL styles;
+    STRBUF body; // The objects, rewritten
+    STRBUF details; // The merged details file
+    bool first_detail;
+    char *err;
+    size_t errlen;
+} MERGE;
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    STRBUF sb;
+    sb_init(&sb);
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        sb_append(&sb, buf, n);
+    bool failed = ferror(fp) || sb_reserve(&sb, 1) != 0;
+    fclose(fp);
+    if (failed) {
+        sb_free(&sb);
+        return NULL;
+    }
+    sb.data[sb.len] = '\0';
+    *len = sb.len;
+    return sb.data;
+}
+
+// Consume lit if the text at *p starts with it
+static bool take(const char **p, const char *lit) {
+    size_t n = strlen(lit);
+    if (strncmp(*p, lit, n) != 0) return false;
+    *p += n;
+    return true;
+}
+
+static bool take_long(const char **p, long *v) {
+    char *end;
+    *v = strtol(*p, &end, 10);
+    if (end == *p) return false;
+    *p = end;
+    return true;
+}
+
+static bool take_int(const char **p, int *v) {
+    long l;
+    if (!take_long(p, &l)) return false;
+    *v = (int)l;
+    return true;
+}
+
+// Read a "  \"key\": [\n" table of one quoted string per line into spans
+// of the text between the quotes
+static bool take_table(const char **p, TEXT_SPAN **items, int *count) {
+    int cap = 0;
+    while (!take(p, "  ],\n")) {
+        const char *line = *p;
+        const char *nl = strchr(line, '\n');
+        if (!nl || !take(p, "    \"")) return false;
+        const char *close = nl[-1] == ',' ? nl - 2 : nl - 1;
+        if (close < *p || *close != '"') return false;
+        if (*count == cap) {
+            cap = cap ? cap * 2 : 64;
+            TEXT_SPAN *grown = mem_realloc(MEM_OTHER, *items, cap * sizeof(**items));
+            if (!grown) return false;
+            *items = grown;
+        }
+        (*items)[*count].s = *p;
+        (*items)[*count].len = (size_t)(close - *p);
+        (*count)++;
+        *p = nl + 1;
+    }
+    return true;
+}
+
+static int *new_id_map(int n) {
+    int *ids = mem_alloc(MEM_OTHER, (n ? n : 1) * sizeof(*ids));
+    if (ids)
+        for (int i = 0; i < n; ++i) ids[i] = -1;
+    return ids;
+}
+
+// Read a partial's header up to its objects array, filling m->areas with
+// the entries it carries
+static bool parse_header(MERGE *m, PARTIAL *pt) {
+    const char *p = pt->text;
+
+    if (!take(&p, "{\n  \"shard\": {\"index\": ") || !take_int(&p, &pt->index) ||
+        !take(&p, ", \"count\": ") || !take_int(&p, &pt->count) ||
+        !take(&p, ", \"areas\": ") || !take_int(&p, &pt->nareas) || !take(&p, "},\n")) {
+        snprintf(m->err, m->errlen, "%s is not a --shard output", pt->path);
+        return false;
+    }
+    if (pt->index < 1 || pt->index > pt->count || pt->nareas < 1) goto bad;
+    if (!m->areas) {
+        m->nareas = pt->nareas;
+        m->areas = mem_calloc(MEM_OTHER, m->nareas, sizeof(*m->areas));
+        if (!m->areas) goto bad;
+    } else if (pt->nareas != m->nareas) {
+        snprintf(m->err, m->errlen, "%s comes from a job over different files", pt->path);
+        return false;
+    }
+
+    // Each entry: its global index, then the area's own lines
+    if (!take(&p, "  \"areas\": [\n")) goto bad;
+    while (!take(&p, "  ],\n")) {
+        int area;
+        if (!take(&p, "    {\n      \"index\": ") || !take_int(&p, &area) || !take(&p, ",\n")) goto bad;
+        if (area < 0 || area >= m->nareas) goto bad;
+        if (m->areas[area].s) {
+            snprintf(m->err, m->errlen, "area %d is in more than one partial output", area);
+            return false;
+        }
+        const char *lines = p;
+        while (strncmp(p, "    }", 5) != 0) {
+            const char *nl = strchr(p, '\n');
+            if (!nl) goto bad;
+            p = nl + 1;
+        }
+        m->areas[area].s = lines;
+        m->areas[area].len = (size_t)(p - lines);
+        p += 5;
+        take(&p, ",");
+        if (!take(&p, "\n")) goto bad;
+    }
+
+    if (take(&p, "  \"details\": \"")) {
+        const char *close = strchr(p, '"');
+        while (close && close[-1] == '\\') close = strchr(close + 1, '"');
+        if (!close) goto bad;
+        pt->details_name.s = p;
+        pt->details_name.len = (size_t)(close - p);
+        p = close + 1;
+        if (!take(&p, ",\n")) goto bad;
+    }
+    if (take(&p, "  \"strings\": [\n")) {
+        pt->has_strings = true;
+        if (!take_table(&p, &pt->strings, &pt->nstrings)) goto bad;
+    }
+    if (take(&p, "  \"styles\": [\n")) {
+        pt->has_styles = true;
+        if (!take_table(&p, &pt->styles, &pt->nstyles)) goto bad;
+    }
+    if (!take(&p, "  \"objects\": [\n")) goto bad;
+    pt->pos = p;
+
+    pt->string_ids = new_id_map(pt->nstrings);
+    pt->style_ids = new_id_map(pt->nstyles);
+    if (!pt->string_ids || !pt->style_ids) {
+        snprintf(m->err, m->errlen, "out of memory");
+        return false;
+    }
+    return true;
+
+bad:
+    snprintf(m->err, m->errlen, "malformed header in %s", pt->path);
+    return false;
+}
+
+// Load the details file a partial names; it sits next to the partial
+static bool load_details(MERGE *m, PARTIAL *pt) {
+    const char *slash = strrchr(pt->path, '/');
+    STRBUF path;
+    sb_init(&path);
+    if (slash) sb_append(&path, pt->path, (size_t)(slash - pt->path) + 1);
+    sb_append(&path, pt->details_name.s, pt->details_name.len);
+    pt->details = path.data ? read_file(path.data, &pt->details_len) : NULL;
+    if (!pt->details)
+        snprintf(m->err, m->errlen, "cannot read details file %s", path.data ? path.data : "");
+    sb_free(&path);
+    return pt->details != NULL;
+}
+
+// Find "\n  }" from p on
+static const char *find_object_end(const char *p, const char *end) {
+    while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        if (end - p >= 4 && !memcmp(p, "\n  }", 4)) return p;
+        p++;
+    }
+    return NULL;
+}
+
+// Step pt to its next object. Returns 1, 0 at the end of the objects, or
+// -1 (with err set) if the text isn't laid out as expected.
+static int next_object(MERGE *m, PARTIAL *pt) {
+    const char *p = pt->pos;
+    const char *end = pt->text + pt->len;
+
+    if (pt->object.s && !take(&p, ",\n")) {
+        if (!take(&p, "\n  ]\n}\n")) goto bad;
+        pt->pos = p;
+        return 0;
+    }
+    if (!pt->object.s && take(&p, "\n  ]\n}\n")) {
+        pt->pos = p;
+        return 0;
+    }
+
+    const char *start = p;
+    if (!take(&p, "  {\n    \"vnum\": ") || !take_long(&p, &pt->vnum)) goto bad;
+    pt->area = 0;
+    if (m->nareas > 1 && (!take(&p, ",\n    \"area\": ") || !take_int(&p, &pt->area))) goto bad;
+    const char *close = find_object_end(p, end);
+    if (!close) goto bad;
+    pt->object.s = start;
+    pt->object.len = (size_t)(close + 4 - start);
+    pt->pos = close + 4;
+    return 1;
+
+bad:
+    snprintf(m->err, m->errlen, "malformed object in %s near byte %ld", pt->path,
+             (long)(p - pt->text));
+    return -1;
+}
+
+// Keys whose numbers index the "strings" table in --dict output
+static bool is_dict_key(const char *key, size_t len) {
+    static const char *const keys[] = {
+        "type", "wear_flags", "extra_flags", "material", "location", "extra",
+        "weapon_type", "damage_type", "flags", "spell", "kind", NULL
+    };
+    for (int i = 0; keys[i]; ++i)
+        if (strlen(keys[i]) == len && !memcmp(keys[i], key, len)) return true;
+    return false;
+}
+
+static bool is_runs_key(const char *key, size_t len) {
+    return len > 5 && !memcmp(key + len - 5, "_runs", 5);
+}
+
+// The merged id of a partial's table entry, interning it on first use so
+// merged ids follow first use in merged order, as in a single run
+static int merged_id(STRING_POOL *pool, const TEXT_SPAN *table, int count, int *ids, long local) {
+    if (local < 0 || local >= count) return -1;
+    if (ids[local] < 0) {
+        const char *s = string_intern_len(pool, table[local].s, table[local].len);
+        ids[local] = s ? string_pool_find(pool, s) : -1;
+    }
+    return ids[local];
+}
+
+// Copy pt's current object into the merged body, renumbering string and
+// style indexes and moving its details record into the merged file. Keys
+// are tracked per nesting level; a number inside an array belongs to the
+// array's key.
+static bool rewrite_object(MERGE *m, PARTIAL *pt) {
+    enum { MAX_DEPTH = 8 };
+    struct { char open; const char *key; size_t keylen; } stack[MAX_DEPTH];
+    int depth = 0;
+    const char *key = NULL;
+    size_t keylen = 0;
+    const char *s = pt->object.s;
+    const char *end = s + pt->object.len;
+    const char *plain = s;
+    STRBUF *out = &m->body;
+
+    for (const char *p = s; p < end; ) {
+        char c = *p;
+        if (c == '"') {
+            const char *q = p + 1;
+            while (q < end && *q != '"') q += *q == '\\' ? 2 : 1;
+            if (q >= end) return false;
+            const char *after = q + 1;
+            while (after < end && *after == ' ') after++;
+            if (after < end && *after == ':') {
+                key = p + 1;
+                keylen = (size_t)(q - p - 1);
+            }
+            p = q + 1;
+        } else if (c == '{' && depth == 1 && key && keylen == 7 && !memcmp(key, "details", 7)) {
+            size_t offset, length;
+            int used = 0;
+            if (sscanf(p, "{\"offset\": %zu, \"length\": %zu}%n", &offset, &length, &used) != 2 || !used ||
+                !pt->details || offset + length > pt->details_len)
+                return false;
+            sb_append(out, plain, (size_t)(p - plain));
+            if (!m->first_detail) sb_puts(&m->details, ",\n");
+            m->first_detail = false;
+            sb_printf(out, "{\"offset\": %zu, \"length\": %zu}", m->details.len, length);
+            sb_append(&m->details, pt->details + offset, length);
+            p += used;
+            plain = p;
+        } else if (c == '{' || c == '[') {
+            if (depth == MAX_DEPTH) return false;
+            stack[depth].open = c;
+            stack[depth].key = key;
+            stack[depth].keylen = keylen;
+            depth++;
+            if (c == '{') key = NULL;
+            p++;
+        } else if (c == '}' || c == ']') {
+            if (depth) depth--;
+            key = depth ? stack[depth].key : NULL;
+            keylen = depth ? stack[depth].keylen : 0;
+            p++;
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            char *num_end;
+            long local = strtol(p, &num_end, 10);
+            bool in_array = depth && stack[depth - 1].open == '[';
+            const char *k = in_array ? stack[depth - 1].key : key;
+            size_t klen = in_array ? stack[depth - 1].keylen : keylen;
+            int id = -2;
+            if (k && pt->has_strings && is_dict_key(k, klen))
+                id = merged_id(&m->strings, pt->strings, pt->nstrings, pt->string_ids, local);
+            else if (k && in_array && pt->has_styles && is_runs_key(k, klen))
+                id = merged_id(&m->styles, pt->styles, pt->nstyles, pt->style_ids, local);
+            if (id == -1) return false;
+            if (id >= 0) {
+                sb_append(out, plain, (size_t)(p - plain));
+                sb_printf(out, "%d", id);
+                plain = num_end;
+            }
+            p = num_end;
+        } else {
+            p++;
+        }
+    }
+    sb_append(out, plain, (size_t)(end - plain));
+    return true;
+}
+
+// Heap of partials ordered by their current object's (vnum, area), the
+// order --sort vnum uses
+static bool object_before(const PARTIAL *a, const PARTIAL *b) {
+    if (a->vnum != b->vnum) return a->vnum < b->vnum;
+    return a->area < b->area;
+}
+
+static void heap_down(PARTIAL **heap, int n, int i) {
+    for (;;) {
+        int least = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && object_before(heap[l], heap[least])) least = l;
+        if (r < n && object_before(heap[r], heap[least])) least = r;
+        if (least == i) return;
+        PARTIAL *t = heap[i];
+        heap[i] = heap[least];
+        heap[least] = t;
+        i = least;
+    }
+}
+
+static bool merge_objects(MERGE *m) {
+    PARTIAL **heap = mem_alloc(MEM_OTHER, m->nparts * sizeof(*heap));
+    if (!heap) {
+        snprintf(m->err, m->errlen, "out of memory");
+        return false;
+    }
+    int n = 0;
+    for (int i = 0; i < m->nparts; ++i) {
+        int got = next_object(m, &m->parts[i]);
+        if (got < 0) goto fail;
+        if (got) heap[n++] = &m->parts[i];
+    }
+    for (int i = n / 2 - 1; i >= 0; --i)
+        heap_down(heap, n, i);
+
+    bool first = true;
+    while (n) {
+        PARTIAL *pt = heap[0];
+        if (!first) sb_puts(&m->body, ",\n");
+        first = false;
+        if (!rewrite_object(m, pt)) {
+            snprintf(m->err, m->errlen, "cannot merge object %ld from %s", pt->vnum, pt->path);
+            goto fail;
+        }
+        int got = next_object(m, pt);
+        if (got < 0) goto fail;
+        if (!got) heap[0] = heap[--n];
+        heap_down(heap, n, 0);
+    }
+    mem_free(heap);
+    return true;
+
+fail:
+    mem_free(heap);
+    return false;
+}
+
+// Emit area entries in the layout of a single run: one "area" object, or
+// the "areas" array, without the shard's index lines
+static void print_areas(STRBUF *out, const MERGE *m) {
+    const char *indent = m->nareas == 1 ? "    " : "      ";
+    if (m->nareas == 1)
+        sb_puts(out, "  \"area\": {\n");
+    else
+        sb_puts(out, "  \"areas\": [\n");
+    for (int i = 0; i < m->nareas; ++i) {
+        if (m->nareas > 1) sb_puts(out, "    {\n");
+        const char *p = m->areas[i].s, *end = p + m->areas[i].len;
+        while (p < end) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            size_t len = nl ? (size_t)(nl - p) + 1 : (size_t)(end - p);
+            size_t skip = strspn(p, " ");
+            sb_puts(out, indent);
+            sb_append(out, p + skip, len - skip);
+            p += len;
+        }
+        if (m->nareas > 1) sb_printf(out, "    }%s\n", i + 1 < m->nareas ? "," : "");
+    }
+    sb_puts(out, m->nareas == 1 ? "  },\n" : "  ],\n");
+}
+
+static void print_table(STRBUF *out, const char *key, const STRING_POOL *pool) {
+    sb_printf(out, "  \"%s\": [\n", key);
+    for (int i = 0; i < pool->count; ++i)
+        sb_printf(out, "    \"%s\"%s\n", pool->strings[i], i + 1 < pool->count ? "," : "");
+    sb_puts(out, "  ],\n");
+}
+
+// Check the partials are the complete, consistent output of one job
+static bool check_partials(MERGE *m, const char *details_path) {
+    const PARTIAL *first = &m->parts[0];
+    if (m->nparts != first->count) {
+        snprintf(m->err, m->errlen, "the job had %d shards but %d partial outputs were given",
+                 first->count, m->nparts);
+        return false;
+    }
+    for (int i = 0; i < m->nparts; ++i) {
+        const PARTIAL *pt = &m->parts[i];
+        if (pt->count != first->count || pt->has_strings != first->has_strings ||
+            pt->has_styles != first->has_styles || !pt->details_name.s != !first->details_name.s) {
+            snprintf(m->err, m->errlen, "%s was written with different options than %s",
+                     pt->path, first->path);
+            return false;
+        }
+        for (int j = 0; j < i; ++j) {
+            if (m->parts[j].index == pt->index) {
+                snprintf(m->err, m->errlen, "%s and %s are both shard %d/%d",
+                         m->parts[j].path, pt->path, pt->index, pt->count);
+                return false;
+            }
+        }
+    }
+    for (int i = 0; i < m->nareas; ++i) {
+        if (!m->areas[i].s) {
+            snprintf(m->err, m->errlen, "no partial output covers area %d", i);
+            return false;
+        }
+    }
+    if (first->details_name.s && !details_path) {
+        snprintf(m->err, m->errlen, "the partial outputs have details files; name the merged one with --details");
+        return false;
+    }
+    if (!first->details_name.s && details_path) {
+        snprintf(m->err, m->errlen, "the partial outputs have no details files to merge");
+        return false;
+    }
+    return true;
+}
+
+static bool write_stdout(const STRBUF *sb) {
+    return sb->len == 0 || fwrite(sb->data, 1, sb->len, stdout) == sb->len;
+}
+
+int shard_merge(const char **partials, int npartials, const char *details_path,
+                char *err, size_t errlen) {
+    MERGE m;
+    memset(&m, 0, sizeof(m));
+    m.nparts = npartials;
+    m.err = err;
+    m.errlen = errlen;
+    m.first_detail = true;
+    string_pool_init(&m.strings);
+    string_pool_init(&m.styles);
+    sb_init(&m.body);
+    sb_init(&m.details);
+    STRBUF header;
+    sb_init(&header);
+    int rc = -1;
+
+    m.parts = mem_calloc(MEM_OTHER, npartials, sizeof(*m.parts));
+    if (!m.parts) {
+        snprintf(err, errlen, "out of memory");
+        goto done;
+    }
+    for (int i = 0; i < npartials; ++i) {
+        PARTIAL *pt = &m.parts[i];
+        pt->path = partials[i];
+        pt->text = read_file(pt->path, &pt->len);
+        if (!pt->text) {
+            snprintf(err, errlen, "cannot read %s", pt->path);
+            goto done;
+        }
+        if (!parse_header(&m, pt)) goto done;
+    }
+    if (!check_partials(&m, details_path)) goto done;
+    for (int i = 0; i < npartials; ++i)
+        if (m.parts[i].details_name.s && !load_details(&m, &m.parts[i])) goto done;
+
+    // Style 0 is the default, unstyled text
+    if (m.parts[0].has_styles) string_intern(&m.styles, "");
+    sb_puts(&m.details, "[\n");
+    if (!merge_objects(&m)) goto done;
+    sb_puts(&m.details, m.first_detail ? "]\n" : "\n]\n");
+
+    sb_puts(&header, "{\n");
+    print_areas(&header, &m);
+    if (details_path) {
+        const char *slash = strrchr(details_path, '/');
+        sb_printf(&header, "  \"details\": \"%s\",\n", slash ? slash + 1 : details_path);
+        if (sb_write_file(&m.details, details_path) != 0) {
+            snprintf(err, errlen, "cannot write details to %s", details_path);
+            goto done;
+        }
+    }
+    if (m.parts[0].has_strings) print_table(&header, "strings", &m.strings);
+    if (m.parts[0].has_styles) print_table(&header, "styles", &m.styles);
+    sb_puts(&header, "  \"objects\": [\n");
+    sb_puts(&m.body, "\n  ]\n}\n");
+
+    if (!header.data || !m.body.data) {
+        snprintf(err, errlen, "out of memory");
+        goto done;
+    }
+    if (!write_stdout(&header) || !write_stdout(&m.body) || fflush(stdout) != 0) {
+        snprintf(err, errlen, "cannot write the merged document");
+        goto done;
+    }
+    rc = 0;
+
+done:
+    for (int i = 0; m.parts && i < npartials; ++i) {
+        PARTIAL *pt = &m.parts[i];
+        mem_free(pt->text);
+        mem_free(pt->details);
+        mem_free(pt->strings);
+        mem_free(pt->string_ids);
+        mem_free(pt->styles);
+        mem_free(pt->style_ids);
+    }
+    mem_free(m.parts);
+    mem_free(m.areas);
+    string_pool_free(&m.strings);
+    string_pool_free(&m.styles);
+    sb_free(&m.body);
+    sb_free(&m.details);
+    sb_free(&header);
+    return rc;
+}
@@ -0,0 +1,31 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stddef.h>
+
+// The area files one --shard i/N run parses. Every shard computes the same
+// plan from the full file list, so the runs need nothing from each other.
+typedef struct shard_plan {
+    int index; // 1 to count
+    int count;
+    int nfiles; // Files in the whole job
+    int *files; // Global indexes of this shard's files, ascending
+    int nowned;
+} SHARD_PLAN;
+
+// Assign files to count shards by size (largest first, each to the shard
+// with the fewest bytes so far) and keep shard index's share. Returns 0, or
+// -1 with a message in err.
+int shard_plan(SHARD_PLAN *plan, const char **files, int nfiles, int index, int count,
+               char *err, size_t errlen);
+void shard_plan_free(SHARD_PLAN *plan);
+
+// Merge the partial outputs of every shard of a job by vnum into the
+// document a single --sort vnum run over all the files would write to
+// stdout: areas, string and style tables and details offsets are rebuilt
+// for the whole set. details_path names the merged details file, needed
+// when the partials have them. Returns 0, or -1 with a message in err.
+int shard_merge(const char **partials, int npartials, const char *details_path,
+                char *err, size_t errlen);
+
+#endif
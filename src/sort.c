@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "sort.h"
+#include "mem.h"
+
+// Vnums are read as ints; flipping the sign bit makes them order correctly
+// as unsigned
+static uint32_t vnum_bits(long vnum) {
+    return (uint32_t)(int32_t)vnum ^ 0x80000000u;
+}
+
+// Order by vnum, then by area
+unsigned long long vnum_sort_key(long vnum, int area) {
+    return (unsigned long long)vnum_bits(vnum) << 32 | (uint32_t)area;
+}
+
+// Order by area, then by vnum
+unsigned long long area_sort_key(int area, long vnum) {
+    return (unsigned long long)(uint32_t)area << 32 | vnum_bits(vnum);
+}
+
+// Stable LSD radix sort on key, one byte per pass. All eight histograms
+// come from a single sweep, and passes where every key has the same byte
+// are skipped, so typical vnum ranges take two or three passes. Returns
+// -1 if the scratch array can't be allocated.
+int obj_refs_sort(OBJ_REF *refs, size_t n) {
+    if (n < 2) return 0;
+
+    size_t (*counts)[256] = mem_calloc(MEM_OTHER, 8, sizeof(*counts));
+    OBJ_REF *tmp = mem_alloc(MEM_OTHER, n * sizeof(*tmp));
+    if (!counts || !tmp) {
+        mem_free(counts);
+        mem_free(tmp);
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        for (int b = 0; b < 8; ++b)
+            counts[b][(refs[i].key >> (8 * b)) & 0xff]++;
+
+    OBJ_REF *from = refs, *to = tmp;
+    for (int b = 0; b < 8; ++b) {
+        size_t *count = counts[b];
+        if (count[(from[0].key >> (8 * b)) & 0xff] == n) continue;
+
+        size_t offset = 0;
+        for (int d = 0; d < 256; ++d) {
+            size_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; ++i)
+            to[count[(from[i].key >> (8 * b)) & 0xff]++] = from[i];
+
+        OBJ_REF *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != refs) memcpy(refs, from, n * sizeof(*refs));
+
+    mem_free(tmp);
+    mem_free(counts);
+    return 0;
+}
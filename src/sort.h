@@ -0,0 +1,19 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+
+#include "areaparse.h"
+
+// An object in output order, with the index of the area it came from
+typedef struct obj_ref {
+    unsigned long long key;
+    OBJ_INDEX_DATA *obj;
+    int area;
+} OBJ_REF;
+
+unsigned long long vnum_sort_key(long vnum, int area);
+unsigned long long area_sort_key(int area, long vnum);
+int obj_refs_sort(OBJ_REF *refs, size_t n);
+
+#endif
@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "sqlite_out.h"
+#include "mem.h"
+
+// Tables are created bare and indexed after the bulk insert, which is much
+// cheaper than maintaining the indexes row by row. Flag sets are kept as
+// the usual space-separated names and also as one row per wear flag, so
+// "wrist items" is an index lookup rather than a LIKE scan.
+static const char *schema_sql =
+    "CREATE TABLE areas ("
+    " id INTEGER PRIMARY KEY, name TEXT, file TEXT, credits TEXT, builders TEXT,"
+    " errors INTEGER);"
+    "CREATE TABLE diagnostics ("
+    " area INTEGER REFERENCES areas(id), byte_offset INTEGER, line INTEGER,"
+    " vnum INTEGER, message TEXT);"
+    "CREATE TABLE objects ("
+    " id INTEGER PRIMARY KEY, area INTEGER REFERENCES areas(id), vnum INTEGER,"
+    " name TEXT, type TEXT, level INTEGER, wear_flags TEXT, extra_flags TEXT,"
+    " material TEXT, condition INTEGER, weight INTEGER, cost INTEGER,"
+    " short_descr TEXT, description TEXT,"
+    " v0 INTEGER, v1 INTEGER, v2 INTEGER, v3 INTEGER, v4 INTEGER,"
+    " weapon_type TEXT, damage_type TEXT, weapon_flags TEXT, spell TEXT);"
+    "CREATE TABLE object_wear ("
+    " object_id INTEGER REFERENCES objects(id), flag TEXT);"
+    "CREATE TABLE affects ("
+    " object_id INTEGER REFERENCES objects(id), type TEXT, location TEXT,"
+    " modifier INTEGER, extra TEXT);"
+    "CREATE TABLE extra_descriptions ("
+    " object_id INTEGER REFERENCES objects(id), keyword TEXT, description TEXT);";
+
+static const char *index_sql =
+    "CREATE INDEX objects_vnum ON objects(vnum);"
+    "CREATE INDEX objects_type ON objects(type);"
+    "CREATE INDEX objects_level ON objects(level);"
+    "CREATE INDEX object_wear_flag ON object_wear(flag, object_id);"
+    "CREATE INDEX affects_object ON affects(object_id);"
+    "CREATE INDEX affects_location ON affects(location, modifier);"
+    "CREATE INDEX extra_descriptions_object ON extra_descriptions(object_id);";
+
+enum { STMT_AREA, STMT_DIAGNOSTIC, STMT_OBJECT, STMT_WEAR, STMT_AFFECT, STMT_EXTRA, STMT_COUNT };
+
+static const char *insert_sql[STMT_COUNT] = {
+    "INSERT INTO areas VALUES (?, ?, ?, ?, ?, ?)",
+    "INSERT INTO diagnostics VALUES (?, ?, ?, ?, ?)",
+    "INSERT INTO objects VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?,"
+    " ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    "INSERT INTO object_wear VALUES (?, ?)",
+    "INSERT INTO affects VALUES (?, ?, ?, ?, ?)",
+    "INSERT INTO extra_descriptions VALUES (?, ?, ?)"
+};
+
+static void bind_text(sqlite3_stmt *st, int col, const char *s) {
+    if (s) sqlite3_bind_text(st, col, s, -1, SQLITE_STATIC);
+    else sqlite3_bind_null(st, col);
+}
+
+// Run a prepared insert and reset it for the next row
+static int step_insert(sqlite3_stmt *st) {
+    int rc = sqlite3_step(st);
+    sqlite3_reset(st);
+    sqlite3_clear_bindings(st);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+// Weapon flag letters as space-separated names, like the other flag columns
+static void weapon_flag_names(const char *letters, char *out, size_t outlen) {
+    size_t len = 0;
+    out[0] = '\0';
+    for (const char *c = letters ? letters : ""; *c && len < outlen; c++)
+        len += snprintf(out + len, outlen - len, "%s%s", len ? " " : "", weapon_flag_letter_name(*c));
+}
+
+static int insert_object(sqlite3_stmt **stmts, const OBJ_INDEX_DATA *obj, long id, int area) {
+    char wear_buf[FLAG_NAMES_MAX];
+    char extra_buf[FLAG_NAMES_MAX];
+    char weapon_buf[FLAG_NAMES_MAX];
+    flag_bits_to_names(&flag_wear, obj->wear_flags, wear_buf, sizeof(wear_buf));
+    flag_bits_to_names(&flag_extra, obj->extra_flags, extra_buf, sizeof(extra_buf));
+
+    sqlite3_stmt *st = stmts[STMT_OBJECT];
+    sqlite3_bind_int64(st, 1, id);
+    sqlite3_bind_int(st, 2, area);
+    sqlite3_bind_int64(st, 3, obj->vnum);
+    bind_text(st, 4, obj->name ? obj->name : "");
+    bind_text(st, 5, item_type_name(obj->item_type));
+    sqlite3_bind_int(st, 6, obj->level);
+    bind_text(st, 7, wear_buf);
+    bind_text(st, 8, extra_buf);
+    bind_text(st, 9, obj->material ? obj->material : "");
+    sqlite3_bind_int(st, 10, obj->condition);
+    sqlite3_bind_int(st, 11, obj->weight);
+    sqlite3_bind_int(st, 12, obj->cost);
+    bind_text(st, 13, obj->short_descr ? obj->short_descr : "");
+    bind_text(st, 14, obj->description ? obj->description : "");
+    for (int i = 0; i < 5; ++i)
+        sqlite3_bind_int(st, 15 + i, obj->value[i]);
+    if (obj->item_type == 5) { // weapon
+        bind_text(st, 20, weapon_type_name(obj->value[0]));
+        bind_text(st, 21, obj->damage_type ? obj->damage_type : "unknown");
+        weapon_flag_names(obj->weapon_flags, weapon_buf, sizeof(weapon_buf));
+        bind_text(st, 22, weapon_buf);
+    } else if (obj->item_type == 40) { // materia
+        bind_text(st, 23, obj->materia_spell ? obj->materia_spell : "");
+    }
+    if (step_insert(st) != 0) return -1;
+
+    // One row per wear flag
+    st = stmts[STMT_WEAR];
+    unsigned long set = (unsigned long)obj->wear_flags & flag_wear.defined;
+    for (; set; set &= set - 1) {
+        sqlite3_bind_int64(st, 1, id);
+        bind_text(st, 2, flag_bit_name(&flag_wear, (long)(set & -set)));
+        if (step_insert(st) != 0) return -1;
+    }
+
+    st = stmts[STMT_AFFECT];
+    for (const AFFECT_OUT *ao = obj->affects_out; ao; ao = ao->next) {
+        sqlite3_bind_int64(st, 1, id);
+        bind_text(st, 2, ao->type);
+        bind_text(st, 3, ao->location);
+        sqlite3_bind_int(st, 4, ao->modifier);
+        bind_text(st, 5, ao->extra && ao->extra[0] ? ao->extra : NULL);
+        if (step_insert(st) != 0) return -1;
+    }
+
+    st = stmts[STMT_EXTRA];
+    for (const EXTRA_DESCR_DATA *ed = obj->extra_descr; ed; ed = ed->next) {
+        sqlite3_bind_int64(st, 1, id);
+        bind_text(st, 2, ed->keyword ? ed->keyword : "");
+        bind_text(st, 3, ed->description ? ed->description : "");
+        if (step_insert(st) != 0) return -1;
+    }
+    return 0;
+}
+
+static int fill_database(sqlite3 *db, AREA_PARSER *parsers, int nareas,
+                         const OBJ_REF *refs, size_t nrefs) {
+    sqlite3_stmt *stmts[STMT_COUNT] = {NULL};
+    int rc = -1;
+
+    // The file is private until the rename, so there is nothing to protect
+    // with a journal or syncs
+    if (sqlite3_exec(db, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF;", NULL, NULL, NULL) != SQLITE_OK
+        || sqlite3_exec(db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK
+        || sqlite3_exec(db, schema_sql, NULL, NULL, NULL) != SQLITE_OK)
+        return -1;
+
+    for (int i = 0; i < STMT_COUNT; ++i)
+        if (sqlite3_prepare_v2(db, insert_sql[i], -1, &stmts[i], NULL) != SQLITE_OK)
+            goto done;
+
+    for (int i = 0; i < nareas; ++i) {
+        const AREA_DATA *area = parsers[i].area;
+        sqlite3_stmt *st = stmts[STMT_AREA];
+        sqlite3_bind_int(st, 1, i);
+        bind_text(st, 2, area->name ? area->name : "");
+        bind_text(st, 3, area->file_name ? area->file_name : "");
+        bind_text(st, 4, area->credits ? area->credits : "");
+        bind_text(st, 5, area->builders ? area->builders : "");
+        sqlite3_bind_int(st, 6, parsers[i].stats.errors);
+        if (step_insert(st) != 0) goto done;
+
+        st = stmts[STMT_DIAGNOSTIC];
+        for (int j = 0; j < parsers[i].ndiagnostics; ++j) {
+            const AREA_DIAGNOSTIC *d = &parsers[i].diagnostics[j];
+            sqlite3_bind_int(st, 1, i);
+            sqlite3_bind_int64(st, 2, d->offset);
+            sqlite3_bind_int64(st, 3, d->line);
+            sqlite3_bind_int64(st, 4, d->vnum);
+            bind_text(st, 5, d->message);
+            if (step_insert(st) != 0) goto done;
+        }
+    }
+
+    // Row ids follow output order, starting at 1
+    for (size_t i = 0; i < nrefs; ++i)
+        if (insert_object(stmts, refs[i].obj, (long)i + 1, refs[i].area) != 0)
+            goto done;
+
+    if (sqlite3_exec(db, index_sql, NULL, NULL, NULL) != SQLITE_OK
+        || sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+        goto done;
+    rc = 0;
+
+done:
+    for (int i = 0; i < STMT_COUNT; ++i)
+        sqlite3_finalize(stmts[i]);
+    return rc;
+}
+
+int sqlite_export(const char *path, AREA_PARSER *parsers, int nareas,
+                  const OBJ_REF *refs, size_t nrefs, char *err, size_t errlen) {
+    size_t len = strlen(path) + 5;
+    char *tmp = mem_alloc(MEM_OTHER, len);
+    if (!tmp) {
+        snprintf(err, errlen, "out of memory");
+        return -1;
+    }
+    snprintf(tmp, len, "%s.tmp", path);
+    remove(tmp);
+
+    sqlite3 *db = NULL;
+    int rc = -1;
+    if (sqlite3_open(tmp, &db) != SQLITE_OK) {
+        snprintf(err, errlen, "cannot open %s: %s", tmp, db ? sqlite3_errmsg(db) : "out of memory");
+    } else if (fill_database(db, parsers, nareas, refs, nrefs) != 0) {
+        snprintf(err, errlen, "%s", sqlite3_errmsg(db));
+    } else {
+        rc = 0;
+    }
+
+    if (sqlite3_close(db) != SQLITE_OK && rc == 0) {
+        snprintf(err, errlen, "cannot close %s", tmp);
+        rc = -1;
+    }
+    if (rc == 0 && rename(tmp, path) != 0) {
+        snprintf(err, errlen, "cannot rename %s to %s", tmp, path);
+        rc = -1;
+    }
+    if (rc != 0) remove(tmp);
+    mem_free(tmp);
+    return rc;
+}
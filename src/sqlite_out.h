@@ -0,0 +1,16 @@
+#ifndef SQLITE_OUT_H
+#define SQLITE_OUT_H
+
+#include <stddef.h>
+
+#include "areaparse.h"
+#include "sort.h"
+
+// Write the areas and objects (in refs order) to a fresh SQLite database at
+// path. The database is built under path.tmp and renamed into place, so
+// readers never see a half-written file. Returns 0, or -1 with a message
+// in err.
+int sqlite_export(const char *path, AREA_PARSER *parsers, int nareas,
+                  const OBJ_REF *refs, size_t nrefs, char *err, size_t errlen);
+
+#endif
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "strbuf.h"
+#include "mem.h"
+
+void sb_init(STRBUF *sb) {
+    sb->data = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+}
+
+void sb_free(STRBUF *sb) {
+    mem_free(sb->data);
+    sb_init(sb);
+}
+
+// Make room for extra bytes plus a terminating NUL
+int sb_reserve(STRBUF *sb, size_t extra) {
+    if (sb->len + extra + 1 <= sb->cap) return 0;
+    size_t cap = sb->cap ? sb->cap : 4096;
+    while (cap < sb->len + extra + 1) cap *= 2;
+    char *data = mem_realloc(MEM_OUTPUT, sb->data, cap);
+    if (!data) return -1;
+    sb->data = data;
+    sb->cap = cap;
+    return 0;
+}
+
+void sb_append(STRBUF *sb, const char *s, size_t len) {
+    if (sb_reserve(sb, len) != 0) return;
+    memcpy(sb->data + sb->len, s, len);
+    sb->len += len;
+    sb->data[sb->len] = '\0';
+}
+
+void sb_puts(STRBUF *sb, const char *s) {
+    sb_append(sb, s, strlen(s));
+}
+
+void sb_printf(STRBUF *sb, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t room = sb->cap > sb->len ? sb->cap - sb->len : 0;
+    int n = vsnprintf(room ? sb->data + sb->len : NULL, room, fmt, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n < room) {
+        sb->len += n;
+        return;
+    }
+    if (sb_reserve(sb, n) != 0) return;
+    va_start(args, fmt);
+    vsnprintf(sb->data + sb->len, sb->cap - sb->len, fmt, args);
+    va_end(args);
+    sb->len += n;
+}
+
+// Append s[0, len) as the body of a JSON string: quotes, backslashes and
+// control characters are escaped, the latter in their short form where JSON
+// has one
+void sb_append_json_string(STRBUF *sb, const char *s, size_t len) {
+    size_t plain = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        char code[8];
+        const char *esc = code;
+        switch (c) {
+            case '"':  esc = "\\\""; break;
+            case '\\': esc = "\\\\"; break;
+            case '\b': esc = "\\b"; break;
+            case '\f': esc = "\\f"; break;
+            case '\n': esc = "\\n"; break;
+            case '\r': esc = "\\r"; break;
+            case '\t': esc = "\\t"; break;
+            default:
+                if (c >= 0x20) continue;
+                snprintf(code, sizeof(code), "\\u%04x", c);
+        }
+        if (i > plain) sb_append(sb, s + plain, i - plain);
+        sb_puts(sb, esc);
+        plain = i + 1;
+    }
+    if (len > plain) sb_append(sb, s + plain, len - plain);
+}
+
+// Write to path.tmp and rename it into place, so readers never see a
+// half-written file
+int sb_write_file(const STRBUF *sb, const char *path) {
+    size_t len = strlen(path) + 5;
+    char *tmp = mem_alloc(MEM_OTHER, len);
+    if (!tmp) return -1;
+    snprintf(tmp, len, "%s.tmp", path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        mem_free(tmp);
+        return -1;
+    }
+    size_t written = sb->len ? fwrite(sb->data, 1, sb->len, fp) : 0;
+    int rc = fclose(fp);
+    if (written != sb->len || rc != 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+        mem_free(tmp);
+        return -1;
+    }
+    mem_free(tmp);
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef STRBUF_H
+#define STRBUF_H
+
+#include <stddef.h>
+
+// Growable byte buffer used to build output before it is written
+typedef struct strbuf {
+    char *data;
+    size_t len;
+    size_t cap;
+} STRBUF;
+
+void sb_init(STRBUF *sb);
+void sb_free(STRBUF *sb);
+int sb_reserve(STRBUF *sb, size_t extra);
+void sb_append(STRBUF *sb, const char *s, size_t len);
+void sb_puts(STRBUF *sb, const char *s);
+void sb_printf(STRBUF *sb, const char *fmt, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+void sb_append_json_string(STRBUF *sb, const char *s, size_t len);
+
+// Write the contents to path through a temporary file and a rename.
+// Returns 0, or -1 on failure.
+int sb_write_file(const STRBUF *sb, const char *path);
+
+#endif
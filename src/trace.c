@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "trace.h"
+#include "areaparse.h"
+#include "mem.h"
+#include "strbuf.h"
+
+void trace_init(TRACE *t, double object_threshold) {
+    memset(t, 0, sizeof(*t));
+    t->origin = monotonic_seconds();
+    t->object_threshold = object_threshold;
+    pthread_mutex_init(&t->lock, NULL);
+}
+
+void trace_free(TRACE *t) {
+    mem_free(t->events);
+    pthread_mutex_destroy(&t->lock);
+    t->events = NULL;
+    t->count = t->capacity = 0;
+}
+
+// Reserve the next event slot; caller holds the lock
+static TRACE_EVENT *trace_next(TRACE *t) {
+    if (t->count == t->capacity) {
+        size_t capacity = t->capacity ? t->capacity * 2 : 256;
+        TRACE_EVENT *events = mem_realloc(MEM_OTHER, t->events, capacity * sizeof(*events));
+        if (!events) return NULL;
+        t->events = events;
+        t->capacity = capacity;
+    }
+    return &t->events[t->count++];
+}
+
+void trace_thread_name(TRACE *t, int tid, const char *name) {
+    pthread_mutex_lock(&t->lock);
+    TRACE_EVENT *ev = trace_next(t);
+    if (ev) {
+        memset(ev, 0, sizeof(*ev));
+        ev->ph = 'M';
+        ev->tid = tid;
+        snprintf(ev->name, sizeof(ev->name), "%s", name);
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+void trace_span(TRACE *t, int tid, const char *cat, const char *name,
+                double start, double end, const char *args_fmt, ...) {
+    char args[TRACE_ARGS_LENGTH] = "";
+    if (args_fmt) {
+        va_list ap;
+        va_start(ap, args_fmt);
+        vsnprintf(args, sizeof(args), args_fmt, ap);
+        va_end(ap);
+    }
+
+    pthread_mutex_lock(&t->lock);
+    TRACE_EVENT *ev = trace_next(t);
+    if (ev) {
+        ev->ph = 'X';
+        ev->tid = tid;
+        ev->cat = cat;
+        snprintf(ev->name, sizeof(ev->name), "%s", name);
+        ev->start = start;
+        ev->dur = end - start;
+        memcpy(ev->args, args, sizeof(args));
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+int trace_write(TRACE *t, const char *path) {
+    STRBUF sb;
+    sb_init(&sb);
+
+    pthread_mutex_lock(&t->lock);
+    sb_puts(&sb, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < t->count; ++i) {
+        const TRACE_EVENT *ev = &t->events[i];
+        // Names come from section words in the area file, so escape them
+        if (ev->ph == 'M') {
+            sb_printf(&sb, "{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"", ev->tid);
+            sb_append_json_string(&sb, ev->name, strlen(ev->name));
+            sb_puts(&sb, "\"}}");
+        } else {
+            sb_printf(&sb, "{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"cat\":\"%s\",\"name\":\"", ev->tid, ev->cat);
+            sb_append_json_string(&sb, ev->name, strlen(ev->name));
+            sb_printf(&sb, "\",\"ts\":%.3f,\"dur\":%.3f,\"args\":{%s}}",
+                      (ev->start - t->origin) * 1e6, ev->dur * 1e6, ev->args);
+        }
+        sb_puts(&sb, i + 1 < t->count ? ",\n" : "\n");
+    }
+    sb_puts(&sb, "]}\n");
+    pthread_mutex_unlock(&t->lock);
+
+    FILE *fp = fopen(path, "w");
+    size_t written = fp && sb.len ? fwrite(sb.data, 1, sb.len, fp) : 0;
+    int rc = fp && fclose(fp) == 0 && written == sb.len ? 0 : -1;
+    sb_free(&sb);
+    return rc;
+}
@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define TRACE_NAME_LENGTH 48
+#define TRACE_ARGS_LENGTH 128
+
+// One complete ("X") span or thread-name ("M") record in Chrome trace-event
+// format. Times are monotonic_seconds() values.
+typedef struct trace_event {
+    char ph;
+    int tid;
+    const char *cat;
+    char name[TRACE_NAME_LENGTH];
+    double start;
+    double dur;
+    char args[TRACE_ARGS_LENGTH]; // JSON object body without braces, may be empty
+} TRACE_EVENT;
+
+// Span recorder shared by the parser and the CLI. Recording takes a lock, so
+// worker threads can report into the same trace under their own tid.
+typedef struct trace {
+    TRACE_EVENT *events;
+    size_t count;
+    size_t capacity;
+    double origin; // Timestamps are written relative to this
+    double object_threshold; // Only objects slower than this (seconds) get a span
+    pthread_mutex_t lock;
+} TRACE;
+
+void trace_init(TRACE *t, double object_threshold);
+void trace_free(TRACE *t);
+void trace_thread_name(TRACE *t, int tid, const char *name);
+void trace_span(TRACE *t, int tid, const char *cat, const char *name,
+                double start, double end, const char *args_fmt, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 7, 8)))
+#endif
+    ;
+int trace_write(TRACE *t, const char *path);
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "world.h"
+#include "mem.h"
+
+static const char *const source_kind_names[] = {
+    "equipped", "carried", "sold", "room", "container"
+};
+
+const char *source_kind_name(int kind) {
+    if (kind < 0 || kind >= (int)(sizeof(source_kind_names) / sizeof(source_kind_names[0])))
+        return "unknown";
+    return source_kind_names[kind];
+}
+
+// Open-addressing vnum -> row table. The first row stored for a vnum wins,
+// matching the MUD, which refuses duplicates and keeps the earlier area.
+typedef struct vnum_map {
+    long *keys;
+    const void **values; // NULL marks an empty slot
+    size_t mask;
+} VNUM_MAP;
+
+static size_t vnum_hash(long vnum) {
+    uint64_t h = (uint64_t)vnum * 0x9e3779b97f4a7c15ull;
+    return (size_t)(h >> 32);
+}
+
+// Sized for n entries at no more than half load
+static int vnum_map_init(VNUM_MAP *map, size_t n) {
+    size_t slots = 16;
+    while (slots < 2 * n) slots *= 2;
+    map->keys = mem_alloc(MEM_WORLD, slots * sizeof(*map->keys));
+    map->values = mem_calloc(MEM_WORLD, slots, sizeof(*map->values));
+    map->mask = slots - 1;
+    return map->keys && map->values ? 0 : -1;
+}
+
+static void vnum_map_free(VNUM_MAP *map) {
+    mem_free(map->keys);
+    mem_free(map->values);
+    memset(map, 0, sizeof(*map));
+}
+
+static void vnum_map_put(VNUM_MAP *map, long vnum, const void *value) {
+    size_t i = vnum_hash(vnum) & map->mask;
+    while (map->values[i]) {
+        if (map->keys[i] == vnum) return;
+        i = (i + 1) & map->mask;
+    }
+    map->keys[i] = vnum;
+    map->values[i] = value;
+}
+
+static const void *vnum_map_get(const VNUM_MAP *map, long vnum) {
+    size_t i = vnum_hash(vnum) & map->mask;
+    while (map->values[i]) {
+        if (map->keys[i] == vnum) return map->values[i];
+        i = (i + 1) & map->mask;
+    }
+    return NULL;
+}
+
+// A source before grouping, with the dense index of its object
+typedef struct pending_source {
+    size_t obj;
+    OBJ_SOURCE source;
+} PENDING_SOURCE;
+
+typedef struct world_join {
+    VNUM_MAP mobs, rooms, shops, objects;
+    OBJ_INDEX_DATA **objs; // Dense index -> object
+    size_t nobjs;
+    PENDING_SOURCE *pending;
+    size_t npending;
+} WORLD_JOIN;
+
+static void world_join_free(WORLD_JOIN *j) {
+    vnum_map_free(&j->mobs);
+    vnum_map_free(&j->rooms);
+    vnum_map_free(&j->shops);
+    vnum_map_free(&j->objects);
+    mem_free(j->objs);
+    mem_free(j->pending);
+}
+
+// Build the vnum tables. Objects map to their dense index + 1, so the
+// value is never NULL.
+static int world_join_index(WORLD_JOIN *j, AREA_PARSER *parsers, int nareas) {
+    size_t nmobs = 0, nrooms = 0, nshops = 0, nresets = 0;
+    for (int a = 0; a < nareas; ++a) {
+        const AREA_WORLD *w = &parsers[a].world;
+        nmobs += w->nmobs;
+        nrooms += w->nrooms;
+        nshops += w->nshops;
+        nresets += w->nresets;
+        for (OBJ_INDEX_DATA *o = parsers[a].object_list; o; o = o->next)
+            j->nobjs++;
+    }
+    if (vnum_map_init(&j->mobs, nmobs) || vnum_map_init(&j->rooms, nrooms)
+        || vnum_map_init(&j->shops, nshops) || vnum_map_init(&j->objects, j->nobjs))
+        return -1;
+    j->objs = mem_alloc(MEM_WORLD, (j->nobjs ? j->nobjs : 1) * sizeof(*j->objs));
+    j->pending = mem_alloc(MEM_WORLD, (nresets ? nresets : 1) * sizeof(*j->pending));
+    if (!j->objs || !j->pending) return -1;
+
+    size_t k = 0;
+    for (int a = 0; a < nareas; ++a) {
+        const AREA_WORLD *w = &parsers[a].world;
+        for (int i = 0; i < w->nmobs; ++i)
+            vnum_map_put(&j->mobs, w->mobs[i].vnum, &w->mobs[i]);
+        for (int i = 0; i < w->nrooms; ++i)
+            vnum_map_put(&j->rooms, w->rooms[i].vnum, &w->rooms[i]);
+        for (int i = 0; i < w->nshops; ++i)
+            vnum_map_put(&j->shops, w->shopkeepers[i], &w->shopkeepers[i]);
+        // The object list is newest first; walk it in file order so the
+        // first definition of a vnum is the one kept
+        size_t first = k;
+        for (OBJ_INDEX_DATA *o = parsers[a].object_list; o; o = o->next)
+            j->objs[k++] = o;
+        for (size_t i = k; i-- > first;)
+            vnum_map_put(&j->objects, j->objs[i]->vnum, (const void *)(uintptr_t)(i + 1));
+    }
+    return 0;
+}
+
+// Walk one area's resets in order, as the MUD runs them: G and E lines
+// belong to the mobile of the last M line.
+static void world_join_resets(WORLD_JOIN *j, const AREA_PARSER *parser, int area) {
+    const AREA_WORLD *w = &parser->world;
+    const MOB_INDEX_DATA *mob = NULL;
+    const ROOM_INDEX_DATA *mob_room = NULL;
+    bool shopkeeper = false;
+
+    for (int i = 0; i < w->nresets; ++i) {
+        const RESET_DATA *r = &w->resets[i];
+        if (r->command == 'M') {
+            mob = vnum_map_get(&j->mobs, r->arg1);
+            mob_room = vnum_map_get(&j->rooms, r->arg3);
+            shopkeeper = vnum_map_get(&j->shops, r->arg1) != NULL;
+            continue;
+        }
+        size_t obj = (uintptr_t)vnum_map_get(&j->objects, r->arg1);
+        if (!obj) continue; // Not parsed, or dropped by a filter
+
+        OBJ_SOURCE s = { 0, NULL, NULL, 0, NULL, area };
+        switch (r->command) {
+        case 'O':
+            s.kind = SOURCE_ROOM;
+            s.room = vnum_map_get(&j->rooms, r->arg3);
+            break;
+        case 'P': {
+            size_t container = (uintptr_t)vnum_map_get(&j->objects, r->arg3);
+            s.kind = SOURCE_CONTAINER;
+            s.container = r->arg3;
+            s.container_obj = container ? j->objs[container - 1] : NULL;
+            break;
+        }
+        case 'G':
+        case 'E':
+            s.kind = r->command == 'E' ? SOURCE_EQUIPPED : shopkeeper ? SOURCE_SOLD : SOURCE_CARRIED;
+            s.mob = mob;
+            s.room = mob_room;
+            break;
+        default:
+            continue;
+        }
+        j->pending[j->npending].obj = obj - 1;
+        j->pending[j->npending].source = s;
+        j->npending++;
+    }
+}
+
+int world_link_sources(WORLD_SOURCES *ws, AREA_PARSER *parsers, int nareas) {
+    WORLD_JOIN j;
+    memset(&j, 0, sizeof(j));
+    memset(ws, 0, sizeof(*ws));
+
+    if (world_join_index(&j, parsers, nareas) != 0) {
+        world_join_free(&j);
+        return -1;
+    }
+    for (int a = 0; a < nareas; ++a)
+        world_join_resets(&j, &parsers[a], a);
+
+    // Counting sort by object keeps each object's sources in reset order
+    size_t *start = mem_calloc(MEM_WORLD, j.nobjs + 1, sizeof(*start));
+    ws->sources = mem_alloc(MEM_WORLD, (j.npending ? j.npending : 1) * sizeof(*ws->sources));
+    if (!start || !ws->sources) {
+        mem_free(start);
+        mem_free(ws->sources);
+        ws->sources = NULL;
+        world_join_free(&j);
+        return -1;
+    }
+    for (size_t i = 0; i < j.npending; ++i)
+        start[j.pending[i].obj + 1]++;
+    for (size_t i = 0; i < j.nobjs; ++i)
+        start[i + 1] += start[i];
+    for (size_t i = 0; i < j.nobjs; ++i) {
+        j.objs[i]->sources = ws->sources + start[i];
+        j.objs[i]->nsources = (int)(start[i + 1] - start[i]);
+    }
+    for (size_t i = 0; i < j.npending; ++i)
+        ws->sources[start[j.pending[i].obj]++] = j.pending[i].source;
+    ws->count = j.npending;
+
+    mem_free(start);
+    world_join_free(&j);
+    return 0;
+}
+
+void world_sources_free(WORLD_SOURCES *ws) {
+    mem_free(ws->sources);
+    memset(ws, 0, sizeof(*ws));
+}
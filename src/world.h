@@ -0,0 +1,42 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stddef.h>
+
+#include "areaparse.h"
+
+enum source_kind {
+    SOURCE_EQUIPPED,  // E: worn by a mob
+    SOURCE_CARRIED,   // G: in a mob's inventory
+    SOURCE_SOLD,      // G on a shopkeeper: in its shop's stock
+    SOURCE_ROOM,      // O: on the floor of a room
+    SOURCE_CONTAINER  // P: inside another object
+};
+
+// One reset that loads an object. Pointers go into the parsers' tables and
+// are NULL when the reset names a vnum no parsed area defines.
+typedef struct obj_source {
+    int kind; // SOURCE_*
+    const MOB_INDEX_DATA *mob; // Equipped, carried, sold
+    const ROOM_INDEX_DATA *room; // Where the mob or the object resets
+    long container; // Container's vnum
+    const OBJ_INDEX_DATA *container_obj;
+    int area; // Parser whose #RESETS has the line
+} OBJ_SOURCE;
+
+typedef struct world_sources {
+    OBJ_SOURCE *sources; // Grouped by object, in reset order within each
+    size_t count;
+} WORLD_SOURCES;
+
+// Join the O, G, E and P resets of every parser (loaded with load_world)
+// against the mobiles, rooms, shops and objects of all of them, and point
+// each object's sources/nsources at its share of ws. Lookups go through
+// vnum hash tables, so the whole join is linear in the size of the tables.
+// Returns 0, or -1 when out of memory (objects are then left without sources).
+int world_link_sources(WORLD_SOURCES *ws, AREA_PARSER *parsers, int nareas);
+void world_sources_free(WORLD_SOURCES *ws);
+
+const char *source_kind_name(int kind);
+
+#endif